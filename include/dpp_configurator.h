@@ -66,11 +66,46 @@ struct dpp_configurator_ctx
     bool config_request_monitor;             // Configuration Request監視状態
 };
 
+// 引数の型（dpp_args_parseで検査する）
+enum dpp_arg_type
+{
+    DPP_ARG_STR,
+    DPP_ARG_INT,  // 10進整数
+    DPP_ARG_REST, // 引数文字列全体を1つの値とする（スキーマの先頭のみ）
+};
+
+#define DPP_ARG_REQUIRED 0x01
+
+// 設定の指定方式（方式の異なるキーは同時に指定できない）
+#define DPP_ARG_MODE_CONF 0x01     // conf/ssid/pass
+#define DPP_ARG_MODE_JSON 0x02     // conf_json
+#define DPP_ARG_MODE_TEMPLATE 0x04 // template
+
+// コマンドが受け付けるキー（key == NULL で終端）
+struct dpp_arg_spec
+{
+    const char *key;
+    enum dpp_arg_type type;
+    unsigned int flags;
+    unsigned int modes; // 併用できる指定方式（0ならどれとでも可）
+};
+
+#define DPP_ARGS_MAX 24
+
+// 解析済みの引数（値は元の引数文字列の中を指す）
+struct dpp_args
+{
+    const struct dpp_arg_spec *schema;
+    char *value[DPP_ARGS_MAX]; // スキーマと同じ順序、未指定ならNULL
+    size_t len[DPP_ARGS_MAX];
+};
+
 // コマンド構造体
 struct dpp_command
 {
     const char *name;
-    int (*handler)(struct dpp_configurator_ctx *ctx, char *args);
+    int (*handler)(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+    const struct dpp_arg_spec *schema;
     const char *help;
 };
 
@@ -80,21 +115,392 @@ void dpp_configurator_deinit(struct dpp_configurator_ctx *ctx);
 int execute_command(struct dpp_configurator_ctx *ctx, const char *cmd, char *args);
 
 // コマンドハンドラー
-int cmd_configurator_add(struct dpp_configurator_ctx *ctx, char *args);
-int cmd_dpp_qr_code(struct dpp_configurator_ctx *ctx, char *args);
-int cmd_bootstrap_get_uri(struct dpp_configurator_ctx *ctx, char *args);
-int cmd_auth_init_real(struct dpp_configurator_ctx *ctx, char *args);
-int cmd_auth_status(struct dpp_configurator_ctx *ctx, char *args);
-int cmd_auth_monitor(struct dpp_configurator_ctx *ctx, char *args);
-int cmd_status(struct dpp_configurator_ctx *ctx, char *args);
-int cmd_help(struct dpp_configurator_ctx *ctx, char *args);
+int cmd_configurator_add(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_dpp_qr_code(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_bootstrap_get_uri(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_auth_init_real(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_auth_status(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_auth_monitor(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_status(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_help(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_bench(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_daemon(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_import(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_compact(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_peer_sync(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_provision(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_metrics(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_template(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_job_add(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_job_list(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_job_run(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+int cmd_simulate(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+
+// DPP認証の開始（auth_init・provisionで共通）
+int dpp_auth_build_params(const char *conf_type, const char *ssid, const char *pass,
+                          const char *matter_pin, const char *conf_json,
+                          char *params, size_t params_size);
+// 設定テンプレート（検証済みの設定を端末ごとの値だけ差し替えて使う）
+#define DPP_AUTH_PARAMS_MAX 2048
+
+struct dpp_template;
+
+const struct dpp_template *dpp_template_get(const char *name);
+void dpp_template_release(const struct dpp_template *tmpl);
+int dpp_template_render(const struct dpp_template *tmpl, const char *pin,
+                        const char *discriminator, char *params, size_t params_size);
+int dpp_template_push(const struct dpp_template *tmpl, const char *interface,
+                      int hostapd_configurator_id);
+
+int dpp_hostapd_configurator(struct dpp_configurator_ctx *ctx, const char *interface,
+                             int configurator_id, bool refresh, bool quiet);
+int dpp_auth_start(struct dpp_configurator_ctx *ctx, const char *interface,
+                   int peer_id, int configurator_id, const char *params, bool quiet);
+
+// DPP URIの解析・事前検証（hostapdへ渡す前にローカルで不正・重複を検出する）
+enum dpp_uri_status
+{
+    DPP_URI_OK,
+    DPP_URI_ERR_PREFIX,
+    DPP_URI_ERR_NO_TERMINATOR,
+    DPP_URI_ERR_BAD_FIELD,
+    DPP_URI_ERR_BAD_CHANNEL,
+    DPP_URI_ERR_BAD_MAC,
+    DPP_URI_ERR_BAD_VERSION,
+    DPP_URI_ERR_BAD_INFO,
+    DPP_URI_ERR_BAD_HOST,
+    DPP_URI_ERR_NO_KEY,
+    DPP_URI_ERR_BAD_BASE64,
+    DPP_URI_ERR_BAD_KEY,
+    DPP_URI_ERR_UNSUPPORTED_CURVE,
+    DPP_URI_ERR_BAD_POINT,
+    DPP_URI_STATUSES
+};
+
+// 各フィールドは解析したURI内を直接指す（NUL終端されない）
+struct dpp_uri
+{
+    const char *chan;
+    size_t chan_len;
+    const char *mac;
+    size_t mac_len;
+    const char *info;
+    size_t info_len;
+    const char *host;
+    size_t host_len;
+    const char *key;
+    size_t key_len;
+    int version; // V:が無ければ0
+    u8 mac_addr[ETH_ALEN];
+    const char *curve; // hostapdの曲線名（"prime256v1" など）
+    u8 pubkey_hash[SHA256_MAC_LEN]; // hostapdのBootstrap鍵ハッシュ（SPKIのSHA-256）
+    size_t error_offset; // エラー時、URI先頭からの位置
+};
+
+struct dpp_uri_ctx;
+
+struct dpp_uri_ctx *dpp_uri_ctx_new(void);
+void dpp_uri_ctx_free(struct dpp_uri_ctx *ctx);
+enum dpp_uri_status dpp_uri_tokenize(const char *uri, size_t len, struct dpp_uri *out);
+enum dpp_uri_status dpp_uri_parse(struct dpp_uri_ctx *ctx, const char *uri, size_t len,
+                                  struct dpp_uri *out);
+const char *dpp_uri_status_str(enum dpp_uri_status status);
+int dpp_uri_channel_freqs(const char *uri, int *freqs, int max_freqs);
 
 // GAS/DPP Configuration Request/Response コマンド
-int cmd_config_request_monitor(struct dpp_configurator_ctx *ctx, char *args);
+int cmd_config_request_monitor(struct dpp_configurator_ctx *ctx, const struct dpp_args *args);
+
+// hostapd制御インターフェースの応答（大きさに合わせて受信し、key=value行を索引する）
+#define HOSTAPD_REPLY_INLINE 4096
+#define HOSTAPD_REPLY_FIELDS 256
+#define HOSTAPD_REPLY_SLOTS 512 // 索引のハッシュ表（FIELDSの2倍）
+
+struct hostapd_reply_field
+{
+    const char *key; // '='で終わる（NUL終端ではない）
+    size_t key_len;
+    const char *value;
+};
+
+struct hostapd_reply
+{
+    char *buf; // NULLなら未受信。inline_bufか確保した領域を指す
+    size_t size;
+    size_t len;
+    int field_count; // 未索引なら-1
+    const char *overflow;
+    struct hostapd_reply_field fields[HOSTAPD_REPLY_FIELDS];
+    uint16_t slots[HOSTAPD_REPLY_SLOTS]; // fieldsの添字+1（0は空き）
+    char inline_buf[HOSTAPD_REPLY_INLINE];
+};
+
+void hostapd_reply_init(struct hostapd_reply *reply);
+void hostapd_reply_free(struct hostapd_reply *reply);
+int hostapd_reply_index(struct hostapd_reply *reply);
+const char *hostapd_reply_get(struct hostapd_reply *reply, const char *key);
+int hostapd_reply_get_int(struct hostapd_reply *reply, const char *key, int def);
+
+// hostapd制御インターフェース（インターフェースごとの永続接続）
+struct hostapd_ctrl;
+
+// 応答しないhostapdへの要求を待たずに失敗させるサーキットブレーカー
+enum hostapd_breaker_state
+{
+    HOSTAPD_BREAKER_CLOSED,    // 通常
+    HOSTAPD_BREAKER_HALF_OPEN, // 次の要求の前にPINGで回復を確認する
+    HOSTAPD_BREAKER_OPEN,      // 要求は送らずに-EHOSTDOWN
+};
+
+struct hostapd_ctrl *hostapd_ctrl_get(const char *interface);
+int hostapd_ctrl_request(struct hostapd_ctrl *ctrl, const char *cmd,
+                         char *response, size_t response_size);
+int hostapd_ctrl_request_reply(struct hostapd_ctrl *ctrl, const char *cmd,
+                               struct hostapd_reply *reply);
+void hostapd_ctrl_close_all(void);
+void hostapd_ctrl_set_dir(const char *dir);
+int hostapd_ctrl_instance_cookie(const char *interface, char *buf, size_t buflen);
+struct hostapd_ctrl *hostapd_ctrl_open_monitor(const char *interface);
+int hostapd_ctrl_recv_event(struct hostapd_ctrl *ctrl, char *buf, size_t buf_size,
+                            int timeout_ms);
+void hostapd_ctrl_close(struct hostapd_ctrl *ctrl);
+enum hostapd_breaker_state hostapd_ctrl_breaker(const char *interface, int *retry_ms);
+void hostapd_ctrl_probe_all(void);
+void hostapd_ctrl_write_health(FILE *fp, bool prometheus);
+
+// 非同期の制御プレーン（多数のhostapdインスタンスへの要求をまとめて送受信する）
+#define DPP_CTRL_ENGINE_WINDOW 16 // 1インスタンスあたりの応答待ちの上限（既定値）
+
+struct dpp_ctrl_engine;
+typedef void (*dpp_ctrl_done_fn)(void *arg, int id, int ret, const char *reply);
+struct dpp_ctrl_engine *dpp_ctrl_engine_new(int window);
+void dpp_ctrl_engine_free(struct dpp_ctrl_engine *engine);
+const char *dpp_ctrl_engine_backend(const struct dpp_ctrl_engine *engine);
+int dpp_ctrl_engine_pending(const struct dpp_ctrl_engine *engine);
+int dpp_ctrl_engine_submit(struct dpp_ctrl_engine *engine, const char *interface,
+                           const char *cmd, dpp_ctrl_done_fn done, void *arg, int id);
+int dpp_ctrl_engine_poll(struct dpp_ctrl_engine *engine, int timeout_ms);
+int dpp_ctrl_engine_run(struct dpp_ctrl_engine *engine);
+int hostapd_ctrl_socket_open(const char *interface);
+
+// hostapd DPPイベントの分類
+enum dpp_event_kind
+{
+    DPP_EVENT_KIND_NONE,         // DPP以外・無関係なイベント
+    DPP_EVENT_KIND_PROGRESS,     // 進行中（認証応答待ち、Configuration Request受信など）
+    DPP_EVENT_KIND_AUTH_SUCCESS, // 認証成功（Configuration待ち）
+    DPP_EVENT_KIND_CONF_SENT,    // Configuration送信完了（成功で終了）
+    DPP_EVENT_KIND_FAILED,       // 失敗で終了
+};
+
+enum dpp_event_kind dpp_event_classify(const char *msg, const char **event_name);
+
+// メトリクス（フェーズごとのレイテンシのヒストグラムと結果のカウンタ）
+#define DPP_METRICS_FILE_NAME "metrics.prom" // デーモンの実行時ディレクトリ内
+
+enum dpp_metrics_phase
+{
+    DPP_METRICS_PHASE_CONFIGURATOR,   // hostapd側Configuratorの参照・追加
+    DPP_METRICS_PHASE_PEER,           // hostapd側Bootstrap IDの参照・登録
+    DPP_METRICS_PHASE_AUTH_INIT,      // DPP_AUTH_INITの送受信（再試行を含む）
+    DPP_METRICS_PHASE_AUTHENTICATION, // DPP_AUTH_INIT受付からDPP-AUTH-SUCCESSまで
+    DPP_METRICS_PHASE_CONFIGURATION,  // DPP-AUTH-SUCCESSからDPP-CONF-SENTまで
+    DPP_METRICS_PHASE_TOTAL,          // 開始から終了（成功・失敗）まで
+    DPP_METRICS_PHASES
+};
+
+enum dpp_metrics_result
+{
+    DPP_METRICS_RESULT_SUCCESS,
+    DPP_METRICS_RESULT_INITIATED, // DPP_AUTH_INITが受け付けられた（完了は待たない）
+    DPP_METRICS_RESULT_HOSTAPD_ERROR,
+    DPP_METRICS_RESULT_CONFIGURATOR_ERROR,
+    DPP_METRICS_RESULT_PEER_ERROR,
+    DPP_METRICS_RESULT_AUTH_INIT_REJECTED,
+    DPP_METRICS_RESULT_AUTH_INIT_FAILED,
+    DPP_METRICS_RESULT_NOT_COMPATIBLE,
+    DPP_METRICS_RESULT_CONF_FAILED,
+    DPP_METRICS_RESULT_FAIL,
+    DPP_METRICS_RESULT_TIMEOUT,
+    DPP_METRICS_RESULT_MONITOR_ERROR,
+    DPP_METRICS_RESULTS
+};
+
+struct dpp_metrics_attempt
+{
+    uint64_t start_ns;
+    uint64_t initiated_ns;
+    uint64_t authenticated_ns;
+};
+
+uint64_t dpp_metrics_now(void);
+void dpp_metrics_phase(enum dpp_metrics_phase phase, uint64_t ns);
+void dpp_metrics_result(enum dpp_metrics_result result);
+enum dpp_metrics_result dpp_metrics_event_result(const char *event_name);
+void dpp_metrics_command(const char *cmd, uint64_t ns, int ret, const char *response);
+void dpp_metrics_attempt_start(struct dpp_metrics_attempt *attempt);
+void dpp_metrics_attempt_initiated(struct dpp_metrics_attempt *attempt);
+bool dpp_metrics_attempt_event(struct dpp_metrics_attempt *attempt, enum dpp_event_kind kind,
+                               const char *event_name);
+void dpp_metrics_attempt_total(const struct dpp_metrics_attempt *attempt);
+void dpp_metrics_attempt_end(const struct dpp_metrics_attempt *attempt,
+                             enum dpp_metrics_result result);
+int dpp_metrics_write(FILE *fp);
+int dpp_metrics_write_file(const char *path);
+void dpp_metrics_set_file(const char *path);
+void dpp_metrics_flush(void);
+void dpp_metrics_reset(void);
+
+int dpp_auth_event_loop(struct dpp_configurator_ctx *ctx, struct hostapd_ctrl *monitor,
+                        int timeout_seconds, struct dpp_metrics_attempt *attempt);
+
+// ログ（レベル・モジュールごとのフィルタ、書式化はバックグラウンドスレッドで行う）
+#define DPP_LOG_ENV "DPP_CONFIGURATOR_LOG"
+
+enum dpp_log_level
+{
+    DPP_LOG_ERROR,
+    DPP_LOG_WARN,
+    DPP_LOG_INFO,
+    DPP_LOG_DEBUG,
+};
+
+enum dpp_log_module
+{
+    DPP_LOG_MAIN,
+    DPP_LOG_CTRL, // hostapd制御インターフェース
+    DPP_LOG_AUTH,
+    DPP_LOG_STATE,
+    DPP_LOG_PEER,
+    DPP_LOG_PROVISION,
+    DPP_LOG_DAEMON,
+    DPP_LOG_MODULES
+};
+
+extern uint8_t dpp_log_levels[DPP_LOG_MODULES];
+
+// 無効なレベルでは配列を1回読むだけで、引数も評価しない（書式文字列はリテラルに限る）
+#define DPP_LOG(module, level, ...)                          \
+    do                                                       \
+    {                                                        \
+        if ((level) <= dpp_log_levels[module])               \
+            dpp_log_write((module), (level), __VA_ARGS__);   \
+    } while (0)
+
+void dpp_log_write(enum dpp_log_module module, enum dpp_log_level level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void dpp_log_set_level(enum dpp_log_level level);
+int dpp_log_configure(const char *spec);
+void dpp_log_flush(void);
+void dpp_log_shutdown(void);
+size_t dpp_log_redact(const char *in, char *out, size_t size);
+
+// デーモンモード（ローカルUNIXソケット経由でコマンドを受け付ける）
+#define DPP_DAEMON_RUNTIME_NAME "dpp_configurator" // 実行時ディレクトリ名
+#define DPP_DAEMON_SOCKET_NAME "daemon.sock"
+#define DPP_DAEMON_NOT_RUNNING (-1000)
+const char *dpp_daemon_runtime_dir(bool create);
+const char *dpp_daemon_socket_path(bool create);
+int dpp_daemon_forward(bool verbose, const char *cmd, const char *args);
+
+// Bootstrap情報の一括保存用レコード（uriはNUL終端でなくてもよい）
+struct dpp_bootstrap_record
+{
+    int id;
+    const char *uri;
+    size_t uri_len;
+    const u8 *pubkey_hash; // NULLでなければ公開鍵の索引にも登録する
+};
+
+// 状態ストア（追記専用ログ + type/IDのハッシュインデックス + 読み取り専用スナップショット）
+#define DPP_STATE_BOOTSTRAP 'B'
+#define DPP_STATE_CONFIGURATOR 'C'
+#define DPP_STATE_HOSTAPD_CONFIGURATOR 'H' // Configurator ID → hostapd側のConfigurator ID
+#define DPP_STATE_HOSTAPD_PEER 'P'         // Bootstrap ID → hostapd側のBootstrap ID
+#define DPP_STATE_BOOTSTRAP_KEY 'K'        // 公開鍵ハッシュ → Bootstrap ID（重複検出用）
+#define DPP_STATE_TEMPLATE 'T'             // 名前のハッシュ → 設定テンプレート
+#define DPP_STATE_JOB 'J'                  // 設定待ちのジョブ（ID 0は採番用）
+
+uint64_t dpp_state_append(uint8_t type, int id, const char *data, size_t len);
+int dpp_state_commit(void);
+int dpp_state_lock(void);
+void dpp_state_unlock(void);
+char *dpp_state_get(uint8_t type, int id);
+int dpp_state_read(uint8_t type, int id, char *buf, size_t size);
+const char *dpp_state_ref(uint8_t type, int id);
+int dpp_state_compact(void);
+size_t dpp_state_uncompacted(void);
+void dpp_state_set_file(const char *path);
+void dpp_state_close(void);
+
+int save_bootstrap_info(int id, const char *uri);
+int save_configurator_info(int id, const char *curve);
+int save_bootstrap_batch(const struct dpp_bootstrap_record *records, size_t count);
+int load_bootstrap_max_id(void);
+char *load_bootstrap_uri(int id);
+#define DPP_BOOTSTRAP_URI_MAX 1024 // lookup_bootstrap_uri()のバッファの大きさ
+int lookup_bootstrap_uri(int id, char *uri, size_t size);
+int lookup_bootstrap_key(const u8 *pubkey_hash);
+int save_bootstrap_key(const u8 *pubkey_hash, int id);
+char *load_configurator_curve(int id);
+int load_hostapd_mapping(uint8_t type, int id, const char *interface, const char *cookie);
+int append_hostapd_mapping(uint8_t type, int id, const char *interface, const char *cookie,
+                           int hostapd_id);
+int save_hostapd_mapping(uint8_t type, int id, const char *interface, const char *cookie,
+                         int hostapd_id);
+
+// hostapdへのピア事前登録（バックグラウンド）
+int dpp_hostapd_peer(const char *interface, int peer_id);
+int dpp_peer_sync_range(const char *interface, int first_id, int last_id);
+int dpp_peer_sync_interfaces(const char *const *interfaces, int count, int first_id,
+                             int last_id, int *registered);
+int dpp_peer_sync_queue(const char *interface, int first_id, int last_id);
+void dpp_peer_sync_wait(void);
+void dpp_peer_sync_check(void);
+void dpp_peer_sync_set_background(bool background);
+bool dpp_peer_sync_background(void);
+void dpp_peer_sync_stop(void);
+
+// 設定待ちジョブのキュー（インターフェースごとに1台ずつ、終わり次第次の端末へ）
+int *provision_parse_peers(const char *spec, size_t *count);
+int dpp_job_queue_start(struct dpp_configurator_ctx *ctx, const char *interfaces);
+void dpp_job_queue_stop(void);
+
+// 事前生成したプロトコル鍵のプール（dpp_keypool.c、-Wl,--wrap=dpp_gen_keypair が必要）
+int dpp_keypool_start(const char *curves, int size);
+void dpp_keypool_stop(void);
+void dpp_keypool_attach(bool attach);
+void dpp_keypool_stats(unsigned long *hits, unsigned long *misses);
+
+// CPUを多く使う処理（設定応答の作成・Connectorの署名）を実行するスレッドプール
+struct dpp_worker_pool;
+struct dpp_worker_job
+{
+    void (*fn)(struct dpp_worker_job *job); // プールのスレッドで呼ばれる（jobを埋め込んだ構造体を使う）
+    struct dpp_worker_job *next;
+};
+struct dpp_worker_pool *dpp_worker_pool_new(int threads);
+void dpp_worker_pool_submit(struct dpp_worker_pool *pool, struct dpp_worker_job *job);
+void dpp_worker_pool_free(struct dpp_worker_pool *pool);
+
+// 16進数・base64コーデック（CPU機能に応じてAVX2/SSE2/スカラーを選択）
+size_t dpp_hex_encode(const u8 *src, size_t len, char *dst);
+int dpp_hex_decode(const char *src, size_t len, u8 *dst);
+bool dpp_hex_valid(const char *src, size_t len);
+int dpp_base64_decode(const char *src, size_t len, u8 *dst, size_t dst_size);
+const char *dpp_codec_impl(void);
+int dpp_codec_select(const char *name);
+
+// コマンドの出力先（スレッドごと。デーモンではクライアントごとのストリーム）
+FILE *dpp_output(void);
+FILE *dpp_output_set(FILE *out);
+int dpp_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
 
 // ユーティリティ関数
-char *parse_argument(char *args, const char *key);
+int dpp_args_parse(char *buf, const struct dpp_arg_spec *schema, struct dpp_args *args);
+char *dpp_arg(const struct dpp_args *args, const char *key);
+int dpp_arg_int(const struct dpp_args *args, const char *key, int def);
 void print_usage(const char *prog_name);
+char *encode_hex_string(const char *str);
 char *decode_hex_string(const char *hex_str);
 bool is_hex_string(const char *str);
 bool is_valid_matter_pin(const char *pin);
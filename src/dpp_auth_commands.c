@@ -14,70 +14,139 @@
 // External functions
 extern int hostapd_cli_send_command(const char *interface, const char *cmd,
                                     char *response, size_t response_size);
-extern char *load_bootstrap_uri(int id);
-extern char *encode_hex_string(const char *str);
 
-// DPP認証を実際のhostapdで実行
-static int dpp_execute_real_auth(struct dpp_configurator_ctx *ctx,
-                                 const char *interface,
-                                 int peer_id, int configurator_id,
-                                 const char *conf_type, const char *ssid, const char *pass,
-                                 const char *matter_pin, const char *conf_json)
+#define DPP_CONFIGURATOR_KEY_HEX_MAX 1024
+
+/*
+ * hostapd側のConfigurator IDを取得
+ * hostapdインスタンス（制御ソケット）ごとに一度だけDPP_CONFIGURATOR_ADDし、
+ * ローカルのConfigurator IDとの対応を状態ストアに保存して再利用する
+ * refreshがtrueなら保存済みの対応を使わずに作り直す
+ */
+int dpp_hostapd_configurator(struct dpp_configurator_ctx *ctx, const char *interface,
+                             int configurator_id, bool refresh, bool quiet)
 {
-    char cmd[512];
+    struct hostapd_ctrl *ctrl;
+    char cookie[64];
+    char key[DPP_CONFIGURATOR_KEY_HEX_MAX];
+    char cmd[DPP_CONFIGURATOR_KEY_HEX_MAX + 64];
     char response[MAX_RESPONSE_SIZE];
+    char *curve = NULL;
+    int hostapd_id;
     int ret;
 
-    (void)ctx; // 未使用パラメータ警告を回避
-
-    printf("Executing DPP authentication via hostapd interface: %s\n", interface);
-
-    // Step 1: hostapd にコンフィギュレーターを追加
-    printf("Step 1: Adding configurator to hostapd...\n");
-    snprintf(cmd, sizeof(cmd), "DPP_CONFIGURATOR_ADD curve=prime256v1");
-    ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
-    if (ret < 0)
+    // 制御ソケットのstat()だけで、保存済みの対応が今のhostapdのものか判定できる
+    if (hostapd_ctrl_instance_cookie(interface, cookie, sizeof(cookie)) < 0)
     {
-        printf("Failed to add configurator to hostapd\n");
+        dpp_printf("Error: hostapd control interface for %s not found\n", interface);
         return -1;
     }
 
-    // レスポンスから実際のコンフィギュレーターIDを取得
-    int hostapd_configurator_id = atoi(response);
-    printf("hostapd configurator ID: %d\n", hostapd_configurator_id);
-
-    // Step 2: hostapd にブートストラップ情報を追加
-    printf("Step 2: Adding bootstrap info to hostapd...\n");
-    char *saved_uri = load_bootstrap_uri(peer_id);
-    if (!saved_uri)
+    if (!refresh)
     {
-        printf("Error: Cannot find bootstrap URI for peer ID %d\n", peer_id);
-        return -1;
+        hostapd_id = load_hostapd_mapping(DPP_STATE_HOSTAPD_CONFIGURATOR, configurator_id, interface, cookie);
+        if (hostapd_id >= 0)
+        {
+            if (!quiet)
+                dpp_printf("Reusing hostapd configurator ID: %d\n", hostapd_id);
+            return hostapd_id;
+        }
     }
 
-    snprintf(cmd, sizeof(cmd), "DPP_QR_CODE %s", saved_uri);
-    ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
-    free(saved_uri);
+    ctrl = hostapd_ctrl_get(interface);
+    if (!ctrl)
+        return -1;
+
+    // ローカルに鍵があれば同じ鍵でhostapd側にも登録する（鍵は表示しない）
+    if (ctx->dpp_global &&
+        dpp_configurator_get_key_id(ctx->dpp_global, configurator_id, key, sizeof(key)) > 0)
+    {
+        if (!quiet)
+            dpp_printf("Adding configurator %d to hostapd with its local key\n", configurator_id);
+        snprintf(cmd, sizeof(cmd), "DPP_CONFIGURATOR_ADD key=%s", key);
+    }
+    else
+    {
+        curve = load_configurator_curve(configurator_id);
+        if (!curve)
+        {
+            dpp_printf("Warning: Configurator ID %d not found, using curve prime256v1\n",
+                       configurator_id);
+        }
+        if (!quiet)
+            dpp_printf("Adding configurator %d to hostapd (curve=%s)\n", configurator_id,
+                       curve ? curve : "prime256v1");
+        snprintf(cmd, sizeof(cmd), "DPP_CONFIGURATOR_ADD curve=%s",
+                 curve ? curve : "prime256v1");
+        free(curve);
+    }
 
-    if (ret < 0)
+    ret = hostapd_ctrl_request(ctrl, cmd, response, sizeof(response));
+    memset(key, 0, sizeof(key));
+    memset(cmd, 0, sizeof(cmd));
+    if (ret < 0 || response[0] < '0' || response[0] > '9')
     {
-        printf("Failed to add bootstrap info to hostapd\n");
+        dpp_printf("Failed to add configurator to hostapd: %s\n",
+                   ret < 0 ? strerror(-ret) : response);
         return -1;
     }
 
-    // レスポンスから実際のピアIDを取得
-    int hostapd_peer_id = atoi(response);
-    printf("hostapd peer ID: %d\n", hostapd_peer_id);
+    hostapd_id = atoi(response);
+    if (!quiet)
+        dpp_printf("hostapd configurator ID: %d\n", hostapd_id);
+    save_hostapd_mapping(DPP_STATE_HOSTAPD_CONFIGURATOR, configurator_id, interface, cookie,
+                         hostapd_id);
+    return hostapd_id;
+}
 
-    // Step 3: DPP auth_init コマンドを構築（hostapdのIDを使用）
-    printf("Step 3: Initiating DPP authentication...\n");
-    
+// hostapd側にConfiguratorが残っているか確認（鍵の取得に成功するか）
+static bool dpp_hostapd_configurator_exists(const char *interface, int hostapd_id)
+{
+    struct hostapd_ctrl *ctrl = hostapd_ctrl_get(interface);
+    struct hostapd_reply reply;
+    char cmd[64];
+    bool exists;
+
+    if (!ctrl)
+        return false;
+    snprintf(cmd, sizeof(cmd), "DPP_CONFIGURATOR_GET_KEY %d", hostapd_id);
+    hostapd_reply_init(&reply);
+    exists = hostapd_ctrl_request_reply(ctrl, cmd, &reply) > 0 &&
+             strncmp(reply.buf, "FAIL", 4) != 0;
+    hostapd_reply_free(&reply); // 鍵を消去してから解放する
+    return exists;
+}
+
+// hostapd側にBootstrap情報が残っているか確認
+static bool dpp_hostapd_peer_exists(const char *interface, int hostapd_peer_id)
+{
+    struct hostapd_ctrl *ctrl = hostapd_ctrl_get(interface);
+    struct hostapd_reply reply;
+    char cmd[64];
+    bool exists;
+
+    if (!ctrl)
+        return false;
+    snprintf(cmd, sizeof(cmd), "DPP_BOOTSTRAP_INFO %d", hostapd_peer_id);
+    hostapd_reply_init(&reply);
+    exists = hostapd_ctrl_request_reply(ctrl, cmd, &reply) > 0 &&
+             strncmp(reply.buf, "FAIL", 4) != 0;
+    hostapd_reply_free(&reply);
+    return exists;
+}
+
+/*
+ * DPP_AUTH_INITの設定部分（conf=... / conf_json=...）を組み立てる
+ * SSIDとパスワードは16進数でなければエンコードする
+ */
+int dpp_auth_build_params(const char *conf_type, const char *ssid, const char *pass,
+                          const char *matter_pin, const char *conf_json,
+                          char *params, size_t params_size)
+{
     // JSON設定が提供されている場合は、それを使用
     if (conf_json) {
-        printf("Using JSON configuration: %s\n", conf_json);
-        snprintf(cmd, sizeof(cmd),
-                 "DPP_AUTH_INIT peer=%d configurator=%d conf_json='%s'",
-                 hostapd_peer_id, hostapd_configurator_id, conf_json);
+        DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "Using JSON configuration: %s", conf_json);
+        snprintf(params, params_size, "conf_json='%s'", conf_json);
     }
     else if (ssid && pass)
     {
@@ -89,45 +158,43 @@ static int dpp_execute_real_auth(struct dpp_configurator_ctx *ctx,
         if (is_hex_string(ssid))
         {
             ssid_hex = strdup(ssid);
-            printf("Using SSID as hex: %s\n", ssid_hex);
+            DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "Using SSID as hex: %s", ssid_hex);
         }
         else
         {
             ssid_hex = encode_hex_string(ssid);
-            printf("Encoded SSID '%s' to hex: %s\n", ssid, ssid_hex);
+            DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "Encoded SSID '%s' to hex: %s", ssid, ssid_hex);
         }
 
         // パスワードが既に16進数でない場合はエンコード
         if (is_hex_string(pass))
         {
             pass_hex = strdup(pass);
-            printf("Using password as hex: %s\n", pass_hex);
+            DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "Using password as hex");
         }
         else
         {
             pass_hex = encode_hex_string(pass);
-            printf("Encoded password '%s' to hex: %s\n", pass, pass_hex);
+            DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "Encoded password to hex");
         }
 
         if (ssid_hex && pass_hex)
         {
             if (matter_pin && strlen(matter_pin) == 8)
             {
-                snprintf(cmd, sizeof(cmd),
-                         "DPP_AUTH_INIT peer=%d configurator=%d conf=%s ssid=%s pass=%s matter_pin=%s",
-                         hostapd_peer_id, hostapd_configurator_id, conf_type, ssid_hex, pass_hex, matter_pin);
-                printf("Including Matter PIN: %s\n", matter_pin);
+                snprintf(params, params_size, "conf=%s ssid=%s pass=%s matter_pin=%s",
+                         conf_type, ssid_hex, pass_hex, matter_pin);
+                DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "Including Matter PIN");
             }
             else
             {
-                snprintf(cmd, sizeof(cmd),
-                         "DPP_AUTH_INIT peer=%d configurator=%d conf=%s ssid=%s pass=%s",
-                         hostapd_peer_id, hostapd_configurator_id, conf_type, ssid_hex, pass_hex);
+                snprintf(params, params_size, "conf=%s ssid=%s pass=%s",
+                         conf_type, ssid_hex, pass_hex);
             }
         }
         else
         {
-            printf("Error: Failed to encode SSID or password to hex\n");
+            dpp_printf("Error: Failed to encode SSID or password to hex\n");
             if (ssid_hex)
                 free(ssid_hex);
             if (pass_hex)
@@ -138,229 +205,387 @@ static int dpp_execute_real_auth(struct dpp_configurator_ctx *ctx,
         free(ssid_hex);
         free(pass_hex);
     }
+    else if (ssid)
+    {
+        // DPP AKM（sta-dpp・ap-dpp）はパスワードなし（ConnectorはConfiguratorが署名する）
+        size_t type_len = conf_type ? strlen(conf_type) : 0;
+        char *ssid_hex;
+
+        if (type_len < 4 || strcmp(conf_type + type_len - 4, "-dpp") != 0)
+        {
+            dpp_printf("Error: conf=%s requires pass=<passphrase> (only *-dpp types take ssid alone)\n",
+                       conf_type ? conf_type : "(none)");
+            return -1;
+        }
+        ssid_hex = is_hex_string(ssid) ? strdup(ssid) : encode_hex_string(ssid);
+        if (!ssid_hex)
+        {
+            dpp_printf("Error: Failed to encode SSID to hex\n");
+            return -1;
+        }
+        if (matter_pin && strlen(matter_pin) == 8)
+            snprintf(params, params_size, "conf=%s ssid=%s matter_pin=%s",
+                     conf_type, ssid_hex, matter_pin);
+        else
+            snprintf(params, params_size, "conf=%s ssid=%s", conf_type, ssid_hex);
+        free(ssid_hex);
+    }
     else
     {
         if (matter_pin && strlen(matter_pin) == 8)
         {
-            snprintf(cmd, sizeof(cmd),
-                     "DPP_AUTH_INIT peer=%d configurator=%d conf=%s matter_pin=%s",
-                     hostapd_peer_id, hostapd_configurator_id, conf_type, matter_pin);
-            printf("Including Matter PIN: %s\n", matter_pin);
+            snprintf(params, params_size, "conf=%s matter_pin=%s", conf_type, matter_pin);
+            DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "Including Matter PIN");
         }
         else
         {
-            snprintf(cmd, sizeof(cmd),
-                     "DPP_AUTH_INIT peer=%d configurator=%d conf=%s",
-                     hostapd_peer_id, hostapd_configurator_id, conf_type);
+            snprintf(params, params_size, "conf=%s", conf_type);
         }
     }
 
-    printf("Sending to hostapd: %s\n", cmd);
+    return 0;
+}
 
-    // hostapdにコマンド送信
-    ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
-    if (ret < 0)
+/*
+ * hostapdでDPP認証を開始する（DPP_AUTH_INITまで。完了はイベントで待つ）
+ * Configurator・ピアはhostapd側のIDに変換し、消えていれば一度だけ登録し直す
+ * quietなら進行状況を表示しない（複数の無線で並列に実行する場合）
+ */
+int dpp_auth_start(struct dpp_configurator_ctx *ctx, const char *interface,
+                   int peer_id, int configurator_id, const char *params, bool quiet)
+{
+    char cmd[DPP_AUTH_PARAMS_MAX + 64];
+    char response[MAX_RESPONSE_SIZE];
+    uint64_t start;
+    int ret;
+
+    // Step 1: hostapd側のコンフィギュレーター（作成済みなら再利用）
+    if (!quiet)
+        dpp_printf("Step 1: Looking up configurator in hostapd...\n");
+    start = dpp_metrics_now();
+    int hostapd_configurator_id = dpp_hostapd_configurator(ctx, interface, configurator_id, false, quiet);
+    dpp_metrics_phase(DPP_METRICS_PHASE_CONFIGURATOR, dpp_metrics_now() - start);
+    if (hostapd_configurator_id < 0)
     {
-        printf("Failed to communicate with hostapd on interface %s\n", interface);
-        printf("Make sure hostapd is running with DPP support and control interface enabled.\n");
-        printf("hostapd.conf should include:\n");
-        printf("  ctrl_interface=/var/run/hostapd\n");
-        printf("  ctrl_interface_group=sudo\n");
+        dpp_metrics_result(DPP_METRICS_RESULT_CONFIGURATOR_ERROR);
         return -1;
     }
 
-    printf("hostapd response: %s\n", response);
+    // Step 2: hostapd側のピアID（事前登録済みならラウンドトリップ不要）
+    if (!quiet)
+        dpp_printf("Step 2: Looking up bootstrap info in hostapd...\n");
+    start = dpp_metrics_now();
+    int hostapd_peer_id = dpp_hostapd_peer(interface, peer_id);
+    dpp_metrics_phase(DPP_METRICS_PHASE_PEER, dpp_metrics_now() - start);
+    if (hostapd_peer_id < 0)
+    {
+        dpp_printf("Failed to add bootstrap info to hostapd\n");
+        dpp_metrics_result(DPP_METRICS_RESULT_PEER_ERROR);
+        return -1;
+    }
+
+    // Step 3: DPP auth_init コマンドを送信（hostapdのIDを使用）
+    if (!quiet)
+    {
+        dpp_printf("hostapd peer ID: %d\n", hostapd_peer_id);
+        dpp_printf("Step 3: Initiating DPP authentication...\n");
+    }
+
+    start = dpp_metrics_now();
+    for (int attempt = 0;; attempt++)
+    {
+        snprintf(cmd, sizeof(cmd), "DPP_AUTH_INIT peer=%d configurator=%d %s",
+                 hostapd_peer_id, hostapd_configurator_id, params);
+        // hostapdにコマンド送信（並列実行時は送受信のログを出さない）
+        if (quiet)
+        {
+            struct hostapd_ctrl *ctrl = hostapd_ctrl_get(interface);
+            ret = ctrl ? hostapd_ctrl_request(ctrl, cmd, response, sizeof(response)) : -1;
+        }
+        else
+        {
+            ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
+        }
+        if (ret < 0)
+        {
+            dpp_printf("Failed to communicate with hostapd on interface %s\n", interface);
+            dpp_printf("Make sure hostapd is running with DPP support and control interface enabled.\n");
+            dpp_printf("hostapd.conf should include:\n");
+            dpp_printf("  ctrl_interface=/var/run/hostapd\n");
+            dpp_printf("  ctrl_interface_group=sudo\n");
+            dpp_metrics_result(DPP_METRICS_RESULT_HOSTAPD_ERROR);
+            return -1;
+        }
+
+        if (attempt > 0 || !strstr(response, "FAIL"))
+            break;
+
+        // 保存済みのIDがhostapdから消えていた場合は一度だけ登録し直す
+        bool stale = false;
+        if (!dpp_hostapd_configurator_exists(interface, hostapd_configurator_id))
+        {
+            dpp_printf("hostapd configurator ID %d is no longer valid, re-adding\n",
+                       hostapd_configurator_id);
+            hostapd_configurator_id = dpp_hostapd_configurator(ctx, interface, configurator_id, true, quiet);
+            if (hostapd_configurator_id < 0)
+            {
+                dpp_metrics_result(DPP_METRICS_RESULT_CONFIGURATOR_ERROR);
+                return -1;
+            }
+            stale = true;
+        }
+        if (!dpp_hostapd_peer_exists(interface, hostapd_peer_id))
+        {
+            char cookie[64];
+            dpp_printf("hostapd peer ID %d is no longer valid, re-adding\n", hostapd_peer_id);
+            if (hostapd_ctrl_instance_cookie(interface, cookie, sizeof(cookie)) == 0)
+                save_hostapd_mapping(DPP_STATE_HOSTAPD_PEER, peer_id, interface, cookie, -1);
+            hostapd_peer_id = dpp_hostapd_peer(interface, peer_id);
+            if (hostapd_peer_id < 0)
+            {
+                dpp_metrics_result(DPP_METRICS_RESULT_PEER_ERROR);
+                return -1;
+            }
+            stale = true;
+        }
+        if (!stale)
+            break;
+    }
+    dpp_metrics_phase(DPP_METRICS_PHASE_AUTH_INIT, dpp_metrics_now() - start);
+
+    if (!quiet)
+        dpp_printf("hostapd response: %s\n", response);
 
     // 応答を解析
     if (strstr(response, "OK") || strstr(response, "Authentication initiated"))
     {
-        printf("✓ DPP Authentication successfully initiated via hostapd\n");
+        if (!quiet)
+            dpp_printf("✓ DPP Authentication successfully initiated via hostapd\n");
         return 0;
     }
     else if (strstr(response, "FAIL"))
     {
-        printf("✗ DPP Authentication failed: %s\n", response);
+        dpp_printf("✗ DPP Authentication failed on %s: %s\n", interface, response);
+        dpp_metrics_result(DPP_METRICS_RESULT_AUTH_INIT_REJECTED);
         return -1;
     }
     else
     {
-        printf("? Unknown response from hostapd: %s\n", response);
+        dpp_printf("? Unknown response from hostapd: %s\n", response);
+        dpp_metrics_result(DPP_METRICS_RESULT_AUTH_INIT_REJECTED);
         return -1;
     }
 }
 
-// 実際の無線通信によるauth_init（hostapd統合版）
-int cmd_auth_init_real(struct dpp_configurator_ctx *ctx, char *args)
+// DPP認証を実際のhostapdで実行
+static int dpp_execute_real_auth(struct dpp_configurator_ctx *ctx,
+                                 const char *interface,
+                                 int peer_id, int configurator_id,
+                                 const char *conf_type, const char *ssid, const char *pass,
+                                 const char *matter_pin, const char *conf_json,
+                                 const struct dpp_template *tmpl, const char *discriminator)
 {
-    int peer_id = -1;
-    int configurator_id = -1;
-    char *conf_type = NULL;
-    char *ssid = NULL;
-    char *pass = NULL;
-    char *interface = NULL;
-    char *matter_pin = NULL;
-    char *conf_json = NULL;
-    int ret = -1;
+    char params[DPP_AUTH_PARAMS_MAX];
 
-    if (ctx->verbose)
-    {
-        printf("Processing auth_init_real command: %s\n", args);
-    }
-
-    // 引数解析
-    char *peer_str = parse_argument(args, "peer");
-    char *configurator_str = parse_argument(args, "configurator");
-    conf_type = parse_argument(args, "conf");
-    ssid = parse_argument(args, "ssid");
-    pass = parse_argument(args, "pass");
-    interface = parse_argument(args, "interface");
-    matter_pin = parse_argument(args, "matter_pin");
-    conf_json = parse_argument(args, "conf_json");
+    dpp_printf("Executing DPP authentication via hostapd interface: %s\n", interface);
 
-    if (peer_str)
+    // テンプレートは検証済みなので端末ごとの値を差し込むだけ
+    if (tmpl)
     {
-        peer_id = atoi(peer_str);
-        free(peer_str);
+        if (dpp_template_render(tmpl, matter_pin, discriminator, params, sizeof(params)) < 0)
+        {
+            dpp_printf("Error: Cannot build configuration from template (check matter_pin/discriminator)\n");
+            return -1;
+        }
     }
-
-    if (configurator_str)
+    else if (dpp_auth_build_params(conf_type, ssid, pass, matter_pin, conf_json,
+                                   params, sizeof(params)) < 0)
     {
-        configurator_id = atoi(configurator_str);
-        free(configurator_str);
+        return -1;
     }
 
+    return dpp_auth_start(ctx, interface, peer_id, configurator_id, params, false);
+}
+
+// 実際の無線通信によるauth_init（hostapd統合版）
+int cmd_auth_init_real(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    int peer_id = dpp_arg_int(args, "peer", -1);
+    int configurator_id = dpp_arg_int(args, "configurator", -1);
+    const char *conf_type = dpp_arg(args, "conf");
+    const char *ssid = dpp_arg(args, "ssid");
+    const char *pass = dpp_arg(args, "pass");
+    const char *interface = dpp_arg(args, "interface");
+    const char *matter_pin = dpp_arg(args, "matter_pin");
+    const char *conf_json = dpp_arg(args, "conf_json");
+    const char *template_name = dpp_arg(args, "template");
+    const char *discriminator = dpp_arg(args, "discriminator");
+    const struct dpp_template *tmpl = NULL;
+    int wait_seconds = dpp_arg_int(args, "wait", 0);
+    struct hostapd_ctrl *monitor = NULL;
+    struct dpp_metrics_attempt attempt;
+    int ret = -1;
+
     // 必須パラメータチェック
     if (peer_id < 0 || configurator_id < 0 || !interface)
     {
-        printf("Error: peer, configurator, and interface parameters required\n");
-        printf("Usage: auth_init_real peer=<id> configurator=<id> interface=<ifname> [conf=<type>] [ssid=<ssid>] [pass=<pass>] [matter_pin=<8-digit-pin>] [conf_json=\"<json>\"]\n");
-        printf("Example (traditional): auth_init_real peer=1 configurator=1 conf=sta-psk interface=wlan0 ssid=MyWiFi pass=secret123 matter_pin=12345678\n");
-        printf("Example (JSON): auth_init_real peer=1 configurator=1 interface=wlan0 conf_json='{\"wi-fi_tech\":\"infra\",\"discovery\":{\"ssid\":\"MyWiFi\"},\"cred\":{\"akm\":\"psk\",\"pass\":\"secret123\"},\"matter\":{\"pinCode\":\"12345678\"}}'\n");
-        printf("Note: Use single quotes around JSON to avoid shell interpretation issues\n");
+        dpp_printf("Error: peer, configurator, and interface parameters required\n");
+        dpp_printf("Usage: auth_init_real peer=<id> configurator=<id> interface=<ifname> [conf=<type>] [ssid=<ssid>] [pass=<pass>] [matter_pin=<8-digit-pin>] [conf_json=\"<json>\"] [template=<name> [discriminator=<n>]] [wait=<seconds>]\n");
+        dpp_printf("Example (traditional): auth_init_real peer=1 configurator=1 conf=sta-psk interface=wlan0 ssid=MyWiFi pass=secret123 matter_pin=12345678\n");
+        dpp_printf("Example (DPP AKM): auth_init_real peer=1 configurator=1 conf=sta-dpp interface=wlan0 ssid=MyWiFi\n");
+        dpp_printf("Example (JSON): auth_init_real peer=1 configurator=1 interface=wlan0 conf_json='{\"wi-fi_tech\":\"infra\",\"discovery\":{\"ssid\":\"MyWiFi\"},\"cred\":{\"akm\":\"psk\",\"pass\":\"secret123\"},\"matter\":{\"pinCode\":\"12345678\"}}'\n");
+        dpp_printf("Note: Use single quotes around JSON to avoid shell interpretation issues\n");
         goto cleanup;
     }
 
-    // JSON設定と従来の設定の混在チェック
-    if (conf_json && (conf_type || ssid || pass || matter_pin))
+    // テンプレートを使う場合は端末ごとの値（matter_pin・discriminator）だけを指定する
+    // （conf・conf_json・templateの混在はスキーマで検査済み）
+    if (template_name)
     {
-        printf("Error: Cannot mix conf_json with traditional parameters (conf, ssid, pass, matter_pin)\n");
-        printf("Use either conf_json OR traditional parameters, not both\n");
+        tmpl = dpp_template_get(template_name);
+        if (!tmpl)
+            goto cleanup;
+    }
+    else if (discriminator)
+    {
+        dpp_printf("Error: discriminator requires a template\n");
         goto cleanup;
     }
 
     // 従来の設定の場合のみconf_typeが必須
-    if (!conf_json && !conf_type)
+    if (!conf_json && !conf_type && !tmpl)
     {
-        printf("Error: conf parameter required when not using conf_json\n");
+        dpp_printf("Error: conf parameter required when not using conf_json\n");
         goto cleanup;
     }
 
     // Matter PINの検証（従来の設定の場合のみ）
-    if (matter_pin && !conf_json)
+    if (matter_pin)
     {
         if (!is_valid_matter_pin(matter_pin))
         {
-            printf("Error: Matter PIN must be exactly 8 digits (0-9 only)\n");
-            printf("Example: matter_pin=12345678\n");
+            dpp_printf("Error: Matter PIN must be exactly 8 digits (0-9 only)\n");
+            dpp_printf("Example: matter_pin=12345678\n");
             goto cleanup;
         }
-        printf("Matter PIN validation: OK\n");
+        dpp_printf("Matter PIN validation: OK\n");
     }
 
-    printf("Real DPP Authentication Parameters:\n");
-    printf("  Interface: %s\n", interface);
-    printf("  Peer ID: %d\n", peer_id);
-    printf("  Configurator ID: %d\n", configurator_id);
+    dpp_printf("Real DPP Authentication Parameters:\n");
+    dpp_printf("  Interface: %s\n", interface);
+    dpp_printf("  Peer ID: %d\n", peer_id);
+    dpp_printf("  Configurator ID: %d\n", configurator_id);
     
-    if (conf_json)
+    if (tmpl)
     {
-        printf("  JSON Configuration: %s\n", conf_json);
+        dpp_printf("  Template: %s\n", template_name);
+        if (matter_pin)
+            dpp_printf("  Matter PIN: %s\n", matter_pin);
+        if (discriminator)
+            dpp_printf("  Discriminator: %s\n", discriminator);
+    }
+    else if (conf_json)
+    {
+        char redacted[1024];
+        dpp_log_redact(conf_json, redacted, sizeof(redacted));
+        dpp_printf("  JSON Configuration: %s\n", redacted);
     }
     else
     {
-        printf("  Configuration type: %s\n", conf_type);
+        dpp_printf("  Configuration type: %s\n", conf_type);
         if (ssid)
-            printf("  SSID: %s\n", ssid);
+            dpp_printf("  SSID: %s\n", ssid);
         if (pass)
-            printf("  Password: %s\n", pass);
+            dpp_printf("  Password: ******** (%zu characters)\n", strlen(pass));
         if (matter_pin)
-            printf("  Matter PIN: %s\n", matter_pin);
+            dpp_printf("  Matter PIN: %s\n", matter_pin);
+    }
+
+    // 完了を待つ場合は、イベントを取りこぼさないよう認証開始前にATTACHしておく
+    if (wait_seconds > 0)
+    {
+        monitor = hostapd_ctrl_open_monitor(interface);
+        if (!monitor)
+        {
+            goto cleanup;
+        }
     }
 
     // 実際のhostapd経由でDPP認証を実行
+    dpp_metrics_attempt_start(&attempt);
     ret = dpp_execute_real_auth(ctx, interface, peer_id, configurator_id,
-                                conf_type, ssid, pass, matter_pin, conf_json);
+                                conf_type, ssid, pass, matter_pin, conf_json, tmpl,
+                                discriminator);
 
-    if (ret == 0)
+    if (ret == 0 && monitor)
     {
-        printf("\n✓ DPP Authentication initiated successfully via hostapd\n");
-        printf("Monitor hostapd logs for authentication progress:\n");
-        printf("  tail -f /var/log/hostapd.log\n");
-        printf("  or use: hostapd_cli -i %s status\n", interface);
+        dpp_metrics_attempt_initiated(&attempt);
+        ret = dpp_auth_event_loop(ctx, monitor, wait_seconds, &attempt);
+    }
+    else if (ret == 0)
+    {
+        // 完了を待たないので結果は「開始した」だけ（時間は終了が分からないので記録しない）
+        dpp_metrics_result(DPP_METRICS_RESULT_INITIATED);
+        dpp_printf("\n✓ DPP Authentication initiated successfully via hostapd\n");
+        dpp_printf("Monitor hostapd logs for authentication progress:\n");
+        dpp_printf("  tail -f /var/log/hostapd.log\n");
+        dpp_printf("  or use: hostapd_cli -i %s status\n", interface);
     }
     else
     {
-        printf("\n✗ Failed to initiate DPP Authentication\n");
-        printf("Troubleshooting steps:\n");
-        printf("1. Verify hostapd is running: systemctl status hostapd\n");
-        printf("2. Check interface exists: ip link show %s\n", interface);
-        printf("3. Verify DPP support: hostapd_cli -i %s help | grep DPP\n", interface);
-        printf("4. Check bootstrap info: hostapd_cli -i %s dpp_bootstrap_get_uri %d\n", interface, peer_id);
+        dpp_metrics_attempt_total(&attempt);
+        dpp_printf("\n✗ Failed to initiate DPP Authentication\n");
+        dpp_printf("Troubleshooting steps:\n");
+        dpp_printf("1. Verify hostapd is running: systemctl status hostapd\n");
+        dpp_printf("2. Check interface exists: ip link show %s\n", interface);
+        dpp_printf("3. Verify DPP support: hostapd_cli -i %s help | grep DPP\n", interface);
+        dpp_printf("4. Check bootstrap info: hostapd_cli -i %s dpp_bootstrap_get_uri %d\n", interface, peer_id);
     }
 
 cleanup:
-    if (conf_type)
-        free(conf_type);
-    if (ssid)
-        free(ssid);
-    if (pass)
-        free(pass);
-    if (interface)
-        free(interface);
-    if (matter_pin)
-        free(matter_pin);
-    if (conf_json)
-        free(conf_json);
+    if (monitor)
+        hostapd_ctrl_close(monitor);
+    dpp_template_release(tmpl);
 
     return ret;
 }
 
 // auth_status コマンド（hostapd統合版）
-int cmd_auth_status(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_auth_status(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
     (void)args; // 未使用パラメータの警告を避ける
 
-    printf("DPP Authentication Status:\n");
+    dpp_printf("DPP Authentication Status:\n");
 
     if (!ctx->current_auth)
     {
-        printf("  No active authentication session\n");
+        dpp_printf("  No active authentication session\n");
         return 0;
     }
 
     struct dpp_authentication *auth = ctx->current_auth;
 
-    printf("  Active authentication session:\n");
-    printf("    Initiator: %s\n", auth->initiator ? "YES" : "NO");
-    printf("    Configurator: %s\n", auth->configurator ? "YES" : "NO");
-    printf("    Peer version: %d\n", auth->peer_version);
-    printf("    Waiting auth response: %s\n", auth->waiting_auth_resp ? "YES" : "NO");
-    printf("    Waiting auth confirm: %s\n", auth->waiting_auth_conf ? "YES" : "NO");
-    printf("    Authentication success: %s\n", auth->auth_success ? "YES" : "NO");
-    printf("    Configuration success: %s\n", auth->waiting_conf_result ? "PENDING" : "COMPLETE");
+    dpp_printf("  Active authentication session:\n");
+    dpp_printf("    Initiator: %s\n", auth->initiator ? "YES" : "NO");
+    dpp_printf("    Configurator: %s\n", auth->configurator ? "YES" : "NO");
+    dpp_printf("    Peer version: %d\n", auth->peer_version);
+    dpp_printf("    Waiting auth response: %s\n", auth->waiting_auth_resp ? "YES" : "NO");
+    dpp_printf("    Waiting auth confirm: %s\n", auth->waiting_auth_conf ? "YES" : "NO");
+    dpp_printf("    Authentication success: %s\n", auth->auth_success ? "YES" : "NO");
+    dpp_printf("    Configuration success: %s\n", auth->waiting_conf_result ? "PENDING" : "COMPLETE");
 
     if (auth->peer_bi)
     {
-        printf("    Peer bootstrap ID: %d\n", auth->peer_bi->id);
+        dpp_printf("    Peer bootstrap ID: %d\n", auth->peer_bi->id);
     }
 
     if (auth->conf)
     {
-        printf("    Configurator object: PRESENT\n");
+        dpp_printf("    Configurator object: PRESENT\n");
     }
     else
     {
-        printf("    Configurator object: MISSING\n");
+        dpp_printf("    Configurator object: MISSING\n");
     }
 
     return 0;
@@ -1,6 +1,6 @@
 /*
  * DPP Configurator - Basic Commands
- * Basic DPP operations: configurator_add, qr_code, bootstrap_get_uri
+ * Basic DPP operations: configurator_add, qr_code, bootstrap_get_uri, compact
  */
 
 #include <stdio.h>
@@ -13,29 +13,23 @@ extern int hostapd_cli_send_command(const char *interface, const char *cmd,
                                     char *response, size_t response_size);
 extern int save_bootstrap_info(int id, const char *uri);
 extern int save_configurator_info(int id, const char *curve);
-extern char *load_bootstrap_uri(int id);
-extern char *encode_hex_string(const char *str);
 
 // configurator_add の実装（hostapd統合版）
-int cmd_configurator_add(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_configurator_add(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
-    char *key_file = NULL;
-    char *curve = NULL;
+    const char *key_file = dpp_arg(args, "key");
+    const char *curve = dpp_arg(args, "curve");
     int id;
     char cmd_str[512];
 
     if (ctx->verbose)
     {
-        printf("Processing configurator_add command: %s\n", args);
+        dpp_printf("Processing configurator_add command\n");
     }
 
-    // 引数解析
-    key_file = parse_argument(args, "key");
-    curve = parse_argument(args, "curve");
-
     if (!curve)
     {
-        curve = strdup("prime256v1"); // デフォルト
+        curve = "prime256v1"; // デフォルト
     }
 
     // コマンド文字列構築
@@ -53,106 +47,134 @@ int cmd_configurator_add(struct dpp_configurator_ctx *ctx, char *args)
 
     if (id < 0)
     {
-        printf("Failed to add configurator\n");
-        if (key_file)
-            free(key_file);
-        if (curve)
-            free(curve);
+        dpp_printf("Failed to add configurator\n");
         return -1;
     }
 
-    printf("Configurator added with ID: %d\n", id);
+    dpp_printf("Configurator added with ID: %d\n", id);
     ctx->configurator_count++;
 
     // Configurator情報を永続化
     save_configurator_info(id, curve);
 
-    // メモリ開放
-    if (key_file)
-        free(key_file);
-    if (curve)
-        free(curve);
-
     return 0;
 }
 
 // dpp_qr_code の実装（hostapd統合版）
-int cmd_dpp_qr_code(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_dpp_qr_code(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
+    const char *qr_uri = dpp_arg(args, "uri");
     struct dpp_bootstrap_info *bi;
+    struct dpp_uri_ctx *uri_ctx;
+    struct dpp_uri uri;
+    enum dpp_uri_status status;
+    int existing_id;
 
     if (ctx->verbose)
     {
-        printf("Processing dpp_qr_code command: %s\n", args);
+        dpp_printf("Processing dpp_qr_code command: %s\n", qr_uri);
     }
 
     // QRコードのURIが必要
-    if (!args || strlen(args) == 0)
+    if (!qr_uri)
     {
-        printf("Error: QR code URI is required\n");
+        dpp_printf("Error: QR code URI is required\n");
         return -1;
     }
 
-    // DPP URIかどうかの基本チェック
-    if (strncmp(args, "DPP:", 4) != 0)
+    // hostapdへ渡す前にURIと公開鍵をローカルで検証する
+    uri_ctx = dpp_uri_ctx_new();
+    status = dpp_uri_parse(uri_ctx, qr_uri, args->len[0], &uri);
+    dpp_uri_ctx_free(uri_ctx);
+    if (status != DPP_URI_OK)
     {
-        printf("Error: Invalid DPP URI format (must start with 'DPP:')\n");
+        dpp_printf("Error: Invalid DPP URI: %s (at offset %zu)\n",
+                   dpp_uri_status_str(status), uri.error_offset);
+        return -1;
+    }
+
+    /*
+     * 重複の確認からIDの割り当て・保存までは状態ファイルを排他する
+     * （同時に動くimportや他のプロセスのdpp_qr_codeと同じIDや公開鍵を登録しない）
+     */
+    if (dpp_state_lock() < 0)
+    {
+        dpp_printf("Error: Failed to lock state file\n");
+        return -1;
+    }
+
+    // 同じ公開鍵のBootstrap情報を重複して登録しない
+    existing_id = lookup_bootstrap_key(uri.pubkey_hash);
+    if (existing_id >= 0)
+    {
+        dpp_state_unlock();
+        dpp_printf("Error: Public key already registered as bootstrap ID %d\n", existing_id);
         return -1;
     }
 
     // Bootstrap情報をhostapdに追加
-    bi = dpp_add_qr_code(ctx->dpp_global, args);
+    bi = dpp_add_qr_code(ctx->dpp_global, qr_uri);
 
     if (!bi)
     {
-        printf("Failed to parse QR code\n");
+        dpp_state_unlock();
+        dpp_printf("Failed to parse QR code\n");
+        return -1;
+    }
+
+    // IDは永続化済みのエントリ（import分を含む）と重複しないように割り当てる
+    // （dpp_global側の次のIDは既存IDの最大値+1で決まるので整合性は保たれる）
+    int next_id = load_bootstrap_max_id() + 1;
+    if ((int)bi->id < next_id)
+    {
+        bi->id = next_id;
+    }
+
+    // 解析した情報を永続化（オリジナルのURIを保存）
+    if (save_bootstrap_info(bi->id, qr_uri) < 0 || save_bootstrap_key(uri.pubkey_hash, bi->id) < 0)
+    {
+        char id_str[16];
+
+        dpp_state_unlock();
+        dpp_printf("Error: Failed to save bootstrap info %d\n", bi->id);
+        snprintf(id_str, sizeof(id_str), "%u", bi->id);
+        dpp_bootstrap_remove(ctx->dpp_global, id_str);
         return -1;
     }
+    dpp_state_unlock();
 
-    printf("Bootstrap info added with ID: %d\n", bi->id);
+    dpp_printf("Bootstrap info added with ID: %d\n", bi->id);
     if (ctx->verbose)
     {
-        printf("  Parsed QR code: %s\n", args);
+        dpp_printf("  Parsed QR code: %s\n", qr_uri);
         if (bi->info)
         {
-            printf("  Device info: %s\n", bi->info);
+            dpp_printf("  Device info: %s\n", bi->info);
         }
         if (bi->chan)
         {
-            printf("  Channel list: %s\n", bi->chan);
+            dpp_printf("  Channel list: %s\n", bi->chan);
         }
     }
     ctx->bootstrap_count++;
 
-    // 解析した情報を永続化（オリジナルのURIを保存）
-    save_bootstrap_info(bi->id, args);
-
     return bi->id;
 }
 
 // bootstrap_get_uri の実装（hostapd統合版）
-int cmd_bootstrap_get_uri(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_bootstrap_get_uri(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
-    int id = -1;
-    char *id_str = NULL;
+    int id = dpp_arg_int(args, "id", -1);
     struct dpp_bootstrap_info *bi;
 
     if (ctx->verbose)
     {
-        printf("Processing bootstrap_get_uri command: %s\n", args);
-    }
-
-    // 引数解析
-    id_str = parse_argument(args, "id");
-    if (id_str)
-    {
-        id = atoi(id_str);
-        free(id_str);
+        dpp_printf("Processing bootstrap_get_uri command: id=%d\n", id);
     }
 
     if (id < 0)
     {
-        printf("Error: id parameter required\n");
+        dpp_printf("Error: id parameter required\n");
         return -1;
     }
 
@@ -161,29 +183,28 @@ int cmd_bootstrap_get_uri(struct dpp_configurator_ctx *ctx, char *args)
     if (!bi)
     {
         // 保存された情報から読み込みを試行
-        char *saved_uri = load_bootstrap_uri(id);
-        if (saved_uri)
+        char saved_uri[DPP_BOOTSTRAP_URI_MAX];
+        if (lookup_bootstrap_uri(id, saved_uri, sizeof(saved_uri)) >= 0)
         {
-            printf("Stored Peer QR Code (ID %d): %s\n", id, saved_uri);
-            free(saved_uri);
+            dpp_printf("Stored Peer QR Code (ID %d): %s\n", id, saved_uri);
             return 0;
         }
         else
         {
-            printf("Error: Bootstrap ID %d not found\n", id);
+            dpp_printf("Error: Bootstrap ID %d not found\n", id);
             return -1;
         }
     }
 
     // Bootstrap情報の詳細を表示
-    printf("Bootstrap ID %d Details:\n", id);
+    dpp_printf("Bootstrap ID %d Details:\n", id);
     if (bi->uri)
     {
-        printf("  URI: %s\n", bi->uri);
+        dpp_printf("  URI: %s\n", bi->uri);
     }
     if (bi->info)
     {
-        printf("  Info: %s\n", bi->info);
+        dpp_printf("  Info: %s\n", bi->info);
     }
 
     // Check if pubkey_hash is set (non-zero)
@@ -199,41 +220,55 @@ int cmd_bootstrap_get_uri(struct dpp_configurator_ctx *ctx, char *args)
 
     if (hash_set)
     {
-        printf("  Public Key Hash: ");
+        dpp_printf("  Public Key Hash: ");
         for (int i = 0; i < SHA256_MAC_LEN; i++)
         {
-            printf("%02x", bi->pubkey_hash[i]);
+            dpp_printf("%02x", bi->pubkey_hash[i]);
             if (i < SHA256_MAC_LEN - 1)
-                printf(":");
+                dpp_printf(":");
         }
-        printf("\n");
+        dpp_printf("\n");
     }
     else
     {
-        printf("  Public Key Hash: (not set)\n");
+        dpp_printf("  Public Key Hash: (not set)\n");
     }
 
-    printf("  Type: %s\n", bi->type == DPP_BOOTSTRAP_QR_CODE ? "QR Code" : bi->type == DPP_BOOTSTRAP_PKEX ? "PKEX"
+    dpp_printf("  Type: %s\n", bi->type == DPP_BOOTSTRAP_QR_CODE ? "QR Code" : bi->type == DPP_BOOTSTRAP_PKEX ? "PKEX"
                                                                                                           : "Other");
 
     return 0;
 }
 
 // status コマンド（hostapd統合版）
-int cmd_status(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_status(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
     (void)args; // 未使用パラメータの警告を避ける
 
-    printf("DPP Configurator Status (hostapd mode):\n");
-    printf("  Configurators: %d\n", ctx->configurator_count);
-    printf("  Bootstrap entries: %d\n", ctx->bootstrap_count);
-    printf("  Verbose mode: %s\n", ctx->verbose ? "enabled" : "disabled");
+    dpp_printf("DPP Configurator Status (hostapd mode):\n");
+    dpp_printf("  Configurators: %d\n", ctx->configurator_count);
+    dpp_printf("  Bootstrap entries: %d\n", ctx->bootstrap_count);
+    dpp_printf("  Verbose mode: %s\n", ctx->verbose ? "enabled" : "disabled");
 
     // 追加情報があれば表示
     if (ctx->dpp_global)
     {
-        printf("  DPP Global: initialized\n");
+        dpp_printf("  DPP Global: initialized\n");
     }
 
     return 0;
 }
+
+// compact コマンド: 状態ログをスナップショットにまとめる
+int cmd_compact(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    (void)ctx;  // 未使用パラメータの警告を避ける
+    (void)args; // 未使用パラメータの警告を避ける
+
+    if (dpp_state_compact() < 0)
+    {
+        dpp_printf("Error: State compaction failed\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,1747 @@
+/*
+ * DPP Configurator - Benchmark Commands
+ * Micro benchmarks for per-device hot paths
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <openssl/crypto.h>
+#include "../include/dpp_configurator.h"
+#include "utils/base64.h"
+
+#define BENCH_RESPONSE_SIZE 4096
+#define BENCH_CTRL_IFNAME "bench0"
+#define BENCH_STATE_LEGACY_LOOKUPS 20 // 旧実装は1回の検索でファイル全体を読むので少なめ
+#define BENCH_MIN_TIME_NS 200000000ULL // 1項目あたりの最低計測時間
+#define BENCH_MAX_RESULTS 64
+#define BENCH_QR_CODE_URI \
+    "DPP:C:81/1;M:5254005828e5;V:2;" \
+    "K:MDkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDIgADURzxmttZoIRIPWGoQMV00XHWCAQIhXruVWOz0NjlkIA=;;"
+
+#ifndef DPP_BENCH_REVISION
+#define DPP_BENCH_REVISION "unknown"
+#endif
+
+
+#ifdef DPP_BENCH_ALLOC_COUNT
+/*
+ * make bench でのみ有効: malloc系をラップして確保回数を数える
+ * （glibcは内部のmalloc呼び出しも実行ファイル側の定義へ解決する）
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t bench_alloc_count;
+
+void *malloc(size_t size)
+{
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_fetch_add(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+static uint64_t bench_allocs(void)
+{
+    return __atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED);
+}
+#endif
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// hostapd制御インターフェースの代わりに応答するループバックサーバー
+struct bench_ctrl_server
+{
+    int sock;
+    char dir[128];
+    char path[192];
+    pthread_t thread;
+};
+
+static void *bench_ctrl_server_thread(void *arg)
+{
+    struct bench_ctrl_server *srv = arg;
+    char buf[256];
+    struct sockaddr_un from;
+    socklen_t fromlen;
+    ssize_t len;
+
+    for (;;)
+    {
+        fromlen = sizeof(from);
+        len = recvfrom(srv->sock, buf, sizeof(buf) - 1, 0,
+                       (struct sockaddr *)&from, &fromlen);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        buf[len] = '\0';
+
+        if (strcmp(buf, "TERMINATE") == 0)
+        {
+            sendto(srv->sock, "OK\n", 3, 0, (struct sockaddr *)&from, fromlen);
+            break;
+        }
+        // hostapdと同様に送信元アドレスへ応答する
+        sendto(srv->sock, "PONG\n", 5, 0, (struct sockaddr *)&from, fromlen);
+    }
+
+    return NULL;
+}
+
+static int bench_ctrl_server_start(struct bench_ctrl_server *srv)
+{
+    struct sockaddr_un addr;
+
+    snprintf(srv->dir, sizeof(srv->dir), "/tmp/dpp-bench-%d", getpid());
+    if (mkdir(srv->dir, 0700) < 0 && errno != EEXIST)
+    {
+        dpp_printf("Error: Failed to create %s: %s\n", srv->dir, strerror(errno));
+        return -1;
+    }
+    snprintf(srv->path, sizeof(srv->path), "%s/%s", srv->dir, BENCH_CTRL_IFNAME);
+    unlink(srv->path);
+
+    srv->sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (srv->sock < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, srv->path, sizeof(addr.sun_path) - 1);
+    if (bind(srv->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        dpp_printf("Error: Failed to bind %s: %s\n", srv->path, strerror(errno));
+        close(srv->sock);
+        return -1;
+    }
+
+    if (pthread_create(&srv->thread, NULL, bench_ctrl_server_thread, srv) != 0)
+    {
+        close(srv->sock);
+        unlink(srv->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void bench_ctrl_server_stop(struct bench_ctrl_server *srv)
+{
+    struct hostapd_ctrl *ctrl;
+    char response[64];
+
+    ctrl = hostapd_ctrl_get(BENCH_CTRL_IFNAME);
+    if (ctrl)
+        hostapd_ctrl_request(ctrl, "TERMINATE", response, sizeof(response));
+    pthread_join(srv->thread, NULL);
+    close(srv->sock);
+    unlink(srv->path);
+    rmdir(srv->dir);
+}
+
+// 従来実装: コマンドごとにソケット作成・/tmpへのbind・close・unlinkを行う
+static int bench_ctrl_oneshot(const char *socket_path, const char *cmd,
+                              char *response, size_t response_size)
+{
+    int sock;
+    struct sockaddr_un local_addr, dest_addr;
+    char local_socket_path[256];
+    struct timeval timeout;
+    fd_set readfds;
+    ssize_t bytes_received;
+
+    if (access(socket_path, F_OK) != 0)
+        return -1;
+
+    sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return -1;
+
+    snprintf(local_socket_path, sizeof(local_socket_path), "/tmp/hostapd_cli_%d", getpid());
+    unlink(local_socket_path);
+
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sun_family = AF_UNIX;
+    strncpy(local_addr.sun_path, local_socket_path, sizeof(local_addr.sun_path) - 1);
+    if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
+        goto fail;
+
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sun_family = AF_UNIX;
+    strncpy(dest_addr.sun_path, socket_path, sizeof(dest_addr.sun_path) - 1);
+    if (sendto(sock, cmd, strlen(cmd), 0,
+               (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0)
+        goto fail;
+
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    FD_ZERO(&readfds);
+    FD_SET(sock, &readfds);
+    if (select(sock + 1, &readfds, NULL, NULL, &timeout) <= 0)
+        goto fail;
+
+    bytes_received = recv(sock, response, response_size - 1, 0);
+    if (bytes_received < 0)
+        goto fail;
+    response[bytes_received] = '\0';
+
+    close(sock);
+    unlink(local_socket_path);
+    return 0;
+
+fail:
+    close(sock);
+    unlink(local_socket_path);
+    return -1;
+}
+
+static void bench_ctrl_engine_done(void *arg, int id, int ret, const char *reply)
+{
+    int *failed = arg;
+
+    (void)id;
+    (void)reply;
+    if (ret < 0)
+        (*failed)++;
+}
+
+// 制御ソケット1コマンドあたりのレイテンシ（従来実装 vs 永続接続 vs 一括送受信）
+static int bench_ctrl(const char *interface, int iterations)
+{
+    struct bench_ctrl_server srv;
+    struct hostapd_ctrl *ctrl;
+    char socket_path[256];
+    char response[BENCH_RESPONSE_SIZE];
+    struct dpp_ctrl_engine *engine;
+    uint64_t start, oneshot_ns, persistent_ns, engine_ns = 0;
+    bool loopback = !interface;
+    int failed = 0;
+    int i;
+
+    if (loopback)
+    {
+        // hostapdが無くても計測できるようにループバックサーバーを起動
+        if (bench_ctrl_server_start(&srv) < 0)
+            return -1;
+        hostapd_ctrl_set_dir(srv.dir);
+        interface = BENCH_CTRL_IFNAME;
+        snprintf(socket_path, sizeof(socket_path), "%s", srv.path);
+    }
+    else
+    {
+        snprintf(socket_path, sizeof(socket_path), "/var/run/hostapd/%s", interface);
+    }
+
+    dpp_printf("Control socket benchmark: %s, %d iterations of PING\n",
+               socket_path, iterations);
+
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        if (bench_ctrl_oneshot(socket_path, "PING", response, sizeof(response)) < 0)
+        {
+            dpp_printf("Error: one-shot request %d failed\n", i);
+            break;
+        }
+    }
+    oneshot_ns = bench_now_ns() - start;
+
+    ctrl = hostapd_ctrl_get(interface);
+    start = bench_now_ns();
+    for (i = 0; ctrl && i < iterations; i++)
+    {
+        if (hostapd_ctrl_request(ctrl, "PING", response, sizeof(response)) < 0)
+        {
+            dpp_printf("Error: persistent request %d failed\n", i);
+            break;
+        }
+    }
+    persistent_ns = bench_now_ns() - start;
+
+    // 要求をまとめて積み、ウィンドウ分ずつ送受信する
+    engine = dpp_ctrl_engine_new(0);
+    if (engine)
+    {
+        start = bench_now_ns();
+        for (i = 0; i < iterations; i++)
+        {
+            if (dpp_ctrl_engine_submit(engine, interface, "PING", bench_ctrl_engine_done,
+                                       &failed, i) < 0)
+            {
+                dpp_printf("Error: batched request %d failed\n", i);
+                break;
+            }
+        }
+        dpp_ctrl_engine_run(engine);
+        engine_ns = bench_now_ns() - start;
+        if (failed)
+            dpp_printf("Error: %d batched requests failed\n", failed);
+    }
+
+    dpp_printf("  %-28s %10.0f ns/op\n", "one-shot socket (before)",
+               (double)oneshot_ns / iterations);
+    dpp_printf("  %-28s %10.0f ns/op\n", "persistent connection (after)",
+               (double)persistent_ns / iterations);
+    if (engine)
+    {
+        dpp_printf("  %-28s %10.0f ns/op (%s, window %d)\n", "batched engine",
+                   (double)engine_ns / iterations, dpp_ctrl_engine_backend(engine),
+                   DPP_CTRL_ENGINE_WINDOW);
+        dpp_ctrl_engine_free(engine);
+    }
+    if (persistent_ns > 0)
+    {
+        dpp_printf("  %-28s %10.2fx\n", "speedup",
+                   (double)oneshot_ns / (double)persistent_ns);
+    }
+
+    if (loopback)
+    {
+        bench_ctrl_server_stop(&srv);
+        hostapd_ctrl_close_all();
+        hostapd_ctrl_set_dir(NULL);
+    }
+
+    return 0;
+}
+
+static void bench_state_uri(char *buf, size_t buflen, int id)
+{
+    snprintf(buf, buflen,
+             "DPP:V:2;M:02%010x;K:MDkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDIgAD%08x"
+             "rHqMgT1c5YxDsoJtm2S4rnZ6ENdrMqOw;;",
+             id, id);
+}
+
+// 旧実装（JSONファイルを先頭からfgetsで走査）の検索
+static char *bench_state_legacy_lookup(const char *path, int id)
+{
+    FILE *fp;
+    char buffer[4096];
+    char pattern[64];
+    char *uri = NULL;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return NULL;
+
+    snprintf(pattern, sizeof(pattern), "\"bootstrap_%d\"", id);
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        if (!strstr(buffer, pattern))
+            continue;
+        if (fgets(buffer, sizeof(buffer), fp))
+        {
+            char *start = strstr(buffer, ": \"");
+            char *end;
+            if (start && (end = strchr(start + 3, '"')))
+            {
+                *end = '\0';
+                uri = strdup(start + 3);
+            }
+        }
+        break;
+    }
+
+    fclose(fp);
+    return uri;
+}
+
+static void bench_state_report(const char *name, uint64_t ns, int ops)
+{
+    dpp_printf("  %-32s %12.0f ns/op\n", name, (double)ns / ops);
+}
+
+// Bootstrapテーブルの検索（旧JSON走査 vs ログ+インデックス vs スナップショット）
+static int bench_state(int entries, int iterations)
+{
+    struct dpp_bootstrap_record *records = NULL;
+    char dir[128], legacy_path[192], log_path[192], snap_path[200];
+    char uri[160];
+    char *uris = NULL;
+    size_t uri_stride = sizeof(uri);
+    uint64_t start, elapsed;
+    unsigned int seed = 1;
+    FILE *fp;
+    int legacy_lookups = iterations < BENCH_STATE_LEGACY_LOOKUPS ? iterations : BENCH_STATE_LEGACY_LOOKUPS;
+    int found = 0;
+    int ret = -1;
+    int i;
+
+    snprintf(dir, sizeof(dir), "/tmp/dpp-bench-%d", getpid());
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+    {
+        dpp_printf("Error: Failed to create %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    snprintf(legacy_path, sizeof(legacy_path), "%s/state.json", dir);
+    snprintf(log_path, sizeof(log_path), "%s/state.log", dir);
+    snprintf(snap_path, sizeof(snap_path), "%s.snap", log_path);
+
+    dpp_printf("State lookup benchmark: %d bootstrap entries, %d lookups\n", entries, iterations);
+
+    // 旧形式のJSONファイル
+    fp = fopen(legacy_path, "w");
+    if (!fp)
+        goto cleanup;
+    fprintf(fp, "{\n");
+    for (i = 1; i <= entries; i++)
+    {
+        bench_state_uri(uri, sizeof(uri), i);
+        fprintf(fp, "  \"bootstrap_%d\": {\n    \"uri\": \"%s\"\n  },\n", i, uri);
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+
+    start = bench_now_ns();
+    for (i = 0; i < legacy_lookups; i++)
+    {
+        char *value = bench_state_legacy_lookup(legacy_path, 1 + rand_r(&seed) % entries);
+        found += value != NULL;
+        free(value);
+    }
+    bench_state_report("legacy JSON scan (before)", bench_now_ns() - start, legacy_lookups);
+
+    // 追記ログ（ベンチマーク用のファイルに切り替える）
+    records = malloc(entries * sizeof(*records));
+    uris = malloc((size_t)entries * uri_stride);
+    if (!records || !uris)
+        goto cleanup;
+    for (i = 0; i < entries; i++)
+    {
+        char *p = uris + (size_t)i * uri_stride;
+        bench_state_uri(p, uri_stride, i + 1);
+        records[i].id = i + 1;
+        records[i].uri = p;
+        records[i].uri_len = strlen(p);
+        records[i].pubkey_hash = NULL;
+    }
+    dpp_state_set_file(log_path);
+    if (save_bootstrap_batch(records, entries) < 0)
+        goto restore;
+    dpp_state_close();
+
+    start = bench_now_ns();
+    load_bootstrap_max_id(); // オープンとインデックス構築
+    elapsed = bench_now_ns() - start;
+    dpp_printf("  %-32s %12.3f ms\n", "open: index whole log", elapsed / 1e6);
+
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        char *value = dpp_state_get(DPP_STATE_BOOTSTRAP, 1 + rand_r(&seed) % entries);
+        found += value != NULL;
+        free(value);
+    }
+    bench_state_report("log index + copy", bench_now_ns() - start, iterations);
+
+    // dpp_state_ref() のポインタは dpp_state_lock() 中だけ有効
+    if (dpp_state_lock() < 0)
+        goto restore;
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+        found += dpp_state_ref(DPP_STATE_BOOTSTRAP, 1 + rand_r(&seed) % entries) != NULL;
+    bench_state_report("log index, zero-copy", bench_now_ns() - start, iterations);
+    dpp_state_unlock();
+
+    // スナップショット
+    start = bench_now_ns();
+    if (dpp_state_compact() < 0)
+        goto restore;
+    elapsed = bench_now_ns() - start;
+    dpp_printf("  %-32s %12.3f ms\n", "compact", elapsed / 1e6);
+    dpp_state_close();
+
+    start = bench_now_ns();
+    load_bootstrap_max_id();
+    elapsed = bench_now_ns() - start;
+    dpp_printf("  %-32s %12.3f ms\n", "open: map snapshot", elapsed / 1e6);
+
+    if (dpp_state_lock() < 0)
+        goto restore;
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++)
+        found += dpp_state_ref(DPP_STATE_BOOTSTRAP, 1 + rand_r(&seed) % entries) != NULL;
+    bench_state_report("snapshot, zero-copy (after)", bench_now_ns() - start, iterations);
+    dpp_state_unlock();
+
+    if (found != legacy_lookups + 3 * iterations)
+        dpp_printf("Warning: %d of %d lookups failed\n", legacy_lookups + 3 * iterations - found,
+                   legacy_lookups + 3 * iterations);
+    ret = 0;
+
+restore:
+    dpp_state_set_file(NULL);
+cleanup:
+    free(records);
+    free(uris);
+    unlink(legacy_path);
+    unlink(log_path);
+    unlink(snap_path);
+    rmdir(dir);
+    return ret;
+}
+
+// 計測対象: n回実行する
+typedef void (*bench_fn)(void *arg, uint64_t n);
+
+struct bench_result
+{
+    char name[48];
+    uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op; // 計測できないビルドでは負数
+    size_t bytes;         // 1回あたりの入力バイト数（スループットを出さない項目は0）
+    int threads;          // ops/sを出す項目の実行スレッド数（出さない項目は0）
+};
+
+// 計測時間が BENCH_MIN_TIME_NS に達するまで回数を増やして実行する
+static void bench_run(const char *name, bench_fn fn, void *arg, struct bench_result *result)
+{
+    uint64_t n = 1;
+    uint64_t elapsed;
+    uint64_t allocs = 0;
+
+    for (;;)
+    {
+#ifdef DPP_BENCH_ALLOC_COUNT
+        allocs = bench_allocs();
+#endif
+        uint64_t start = bench_now_ns();
+        fn(arg, n);
+        elapsed = bench_now_ns() - start;
+#ifdef DPP_BENCH_ALLOC_COUNT
+        allocs = bench_allocs() - allocs;
+#endif
+        if (elapsed >= BENCH_MIN_TIME_NS || n >= (1ULL << 40))
+            break;
+
+        // 前回の結果から必要な回数を見積もる（増やしすぎないよう上限は100倍）
+        uint64_t next = elapsed ? n * BENCH_MIN_TIME_NS / elapsed * 6 / 5 : n * 100;
+        if (next > n * 100)
+            next = n * 100;
+        n = next > n ? next : n + 1;
+    }
+
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->bytes = 0;
+    result->threads = 0;
+    result->iterations = n;
+    result->ns_per_op = (double)elapsed / n;
+#ifdef DPP_BENCH_ALLOC_COUNT
+    result->allocs_per_op = (double)allocs / n;
+#else
+    (void)allocs;
+    result->allocs_per_op = -1;
+#endif
+}
+
+static volatile uintptr_t bench_sink; // 最適化で呼び出しが消えないようにする
+
+#define BENCH_ARGS "peer=1 configurator=1 conf=sta-psk interface=wlan0 " \
+                   "ssid=MyNetwork pass=mypassword matter_pin=12345678"
+
+// auth_initと同じキー構成
+static const struct dpp_arg_spec bench_args_schema[] = {
+    {"peer", DPP_ARG_INT, DPP_ARG_REQUIRED, 0},
+    {"configurator", DPP_ARG_INT, DPP_ARG_REQUIRED, 0},
+    {"interface", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"conf", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"ssid", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"pass", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"matter_pin", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF | DPP_ARG_MODE_TEMPLATE},
+    {"conf_json", DPP_ARG_STR, 0, DPP_ARG_MODE_JSON},
+    {"template", DPP_ARG_STR, 0, DPP_ARG_MODE_TEMPLATE},
+    {"discriminator", DPP_ARG_INT, 0, DPP_ARG_MODE_TEMPLATE},
+    {"wait", DPP_ARG_INT, 0, 0},
+    {NULL}};
+
+// コマンド1回分: 引数文字列全体を分解・検査し、全ての値を取り出す
+static void bench_args_parse(void *arg, uint64_t n)
+{
+    static const char src[] = BENCH_ARGS;
+    char args[sizeof(src)];
+    struct dpp_args parsed;
+
+    (void)arg;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        memcpy(args, src, sizeof(src)); // 解析は値の終端を書き込むので毎回戻す
+        if (dpp_args_parse(args, bench_args_schema, &parsed) == 0)
+            bench_sink += (uintptr_t)dpp_arg(&parsed, "matter_pin") +
+                          (uintptr_t)dpp_arg_int(&parsed, "peer", -1);
+    }
+}
+
+static void bench_encode_hex(void *arg, uint64_t n)
+{
+    (void)arg;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        char *hex = encode_hex_string("MyNetwork-5G");
+        bench_sink += (uintptr_t)hex;
+        free(hex);
+    }
+}
+
+static void bench_decode_hex(void *arg, uint64_t n)
+{
+    (void)arg;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        char *str = decode_hex_string("4d794e6574776f726b2d3547");
+        bench_sink += (uintptr_t)str;
+        free(str);
+    }
+}
+
+static void bench_is_hex_string(void *arg, uint64_t n)
+{
+    (void)arg;
+    for (uint64_t i = 0; i < n; i++)
+        bench_sink += is_hex_string("4d794e6574776f726b2d3547");
+}
+
+// シングルBSSのAPのSTATUS応答（抜粋）
+#define BENCH_STATUS_REPLY                                                             \
+    "state=ENABLED\nphy=phy0\nfreq=2437\nnum_sta_non_erp=0\nnum_sta_no_short_slot_time=0\n" \
+    "num_sta_no_short_preamble=0\nolbc=0\nnum_sta_ht_no_gf=0\nnum_sta_no_ht=0\n"          \
+    "num_sta_ht_20_mhz=0\nnum_sta_ht40_intolerant=0\nolbc_ht=0\nht_op_mode=0x0\n"         \
+    "cac_time_seconds=0\ncac_time_left_seconds=N/A\nchannel=6\nsecondary_channel=0\n"     \
+    "ieee80211n=1\nieee80211ac=0\nieee80211ax=0\nbeacon_int=100\ndtim_period=2\n"        \
+    "supported_rates=02 04 0b 16 0c 12 18 24 30 48 60 6c\nmax_txpower=20\n"              \
+    "bss[0]=wlan0\nbssid[0]=02:00:00:00:01:00\nssid[0]=MyNetwork\nnum_sta[0]=0\n"
+
+// STATUS応答を索引化して3項目を引く（索引は値を終端するので毎回元に戻す）
+static void bench_reply_get(void *arg, uint64_t n)
+{
+    struct hostapd_reply *reply = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        memcpy(reply->inline_buf, BENCH_STATUS_REPLY, sizeof(BENCH_STATUS_REPLY));
+        reply->buf = reply->inline_buf;
+        reply->len = sizeof(BENCH_STATUS_REPLY) - 1;
+        reply->field_count = -1;
+        bench_sink += hostapd_reply_get_int(reply, "freq", 0) +
+                      (uintptr_t)hostapd_reply_get(reply, "state") +
+                      (uintptr_t)hostapd_reply_get(reply, "ssid[0]");
+    }
+}
+
+static void bench_is_valid_matter_pin(void *arg, uint64_t n)
+{
+    (void)arg;
+    for (uint64_t i = 0; i < n; i++)
+        bench_sink += is_valid_matter_pin("12345678");
+}
+
+// dpp_uri_parse: 構文・公開鍵の検証と鍵ハッシュの計算（importのワーカーと同じくctxを使い回す）
+static void bench_uri_parse(void *arg, uint64_t n)
+{
+    struct dpp_uri_ctx *uri_ctx = arg;
+    struct dpp_uri uri;
+
+    for (uint64_t i = 0; i < n; i++)
+        bench_sink += dpp_uri_parse(uri_ctx, BENCH_QR_CODE_URI, sizeof(BENCH_QR_CODE_URI) - 1, &uri);
+}
+
+// dpp_add_qr_code: 追加したエントリはその都度削除してdpp_globalを一定に保つ
+static void bench_add_qr_code_uri(struct dpp_global *dpp, const char *uri, uint64_t n)
+{
+    char id[16];
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        struct dpp_bootstrap_info *bi = dpp_add_qr_code(dpp, uri);
+        if (!bi)
+            continue;
+        snprintf(id, sizeof(id), "%u", bi->id);
+        dpp_bootstrap_remove(dpp, id);
+    }
+}
+
+static void bench_add_qr_code(void *arg, uint64_t n)
+{
+    bench_add_qr_code_uri(arg, BENCH_QR_CODE_URI, n);
+}
+
+struct bench_lookup_arg
+{
+    int entries;
+    unsigned int seed;
+};
+
+static void bench_load_bootstrap_uri(void *arg, uint64_t n)
+{
+    struct bench_lookup_arg *lookup = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        char *uri = load_bootstrap_uri(1 + rand_r(&lookup->seed) % lookup->entries);
+        bench_sink += (uintptr_t)uri;
+        free(uri);
+    }
+}
+
+// entries件のBootstrapテーブルを作り、load_bootstrap_uri() を計測する
+static int bench_helpers_lookup(int entries, struct bench_result *result)
+{
+    struct dpp_bootstrap_record *records;
+    struct bench_lookup_arg lookup = {entries, 1};
+    char dir[128], log_path[192], snap_path[200], name[48];
+    char *uris;
+    size_t uri_stride = 160;
+    int ret = -1;
+    int i;
+
+    records = malloc(entries * sizeof(*records));
+    uris = malloc((size_t)entries * uri_stride);
+    if (!records || !uris)
+    {
+        free(records);
+        free(uris);
+        return -1;
+    }
+    for (i = 0; i < entries; i++)
+    {
+        char *p = uris + (size_t)i * uri_stride;
+        bench_state_uri(p, uri_stride, i + 1);
+        records[i].id = i + 1;
+        records[i].uri = p;
+        records[i].uri_len = strlen(p);
+        records[i].pubkey_hash = NULL;
+    }
+
+    snprintf(dir, sizeof(dir), "/tmp/dpp-bench-%d", getpid());
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+    {
+        dpp_printf("Error: Failed to create %s: %s\n", dir, strerror(errno));
+        goto cleanup;
+    }
+    snprintf(log_path, sizeof(log_path), "%s/state.log", dir);
+    snprintf(snap_path, sizeof(snap_path), "%s.snap", log_path);
+
+    // 通常運用と同じく、スナップショット済みのテーブルを引く
+    dpp_state_set_file(log_path);
+    if (save_bootstrap_batch(records, entries) == 0 && dpp_state_compact() == 0)
+    {
+        snprintf(name, sizeof(name), "load_bootstrap_uri/%d", entries);
+        bench_run(name, bench_load_bootstrap_uri, &lookup, result);
+        ret = 0;
+    }
+    dpp_state_set_file(NULL);
+
+    unlink(log_path);
+    unlink(snap_path);
+    rmdir(dir);
+cleanup:
+    free(records);
+    free(uris);
+    return ret;
+}
+
+// ns/op から MB/s を求める
+static double bench_mb_per_s(const struct bench_result *result)
+{
+    return result->ns_per_op > 0 ? result->bytes * 1e3 / result->ns_per_op : 0;
+}
+
+// ns/op から ops/s を求める（並列実行の項目は全スレッド合計）
+static double bench_ops_per_s(const struct bench_result *result)
+{
+    return result->ns_per_op > 0 ? 1e9 / result->ns_per_op : 0;
+}
+
+static int bench_results_write(FILE *fp, const char *suite, const char *title,
+                               const struct bench_result *results, int count, bool json)
+{
+    int i;
+
+    if (json)
+    {
+        fprintf(fp, "{\n  \"suite\": \"%s\",\n  \"revision\": \"%s\",\n"
+                    "  \"results\": [\n",
+                suite, DPP_BENCH_REVISION);
+        for (i = 0; i < count; i++)
+        {
+            fprintf(fp, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, ",
+                    results[i].name, (unsigned long long)results[i].iterations,
+                    results[i].ns_per_op);
+            if (results[i].bytes)
+                fprintf(fp, "\"bytes\": %zu, \"mb_per_s\": %.1f, ", results[i].bytes,
+                        bench_mb_per_s(&results[i]));
+            if (results[i].threads)
+                fprintf(fp, "\"threads\": %d, \"ops_per_s\": %.1f, ", results[i].threads,
+                        bench_ops_per_s(&results[i]));
+            if (results[i].allocs_per_op < 0)
+                fprintf(fp, "\"allocs_per_op\": null}");
+            else
+                fprintf(fp, "\"allocs_per_op\": %.2f}", results[i].allocs_per_op);
+            fprintf(fp, "%s\n", i + 1 < count ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+    }
+    else
+    {
+        fprintf(fp, "%s (revision %s)\n", title, DPP_BENCH_REVISION);
+        for (i = 0; i < count; i++)
+        {
+            fprintf(fp, "  %-40s %12llu %12.1f ns/op", results[i].name,
+                    (unsigned long long)results[i].iterations, results[i].ns_per_op);
+            if (results[i].bytes)
+                fprintf(fp, " %10.1f MB/s", bench_mb_per_s(&results[i]));
+            if (results[i].threads)
+                fprintf(fp, " %10.1f ops/s (%d threads)", bench_ops_per_s(&results[i]),
+                        results[i].threads);
+            if (results[i].allocs_per_op >= 0)
+                fprintf(fp, " %8.2f allocs/op", results[i].allocs_per_op);
+            fprintf(fp, "\n");
+        }
+    }
+
+    return ferror(fp) ? -1 : 0;
+}
+
+// 結果を標準出力か out のファイルへ書き出す
+static int bench_results_output(const char *suite, const char *title,
+                                const struct bench_result *results, int count, bool json,
+                                const char *out)
+{
+    FILE *fp;
+    int ret = 0;
+
+    if (!out)
+        return bench_results_write(dpp_output(), suite, title, results, count, json);
+
+    fp = fopen(out, "w");
+    if (!fp)
+    {
+        dpp_printf("Error: Cannot open %s: %s\n", out, strerror(errno));
+        return -1;
+    }
+    if (bench_results_write(fp, suite, title, results, count, json) < 0)
+        ret = -1;
+    if (fclose(fp) != 0)
+        ret = -1;
+    if (ret == 0)
+        dpp_printf("Benchmark results written to %s\n", out);
+    return ret;
+}
+
+// デバイスごとに呼ばれるヘルパー関数の ns/op と allocs/op
+static int bench_helpers(struct dpp_configurator_ctx *ctx, const char *sizes,
+                         bool json, const char *out)
+{
+    struct bench_result results[BENCH_MAX_RESULTS];
+    struct dpp_uri_ctx *uri_ctx;
+    struct hostapd_reply *reply;
+    char *list, *token, *saveptr = NULL;
+    int count = 0;
+    int ret = 0;
+
+    bench_run("dpp_args_parse", bench_args_parse, NULL, &results[count++]);
+    bench_run("encode_hex_string", bench_encode_hex, NULL, &results[count++]);
+    bench_run("decode_hex_string", bench_decode_hex, NULL, &results[count++]);
+    bench_run("is_hex_string", bench_is_hex_string, NULL, &results[count++]);
+    bench_run("is_valid_matter_pin", bench_is_valid_matter_pin, NULL, &results[count++]);
+    reply = malloc(sizeof(*reply));
+    if (reply)
+    {
+        hostapd_reply_init(reply);
+        bench_run("hostapd_reply_get", bench_reply_get, reply, &results[count++]);
+        free(reply);
+    }
+    uri_ctx = dpp_uri_ctx_new();
+    if (uri_ctx)
+        bench_run("dpp_uri_parse", bench_uri_parse, uri_ctx, &results[count++]);
+    dpp_uri_ctx_free(uri_ctx);
+    if (ctx->dpp_global)
+        bench_run("dpp_add_qr_code", bench_add_qr_code, ctx->dpp_global, &results[count++]);
+
+    list = strdup(sizes ? sizes : "10,10000,1000000");
+    if (!list)
+        return -1;
+    for (token = strtok_r(list, ",", &saveptr); token && count < BENCH_MAX_RESULTS;
+         token = strtok_r(NULL, ",", &saveptr))
+    {
+        int entries = atoi(token);
+        if (entries <= 0)
+        {
+            dpp_printf("Error: Invalid table size: %s\n", token);
+            ret = -1;
+            continue;
+        }
+        if (bench_helpers_lookup(entries, &results[count]) == 0)
+            count++;
+        else
+            ret = -1;
+    }
+    free(list);
+
+    if (bench_results_output("helpers", "Helper benchmark", results, count, json, out) < 0)
+        ret = -1;
+    return ret;
+}
+
+/*
+ * コーデックの各実装のスループット
+ * 32バイト（SSIDの最大長）、91バイト（P-256のDER公開鍵）と4 KiBの入力で計測する
+ */
+#define BENCH_CODEC_MAX 4096
+
+struct bench_codec_data
+{
+    size_t len; // 元データのバイト数
+    size_t hex_len;
+    size_t b64_len;
+    u8 raw[BENCH_CODEC_MAX];
+    char hex[2 * BENCH_CODEC_MAX + 1];
+    char b64[(BENCH_CODEC_MAX + 2) / 3 * 4 + 1];
+    u8 out[BENCH_CODEC_MAX + 3];
+};
+
+static void bench_codec_fill(struct bench_codec_data *data, size_t len)
+{
+    static const char b64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t seed = 0x12345678;
+    size_t i, n = 0;
+
+    data->len = len;
+    for (i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        data->raw[i] = seed >> 16;
+    }
+    data->hex_len = dpp_hex_encode(data->raw, len, data->hex);
+
+    for (i = 0; i < len; i += 3)
+    {
+        uint32_t word = (uint32_t)data->raw[i] << 16;
+        if (i + 1 < len)
+            word |= (uint32_t)data->raw[i + 1] << 8;
+        if (i + 2 < len)
+            word |= data->raw[i + 2];
+        data->b64[n++] = b64[word >> 18 & 0x3f];
+        data->b64[n++] = b64[word >> 12 & 0x3f];
+        data->b64[n++] = i + 1 < len ? b64[word >> 6 & 0x3f] : '=';
+        data->b64[n++] = i + 2 < len ? b64[word & 0x3f] : '=';
+    }
+    data->b64[n] = '\0';
+    data->b64_len = n;
+}
+
+static void bench_codec_hex_encode(void *arg, uint64_t n)
+{
+    struct bench_codec_data *data = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+        bench_sink += dpp_hex_encode(data->raw, data->len, data->hex);
+}
+
+static void bench_codec_hex_decode(void *arg, uint64_t n)
+{
+    struct bench_codec_data *data = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+        bench_sink += dpp_hex_decode(data->hex, data->hex_len, data->out);
+}
+
+static void bench_codec_hex_valid(void *arg, uint64_t n)
+{
+    struct bench_codec_data *data = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+        bench_sink += dpp_hex_valid(data->hex, data->hex_len);
+}
+
+static void bench_codec_base64_decode(void *arg, uint64_t n)
+{
+    struct bench_codec_data *data = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+        bench_sink += dpp_base64_decode(data->b64, data->b64_len, data->out, sizeof(data->out));
+}
+
+static int bench_codec(bool json, const char *out)
+{
+    static const char *const impls[] = {"scalar", "sse2", "avx2"};
+    static const size_t sizes[] = {32, 91, BENCH_CODEC_MAX};
+    struct bench_result results[BENCH_MAX_RESULTS];
+    struct bench_codec_data *data;
+    char name[48];
+    int count = 0;
+
+    data = malloc(sizeof(*data));
+    if (!data)
+        return -1;
+
+    dpp_printf("Codec implementation: %s\n", dpp_codec_impl());
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        bench_codec_fill(data, sizes[s]);
+        for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+        {
+            if (dpp_codec_select(impls[i]) < 0 || count + 4 > BENCH_MAX_RESULTS)
+                continue;
+
+            // スループットは入力のバイト数で計算する
+            snprintf(name, sizeof(name), "hex_encode/%s/%zu", impls[i], data->len);
+            bench_run(name, bench_codec_hex_encode, data, &results[count]);
+            results[count++].bytes = data->len;
+            snprintf(name, sizeof(name), "hex_decode/%s/%zu", impls[i], data->len);
+            bench_run(name, bench_codec_hex_decode, data, &results[count]);
+            results[count++].bytes = data->hex_len;
+            snprintf(name, sizeof(name), "hex_valid/%s/%zu", impls[i], data->len);
+            bench_run(name, bench_codec_hex_valid, data, &results[count]);
+            results[count++].bytes = data->hex_len;
+            snprintf(name, sizeof(name), "base64_decode/%s/%zu", impls[i], data->len);
+            bench_run(name, bench_codec_base64_decode, data, &results[count]);
+            results[count++].bytes = data->b64_len;
+        }
+    }
+    dpp_codec_select(NULL);
+    free(data);
+
+    return bench_results_output("codec", "Codec benchmark", results, count, json, out);
+}
+
+/*
+ * DPP曲線ごとの暗号処理のコスト
+ * Configurator鍵生成、ブートストラップ鍵の復号（dpp_add_qr_code）、
+ * 認証のECDH/KDFとConnector署名を、1スレッドと複数スレッドで計測する
+ */
+#define BENCH_CRYPTO_MAX_THREADS 256
+#define BENCH_CRYPTO_BATCH_NS 10000000ULL // 並列実行で締め切りを確認する間隔の目安
+#define BENCH_CRYPTO_CURVES \
+    "prime256v1,secp384r1,secp521r1,brainpoolP256r1,brainpoolP384r1,brainpoolP512r1"
+
+
+// スレッドごとの状態（dpp_globalはスレッド間で共有しない）
+struct bench_crypto_state
+{
+    const struct dpp_curve_params *curve;
+    struct dpp_global *dpp;
+    struct dpp_configurator *conf;
+    struct crypto_ec_key *peer_bootstrap_key; // B_R（dppが所有する）
+    struct crypto_ec_key *peer_protocol_key;  // P_R
+    struct wpabuf *connector;                 // 署名するConnectorの本体
+    char conf_cmd[48];
+    char *uri;
+};
+
+struct bench_crypto_op
+{
+    const char *name;
+    bench_fn fn;
+};
+
+// configurator_add と同じ処理: 署名鍵の生成とkidの計算
+static void bench_crypto_configurator_keygen(void *arg, uint64_t n)
+{
+    struct bench_crypto_state *state = arg;
+    char id[16];
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        int ret = dpp_configurator_add(state->dpp, state->conf_cmd);
+        if (ret < 0)
+            continue;
+        snprintf(id, sizeof(id), "%d", ret);
+        dpp_configurator_remove(state->dpp, id);
+    }
+}
+
+static void bench_crypto_add_qr_code(void *arg, uint64_t n)
+{
+    struct bench_crypto_state *state = arg;
+
+    bench_add_qr_code_uri(state->dpp, state->uri, n);
+}
+
+// Auth Requestごとに作るプロトコル鍵 P_I
+static void bench_crypto_protocol_keygen(void *arg, uint64_t n)
+{
+    struct bench_crypto_state *state = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        struct crypto_ec_key *key = dpp_gen_keypair(state->curve);
+        bench_sink += (uintptr_t)key;
+        crypto_ec_key_deinit(key);
+    }
+}
+
+// 認証1回分のInitiator側の鍵計算: P_Iの生成、M = P_I * B_R → k1、N = P_I * P_R → k2
+static void bench_crypto_auth_ecdh_kdf(void *arg, uint64_t n)
+{
+    struct bench_crypto_state *state = arg;
+    unsigned int hash_len = state->curve->hash_len;
+    u8 secret[DPP_MAX_SHARED_SECRET_LEN], k1[DPP_MAX_HASH_LEN], k2[DPP_MAX_HASH_LEN];
+    size_t secret_len;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        struct crypto_ec_key *key = dpp_gen_keypair(state->curve);
+        if (!key)
+            continue;
+        if (dpp_ecdh(key, state->peer_bootstrap_key, secret, &secret_len) == 0)
+            dpp_derive_k1(secret, secret_len, k1, hash_len);
+        if (dpp_ecdh(key, state->peer_protocol_key, secret, &secret_len) == 0)
+            dpp_derive_k2(secret, secret_len, k2, hash_len);
+        bench_sink += k1[0] + k2[0];
+        crypto_ec_key_deinit(key);
+    }
+}
+
+static void bench_crypto_sign_connector(void *arg, uint64_t n)
+{
+    struct bench_crypto_state *state = arg;
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        char *signed_connector = dpp_sign_connector(state->conf, state->connector);
+        bench_sink += (uintptr_t)signed_connector;
+        os_free(signed_connector);
+    }
+}
+
+static const struct bench_crypto_op bench_crypto_ops[] = {
+    {"configurator_keygen", bench_crypto_configurator_keygen},
+    {"add_qr_code", bench_crypto_add_qr_code},
+    {"protocol_keygen", bench_crypto_protocol_keygen},
+    {"auth_ecdh_kdf", bench_crypto_auth_ecdh_kdf},
+    {"sign_connector", bench_crypto_sign_connector},
+    {NULL, NULL}};
+
+static void bench_crypto_state_free(struct bench_crypto_state *state)
+{
+    crypto_ec_key_deinit(state->peer_protocol_key);
+    wpabuf_free(state->connector);
+    free(state->uri);
+    if (state->dpp)
+        dpp_global_deinit(state->dpp);
+    memset(state, 0, sizeof(*state));
+}
+
+// 相手のブートストラップ鍵とプロトコル鍵、署名用のConfiguratorを用意する
+static int bench_crypto_state_init(struct bench_crypto_state *state,
+                                   const struct dpp_curve_params *curve)
+{
+    struct dpp_global_config config;
+    struct dpp_bootstrap_info *bi;
+    char cmd[64], coord[96], payload[512];
+    int id, len, coord_len;
+
+    memset(state, 0, sizeof(*state));
+    memset(&config, 0, sizeof(config));
+    state->curve = curve;
+    snprintf(state->conf_cmd, sizeof(state->conf_cmd), "curve=%s", curve->name);
+    state->dpp = dpp_global_init(&config);
+    if (!state->dpp)
+        return -1;
+
+    id = dpp_configurator_add(state->dpp, state->conf_cmd);
+    state->conf = id > 0 ? dpp_configurator_get_id(state->dpp, id) : NULL;
+    snprintf(cmd, sizeof(cmd), "type=qrcode curve=%s", curve->name);
+    id = dpp_bootstrap_gen(state->dpp, cmd);
+    bi = id > 0 ? dpp_bootstrap_get_id(state->dpp, id) : NULL;
+    if (!state->conf || !bi || !bi->uri)
+        goto fail;
+    state->peer_bootstrap_key = bi->pubkey;
+    state->uri = strdup(bi->uri);
+    state->peer_protocol_key = dpp_gen_keypair(curve);
+    if (!state->uri || !state->peer_protocol_key)
+        goto fail;
+
+    // netAccessKeyの座標は内容を問わないので、実際のConnectorと同じ長さのダミーにする
+    coord_len = (curve->prime_len * 4 + 2) / 3; // base64url
+    memset(coord, 'A', coord_len);
+    len = snprintf(payload, sizeof(payload),
+                   "{\"groups\":[{\"groupId\":\"*\",\"netRole\":\"sta\"}],"
+                   "\"netAccessKey\":{\"kty\":\"EC\",\"crv\":\"%s\",\"x\":\"%.*s\",\"y\":\"%.*s\"}}",
+                   curve->jwk_crv, coord_len, coord, coord_len, coord);
+    state->connector = wpabuf_alloc_copy(payload, len);
+    if (!state->connector)
+        goto fail;
+    return 0;
+
+fail:
+    bench_crypto_state_free(state);
+    return -1;
+}
+
+// 全スレッドの起動を待ってから同時に計測を始める
+struct bench_crypto_start
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool started;
+    uint64_t time;
+};
+
+struct bench_crypto_thread
+{
+    pthread_t thread;
+    struct bench_crypto_start *start;
+    struct bench_crypto_state *state;
+    bench_fn fn;
+    uint64_t batch;
+    uint64_t ops;
+    uint64_t end;
+};
+
+static void *bench_crypto_thread_main(void *arg)
+{
+    struct bench_crypto_thread *thread = arg;
+    struct bench_crypto_start *start = thread->start;
+    uint64_t now;
+
+    pthread_mutex_lock(&start->lock);
+    while (!start->started)
+        pthread_cond_wait(&start->cond, &start->lock);
+    pthread_mutex_unlock(&start->lock);
+
+    do
+    {
+        thread->fn(thread->state, thread->batch);
+        thread->ops += thread->batch;
+        now = bench_now_ns();
+    } while (now - start->time < BENCH_MIN_TIME_NS);
+    thread->end = now;
+    return NULL;
+}
+
+/*
+ * threads本のスレッドで同じ処理を同時に実行し、全体の ops/s を求める
+ * 各スレッドは締め切りまで batch 回ずつ実行し、最後に終わったスレッドまでを経過時間とする
+ */
+static int bench_crypto_parallel(const char *name, bench_fn fn, struct bench_crypto_state *states,
+                                 int threads, double ns_per_op, struct bench_result *result)
+{
+    struct bench_crypto_start start = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, 0};
+    struct bench_crypto_thread *workers;
+    uint64_t batch = ns_per_op > 0 ? (uint64_t)(BENCH_CRYPTO_BATCH_NS / ns_per_op) : 1;
+    uint64_t ops = 0, end = 0;
+    int started;
+    int err = 0;
+
+    workers = calloc(threads, sizeof(*workers));
+    if (!workers)
+        return -1;
+    for (started = 0; started < threads; started++)
+    {
+        workers[started].start = &start;
+        workers[started].state = &states[started];
+        workers[started].fn = fn;
+        workers[started].batch = batch ? batch : 1;
+        err = pthread_create(&workers[started].thread, NULL, bench_crypto_thread_main,
+                             &workers[started]);
+        if (err != 0)
+            break;
+    }
+
+    pthread_mutex_lock(&start.lock);
+    start.time = bench_now_ns();
+    start.started = true;
+    pthread_cond_broadcast(&start.cond);
+    pthread_mutex_unlock(&start.lock);
+
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        ops += workers[i].ops;
+        if (workers[i].end > end)
+            end = workers[i].end;
+    }
+    free(workers);
+    if (started < threads)
+    {
+        dpp_printf("Error: Cannot start benchmark thread: %s\n", strerror(err));
+        return -1;
+    }
+
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->iterations = ops;
+    result->ns_per_op = (double)(end - start.time) / ops;
+    result->allocs_per_op = -1;
+    result->bytes = 0;
+    result->threads = threads;
+    return 0;
+}
+
+// 1曲線分: 各処理を1スレッドとthreadsスレッドで計測する
+static int bench_crypto_curve(const struct dpp_curve_params *curve, int threads,
+                              struct bench_result *results, int *count)
+{
+    struct bench_crypto_state *states;
+    char name[48];
+    int initialized = 0;
+    int ret = 0;
+
+    states = calloc(threads, sizeof(*states));
+    if (!states)
+        return -1;
+    for (; initialized < threads; initialized++)
+    {
+        if (bench_crypto_state_init(&states[initialized], curve) < 0)
+            break;
+    }
+    if (initialized < threads)
+    {
+        dpp_printf("Error: Cannot set up curve %s\n", curve->name);
+        ret = -1;
+        goto out;
+    }
+
+    for (const struct bench_crypto_op *op = bench_crypto_ops; op->name; op++)
+    {
+        struct bench_result *single = &results[*count];
+
+        if (*count + (threads > 1 ? 2 : 1) > BENCH_MAX_RESULTS)
+            break;
+        snprintf(name, sizeof(name), "%s/%s", op->name, curve->name);
+        bench_run(name, op->fn, &states[0], single);
+        single->threads = 1;
+        (*count)++;
+        if (threads > 1)
+        {
+            snprintf(name, sizeof(name), "%s/%s/x%d", op->name, curve->name, threads);
+            if (bench_crypto_parallel(name, op->fn, states, threads, single->ns_per_op,
+                                      &results[*count]) == 0)
+                (*count)++;
+            else
+                ret = -1;
+        }
+    }
+
+out:
+    for (int i = 0; i < initialized; i++)
+        bench_crypto_state_free(&states[i]);
+    free(states);
+    return ret;
+}
+
+// 曲線ごとの ops/s の一覧（threadsスレッドの値と、1スレッドの threads 倍に対する割合）
+static void bench_crypto_summary(const struct bench_result *results, int count, int threads)
+{
+    const char *curve = NULL;
+    int i;
+
+    dpp_printf("\n%-16s %-20s %12s", "Curve", "Operation", "1 thread");
+    if (threads > 1)
+        dpp_printf(" %10d threads %8s", threads, "scaling");
+    dpp_printf("\n");
+    for (i = 0; i < count; i++)
+    {
+        const char *slash = strchr(results[i].name, '/');
+        const char *cname = slash ? slash + 1 : "";
+        int op_len = slash ? (int)(slash - results[i].name) : 0;
+
+        if (results[i].threads != 1)
+            continue;
+        dpp_printf("%-16s %-20.*s %12.1f", curve && strcmp(curve, cname) == 0 ? "" : cname, op_len,
+                   results[i].name, bench_ops_per_s(&results[i]));
+        curve = cname;
+        if (i + 1 < count && results[i + 1].threads > 1)
+            dpp_printf(" %18.1f %7.0f%%", bench_ops_per_s(&results[i + 1]),
+                       100.0 * bench_ops_per_s(&results[i + 1]) /
+                           (bench_ops_per_s(&results[i]) * results[i + 1].threads));
+        dpp_printf("\n");
+    }
+}
+
+static int bench_crypto(const char *curves, int threads, bool json, const char *out)
+{
+    struct bench_result results[BENCH_MAX_RESULTS];
+    char *list, *token, *saveptr = NULL;
+    int count = 0;
+    int ret = 0;
+
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > BENCH_CRYPTO_MAX_THREADS)
+        threads = BENCH_CRYPTO_MAX_THREADS;
+
+    list = strdup(curves ? curves : BENCH_CRYPTO_CURVES);
+    if (!list)
+        return -1;
+
+    if (!json)
+        dpp_printf("Crypto library: %s, %d threads\n", OpenSSL_version(OPENSSL_VERSION), threads);
+    for (token = strtok_r(list, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr))
+    {
+        const struct dpp_curve_params *curve = dpp_get_curve_name(token);
+
+        if (!curve)
+        {
+            dpp_printf("Error: Unknown curve: %s\n", token);
+            ret = -1;
+            continue;
+        }
+        if (bench_crypto_curve(curve, threads, results, &count) < 0)
+            ret = -1;
+    }
+    free(list);
+
+    if (bench_results_output("crypto", "Crypto benchmark", results, count, json, out) < 0)
+        ret = -1;
+    if (!json)
+        bench_crypto_summary(results, count, threads);
+    return ret;
+}
+
+/*
+ * sta-dpp用Connectorの作成と署名を、ワーカープールのスレッド数を変えて計測する
+ * 全スレッドが1つのConfigurator（C-sign鍵）で署名する。netAccessKeyは端末ごとに異なる
+ */
+#define BENCH_CONNECTOR_KEYS 64  // netAccessKeyとして順に使う端末の公開鍵
+#define BENCH_CONNECTOR_BATCH 8  // ジョブ1つで署名する数
+#define BENCH_CONNECTOR_JOBS 4   // スレッドあたりの投入済みジョブ数
+
+struct bench_connector_run
+{
+    const struct dpp_curve_params *curve;
+    struct dpp_configurator *conf;
+    struct wpabuf *keys[BENCH_CONNECTOR_KEYS]; // 端末の公開鍵（x || y）
+    struct dpp_worker_pool *pool;
+    uint64_t deadline;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int outstanding; // 未完了のジョブ
+    uint64_t signed_count;
+    uint64_t failed;
+    uint64_t end;
+};
+
+struct bench_connector_job
+{
+    struct dpp_worker_job job; // 先頭に置く
+    struct bench_connector_run *run;
+    unsigned int next_key;
+};
+
+// hostapdが設定オブジェクトに入れるのと同じ形のConnector本体を作って署名する
+static char *bench_connector_sign(struct bench_connector_run *run, const struct wpabuf *key)
+{
+    size_t len = wpabuf_len(key) / 2;
+    char *x = base64_url_encode(wpabuf_head_u8(key), len, NULL);
+    char *y = base64_url_encode(wpabuf_head_u8(key) + len, len, NULL);
+    struct wpabuf *dppcon = NULL;
+    char *connector = NULL;
+
+    if (x && y)
+        dppcon = wpabuf_alloc(128 + strlen(x) + strlen(y));
+    if (dppcon)
+    {
+        wpabuf_printf(dppcon,
+                      "{\"groups\":[{\"groupId\":\"*\",\"netRole\":\"sta\"}],"
+                      "\"netAccessKey\":{\"kty\":\"EC\",\"crv\":\"%s\",\"x\":\"%s\",\"y\":\"%s\"}}",
+                      run->curve->jwk_crv, x, y);
+        connector = dpp_sign_connector(run->conf, dppcon);
+    }
+    wpabuf_free(dppcon);
+    os_free(x);
+    os_free(y);
+    return connector;
+}
+
+// プールのスレッド: BENCH_CONNECTOR_BATCH個署名し、締め切り前なら自分を投入し直す
+static void bench_connector_job_run(struct dpp_worker_job *job)
+{
+    struct bench_connector_job *connector_job = (struct bench_connector_job *)job;
+    struct bench_connector_run *run = connector_job->run;
+    uint64_t signed_count = 0, failed = 0, now;
+
+    for (int i = 0; i < BENCH_CONNECTOR_BATCH; i++)
+    {
+        char *connector = bench_connector_sign(
+            run, run->keys[connector_job->next_key++ % BENCH_CONNECTOR_KEYS]);
+        if (connector)
+            signed_count++;
+        else
+            failed++;
+        os_free(connector);
+    }
+    now = bench_now_ns();
+
+    pthread_mutex_lock(&run->lock);
+    run->signed_count += signed_count;
+    run->failed += failed;
+    if (now < run->deadline && !failed)
+    {
+        pthread_mutex_unlock(&run->lock);
+        dpp_worker_pool_submit(run->pool, job);
+        return;
+    }
+    if (now > run->end)
+        run->end = now;
+    if (--run->outstanding == 0)
+        pthread_cond_signal(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+}
+
+// threads本のプールで BENCH_MIN_TIME_NS の間署名し続ける
+static int bench_connector_pool(struct bench_connector_run *run, int threads,
+                                struct bench_result *result)
+{
+    struct bench_connector_job *jobs;
+    int job_count = threads * BENCH_CONNECTOR_JOBS;
+    uint64_t start;
+    int i;
+
+    jobs = calloc(job_count, sizeof(*jobs));
+    run->pool = jobs ? dpp_worker_pool_new(threads) : NULL;
+    if (!run->pool)
+    {
+        free(jobs);
+        return -1;
+    }
+    run->signed_count = 0;
+    run->failed = 0;
+    run->end = 0;
+    run->outstanding = job_count;
+    start = bench_now_ns();
+    run->deadline = start + BENCH_MIN_TIME_NS;
+    for (i = 0; i < job_count; i++)
+    {
+        jobs[i].job.fn = bench_connector_job_run;
+        jobs[i].run = run;
+        jobs[i].next_key = i;
+        dpp_worker_pool_submit(run->pool, &jobs[i].job);
+    }
+
+    pthread_mutex_lock(&run->lock);
+    while (run->outstanding > 0)
+        pthread_cond_wait(&run->cond, &run->lock);
+    pthread_mutex_unlock(&run->lock);
+    dpp_worker_pool_free(run->pool);
+    run->pool = NULL;
+    free(jobs);
+    if (run->failed || !run->signed_count)
+    {
+        dpp_printf("Error: Connector signing failed (curve %s)\n", run->curve->name);
+        return -1;
+    }
+
+    snprintf(result->name, sizeof(result->name), "connectors/%s/%d", run->curve->name, threads);
+    result->iterations = run->signed_count;
+    result->ns_per_op = (double)(run->end - start) / run->signed_count;
+    result->allocs_per_op = -1;
+    result->bytes = 0;
+    result->threads = threads;
+    return 0;
+}
+
+// 1曲線分: スレッド数を1, 2, 4, ... max_threadsと増やして計測する
+static int bench_connector_curve(const struct dpp_curve_params *curve, int max_threads,
+                                 struct bench_result *results, int *count)
+{
+    struct bench_connector_run run;
+    struct dpp_global_config config;
+    struct dpp_global *dpp;
+    char cmd[48];
+    int threads, id, i;
+    int ret = 0;
+
+    memset(&run, 0, sizeof(run));
+    memset(&config, 0, sizeof(config));
+    run.curve = curve;
+    dpp = dpp_global_init(&config);
+    if (!dpp)
+        return -1;
+    snprintf(cmd, sizeof(cmd), "curve=%s", curve->name);
+    id = dpp_configurator_add(dpp, cmd);
+    run.conf = id > 0 ? dpp_configurator_get_id(dpp, id) : NULL;
+    for (i = 0; run.conf && i < BENCH_CONNECTOR_KEYS; i++)
+    {
+        struct crypto_ec_key *key = dpp_gen_keypair(curve);
+        if (key)
+            run.keys[i] = dpp_get_pubkey_point(key, 0);
+        crypto_ec_key_deinit(key);
+        if (!run.keys[i])
+            break;
+    }
+    if (!run.conf || i < BENCH_CONNECTOR_KEYS)
+    {
+        dpp_printf("Error: Cannot set up curve %s\n", curve->name);
+        ret = -1;
+        goto out;
+    }
+
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.cond, NULL);
+    for (threads = 1; *count < BENCH_MAX_RESULTS; threads *= 2)
+    {
+        if (threads > max_threads)
+            threads = max_threads;
+        if (bench_connector_pool(&run, threads, &results[*count]) < 0)
+        {
+            ret = -1;
+            break;
+        }
+        (*count)++;
+        if (threads == max_threads)
+            break;
+    }
+    pthread_mutex_destroy(&run.lock);
+    pthread_cond_destroy(&run.cond);
+
+out:
+    for (i = 0; i < BENCH_CONNECTOR_KEYS; i++)
+        wpabuf_free(run.keys[i]);
+    dpp_global_deinit(dpp);
+    return ret;
+}
+
+// スレッド数ごとの connectors/s と1スレッドに対する倍率
+static void bench_connector_summary(const struct bench_result *results, int count)
+{
+    double base = 0;
+    int i;
+
+    dpp_printf("\n%-16s %8s %14s %8s\n", "Curve", "Threads", "Connectors/s", "Speedup");
+    for (i = 0; i < count; i++)
+    {
+        const char *curve = results[i].name + strlen("connectors/");
+        int curve_len = (int)(strrchr(results[i].name, '/') - curve);
+
+        if (results[i].threads == 1)
+            base = bench_ops_per_s(&results[i]);
+        dpp_printf("%-16.*s %8d %14.1f %7.2fx\n", results[i].threads == 1 ? curve_len : 0, curve,
+                   results[i].threads, bench_ops_per_s(&results[i]),
+                   base > 0 ? bench_ops_per_s(&results[i]) / base : 0.0);
+    }
+}
+
+static int bench_connectors(const char *curves, int threads, bool json, const char *out)
+{
+    struct bench_result results[BENCH_MAX_RESULTS];
+    char *list, *token, *saveptr = NULL;
+    int count = 0;
+    int ret = 0;
+
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > BENCH_CRYPTO_MAX_THREADS)
+        threads = BENCH_CRYPTO_MAX_THREADS;
+    list = strdup(curves ? curves : "prime256v1");
+    if (!list)
+        return -1;
+
+    if (!json)
+        dpp_printf("Crypto library: %s, up to %d threads\n", OpenSSL_version(OPENSSL_VERSION), threads);
+    for (token = strtok_r(list, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr))
+    {
+        const struct dpp_curve_params *curve = dpp_get_curve_name(token);
+
+        if (!curve)
+        {
+            dpp_printf("Error: Unknown curve: %s\n", token);
+            ret = -1;
+            continue;
+        }
+        if (bench_connector_curve(curve, threads, results, &count) < 0)
+            ret = -1;
+    }
+    free(list);
+
+    if (bench_results_output("connectors", "Connector signing benchmark", results, count, json,
+                             out) < 0)
+        ret = -1;
+    if (!json)
+        bench_connector_summary(results, count);
+    return ret;
+}
+
+// bench コマンド
+int cmd_bench(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *suite = dpp_arg(args, "suite");
+    const char *interface = dpp_arg(args, "interface");
+    const char *sizes = dpp_arg(args, "sizes");
+    const char *format = dpp_arg(args, "format");
+    const char *out = dpp_arg(args, "out");
+    const char *curves = dpp_arg(args, "curves");
+    int threads = dpp_arg_int(args, "threads", 0);
+    int iterations = dpp_arg_int(args, "iterations", 10000);
+    int entries = dpp_arg_int(args, "entries", 1000000);
+    int ret = -1;
+
+    if (iterations <= 0 || entries <= 0 || threads < 0)
+    {
+        dpp_printf("Error: iterations, entries and threads must be positive\n");
+        return -1;
+    }
+
+    if (!suite || strcmp(suite, "ctrl") == 0)
+    {
+        ret = bench_ctrl(interface, iterations);
+    }
+    else if (strcmp(suite, "state") == 0)
+    {
+        ret = bench_state(entries, iterations);
+    }
+    else if (strcmp(suite, "helpers") == 0 || strcmp(suite, "codec") == 0 ||
+             strcmp(suite, "crypto") == 0 || strcmp(suite, "connectors") == 0)
+    {
+        bool json = format && strcmp(format, "json") == 0;
+
+        if (format && !json && strcmp(format, "text") != 0)
+            dpp_printf("Error: Unknown format: %s (use text or json)\n", format);
+        else if (strcmp(suite, "codec") == 0)
+            ret = bench_codec(json, out);
+        else if (strcmp(suite, "crypto") == 0)
+            ret = bench_crypto(curves, threads, json, out);
+        else if (strcmp(suite, "connectors") == 0)
+            ret = bench_connectors(curves, threads, json, out);
+        else
+            ret = bench_helpers(ctx, sizes, json, out);
+    }
+    else
+    {
+        dpp_printf("Error: Unknown benchmark suite: %s\n", suite);
+        dpp_printf("Usage: bench [suite=ctrl|state|helpers|codec|crypto|connectors] [iterations=<n>] [interface=<ifname>] [entries=<n>]\n");
+        dpp_printf("             [sizes=<n,n,...>] [curves=<curve,...>] [threads=<n>] [format=text|json] [out=<file>]\n");
+    }
+
+    return ret;
+}
@@ -0,0 +1,575 @@
+/*
+ * DPP Configurator - Hex/Base64 Codec
+ * Hex encode/decode/validate and base64 decode with SSE2/AVX2 kernels
+ *
+ * The implementation is chosen once at first use from the CPU features
+ * (AVX2, then SSE2, then the portable scalar code). The vector kernels are
+ * compiled with per-function target attributes, so the binary itself does
+ * not require AVX2. Inputs shorter than one vector and the tails of longer
+ * inputs are handled by the scalar code, and the base64 padding quantum is
+ * always decoded by the scalar code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/dpp_configurator.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DPP_CODEC_X86 1
+#endif
+
+struct dpp_codec_ops
+{
+    const char *name;
+    void (*hex_encode)(const u8 *src, size_t len, char *dst);
+    int (*hex_decode)(const char *src, size_t len, u8 *dst);
+    bool (*hex_valid)(const char *src, size_t len);
+    size_t (*base64_decode)(const char *src, size_t len, u8 *dst, size_t *done);
+};
+
+static const char codec_hex_digits[] = "0123456789abcdef";
+
+// 16進数の値（無効な文字は0xff）
+static u8 codec_hex_table[256];
+// base64の値（無効な文字は0xff）
+static u8 codec_base64_table[256];
+
+static void codec_tables_init(void)
+{
+    int i;
+
+    memset(codec_hex_table, 0xff, sizeof(codec_hex_table));
+    for (i = 0; i < 10; i++)
+        codec_hex_table['0' + i] = i;
+    for (i = 0; i < 6; i++)
+    {
+        codec_hex_table['a' + i] = 10 + i;
+        codec_hex_table['A' + i] = 10 + i;
+    }
+
+    memset(codec_base64_table, 0xff, sizeof(codec_base64_table));
+    for (i = 0; i < 26; i++)
+    {
+        codec_base64_table['A' + i] = i;
+        codec_base64_table['a' + i] = 26 + i;
+    }
+    for (i = 0; i < 10; i++)
+        codec_base64_table['0' + i] = 52 + i;
+    codec_base64_table['+'] = 62;
+    codec_base64_table['/'] = 63;
+}
+
+/* スカラー実装（ベクトル版の端数処理にも使う） */
+
+static void codec_hex_encode_scalar(const u8 *src, size_t len, char *dst)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[2 * i] = codec_hex_digits[src[i] >> 4];
+        dst[2 * i + 1] = codec_hex_digits[src[i] & 0x0f];
+    }
+}
+
+static int codec_hex_decode_scalar(const char *src, size_t len, u8 *dst)
+{
+    for (size_t i = 0; i < len / 2; i++)
+    {
+        u8 hi = codec_hex_table[(u8)src[2 * i]];
+        u8 lo = codec_hex_table[(u8)src[2 * i + 1]];
+        if ((hi | lo) & 0xf0)
+            return -1;
+        dst[i] = hi << 4 | lo;
+    }
+    return 0;
+}
+
+static bool codec_hex_valid_scalar(const char *src, size_t len)
+{
+    u8 bad = 0;
+
+    for (size_t i = 0; i < len; i++)
+        bad |= codec_hex_table[(u8)src[i]];
+    return !(bad & 0xf0);
+}
+
+// パディングを含まない4文字単位をデコードし、処理した文字数を*doneに返す
+static size_t codec_base64_decode_scalar(const char *src, size_t len, u8 *dst, size_t *done)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        u8 a = codec_base64_table[(u8)src[i]];
+        u8 b = codec_base64_table[(u8)src[i + 1]];
+        u8 c = codec_base64_table[(u8)src[i + 2]];
+        u8 d = codec_base64_table[(u8)src[i + 3]];
+        if ((a | b | c | d) & 0xc0)
+            break;
+        uint32_t word = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+        dst[n++] = word >> 16;
+        dst[n++] = word >> 8;
+        dst[n++] = word;
+    }
+    *done = i;
+    return n;
+}
+
+static const struct dpp_codec_ops codec_scalar = {
+    "scalar",
+    codec_hex_encode_scalar,
+    codec_hex_decode_scalar,
+    codec_hex_valid_scalar,
+    codec_base64_decode_scalar,
+};
+
+#ifdef DPP_CODEC_X86
+
+/*
+ * SSE2: 16バイト（32文字）単位
+ * AVX2版の端数処理からも呼ぶので、VEX命令のまま展開されるよう常にインライン化する
+ */
+
+// 0-15の値を '0'-'9','a'-'f' に変換
+__attribute__((target("sse2"))) static inline __m128i codec_sse2_nibble_ascii(__m128i n)
+{
+    __m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+                        _mm_and_si128(letter, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+/*
+ * 16進数の文字を値に変換し、無効な文字があれば*badにビットを立てる
+ * 数字は c - '0' が 0-9、英字は (c | 0x20) - 'a' が 0-5（符号付き比較で0x80以上も除外）
+ */
+__attribute__((target("sse2"))) static inline __m128i codec_sse2_hex_value(__m128i c, __m128i *bad)
+{
+    __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_d = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)),
+                                 _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+    __m128i is_l = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8(-1)),
+                                 _mm_cmplt_epi8(l, _mm_set1_epi8(6)));
+
+    *bad = _mm_or_si128(*bad, _mm_andnot_si128(_mm_or_si128(is_d, is_l), _mm_set1_epi8(-1)));
+    return _mm_or_si128(_mm_and_si128(is_d, d),
+                        _mm_and_si128(is_l, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+// 隣り合う2つの値を1バイトにまとめ、16ビットごとの下位バイトに置く
+__attribute__((target("sse2"))) static inline __m128i codec_sse2_hex_pairs(__m128i v)
+{
+    return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0x00f0)),
+                        _mm_srli_epi16(v, 8));
+}
+
+__attribute__((target("sse2"), always_inline)) static inline void
+codec_hex_encode_sse2(const u8 *src, size_t len, char *dst)
+{
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = codec_sse2_nibble_ascii(_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        __m128i lo = codec_sse2_nibble_ascii(_mm_and_si128(v, mask));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    codec_hex_encode_scalar(src + i, len - i, dst + 2 * i);
+}
+
+__attribute__((target("sse2"), always_inline)) static inline int
+codec_hex_decode_sse2(const char *src, size_t len, u8 *dst)
+{
+    __m128i bad = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m128i v0 = codec_sse2_hex_value(_mm_loadu_si128((const __m128i *)(src + i)), &bad);
+        __m128i v1 = codec_sse2_hex_value(_mm_loadu_si128((const __m128i *)(src + i + 16)), &bad);
+        _mm_storeu_si128((__m128i *)(dst + i / 2),
+                         _mm_packus_epi16(codec_sse2_hex_pairs(v0), codec_sse2_hex_pairs(v1)));
+    }
+    if (_mm_movemask_epi8(bad))
+        return -1;
+    return codec_hex_decode_scalar(src + i, len - i, dst + i / 2);
+}
+
+__attribute__((target("sse2"), always_inline)) static inline bool
+codec_hex_valid_sse2(const char *src, size_t len)
+{
+    __m128i bad = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+        codec_sse2_hex_value(_mm_loadu_si128((const __m128i *)(src + i)), &bad);
+    return !_mm_movemask_epi8(bad) && codec_hex_valid_scalar(src + i, len - i);
+}
+
+/*
+ * base64の文字を6ビットの値に変換（範囲の比較で求める。pshufbが無いSSE2向け）
+ * 'A'-'Z': -65, 'a'-'z': -71, '0'-'9': +4, '+': +19, '/': +16
+ */
+__attribute__((target("sse2"))) static inline __m128i codec_sse2_base64_value(__m128i c,
+                                                                             __m128i *bad)
+{
+    __m128i is_u = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                                 _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+    __m128i is_l = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+                                 _mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+    __m128i is_d = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                 _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i is_p = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+    __m128i is_s = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+    __m128i valid = _mm_or_si128(_mm_or_si128(is_u, is_l), _mm_or_si128(is_d, _mm_or_si128(is_p, is_s)));
+    __m128i offset = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(is_u, _mm_set1_epi8(-65)), _mm_and_si128(is_l, _mm_set1_epi8(-71))),
+        _mm_or_si128(_mm_and_si128(is_d, _mm_set1_epi8(4)),
+                     _mm_or_si128(_mm_and_si128(is_p, _mm_set1_epi8(19)),
+                                  _mm_and_si128(is_s, _mm_set1_epi8(16)))));
+
+    *bad = _mm_andnot_si128(valid, _mm_set1_epi8(-1));
+    return _mm_add_epi8(c, offset);
+}
+
+// 16文字を4つの24ビット値にまとめる（バイトの並べ替えはpshufbが無いのでスカラーで行う）
+__attribute__((target("sse2"), always_inline)) static inline size_t
+codec_base64_decode_sse2(const char *src, size_t len, u8 *dst, size_t *done)
+{
+    uint32_t words[4];
+    size_t i = 0, n = 0, rest;
+
+    // 最後の4文字（パディングを含みうる）はスカラー側で処理する
+    for (; i + 16 + 4 <= len; i += 16)
+    {
+        __m128i bad;
+        __m128i v = codec_sse2_base64_value(_mm_loadu_si128((const __m128i *)(src + i)), &bad);
+        if (_mm_movemask_epi8(bad))
+            break;
+        // 6ビット x2 -> 12ビット（16ビットごと）、12ビット x2 -> 24ビット（32ビットごと）
+        __m128i w = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x003f)), 6),
+                                 _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)words, _mm_madd_epi16(w, _mm_set1_epi32(0x00011000)));
+        for (int j = 0; j < 4; j++)
+        {
+            dst[n++] = words[j] >> 16;
+            dst[n++] = words[j] >> 8;
+            dst[n++] = words[j];
+        }
+    }
+    n += codec_base64_decode_scalar(src + i, len - i, dst + n, &rest);
+    *done = i + rest;
+    return n;
+}
+
+static const struct dpp_codec_ops codec_sse2 = {
+    "sse2",
+    codec_hex_encode_sse2,
+    codec_hex_decode_sse2,
+    codec_hex_valid_sse2,
+    codec_base64_decode_sse2,
+};
+
+/* AVX2: 32バイト（64文字）単位 */
+
+__attribute__((target("avx2"))) static inline __m256i codec_avx2_nibble_ascii(__m256i n)
+{
+    __m256i letter = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
+    return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')),
+                           _mm256_and_si256(letter, _mm256_set1_epi8('a' - '0' - 10)));
+}
+
+__attribute__((target("avx2"))) static inline __m256i codec_avx2_hex_value(__m256i c, __m256i *bad)
+{
+    __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_d = _mm256_and_si256(_mm256_cmpgt_epi8(d, _mm256_set1_epi8(-1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8(10), d));
+    __m256i is_l = _mm256_and_si256(_mm256_cmpgt_epi8(l, _mm256_set1_epi8(-1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8(6), l));
+
+    *bad = _mm256_or_si256(*bad, _mm256_andnot_si256(_mm256_or_si256(is_d, is_l),
+                                                     _mm256_set1_epi8(-1)));
+    return _mm256_or_si256(_mm256_and_si256(is_d, d),
+                           _mm256_and_si256(is_l, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2"))) static void codec_hex_encode_avx2(const u8 *src, size_t len,
+                                                                 char *dst)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i hi = codec_avx2_nibble_ascii(_mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        __m256i lo = codec_avx2_nibble_ascii(_mm256_and_si256(v, mask));
+        // unpackは128ビットのレーンごとなので、レーンを入れ替えて入力順に戻す
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    codec_hex_encode_sse2(src + i, len - i, dst + 2 * i);
+}
+
+__attribute__((target("avx2"))) static int codec_hex_decode_avx2(const char *src, size_t len,
+                                                                u8 *dst)
+{
+    __m256i bad = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64)
+    {
+        __m256i v0 = codec_avx2_hex_value(_mm256_loadu_si256((const __m256i *)(src + i)), &bad);
+        __m256i v1 = codec_avx2_hex_value(_mm256_loadu_si256((const __m256i *)(src + i + 32)), &bad);
+        // 値の組は maddubs で (hi * 16 + lo) にまとめる
+        __m256i w0 = _mm256_maddubs_epi16(v0, _mm256_set1_epi16(0x0110));
+        __m256i w1 = _mm256_maddubs_epi16(v1, _mm256_set1_epi16(0x0110));
+        _mm256_storeu_si256((__m256i *)(dst + i / 2),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(w0, w1), 0xd8));
+    }
+    if (_mm256_movemask_epi8(bad))
+        return -1;
+    return codec_hex_decode_sse2(src + i, len - i, dst + i / 2);
+}
+
+__attribute__((target("avx2"))) static bool codec_hex_valid_avx2(const char *src, size_t len)
+{
+    __m256i bad = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+        codec_avx2_hex_value(_mm256_loadu_si256((const __m256i *)(src + i)), &bad);
+    return !_mm256_movemask_epi8(bad) && codec_hex_valid_sse2(src + i, len - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i codec_avx2_base64_value(__m256i c,
+                                                                             __m256i *bad)
+{
+    __m256i is_u = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+    __m256i is_l = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+    __m256i is_d = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    __m256i is_p = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+    __m256i is_s = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+    __m256i valid = _mm256_or_si256(_mm256_or_si256(is_u, is_l),
+                                    _mm256_or_si256(is_d, _mm256_or_si256(is_p, is_s)));
+    __m256i offset = _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(is_u, _mm256_set1_epi8(-65)),
+                        _mm256_and_si256(is_l, _mm256_set1_epi8(-71))),
+        _mm256_or_si256(_mm256_and_si256(is_d, _mm256_set1_epi8(4)),
+                        _mm256_or_si256(_mm256_and_si256(is_p, _mm256_set1_epi8(19)),
+                                        _mm256_and_si256(is_s, _mm256_set1_epi8(16)))));
+
+    *bad = _mm256_andnot_si256(valid, _mm256_set1_epi8(-1));
+    return _mm256_add_epi8(c, offset);
+}
+
+// 32文字 -> 24バイト。書き込みは32バイト単位なので出力側に8バイトの余裕が必要
+__attribute__((target("avx2"))) static size_t codec_base64_decode_avx2(const char *src, size_t len,
+                                                                      u8 *dst, size_t *done)
+{
+    // 各32ビットの24ビット値をビッグエンディアンの3バイトに並べ、レーンごとに12バイトへ詰める
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0, n = 0, rest;
+
+    for (; i + 32 + 4 <= len && (len - i) / 4 * 3 >= 32; i += 32)
+    {
+        __m256i bad;
+        __m256i v = codec_avx2_base64_value(_mm256_loadu_si256((const __m256i *)(src + i)), &bad);
+        if (_mm256_movemask_epi8(bad))
+            break;
+        __m256i w = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        __m256i d = _mm256_madd_epi16(w, _mm256_set1_epi32(0x00011000));
+        d = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(d, shuffle), compact);
+        _mm256_storeu_si256((__m256i *)(dst + n), d);
+        n += 24;
+    }
+    n += codec_base64_decode_sse2(src + i, len - i, dst + n, &rest);
+    *done = i + rest;
+    return n;
+}
+
+static const struct dpp_codec_ops codec_avx2 = {
+    "avx2",
+    codec_hex_encode_avx2,
+    codec_hex_decode_avx2,
+    codec_hex_valid_avx2,
+    codec_base64_decode_avx2,
+};
+
+#endif /* DPP_CODEC_X86 */
+
+static const struct dpp_codec_ops *codec_ops = &codec_scalar;
+static pthread_once_t codec_once = PTHREAD_ONCE_INIT;
+
+static void codec_init(void)
+{
+    codec_tables_init();
+#ifdef DPP_CODEC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        codec_ops = &codec_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        codec_ops = &codec_sse2;
+#endif
+}
+
+static inline const struct dpp_codec_ops *codec_get(void)
+{
+    pthread_once(&codec_once, codec_init);
+    return codec_ops;
+}
+
+// 使用中の実装名（"avx2"・"sse2"・"scalar"）
+const char *dpp_codec_impl(void)
+{
+    return codec_get()->name;
+}
+
+/*
+ * 実装を切り替える（ベンチマーク用）。NULLならCPU機能から選び直す
+ * 戻り値: 0 成功、-1 不明な名前かCPUが対応していない
+ */
+int dpp_codec_select(const char *name)
+{
+    codec_get();
+    if (!name)
+    {
+        codec_init();
+        return 0;
+    }
+    if (strcmp(name, "scalar") == 0)
+    {
+        codec_ops = &codec_scalar;
+        return 0;
+    }
+#ifdef DPP_CODEC_X86
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    {
+        codec_ops = &codec_sse2;
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        codec_ops = &codec_avx2;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+// 16進数エンコード（dstは 2 * len + 1 バイト）。戻り値は文字数
+size_t dpp_hex_encode(const u8 *src, size_t len, char *dst)
+{
+    codec_get()->hex_encode(src, len, dst);
+    dst[2 * len] = '\0';
+    return 2 * len;
+}
+
+// 16進数デコード（dstは len / 2 バイト）。戻り値はバイト数、奇数長か無効な文字なら-1
+int dpp_hex_decode(const char *src, size_t len, u8 *dst)
+{
+    if (len % 2)
+        return -1;
+    if (codec_get()->hex_decode(src, len, dst) < 0)
+        return -1;
+    return (int)(len / 2);
+}
+
+// 空でない偶数長の16進数文字列か
+bool dpp_hex_valid(const char *src, size_t len)
+{
+    return len > 0 && len % 2 == 0 && codec_get()->hex_valid(src, len);
+}
+
+/*
+ * base64デコード（hostapdのbase64_decode() と同じくパディング必須）
+ * 戻り値: バイト数。形式が不正か dst_size に収まらなければ-1
+ */
+int dpp_base64_decode(const char *src, size_t len, u8 *dst, size_t dst_size)
+{
+    size_t n, done;
+    int pad = 0;
+
+    if (len == 0 || len % 4 || len / 4 * 3 > dst_size)
+        return -1;
+    if (src[len - 1] == '=')
+        pad = src[len - 2] == '=' ? 2 : 1;
+
+    n = codec_get()->base64_decode(src, len - 4, dst, &done);
+    if (done != len - 4)
+        return -1;
+
+    // 最後の4文字（パディングを含みうる）
+    u8 v[4];
+    for (int j = 0; j < 4; j++)
+    {
+        v[j] = j < 4 - pad ? codec_base64_table[(u8)src[len - 4 + j]] : 0;
+        if (v[j] & 0xc0)
+            return -1;
+    }
+    uint32_t word = (uint32_t)v[0] << 18 | (uint32_t)v[1] << 12 | (uint32_t)v[2] << 6 | v[3];
+    dst[n++] = word >> 16;
+    if (pad < 2)
+        dst[n++] = word >> 8;
+    if (pad < 1)
+        dst[n++] = word;
+    return (int)n;
+}
+
+// 文字列を16進数エンコードする関数
+char *encode_hex_string(const char *str)
+{
+    size_t len;
+    char *hex_str;
+
+    if (!str)
+        return NULL;
+
+    len = strlen(str);
+    hex_str = malloc(len * 2 + 1);
+    if (!hex_str)
+        return NULL;
+    dpp_hex_encode((const u8 *)str, len, hex_str);
+    return hex_str;
+}
+
+// 16進数文字列をデコードする関数
+char *decode_hex_string(const char *hex_str)
+{
+    size_t hex_len;
+    char *str;
+
+    if (!hex_str)
+        return NULL;
+
+    hex_len = strlen(hex_str);
+    str = malloc(hex_len / 2 + 1);
+    if (!str)
+        return NULL;
+    if (dpp_hex_decode(hex_str, hex_len, (u8 *)str) < 0)
+    {
+        free(str);
+        return NULL;
+    }
+    str[hex_len / 2] = '\0';
+    return str;
+}
+
+// 文字列が16進数かどうかを判定する関数（偶数長である必要がある）
+bool is_hex_string(const char *str)
+{
+    return str && dpp_hex_valid(str, strlen(str));
+}
@@ -0,0 +1,954 @@
+/*
+ * DPP Configurator - Control Engine
+ * Asynchronous control-plane I/O to many hostapd instances (io_uring or epoll)
+ *
+ * Requests are queued per hostapd instance and sent in FIFO order. Up to
+ * `window` requests per instance are in flight at a time; hostapd answers
+ * datagrams in the order it receives them, so replies are matched to the
+ * oldest in-flight request. One thread drives every instance: each round
+ * submits all sendable requests and reaps all completions at once.
+ *
+ * With CONFIG_DPP_IO_URING the rounds are a single io_uring_enter() each
+ * (raw syscalls, no liburing). When io_uring is unavailable at runtime
+ * (old kernel, seccomp) or DPP_CTRL_ENGINE=epoll is set, non-blocking
+ * sockets and epoll are used instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "../include/dpp_configurator.h"
+
+#ifdef CONFIG_DPP_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define CTRL_ENGINE_TIMEOUT_MS 5000  // hostapd_ctrl_request() と同じ応答待ち時間
+#define CTRL_ENGINE_RX_SIZE 65536    // 1インスタンスあたりの受信バッファ
+#define CTRL_ENGINE_MAX_EVENTS 64
+#define CTRL_ENGINE_RING_ENTRIES 256
+
+// 要求（cmdは構造体の後ろに続けて確保する）
+struct ctrl_request
+{
+    struct ctrl_request *next;
+    dpp_ctrl_done_fn done;
+    void *arg;
+    int id;
+    bool retried; // 接続し直して一度だけ再送する
+    uint64_t deadline_ns;
+    size_t len;
+    char cmd[];
+};
+
+// hostapdインスタンスごとの送信待ちと応答待ち（どちらもFIFO）
+struct ctrl_instance
+{
+    char interface[108];
+    int sock;
+    unsigned int gen; // ソケットを開き直すたびに増やす（古い完了通知を捨てる）
+    struct ctrl_request *queue_head, *queue_tail;
+    struct ctrl_request *flight_head, *flight_tail;
+    struct ctrl_request *sending; // io_uring: 送信完了待ち
+    int in_flight;
+    bool recv_armed;
+    bool want_out; // 相手の受信キューが一杯（書き込み可能になるのを待つ）
+    char *rx;
+};
+
+struct ctrl_backend;
+
+struct dpp_ctrl_engine
+{
+    const struct ctrl_backend *backend;
+    struct ctrl_instance *instances;
+    int count;
+    int capacity;
+    int window;
+    int pending; // 完了していない要求の数
+    int epfd;
+#ifdef CONFIG_DPP_IO_URING
+    struct
+    {
+        int fd;
+        unsigned int entries;
+        unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+        unsigned int *cq_head, *cq_tail, *cq_mask;
+        unsigned int sq_local_tail;
+        unsigned int to_submit;
+        struct io_uring_sqe *sqes;
+        struct io_uring_cqe *cqes;
+        void *sq_ptr, *cq_ptr;
+        size_t sq_len, cq_len, sqes_len;
+        bool timeout_armed;
+        struct __kernel_timespec ts;
+        char **retired; // 取り消した受信の受信バッファ（完了通知が届くまで解放しない）
+        int retired_count;
+    } ring;
+#endif
+};
+
+struct ctrl_backend
+{
+    const char *name;
+    int (*init)(struct dpp_ctrl_engine *engine);
+    void (*cleanup)(struct dpp_ctrl_engine *engine);
+    int (*attach)(struct dpp_ctrl_engine *engine, int index);
+    void (*detach)(struct dpp_ctrl_engine *engine, int index);
+    int (*round)(struct dpp_ctrl_engine *engine, int timeout_ms);
+};
+
+static uint64_t ctrl_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void ctrl_complete(struct dpp_ctrl_engine *engine, struct ctrl_request *req, int ret,
+                          const char *reply)
+{
+    engine->pending--;
+    if (req->done)
+        req->done(req->arg, req->id, ret, ret >= 0 ? reply : "");
+    free(req);
+}
+
+static void ctrl_fail_list(struct dpp_ctrl_engine *engine, struct ctrl_request *req, int ret)
+{
+    while (req)
+    {
+        struct ctrl_request *next = req->next;
+        ctrl_complete(engine, req, ret, NULL);
+        req = next;
+    }
+}
+
+static void ctrl_flight_push(struct ctrl_instance *inst, struct ctrl_request *req)
+{
+    req->next = NULL;
+    req->deadline_ns = ctrl_now_ns() + CTRL_ENGINE_TIMEOUT_MS * 1000000ULL;
+    if (inst->flight_tail)
+        inst->flight_tail->next = req;
+    else
+        inst->flight_head = req;
+    inst->flight_tail = req;
+    inst->in_flight++;
+}
+
+static struct ctrl_request *ctrl_queue_pop(struct ctrl_instance *inst)
+{
+    struct ctrl_request *req = inst->queue_head;
+
+    inst->queue_head = req->next;
+    if (!inst->queue_head)
+        inst->queue_tail = NULL;
+    req->next = NULL;
+    return req;
+}
+
+// 送信待ちの先頭に戻す（再接続後に再送する）
+static void ctrl_queue_unshift(struct ctrl_instance *inst, struct ctrl_request *req)
+{
+    req->next = inst->queue_head;
+    inst->queue_head = req;
+    if (!inst->queue_tail)
+        inst->queue_tail = req;
+}
+
+// 応答を最も古い応答待ちの要求に対応付ける（lenは切り詰め前の長さ）
+static void ctrl_reply(struct dpp_ctrl_engine *engine, struct ctrl_instance *inst, ssize_t len)
+{
+    struct ctrl_request *req = inst->flight_head;
+
+    if (!req)
+    {
+        DPP_LOG(DPP_LOG_CTRL, DPP_LOG_DEBUG, "%s: unexpected reply dropped", inst->interface);
+        return;
+    }
+    inst->flight_head = req->next;
+    if (!inst->flight_head)
+        inst->flight_tail = NULL;
+    inst->in_flight--;
+
+    if (len >= CTRL_ENGINE_RX_SIZE)
+    {
+        inst->rx[CTRL_ENGINE_RX_SIZE - 1] = '\0';
+        ctrl_complete(engine, req, -EMSGSIZE, NULL);
+        return;
+    }
+    inst->rx[len] = '\0';
+    ctrl_complete(engine, req, (int)len, inst->rx);
+}
+
+/*
+ * 接続し直す（タイムアウト・送信エラー時）
+ * 応答待ちの要求は失敗させる。古いソケットへの遅延応答は新しい要求と混ざらない
+ */
+static void ctrl_instance_reset(struct dpp_ctrl_engine *engine, int index, int err)
+{
+    struct ctrl_instance *inst = &engine->instances[index];
+    struct ctrl_request *flight = inst->flight_head;
+
+    inst->flight_head = inst->flight_tail = NULL;
+    inst->in_flight = 0;
+    if (inst->sock >= 0)
+    {
+        engine->backend->detach(engine, index);
+        close(inst->sock);
+    }
+    inst->gen++;
+    inst->sock = hostapd_ctrl_socket_open(inst->interface);
+    if (inst->sock >= 0 && engine->backend->attach(engine, index) < 0)
+    {
+        close(inst->sock);
+        inst->sock = -1;
+    }
+
+    // 接続できなければ送信待ちも失敗させる（完了処理は状態を更新し終えてから呼ぶ）
+    if (inst->sock < 0)
+    {
+        struct ctrl_request *queue = inst->queue_head;
+        inst->queue_head = inst->queue_tail = NULL;
+        ctrl_fail_list(engine, queue, -ECONNREFUSED);
+    }
+    ctrl_fail_list(engine, flight, err);
+}
+
+// 送信エラーの処理（再起動したhostapdへは一度だけ接続し直して再送する）
+static void ctrl_send_failed(struct dpp_ctrl_engine *engine, int index, struct ctrl_request *req,
+                             int err)
+{
+    struct ctrl_instance *inst = &engine->instances[index];
+
+    if (!req->retried && (err == ECONNREFUSED || err == ENOENT || err == ENOTCONN))
+    {
+        req->retried = true;
+        ctrl_queue_unshift(inst, req);
+        ctrl_instance_reset(engine, index, -err);
+        return;
+    }
+    ctrl_complete(engine, req, -err, NULL);
+}
+
+// 期限切れの応答待ちがあるインスタンスを接続し直す。戻り値: 次の期限までのms（無ければ-1）
+static int ctrl_expire(struct dpp_ctrl_engine *engine)
+{
+    uint64_t now = ctrl_now_ns();
+    uint64_t next = 0;
+    int i;
+
+    for (i = 0; i < engine->count; i++)
+    {
+        struct ctrl_instance *inst = &engine->instances[i];
+        if (!inst->flight_head)
+            continue;
+        if (inst->flight_head->deadline_ns <= now)
+        {
+            DPP_LOG(DPP_LOG_CTRL, DPP_LOG_WARN, "%s: timeout waiting for %d replies",
+                    inst->interface, inst->in_flight);
+            ctrl_instance_reset(engine, i, -ETIMEDOUT);
+            continue;
+        }
+        if (!next || inst->flight_head->deadline_ns < next)
+            next = inst->flight_head->deadline_ns;
+    }
+    return next ? (int)((next - now + 999999) / 1000000) : -1;
+}
+
+/* epoll */
+
+static int ctrl_epoll_init(struct dpp_ctrl_engine *engine)
+{
+    engine->epfd = epoll_create1(EPOLL_CLOEXEC);
+    return engine->epfd < 0 ? -1 : 0;
+}
+
+static void ctrl_epoll_cleanup(struct dpp_ctrl_engine *engine)
+{
+    if (engine->epfd >= 0)
+        close(engine->epfd);
+    engine->epfd = -1;
+}
+
+static int ctrl_epoll_attach(struct dpp_ctrl_engine *engine, int index)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = index};
+
+    engine->instances[index].want_out = false;
+    return epoll_ctl(engine->epfd, EPOLL_CTL_ADD, engine->instances[index].sock, &ev);
+}
+
+static void ctrl_epoll_detach(struct dpp_ctrl_engine *engine, int index)
+{
+    epoll_ctl(engine->epfd, EPOLL_CTL_DEL, engine->instances[index].sock, NULL);
+}
+
+// 送信できるだけ送る（送信バッファが一杯ならEPOLLOUTを待つ）
+static void ctrl_epoll_send(struct dpp_ctrl_engine *engine, int index)
+{
+    struct ctrl_instance *inst = &engine->instances[index];
+    bool want_out = false;
+
+    while (inst->sock >= 0 && inst->queue_head && inst->in_flight < engine->window)
+    {
+        struct ctrl_request *req = inst->queue_head;
+        if (send(inst->sock, req->cmd, req->len, MSG_DONTWAIT) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+            {
+                want_out = true;
+                break;
+            }
+            ctrl_send_failed(engine, index, ctrl_queue_pop(inst), errno);
+            inst = &engine->instances[index];
+            continue;
+        }
+        ctrl_flight_push(inst, ctrl_queue_pop(inst));
+    }
+
+    if (inst->sock >= 0 && want_out != inst->want_out)
+    {
+        struct epoll_event ev = {.events = EPOLLIN | (want_out ? EPOLLOUT : 0),
+                                 .data.u32 = index};
+        epoll_ctl(engine->epfd, EPOLL_CTL_MOD, inst->sock, &ev);
+        inst->want_out = want_out;
+    }
+}
+
+static int ctrl_epoll_round(struct dpp_ctrl_engine *engine, int timeout_ms)
+{
+    struct epoll_event events[CTRL_ENGINE_MAX_EVENTS];
+    int completed = engine->pending;
+    int i, n;
+
+    for (i = 0; i < engine->count; i++)
+        ctrl_epoll_send(engine, i);
+
+    n = epoll_wait(engine->epfd, events, CTRL_ENGINE_MAX_EVENTS, timeout_ms);
+    if (n < 0 && errno != EINTR)
+        return -errno;
+
+    for (i = 0; i < n; i++)
+    {
+        int index = events[i].data.u32;
+        unsigned int gen = engine->instances[index].gen;
+
+        // 届いている応答をまとめて受信する
+        // （完了処理で要求が追加されinstancesが移動しうるので毎回添字で引く）
+        while ((events[i].events & EPOLLIN) && engine->instances[index].gen == gen)
+        {
+            struct ctrl_instance *inst = &engine->instances[index];
+            ssize_t len = recv(inst->sock, inst->rx, CTRL_ENGINE_RX_SIZE - 1,
+                               MSG_DONTWAIT | MSG_TRUNC);
+            if (len < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN)
+                    ctrl_instance_reset(engine, index, -errno);
+                break;
+            }
+            ctrl_reply(engine, inst, len);
+        }
+        if (engine->instances[index].gen == gen)
+            ctrl_epoll_send(engine, index);
+    }
+    return completed - engine->pending;
+}
+
+static const struct ctrl_backend ctrl_backend_epoll = {
+    "epoll",
+    ctrl_epoll_init,
+    ctrl_epoll_cleanup,
+    ctrl_epoll_attach,
+    ctrl_epoll_detach,
+    ctrl_epoll_round,
+};
+
+#ifdef CONFIG_DPP_IO_URING
+
+/* io_uring（liburingを使わずシステムコールを直接呼ぶ） */
+
+enum ctrl_uring_op
+{
+    CTRL_URING_SEND = 1,
+    CTRL_URING_RECV,
+    CTRL_URING_TIMEOUT,
+    CTRL_URING_CANCEL,
+    CTRL_URING_POLL,
+};
+
+// user_data: インスタンス番号 << 32 | 世代 << 8 | 操作
+static uint64_t ctrl_uring_tag(int index, unsigned int gen, enum ctrl_uring_op op)
+{
+    return (uint64_t)index << 32 | (uint64_t)(gen & 0xffffff) << 8 | op;
+}
+
+static int ctrl_uring_enter(struct dpp_ctrl_engine *engine, unsigned int min_complete)
+{
+    unsigned int to_submit = engine->ring.to_submit;
+    int ret;
+
+    // 送信するSQEを公開してから呼ぶ
+    __atomic_store_n(engine->ring.sq_tail, engine->ring.sq_local_tail, __ATOMIC_RELEASE);
+    ret = syscall(__NR_io_uring_enter, engine->ring.fd, to_submit, min_complete,
+                  min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (ret < 0)
+        return -errno;
+    engine->ring.to_submit -= ret;
+    return ret;
+}
+
+static struct io_uring_sqe *ctrl_uring_sqe(struct dpp_ctrl_engine *engine)
+{
+    unsigned int head = __atomic_load_n(engine->ring.sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+    unsigned int index;
+
+    // SQが一杯なら先に送る
+    if (engine->ring.sq_local_tail - head >= engine->ring.entries)
+    {
+        if (ctrl_uring_enter(engine, 0) < 0)
+            return NULL;
+        head = __atomic_load_n(engine->ring.sq_head, __ATOMIC_ACQUIRE);
+        if (engine->ring.sq_local_tail - head >= engine->ring.entries)
+            return NULL;
+    }
+
+    index = engine->ring.sq_local_tail & *engine->ring.sq_mask;
+    sqe = &engine->ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    engine->ring.sq_array[index] = index;
+    engine->ring.sq_local_tail++;
+    engine->ring.to_submit++;
+    return sqe;
+}
+
+/*
+ * 使う命令が全て実装されているか（IORING_REGISTER_PROBEは5.6以降）
+ * 機能フラグではSEND・RECVの有無が分からないので、命令ごとに確かめる
+ */
+static bool ctrl_uring_supported(int fd)
+{
+    static const unsigned char ops[] = {
+        IORING_OP_SEND, IORING_OP_RECV, IORING_OP_POLL_ADD,
+        IORING_OP_POLL_REMOVE, IORING_OP_ASYNC_CANCEL, IORING_OP_TIMEOUT,
+    };
+    struct io_uring_probe *probe;
+    size_t i;
+    bool ok;
+
+    probe = calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (!probe)
+        return false;
+    ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (i = 0; ok && i < sizeof(ops); i++)
+    {
+        ok = ops[i] < probe->ops_len && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+static int ctrl_uring_init(struct dpp_ctrl_engine *engine)
+{
+    struct io_uring_params params;
+    int fd;
+
+    memset(&params, 0, sizeof(params));
+    memset(&engine->ring, 0, sizeof(engine->ring));
+    engine->ring.fd = -1;
+
+    fd = syscall(__NR_io_uring_setup, CTRL_ENGINE_RING_ENTRIES, &params);
+    if (fd < 0)
+        return -1;
+    // SENDとRECV（5.6以降）が無いカーネルではepollを使う
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !ctrl_uring_supported(fd))
+    {
+        close(fd);
+        return -1;
+    }
+
+    engine->ring.fd = fd;
+    engine->ring.entries = params.sq_entries;
+    engine->ring.sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    engine->ring.cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (engine->ring.cq_len > engine->ring.sq_len)
+        engine->ring.sq_len = engine->ring.cq_len;
+    engine->ring.sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    engine->ring.sq_ptr = mmap(NULL, engine->ring.sq_len, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (engine->ring.sq_ptr == MAP_FAILED)
+        goto fail;
+    engine->ring.cq_ptr = engine->ring.sq_ptr; // IORING_FEAT_SINGLE_MMAP
+    engine->ring.sqes = mmap(NULL, engine->ring.sqes_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (engine->ring.sqes == MAP_FAILED)
+    {
+        munmap(engine->ring.sq_ptr, engine->ring.sq_len);
+        goto fail;
+    }
+
+    engine->ring.sq_head = (unsigned int *)((char *)engine->ring.sq_ptr + params.sq_off.head);
+    engine->ring.sq_tail = (unsigned int *)((char *)engine->ring.sq_ptr + params.sq_off.tail);
+    engine->ring.sq_mask = (unsigned int *)((char *)engine->ring.sq_ptr + params.sq_off.ring_mask);
+    engine->ring.sq_array = (unsigned int *)((char *)engine->ring.sq_ptr + params.sq_off.array);
+    engine->ring.cq_head = (unsigned int *)((char *)engine->ring.cq_ptr + params.cq_off.head);
+    engine->ring.cq_tail = (unsigned int *)((char *)engine->ring.cq_ptr + params.cq_off.tail);
+    engine->ring.cq_mask = (unsigned int *)((char *)engine->ring.cq_ptr + params.cq_off.ring_mask);
+    engine->ring.cqes = (struct io_uring_cqe *)((char *)engine->ring.cq_ptr + params.cq_off.cqes);
+    engine->ring.sq_local_tail = *engine->ring.sq_tail;
+    return 0;
+
+fail:
+    close(fd);
+    engine->ring.fd = -1;
+    return -1;
+}
+
+static void ctrl_uring_cleanup(struct dpp_ctrl_engine *engine)
+{
+    int i;
+
+    if (engine->ring.fd < 0)
+        return;
+    // リングを閉じると未完了の操作は取り消される
+    munmap(engine->ring.sqes, engine->ring.sqes_len);
+    munmap(engine->ring.sq_ptr, engine->ring.sq_len);
+    close(engine->ring.fd);
+    engine->ring.fd = -1;
+    for (i = 0; i < engine->ring.retired_count; i++)
+        free(engine->ring.retired[i]);
+    free(engine->ring.retired);
+}
+
+static int ctrl_uring_attach(struct dpp_ctrl_engine *engine, int index)
+{
+    (void)engine;
+    (void)index;
+    return 0;
+}
+
+/*
+ * 受信を取り消す。カーネルがまだ受信バッファに書き込みうるので、
+ * バッファは退避してエンジンの解放時まで残し、インスタンスには新しいものを割り当てる
+ */
+static void ctrl_uring_detach(struct dpp_ctrl_engine *engine, int index)
+{
+    struct ctrl_instance *inst = &engine->instances[index];
+    struct io_uring_sqe *sqe;
+    char **retired;
+    char *rx;
+
+    if (inst->sending)
+    {
+        // 送信中の要求は完了通知を待たずに送信待ちへ戻す（世代が変わるので通知は捨てられる）
+        ctrl_queue_unshift(inst, inst->sending);
+        inst->sending = NULL;
+    }
+    if (inst->want_out)
+    {
+        inst->want_out = false;
+        sqe = ctrl_uring_sqe(engine);
+        if (sqe)
+        {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->addr = ctrl_uring_tag(index, inst->gen, CTRL_URING_POLL);
+            sqe->user_data = ctrl_uring_tag(index, inst->gen, CTRL_URING_CANCEL);
+        }
+    }
+    if (!inst->recv_armed)
+        return;
+    inst->recv_armed = false;
+
+    sqe = ctrl_uring_sqe(engine);
+    if (sqe)
+    {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = ctrl_uring_tag(index, inst->gen, CTRL_URING_RECV);
+        sqe->user_data = ctrl_uring_tag(index, inst->gen, CTRL_URING_CANCEL);
+    }
+
+    rx = malloc(CTRL_ENGINE_RX_SIZE);
+    retired = realloc(engine->ring.retired,
+                      (engine->ring.retired_count + 1) * sizeof(*retired));
+    if (!rx || !retired)
+    {
+        // 退避できなければバッファを使い続ける（遅延応答で内容が上書きされうる）
+        free(rx);
+        if (retired)
+            engine->ring.retired = retired;
+        return;
+    }
+    engine->ring.retired = retired;
+    retired[engine->ring.retired_count++] = inst->rx;
+    inst->rx = rx;
+}
+
+static void ctrl_uring_prepare(struct dpp_ctrl_engine *engine, int index)
+{
+    struct ctrl_instance *inst = &engine->instances[index];
+    struct io_uring_sqe *sqe;
+
+    if (inst->sock < 0)
+        return;
+
+    /*
+     * 1インスタンスにつき送信は1つずつ（順序を保つ）。複数インスタンスの送信は同じ呼び出しで送る
+     * 受信キューが一杯のときにカーネル側で再試行させると空のデータグラムが送られることがあるため、
+     * MSG_DONTWAITで送り、EAGAINならPOLLOUTを待ってから送り直す
+     */
+    if (!inst->sending && !inst->want_out && inst->queue_head &&
+        inst->in_flight < engine->window)
+    {
+        sqe = ctrl_uring_sqe(engine);
+        if (!sqe)
+            return;
+        inst->sending = ctrl_queue_pop(inst);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = inst->sock;
+        sqe->addr = (uintptr_t)inst->sending->cmd;
+        sqe->len = inst->sending->len;
+        sqe->msg_flags = MSG_DONTWAIT;
+        sqe->user_data = ctrl_uring_tag(index, inst->gen, CTRL_URING_SEND);
+    }
+
+    if (!inst->recv_armed && (inst->in_flight > 0 || inst->sending))
+    {
+        sqe = ctrl_uring_sqe(engine);
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = inst->sock;
+        sqe->addr = (uintptr_t)inst->rx;
+        sqe->len = CTRL_ENGINE_RX_SIZE - 1;
+        sqe->msg_flags = MSG_TRUNC; // 切り詰め前の長さを返す
+        sqe->user_data = ctrl_uring_tag(index, inst->gen, CTRL_URING_RECV);
+        inst->recv_armed = true;
+    }
+}
+
+static void ctrl_uring_cqe(struct dpp_ctrl_engine *engine, uint64_t tag, int res)
+{
+    enum ctrl_uring_op op = tag & 0xff;
+    int index = (int)(tag >> 32);
+    struct ctrl_instance *inst;
+
+    if (op == CTRL_URING_TIMEOUT)
+    {
+        engine->ring.timeout_armed = false;
+        return;
+    }
+    if (op == CTRL_URING_CANCEL || index >= engine->count)
+        return;
+
+    inst = &engine->instances[index];
+    if (((tag >> 8) & 0xffffff) != (inst->gen & 0xffffff))
+        return; // 接続し直す前のソケットの通知
+
+    if (op == CTRL_URING_SEND)
+    {
+        struct ctrl_request *req = inst->sending;
+        inst->sending = NULL;
+        if (!req)
+            return;
+        if (res == -EAGAIN || res == -EINTR)
+        {
+            struct io_uring_sqe *sqe;
+
+            ctrl_queue_unshift(inst, req);
+            if (res == -EAGAIN && (sqe = ctrl_uring_sqe(engine)) != NULL)
+            {
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = inst->sock;
+                sqe->poll32_events = POLLOUT;
+                sqe->user_data = ctrl_uring_tag(index, inst->gen, CTRL_URING_POLL);
+                inst->want_out = true;
+            }
+        }
+        else if (res < 0)
+            ctrl_send_failed(engine, index, req, -res);
+        else
+            ctrl_flight_push(inst, req);
+    }
+    else if (op == CTRL_URING_POLL)
+    {
+        inst->want_out = false;
+    }
+    else if (op == CTRL_URING_RECV)
+    {
+        inst->recv_armed = false;
+        if (res >= 0)
+            ctrl_reply(engine, inst, res);
+        else if (res != -EAGAIN && res != -EINTR && res != -ECANCELED)
+            ctrl_instance_reset(engine, index, res);
+    }
+}
+
+static void ctrl_uring_reap(struct dpp_ctrl_engine *engine)
+{
+    unsigned int head = *engine->ring.cq_head;
+    unsigned int tail = __atomic_load_n(engine->ring.cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &engine->ring.cqes[head & *engine->ring.cq_mask];
+        uint64_t tag = cqe->user_data;
+        int res = cqe->res;
+
+        head++;
+        // 完了処理で新しいSQEを作ることがあるので先にCQを進める
+        __atomic_store_n(engine->ring.cq_head, head, __ATOMIC_RELEASE);
+        ctrl_uring_cqe(engine, tag, res);
+        tail = __atomic_load_n(engine->ring.cq_tail, __ATOMIC_ACQUIRE);
+    }
+}
+
+static int ctrl_uring_round(struct dpp_ctrl_engine *engine, int timeout_ms)
+{
+    int completed = engine->pending;
+    int ret;
+    int i;
+
+    for (i = 0; i < engine->count; i++)
+        ctrl_uring_prepare(engine, i);
+
+    // 応答待ちの期限（最も早いもの）で起きるためのタイムアウト
+    if (timeout_ms >= 0 && !engine->ring.timeout_armed)
+    {
+        struct io_uring_sqe *sqe = ctrl_uring_sqe(engine);
+        if (sqe)
+        {
+            engine->ring.ts.tv_sec = timeout_ms / 1000;
+            engine->ring.ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->addr = (uintptr_t)&engine->ring.ts;
+            sqe->len = 1;
+            sqe->user_data = ctrl_uring_tag(0, 0, CTRL_URING_TIMEOUT);
+            engine->ring.timeout_armed = true;
+        }
+    }
+
+    // 送信と完了待ちを1回のシステムコールで行う
+    ret = ctrl_uring_enter(engine, timeout_ms == 0 ? 0 : 1);
+    if (ret < 0 && ret != -EINTR && ret != -EBUSY)
+        return ret;
+    ctrl_uring_reap(engine);
+    return completed - engine->pending;
+}
+
+static const struct ctrl_backend ctrl_backend_uring = {
+    "io_uring",
+    ctrl_uring_init,
+    ctrl_uring_cleanup,
+    ctrl_uring_attach,
+    ctrl_uring_detach,
+    ctrl_uring_round,
+};
+
+#endif /* CONFIG_DPP_IO_URING */
+
+/*
+ * エンジンを作成する
+ * window: 1インスタンスあたりの同時に応答待ちにする要求数（0なら既定値）
+ */
+struct dpp_ctrl_engine *dpp_ctrl_engine_new(int window)
+{
+    struct dpp_ctrl_engine *engine;
+    const char *backend = getenv("DPP_CTRL_ENGINE");
+
+    engine = calloc(1, sizeof(*engine));
+    if (!engine)
+        return NULL;
+    engine->window = window > 0 ? window : DPP_CTRL_ENGINE_WINDOW;
+    engine->epfd = -1;
+
+#ifdef CONFIG_DPP_IO_URING
+    if (!backend || strcmp(backend, "epoll") != 0)
+    {
+        engine->backend = &ctrl_backend_uring;
+        if (ctrl_uring_init(engine) == 0)
+            return engine;
+        DPP_LOG(DPP_LOG_CTRL, DPP_LOG_INFO, "io_uring unavailable (%s), using epoll",
+                strerror(errno));
+    }
+#else
+    (void)backend;
+#endif
+
+    engine->backend = &ctrl_backend_epoll;
+    if (ctrl_epoll_init(engine) < 0)
+    {
+        free(engine);
+        return NULL;
+    }
+    return engine;
+}
+
+// 未完了の要求は -ECANCELED で完了させてから解放する
+void dpp_ctrl_engine_free(struct dpp_ctrl_engine *engine)
+{
+    int i;
+
+    if (!engine)
+        return;
+
+    engine->backend->cleanup(engine);
+    for (i = 0; i < engine->count; i++)
+    {
+        struct ctrl_instance *inst = &engine->instances[i];
+        if (inst->sending)
+            ctrl_complete(engine, inst->sending, -ECANCELED, NULL);
+        ctrl_fail_list(engine, inst->flight_head, -ECANCELED);
+        ctrl_fail_list(engine, inst->queue_head, -ECANCELED);
+        if (inst->sock >= 0)
+            close(inst->sock);
+        free(inst->rx);
+    }
+    free(engine->instances);
+    free(engine);
+}
+
+const char *dpp_ctrl_engine_backend(const struct dpp_ctrl_engine *engine)
+{
+    return engine->backend->name;
+}
+
+int dpp_ctrl_engine_pending(const struct dpp_ctrl_engine *engine)
+{
+    return engine->pending;
+}
+
+// インターフェースのインスタンスを探す（無ければ接続して追加）
+static int ctrl_instance_get(struct dpp_ctrl_engine *engine, const char *interface)
+{
+    struct ctrl_instance *inst;
+    int i;
+
+    for (i = 0; i < engine->count; i++)
+    {
+        if (strcmp(engine->instances[i].interface, interface) == 0)
+            return engine->instances[i].sock >= 0 ? i : -1;
+    }
+
+    if (engine->count == engine->capacity)
+    {
+        int capacity = engine->capacity ? engine->capacity * 2 : 8;
+        struct ctrl_instance *instances =
+            realloc(engine->instances, capacity * sizeof(*instances));
+        if (!instances)
+            return -1;
+        engine->instances = instances;
+        engine->capacity = capacity;
+    }
+
+    inst = &engine->instances[engine->count];
+    memset(inst, 0, sizeof(*inst));
+    snprintf(inst->interface, sizeof(inst->interface), "%s", interface);
+    inst->rx = malloc(CTRL_ENGINE_RX_SIZE);
+    if (!inst->rx)
+        return -1;
+    inst->sock = hostapd_ctrl_socket_open(interface);
+    if (inst->sock < 0 || engine->backend->attach(engine, engine->count) < 0)
+    {
+        // 接続できないインターフェースも記録し、以降の要求はすぐに失敗させる
+        if (inst->sock >= 0)
+            close(inst->sock);
+        inst->sock = -1;
+        engine->count++;
+        return -1;
+    }
+    return engine->count++;
+}
+
+/*
+ * 要求を追加する（送信は dpp_ctrl_engine_poll/run で行う）
+ * done(arg, id, ret, reply) はエンジンを動かしているスレッドから呼ばれる
+ * ret は応答のバイト数か負のerrno。同じインターフェースの要求は追加した順に送られ、完了する
+ * 戻り値: 0 成功、-1 インターフェースに接続できない
+ */
+int dpp_ctrl_engine_submit(struct dpp_ctrl_engine *engine, const char *interface,
+                           const char *cmd, dpp_ctrl_done_fn done, void *arg, int id)
+{
+    struct ctrl_instance *inst;
+    struct ctrl_request *req;
+    size_t len = strlen(cmd);
+    int index;
+
+    // 同期APIでブレーカーが開いているインスタンスには送らない
+    if (hostapd_ctrl_breaker(interface, NULL) == HOSTAPD_BREAKER_OPEN)
+        return -1;
+    index = ctrl_instance_get(engine, interface);
+    if (index < 0)
+        return -1;
+    inst = &engine->instances[index];
+
+    req = malloc(sizeof(*req) + len + 1);
+    if (!req)
+        return -1;
+    req->next = NULL;
+    req->done = done;
+    req->arg = arg;
+    req->id = id;
+    req->retried = false;
+    req->deadline_ns = 0;
+    req->len = len;
+    memcpy(req->cmd, cmd, len + 1);
+
+    if (inst->queue_tail)
+        inst->queue_tail->next = req;
+    else
+        inst->queue_head = req;
+    inst->queue_tail = req;
+    engine->pending++;
+    return 0;
+}
+
+/*
+ * 送信できる要求をすべて送り、完了を待って処理する（1ラウンド）
+ * timeout_ms: 完了が無いときに待つ上限（-1なら応答待ちの期限まで）
+ * 戻り値: 完了した要求の数、エラー時は負のerrno
+ */
+int dpp_ctrl_engine_poll(struct dpp_ctrl_engine *engine, int timeout_ms)
+{
+    int pending = engine->pending;
+    int next = ctrl_expire(engine);
+    int ret;
+
+    if (engine->pending == 0)
+        return pending;
+    if (next >= 0 && (timeout_ms < 0 || next < timeout_ms))
+        timeout_ms = next;
+
+    ret = engine->backend->round(engine, timeout_ms);
+    if (ret < 0)
+        return ret;
+    ctrl_expire(engine);
+    return pending - engine->pending;
+}
+
+// すべての要求が完了するまで動かす
+int dpp_ctrl_engine_run(struct dpp_ctrl_engine *engine)
+{
+    while (engine->pending > 0)
+    {
+        int ret = dpp_ctrl_engine_poll(engine, -1);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
@@ -0,0 +1,481 @@
+/*
+ * DPP Configurator - Daemon Mode
+ * Long-running configurator serving commands over a local UNIX socket
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "../include/dpp_configurator.h"
+
+#define DPP_DAEMON_MAX_REQUEST 65536
+#define DPP_DAEMON_COMPACT_INTERVAL_MS (60 * 1000)
+#define DPP_DAEMON_COMPACT_THRESHOLD 4096 // スナップショット外のエントリ数
+#define DPP_DAEMON_CLIENT_TIMEOUT_MS 5000    // 要求の受信・応答の送信を待つ上限
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_signal_handler(int sig)
+{
+    (void)sig;
+    daemon_stop = 1;
+}
+
+/*
+ * 実行時ディレクトリ（$XDG_RUNTIME_DIR/dpp_configurator、無ければ /run/user/<uid>/…、
+ * rootなら /run/dpp_configurator）。所有者のみアクセスできる0700のディレクトリで、
+ * 他のユーザーが作ったものやシンボリックリンクは使わない
+ * ディレクトリを作るのはデーモンの起動時（create）だけで、クライアントは調べるだけ
+ */
+const char *dpp_daemon_runtime_dir(bool create)
+{
+    static char dir[108];
+    const char *base = getenv("XDG_RUNTIME_DIR");
+    struct stat st;
+
+    if (base && *base)
+        snprintf(dir, sizeof(dir), "%s/%s", base, DPP_DAEMON_RUNTIME_NAME);
+    else if (geteuid() == 0)
+        snprintf(dir, sizeof(dir), "/run/%s", DPP_DAEMON_RUNTIME_NAME);
+    else
+        snprintf(dir, sizeof(dir), "/run/user/%u/%s", (unsigned int)geteuid(),
+                 DPP_DAEMON_RUNTIME_NAME);
+
+    if (create && mkdir(dir, 0700) < 0 && errno != EEXIST)
+        return NULL;
+    if (lstat(dir, &st) < 0)
+        return NULL;
+    if (!S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 0077) != 0)
+    {
+        DPP_LOG(DPP_LOG_DAEMON, DPP_LOG_WARN, "refusing runtime directory %s (not a private directory)",
+                dir);
+        return NULL;
+    }
+    return dir;
+}
+
+// ソケットパス（環境変数 DPP_CONFIGURATOR_SOCKET で上書き可能。決められなければNULL）
+const char *dpp_daemon_socket_path(bool create)
+{
+    static char path[108];
+    const char *env = getenv("DPP_CONFIGURATOR_SOCKET");
+    const char *dir;
+
+    if (env && *env)
+        return env;
+    dir = dpp_daemon_runtime_dir(create);
+    if (!dir)
+        return NULL;
+    snprintf(path, sizeof(path), "%s/%s", dir, DPP_DAEMON_SOCKET_NAME);
+    return path;
+}
+
+// 既定のメトリクスファイル（実行時ディレクトリ内。他のユーザーが先に置けない場所に書く）
+static const char *daemon_metrics_path(void)
+{
+    static char path[256];
+    const char *dir = dpp_daemon_runtime_dir(true);
+
+    if (!dir)
+        return NULL;
+    snprintf(path, sizeof(path), "%s/%s", dir, DPP_METRICS_FILE_NAME);
+    return path;
+}
+
+static int daemon_fill_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (!path || strlen(path) >= sizeof(addr->sun_path))
+        return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// 接続相手が同じユーザーのプロセスか（SO_PEERCRED）
+static bool daemon_peer_trusted(int sock)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || len != sizeof(cred))
+        return false;
+    return cred.uid == geteuid();
+}
+
+static int daemon_write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * クライアント: デーモンが起動していればコマンドを転送する
+ *
+ * 要求: "<verbose>\n<command>\n<args>" を送信後に書き込み側をshutdown
+ * 応答: コマンドの標準出力、'\0'、終了コード（10進文字列）
+ *
+ * 戻り値: コマンドの終了コード。デーモンに接続できなければ DPP_DAEMON_NOT_RUNNING
+ */
+int dpp_daemon_forward(bool verbose, const char *cmd, const char *args)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    char buf[4096];
+    char status[32];
+    size_t status_len = 0;
+    bool in_status = false;
+    int sock;
+    ssize_t n;
+
+    if (daemon_fill_addr(&addr, dpp_daemon_socket_path(false)) < 0)
+        return DPP_DAEMON_NOT_RUNNING;
+
+    // 自分のユーザー以外が作ったソケットにはパスワードや鍵を送らない
+    if (lstat(addr.sun_path, &st) < 0)
+        return DPP_DAEMON_NOT_RUNNING;
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != geteuid())
+    {
+        DPP_LOG(DPP_LOG_DAEMON, DPP_LOG_WARN, "ignoring %s (not a socket owned by this user)",
+                addr.sun_path);
+        return DPP_DAEMON_NOT_RUNNING;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return DPP_DAEMON_NOT_RUNNING;
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return DPP_DAEMON_NOT_RUNNING;
+    }
+    if (!daemon_peer_trusted(sock))
+    {
+        DPP_LOG(DPP_LOG_DAEMON, DPP_LOG_WARN, "ignoring daemon on %s (running as another user)",
+                addr.sun_path);
+        close(sock);
+        return DPP_DAEMON_NOT_RUNNING;
+    }
+
+    snprintf(buf, sizeof(buf), "%d\n%s\n", verbose ? 1 : 0, cmd);
+    if (daemon_write_all(sock, buf, strlen(buf)) < 0 ||
+        daemon_write_all(sock, args ? args : "", args ? strlen(args) : 0) < 0)
+    {
+        dpp_printf("Error: Failed to send command to daemon: %s\n", strerror(errno));
+        close(sock);
+        return -1;
+    }
+    shutdown(sock, SHUT_WR);
+
+    // 出力をそのまま標準出力へ流し、'\0'以降を終了コードとして読む
+    while ((n = read(sock, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (in_status)
+            {
+                if (status_len < sizeof(status) - 1)
+                    status[status_len++] = buf[i];
+            }
+            else if (buf[i] == '\0')
+            {
+                fwrite(buf, 1, i, stdout);
+                in_status = true;
+            }
+        }
+        if (!in_status)
+            fwrite(buf, 1, n, stdout);
+    }
+    fflush(dpp_output());
+    close(sock);
+
+    if (!in_status)
+    {
+        dpp_printf("Error: Connection to daemon closed unexpectedly\n");
+        return -1;
+    }
+    status[status_len] = '\0';
+    return atoi(status);
+}
+
+// 1リクエストを処理（デーモンはシングルスレッドで順番に処理する）
+static void daemon_handle_client(struct dpp_configurator_ctx *ctx, int client)
+{
+    struct timeval tv = {DPP_DAEMON_CLIENT_TIMEOUT_MS / 1000,
+                         (DPP_DAEMON_CLIENT_TIMEOUT_MS % 1000) * 1000};
+    char *req;
+    size_t len = 0;
+    ssize_t n;
+    char *cmd, *args, *p;
+    FILE *out, *saved_out;
+    int out_fd;
+    int ret;
+
+    if (!daemon_peer_trusted(client))
+    {
+        DPP_LOG(DPP_LOG_DAEMON, DPP_LOG_WARN, "rejected connection from another user");
+        return;
+    }
+
+    // 要求を送らない・応答を読まないクライアントでデーモンを止めない
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    req = malloc(DPP_DAEMON_MAX_REQUEST + 1);
+    if (!req)
+        return;
+
+    while (len < DPP_DAEMON_MAX_REQUEST &&
+           (n = read(client, req + len, DPP_DAEMON_MAX_REQUEST - len)) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                DPP_LOG(DPP_LOG_DAEMON, DPP_LOG_WARN, "client sent no complete request in %d ms",
+                        DPP_DAEMON_CLIENT_TIMEOUT_MS);
+            free(req);
+            return;
+        }
+        len += n;
+    }
+    req[len] = '\0';
+
+    // "<verbose>\n<command>\n<args>" を分解
+    p = strchr(req, '\n');
+    if (!p)
+    {
+        free(req);
+        return;
+    }
+    *p = '\0';
+    cmd = p + 1;
+    p = strchr(cmd, '\n');
+    if (p)
+    {
+        *p = '\0';
+        args = p + 1;
+    }
+    else
+    {
+        args = cmd + strlen(cmd);
+    }
+
+    // コマンドの出力はクライアント専用のストリームへ（バックグラウンドスレッドの出力は混ざらない）
+    out_fd = dup(client);
+    out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    if (!out)
+    {
+        if (out_fd >= 0)
+            close(out_fd);
+        free(req);
+        return;
+    }
+    saved_out = dpp_output_set(out);
+
+    DPP_LOG(DPP_LOG_DAEMON, DPP_LOG_DEBUG, "request: %s %s", cmd, args);
+    ctx->verbose = atoi(req) != 0;
+    if (strcmp(cmd, "daemon") == 0)
+    {
+        dpp_printf("Error: daemon is already running\n");
+        ret = -1;
+    }
+    else
+    {
+        ret = execute_command(ctx, cmd, args);
+    }
+    ctx->verbose = false;
+
+    // この要求のログを書き出してから応答を返す（クライアントの終了後にログが続かないように）
+    dpp_log_flush();
+    dpp_output_set(saved_out);
+    fputc('\0', out);
+    fprintf(out, "%d", ret);
+    fclose(out);
+    free(req);
+}
+
+// daemon コマンド: ctxとhostapd接続を保持したままリクエストを待ち受ける
+int cmd_daemon(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct pollfd pfd;
+    const char *socket_path;
+    const char *metrics_file;
+    const char *jobs;
+    mode_t old_umask;
+    int sock, client;
+
+    socket_path = dpp_arg(args, "socket");
+    if (!socket_path)
+        socket_path = dpp_daemon_socket_path(true);
+    if (!socket_path)
+    {
+        dpp_printf("Error: No private runtime directory (set XDG_RUNTIME_DIR or socket=<path>)\n");
+        return -1;
+    }
+    if (daemon_fill_addr(&addr, socket_path) < 0)
+    {
+        dpp_printf("Error: Invalid daemon socket path\n");
+        return -1;
+    }
+
+    // Prometheus形式のメトリクスを書き出すファイル（metrics=none で無効）
+    metrics_file = dpp_arg(args, "metrics");
+    if (!metrics_file)
+        metrics_file = daemon_metrics_path();
+    if (!metrics_file)
+    {
+        dpp_printf("Warning: No private runtime directory, metrics file disabled (use metrics=<file>)\n");
+        metrics_file = "none";
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        dpp_printf("Error: Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // 既に別のデーモンが応答するなら起動しない。応答しなければ古いソケットを削除
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        dpp_printf("Error: daemon already running on %s\n", socket_path);
+        close(sock);
+        return -1;
+    }
+    close(sock);
+    unlink(socket_path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        return -1;
+    }
+
+    // ソケットは所有者のみアクセス可能にする
+    old_umask = umask(0077);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 64) < 0)
+    {
+        dpp_printf("Error: Failed to listen on %s: %s\n", socket_path, strerror(errno));
+        umask(old_umask);
+        close(sock);
+        return -1;
+    }
+    umask(old_umask);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // クライアントが途中で切断しても終了しない
+
+    // インポートしたピアの事前登録はバックグラウンドで続ける
+    dpp_peer_sync_set_background(true);
+
+    // 指定したインターフェースでジョブキューを処理し続ける
+    jobs = dpp_arg(args, "jobs");
+    if (jobs && dpp_job_queue_start(ctx, jobs) < 0)
+    {
+        dpp_peer_sync_set_background(false);
+        close(sock);
+        unlink(socket_path);
+        return -1;
+    }
+
+    if (strcmp(metrics_file, "none") != 0)
+    {
+        dpp_metrics_set_file(metrics_file);
+        dpp_metrics_flush();
+    }
+
+    dpp_printf("DPP Configurator daemon listening on %s\n", socket_path);
+    if (strcmp(metrics_file, "none") != 0)
+        dpp_printf("Writing metrics to %s\n", metrics_file);
+    if (jobs)
+        dpp_printf("Processing the job queue on %s\n", jobs);
+    fflush(dpp_output());
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    while (!daemon_stop)
+    {
+        int n = poll(&pfd, 1, DPP_DAEMON_COMPACT_INTERVAL_MS);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            dpp_printf("Error: poll() failed: %s\n", strerror(errno));
+            break;
+        }
+        if (n == 0)
+        {
+            // RTTの推定を更新し、止まったhostapdを要求が来る前に見つける
+            hostapd_ctrl_probe_all();
+
+            // hostapdが再起動していれば事前登録をやり直す
+            dpp_peer_sync_check();
+            dpp_metrics_flush();
+
+            // アイドル時にログ末尾が大きくなっていればスナップショットを作り直す
+            if (dpp_state_uncompacted() >= DPP_DAEMON_COMPACT_THRESHOLD)
+            {
+                dpp_state_compact();
+                fflush(dpp_output());
+            }
+            continue;
+        }
+
+        /*
+         * 要求は1つずつ処理する。コマンドはctx（dpp_globalのBootstrap・Configurator一覧）を
+         * 共有していてスレッドセーフではないので、長いprovisionやimportの間は次のクライアントが待つ
+         * （ジョブキューと事前登録は専用のスレッドで動くので止まらない）
+         */
+        client = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+        daemon_handle_client(ctx, client);
+        close(client);
+        dpp_metrics_flush();
+    }
+
+    dpp_printf("DPP Configurator daemon stopping\n");
+    dpp_job_queue_stop();
+    dpp_peer_sync_stop();
+    dpp_peer_sync_set_background(false);
+    dpp_metrics_flush();
+    dpp_metrics_set_file(NULL);
+    close(sock);
+    unlink(socket_path);
+    return 0;
+}
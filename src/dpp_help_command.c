@@ -8,49 +8,90 @@
 #include <string.h>
 #include "../include/dpp_configurator.h"
 
-int cmd_help(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_help(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
     (void)ctx;  // 未使用パラメータの警告を避ける
     (void)args; // 未使用パラメータの警告を避ける
 
-    printf("DPP Configurator CLI Tool (hostapd mode)\n");
-    printf("=========================================\n\n");
-
-    printf("Basic Commands:\n");
-    printf("  %-25s %s\n", "configurator_add", "Add configurator (curve=prime256v1)");
-    printf("  %-25s %s\n", "dpp_qr_code", "Parse QR code and add bootstrap");
-    printf("  %-25s %s\n", "bootstrap_get_uri", "Get bootstrap URI by ID");
-    printf("  %-25s %s\n", "auth_init", "Initiate DPP authentication");
-    printf("  %-25s %s\n", "status", "Show configurator status");
-
-    printf("\nUtility Commands:\n");
-    printf("  %-25s %s\n", "help", "Show this help");
-
-    printf("\nUsage Examples:\n");
-    printf("  Basic Setup:\n");
-    printf("    configurator_add curve=prime256v1\n");
-    printf("    dpp_qr_code \"DPP:C:81/6;M:12:34:56:78:90:ab;K:MDkwEwYH...6DjUD8=;;\"\n");
-    printf("    bootstrap_get_uri id=1\n");
-    printf("\n");
-    printf("  Authentication:\n");
-    printf("    auth_init peer=1 configurator=1 conf=sta-psk interface=wlo1 ssid=MyNetwork pass=mypassword\n");
-    printf("    auth_init peer=1 configurator=1 conf=sta-psk interface=wlo1 ssid=MyNetwork pass=mypassword matter_pin=12345678\n");
-
-    printf("\nMatter Support:\n");
-    printf("  - Add matter_pin=XXXXXXXX to include 8-digit Matter PIN code\n");
-    printf("  - Matter PIN is included in DPP configuration for device commissioning\n");
-    printf("  - PIN must be exactly 8 digits (0-9)\n");
-
-    printf("\nNotes:\n");
-    printf("  - This tool integrates with hostapd for real DPP wireless communication\n");
-    printf("  - SSID and password are automatically hex-encoded for hostapd\n");
-    printf("  - Monitor DPP authentication progress with hostapd logs\n");
-    printf("  - Matter PIN is passed through to enrollee for Matter device setup\n");
-
-    printf("\nImportant:\n");
-    printf("  - Make sure hostapd is running with DPP support enabled\n");
-    printf("  - Ensure control interface is properly configured\n");
-    printf("  - Run with appropriate privileges (sudo if needed)\n");
+    dpp_printf("DPP Configurator CLI Tool (hostapd mode)\n");
+    dpp_printf("=========================================\n\n");
+
+    dpp_printf("Basic Commands:\n");
+    dpp_printf("  %-25s %s\n", "configurator_add", "Add configurator (curve=prime256v1)");
+    dpp_printf("  %-25s %s\n", "dpp_qr_code", "Parse QR code and add bootstrap");
+    dpp_printf("  %-25s %s\n", "import", "Bulk import URIs (file=<path> [format=csv|jsonl] [threads=<n>] [interface=<ifname>])");
+    dpp_printf("  %-25s %s\n", "peer_sync", "Register stored peers with hostapd (interface=<ifname>[,<ifname>...] [from=<id>] [to=<id>])");
+    dpp_printf("  %-25s %s\n", "bootstrap_get_uri", "Get bootstrap URI by ID");
+    dpp_printf("  %-25s %s\n", "auth_init", "Initiate DPP authentication");
+    dpp_printf("  %-25s %s\n", "template", "Configuration template (name=<name> conf_json=<json> | conf=<type> ssid= pass= | remove=1 | push=<ifname>)");
+    dpp_printf("  %-25s %s\n", "provision", "Provision across radios (interfaces=<if1,if2> peers=<from-to> [policy=least-loaded|channel] [order=channel|fifo])");
+    dpp_printf("  %-25s %s\n", "job_add", "Queue enrollees (peers=<from-to> conf=<type> ... [interface=<ifname>] [attempts=<n>])");
+    dpp_printf("  %-25s %s\n", "job_list", "List queued jobs ([status=pending|done|failed|all])");
+    dpp_printf("  %-25s %s\n", "job_run", "Process the job queue until it is empty (interfaces=<if1,if2> [timeout=<s>])");
+    dpp_printf("  %-25s %s\n", "auth_monitor", "Wait for DPP events (interface=<ifname> [timeout=<s>])");
+    dpp_printf("  %-25s %s\n", "status", "Show configurator status");
+
+    dpp_printf("\nUtility Commands:\n");
+    dpp_printf("  %-25s %s\n", "help", "Show this help");
+    dpp_printf("  %-25s %s\n", "compact", "Compact the state log into a read-only snapshot");
+    dpp_printf("  %-25s %s\n", "metrics", "Show phase/command latency histograms ([format=prometheus|summary] [out=<file>] [reset=1])");
+    dpp_printf("  %-25s %s\n", "bench", "Run benchmarks (suite=ctrl|state|helpers|codec|crypto|connectors [interface=<ifname>] [entries=<n>] [curves=<curve,...>] [threads=<n>] [format=json] [out=<file>])");
+    dpp_printf("  %-25s %s\n", "simulate", "In-memory DPP exchanges, no radio ([enrollees=<n>] [threads=<n>] [signers=<n>] [curve=<curve>] [keypool=<n>] [conf=<type>])");
+    dpp_printf("  %-25s %s\n", "daemon", "Keep state and hostapd connections alive ([socket=<path>] [metrics=<file>|none] [jobs=<if1,if2>])");
+
+    dpp_printf("\nUsage Examples:\n");
+    dpp_printf("  Basic Setup:\n");
+    dpp_printf("    configurator_add curve=prime256v1\n");
+    dpp_printf("    dpp_qr_code \"DPP:C:81/6;M:12:34:56:78:90:ab;K:MDkwEwYH...6DjUD8=;;\"\n");
+    dpp_printf("    bootstrap_get_uri id=1\n");
+    dpp_printf("    import file=lot-0421.csv threads=8 batch=4096\n");
+    dpp_printf("    import file=lot-0421.csv interface=wlo1\n");
+    dpp_printf("\n");
+    dpp_printf("  Authentication:\n");
+    dpp_printf("    auth_init peer=1 configurator=1 conf=sta-psk interface=wlo1 ssid=MyNetwork pass=mypassword\n");
+    dpp_printf("    auth_init peer=1 configurator=1 conf=sta-psk interface=wlo1 ssid=MyNetwork pass=mypassword matter_pin=12345678\n");
+    dpp_printf("    auth_init peer=1 configurator=1 conf=sta-psk interface=wlo1 ssid=MyNetwork pass=mypassword wait=30\n");
+    dpp_printf("    auth_monitor interface=wlo1 timeout=30\n");
+    dpp_printf("    provision interfaces=wlan0,wlan1,wlan2,wlan3 peers=1-500 configurator=1 conf=sta-psk ssid=MyNetwork pass=mypassword policy=channel\n");
+    dpp_printf("\n");
+    dpp_printf("  Job Queue:\n");
+    dpp_printf("    job_add peers=1-500 configurator=1 conf=sta-psk ssid=MyNetwork pass=mypassword\n");
+    dpp_printf("    job_run interfaces=wlan0,wlan1\n");
+    dpp_printf("    job_list status=failed\n");
+    dpp_printf("\n");
+    dpp_printf("  Templates:\n");
+    dpp_printf("    template name=office conf=sta-psk ssid=MyNetwork pass=mypassword\n");
+    dpp_printf("    auth_init peer=1 configurator=1 interface=wlo1 template=office matter_pin=12345678\n");
+    dpp_printf("    provision interfaces=wlan0,wlan1 template=office devices=lot-0421-pins.txt\n");
+
+    dpp_printf("\nMatter Support:\n");
+    dpp_printf("  - Add matter_pin=XXXXXXXX to include 8-digit Matter PIN code\n");
+    dpp_printf("  - Matter PIN is included in DPP configuration for device commissioning\n");
+    dpp_printf("  - PIN must be exactly 8 digits (0-9)\n");
+
+    dpp_printf("\nDaemon Mode:\n");
+    dpp_printf("  - Start once with: daemon [socket=<path>]\n");
+    dpp_printf("  - While it runs, every other command is forwarded to it over the socket\n");
+    dpp_printf("  - Socket path: $XDG_RUNTIME_DIR/%s/%s (override with DPP_CONFIGURATOR_SOCKET)\n",
+               DPP_DAEMON_RUNTIME_NAME, DPP_DAEMON_SOCKET_NAME);
+    dpp_printf("  - Only clients running as the daemon's user are served\n");
+    dpp_printf("  - Use -n to run a command locally without forwarding\n");
+    dpp_printf("  - Metrics are written to $XDG_RUNTIME_DIR/%s/%s after every request (metrics=none disables)\n",
+               DPP_DAEMON_RUNTIME_NAME, DPP_METRICS_FILE_NAME);
+    dpp_printf("  - With jobs=<if1,if2> the daemon keeps processing the job queue; job_add from any client feeds it\n");
+
+    dpp_printf("\nNotes:\n");
+    dpp_printf("  - This tool integrates with hostapd for real DPP wireless communication\n");
+    dpp_printf("  - SSID and password are automatically hex-encoded for hostapd\n");
+    dpp_printf("  - Monitor DPP authentication progress with auth_monitor or auth_init wait=<s>\n");
+    dpp_printf("  - Matter PIN is passed through to enrollee for Matter device setup\n");
+    dpp_printf("  - Debug logs go to stderr: -v, or %s=<level>[,<module>=<level>] (passwords are masked)\n", DPP_LOG_ENV);
+    dpp_printf("  - For a command forwarded to the daemon, -v only adds verbose output; start the daemon with -v for its debug logs\n");
+
+    dpp_printf("\nImportant:\n");
+    dpp_printf("  - Make sure hostapd is running with DPP support enabled\n");
+    dpp_printf("  - Ensure control interface is properly configured\n");
+    dpp_printf("  - Run with appropriate privileges (sudo if needed)\n");
 
     return 0;
 }
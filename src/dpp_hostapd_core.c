@@ -5,146 +5,1015 @@
 
 #include <stdbool.h>
 #include <errno.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include "../include/dpp_configurator.h"
 
 #define MAX_RESPONSE_SIZE 4096
 #define HOSTAPD_CLI_PATH "/var/run/hostapd"
 
-// hostapd制御ソケット通信
-int hostapd_cli_send_command(const char *interface, const char *cmd,
-                             char *response, size_t response_size)
+/*
+ * 応答待ちのタイムアウトはインスタンスごとのRTTから決める（RFC 6298と同じ SRTT + 4*RTTVAR）
+ * 計測前は HOSTAPD_CTRL_TIMEOUT_INITIAL_MS、タイムアウトが続くと倍にする
+ */
+#define HOSTAPD_CTRL_TIMEOUT_MIN_MS 200
+#define HOSTAPD_CTRL_TIMEOUT_INITIAL_MS 1000
+#define HOSTAPD_CTRL_TIMEOUT_MAX_MS 5000
+#define HOSTAPD_CTRL_PROBE_TIMEOUT_MS 1000 // PINGによる生存確認の上限
+
+// サーキットブレーカーが開いている時間（失敗が続くと倍にする）
+#define HOSTAPD_CTRL_COOLDOWN_MIN_MS 1000
+#define HOSTAPD_CTRL_COOLDOWN_MAX_MS 30000
+
+// hostapd制御インターフェースへの永続接続（インターフェースごとに1つ）
+struct hostapd_ctrl
 {
+    struct hostapd_ctrl *next;
+    char interface[108]; // インターフェース名、または制御ソケットのパス
+    struct sockaddr_un dest_addr;
     int sock;
-    struct sockaddr_un local_addr, dest_addr;
-    char socket_path[256];
-    char local_socket_path[256];
-    ssize_t bytes_sent, bytes_received;
-    struct timeval timeout;
-    fd_set readfds;
+    pthread_mutex_t lock; // 1リクエスト（送信〜応答受信）単位で排他
 
-    // ソケットパス構築
-    snprintf(socket_path, sizeof(socket_path), "%s/%s", HOSTAPD_CLI_PATH, interface);
+    // 応答時間の推定とサーキットブレーカー（lock保持で更新、他スレッドはatomicに読む）
+    uint32_t srtt_us; // 0なら未計測
+    uint32_t rttvar_us;
+    unsigned int backoff; // 続けてタイムアウトした回数
+    enum hostapd_breaker_state breaker;
+    uint64_t open_until_ns; // OPENの間、これ以降の要求でPINGを送って半開にする
+    uint32_t cooldown_ms;
+    uint64_t lost_ns;        // 失敗した要求で待った時間の合計
+    uint64_t fast_failures;  // ブレーカーが開いていたため送らずに失敗させた要求
+    uint64_t breaker_opens;
+};
 
-    printf("Attempting to connect to hostapd control socket: %s\n", socket_path);
+static struct hostapd_ctrl *ctrl_list = NULL;
+static pthread_mutex_t ctrl_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static char ctrl_dir[192] = HOSTAPD_CLI_PATH;
 
-    // ソケットファイルの存在確認
-    if (access(socket_path, F_OK) != 0)
-    {
-        printf("Error: hostapd control socket not found: %s\n", socket_path);
-        printf("Make sure hostapd is running with control interface enabled\n");
+// 制御ソケットディレクトリを変更（ベンチマーク・複数hostapd用）
+void hostapd_ctrl_set_dir(const char *dir)
+{
+    pthread_mutex_lock(&ctrl_list_lock);
+    snprintf(ctrl_dir, sizeof(ctrl_dir), "%s", dir ? dir : HOSTAPD_CLI_PATH);
+    pthread_mutex_unlock(&ctrl_list_lock);
+}
+
+/*
+ * 制御ソケットのパス
+ * "/"を含む場合はパスとしてそのまま使う（hostapdごとに別のctrl_interfaceを持つ場合）
+ * ctrl_list_lockを保持して呼ぶ
+ */
+static void hostapd_ctrl_socket_path(const char *interface, char *buf, size_t buflen)
+{
+    if (strchr(interface, '/'))
+        snprintf(buf, buflen, "%s", interface);
+    else
+        snprintf(buf, buflen, "%s/%s", ctrl_dir, interface);
+}
+
+/*
+ * hostapdインスタンスの識別子（制御ソケットのinodeと変更時刻）
+ * hostapdは起動時にソケットを作り直すので、再起動すると値が変わる
+ */
+int hostapd_ctrl_instance_cookie(const char *interface, char *buf, size_t buflen)
+{
+    char path[256];
+    struct stat sb;
+
+    pthread_mutex_lock(&ctrl_list_lock);
+    hostapd_ctrl_socket_path(interface, path, sizeof(path));
+    pthread_mutex_unlock(&ctrl_list_lock);
+
+    if (stat(path, &sb) < 0)
         return -1;
-    }
 
-    // UNIXソケット作成
-    sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    snprintf(buf, buflen, "%llx.%llx.%lx", (unsigned long long)sb.st_ino,
+             (unsigned long long)sb.st_ctim.tv_sec, (long)sb.st_ctim.tv_nsec);
+    return 0;
+}
+
+// ソケットを作成し、抽象名前空間に自動バインドしてhostapdへconnectする（戻り値: ソケット）
+static int hostapd_ctrl_connect_addr(const struct sockaddr_un *dest_addr, int flags)
+{
+    struct sockaddr_un local_addr;
+    int sock;
+
+    sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | flags, 0);
     if (sock < 0)
     {
-        printf("Error: Failed to create socket: %s\n", strerror(errno));
+        dpp_printf("Error: Failed to create socket: %s\n", strerror(errno));
         return -1;
     }
 
-    // クライアント側のソケットパスを作成（hostapdが応答を送り返すため）
-    snprintf(local_socket_path, sizeof(local_socket_path), "/tmp/hostapd_cli_%d", getpid());
-
-    // 既存のソケットファイルを削除
-    unlink(local_socket_path);
-
-    // ローカルアドレス設定
+    // sun_familyのみでbindするとカーネルが一意な抽象アドレスを割り当てる
+    // （/tmpにファイルを作らないのでunlinkも不要）
     memset(&local_addr, 0, sizeof(local_addr));
     local_addr.sun_family = AF_UNIX;
-    strncpy(local_addr.sun_path, local_socket_path, sizeof(local_addr.sun_path) - 1);
+    if (bind(sock, (struct sockaddr *)&local_addr, sizeof(sa_family_t)) < 0)
+    {
+        dpp_printf("Error: Failed to bind socket: %s\n", strerror(errno));
+        close(sock);
+        return -1;
+    }
 
-    // ソケットをローカルアドレスにバインド
-    if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
+    // connectしておけば他の送信元からのデータグラムはカーネルで破棄される
+    if (connect(sock, (const struct sockaddr *)dest_addr, sizeof(*dest_addr)) < 0)
     {
-        printf("Error: Failed to bind socket: %s\n", strerror(errno));
+        dpp_printf("Error: Failed to connect to %s: %s\n", dest_addr->sun_path, strerror(errno));
         close(sock);
-        unlink(local_socket_path);
         return -1;
     }
 
-    // サーバーアドレス設定
+    return sock;
+}
+
+static int hostapd_ctrl_connect(struct hostapd_ctrl *ctrl)
+{
+    int sock = hostapd_ctrl_connect_addr(&ctrl->dest_addr, 0);
+
+    if (sock < 0)
+        return -1;
+    ctrl->sock = sock;
+    return 0;
+}
+
+/*
+ * 非同期エンジン用: 制御ソケットへ接続したノンブロッキングのソケットを返す
+ * （永続接続とは別のソケットなので、応答が同期APIの要求と混ざらない）
+ */
+int hostapd_ctrl_socket_open(const char *interface)
+{
+    struct sockaddr_un dest_addr;
+
     memset(&dest_addr, 0, sizeof(dest_addr));
     dest_addr.sun_family = AF_UNIX;
-    strncpy(dest_addr.sun_path, socket_path, sizeof(dest_addr.sun_path) - 1);
+    pthread_mutex_lock(&ctrl_list_lock);
+    hostapd_ctrl_socket_path(interface, dest_addr.sun_path, sizeof(dest_addr.sun_path));
+    pthread_mutex_unlock(&ctrl_list_lock);
+
+    return hostapd_ctrl_connect_addr(&dest_addr, SOCK_NONBLOCK);
+}
 
-    // コマンド送信
-    printf("Sending command: %s\n", cmd);
-    bytes_sent = sendto(sock, cmd, strlen(cmd), 0,
-                        (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (bytes_sent < 0)
+// 接続オブジェクトを作成して制御ソケットへ接続
+static struct hostapd_ctrl *hostapd_ctrl_open(const char *interface)
+{
+    struct hostapd_ctrl *ctrl;
+
+    ctrl = calloc(1, sizeof(*ctrl));
+    if (!ctrl)
+        return NULL;
+    snprintf(ctrl->interface, sizeof(ctrl->interface), "%s", interface);
+    ctrl->dest_addr.sun_family = AF_UNIX;
+    hostapd_ctrl_socket_path(interface, ctrl->dest_addr.sun_path,
+                             sizeof(ctrl->dest_addr.sun_path));
+    ctrl->sock = -1;
+    pthread_mutex_init(&ctrl->lock, NULL);
+
+    DPP_LOG(DPP_LOG_CTRL, DPP_LOG_DEBUG, "Connecting to hostapd control socket %s",
+            ctrl->dest_addr.sun_path);
+
+    // ソケットファイルの存在確認
+    if (access(ctrl->dest_addr.sun_path, F_OK) != 0)
     {
-        printf("Error: Failed to send command to hostapd: %s\n", strerror(errno));
-        close(sock);
-        unlink(local_socket_path);
-        return -1;
+        dpp_printf("Error: hostapd control socket not found: %s\n", ctrl->dest_addr.sun_path);
+        dpp_printf("Make sure hostapd is running with control interface enabled\n");
+        pthread_mutex_destroy(&ctrl->lock);
+        free(ctrl);
+        return NULL;
+    }
+
+    if (hostapd_ctrl_connect(ctrl) < 0)
+    {
+        pthread_mutex_destroy(&ctrl->lock);
+        free(ctrl);
+        return NULL;
     }
 
-    printf("Command sent successfully, waiting for response...\n");
+    return ctrl;
+}
+
+static void hostapd_ctrl_free(struct hostapd_ctrl *ctrl)
+{
+    if (ctrl->sock >= 0)
+        close(ctrl->sock);
+    pthread_mutex_destroy(&ctrl->lock);
+    free(ctrl);
+}
 
-    // タイムアウト設定 (5秒)
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
+// インターフェースの接続を取得（未接続なら作成してキャッシュ）
+struct hostapd_ctrl *hostapd_ctrl_get(const char *interface)
+{
+    struct hostapd_ctrl *ctrl;
 
-    // selectを使用してタイムアウト付きで応答を待機
-    FD_ZERO(&readfds);
-    FD_SET(sock, &readfds);
+    if (!interface)
+        return NULL;
 
-    int select_result = select(sock + 1, &readfds, NULL, NULL, &timeout);
-    if (select_result < 0)
+    pthread_mutex_lock(&ctrl_list_lock);
+    for (ctrl = ctrl_list; ctrl; ctrl = ctrl->next)
     {
-        printf("Error: select() failed: %s\n", strerror(errno));
-        close(sock);
-        unlink(local_socket_path);
-        return -1;
+        if (strcmp(ctrl->interface, interface) == 0)
+        {
+            pthread_mutex_unlock(&ctrl_list_lock);
+            return ctrl;
+        }
     }
-    else if (select_result == 0)
+
+    ctrl = hostapd_ctrl_open(interface);
+    if (ctrl)
     {
-        printf("Error: Timeout waiting for response from hostapd\n");
-        printf("hostapd may not be running or may not support the command\n");
-        close(sock);
-        unlink(local_socket_path);
-        return -1;
+        ctrl->next = ctrl_list;
+        ctrl_list = ctrl;
     }
+    pthread_mutex_unlock(&ctrl_list_lock);
+    return ctrl;
+}
 
-    // 応答受信
-    bytes_received = recv(sock, response, response_size - 1, 0);
-    if (bytes_received < 0)
+// 前回タイムアウトしたリクエストの遅延応答などを読み捨てる
+static void hostapd_ctrl_drain(struct hostapd_ctrl *ctrl)
+{
+    char buf[256];
+
+    while (recv(ctrl->sock, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+        ;
+}
+
+// 応答の受信先（growなら応答の大きさに合わせて確保し直す）
+struct ctrl_rx
+{
+    char *buf;
+    size_t size;
+    bool grow;
+    bool heap; // bufをこのモジュールで確保したか
+};
+
+/*
+ * 届いているデータグラム1つを受信する
+ * MSG_PEEK|MSG_TRUNCで実際の長さを調べてから受け取るので、growなら切り詰めない
+ * 固定長のバッファに収まらない場合は読み捨てて-EMSGSIZEを返す
+ */
+static ssize_t hostapd_ctrl_recv_sized(int sock, struct ctrl_rx *rx)
+{
+    ssize_t len, n;
+
+    len = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+    if (len < 0)
+        return -errno;
+
+    if ((size_t)len >= rx->size && rx->grow)
     {
-        printf("Error: Failed to receive response from hostapd: %s\n", strerror(errno));
-        close(sock);
-        unlink(local_socket_path);
-        return -1;
+        size_t size = (size_t)len + 1;
+        char *buf = rx->heap ? realloc(rx->buf, size) : malloc(size);
+        if (!buf)
+        {
+            recv(sock, rx->buf, 0, MSG_DONTWAIT);
+            return -ENOMEM;
+        }
+        rx->buf = buf;
+        rx->size = size;
+        rx->heap = true;
+    }
+
+    n = recv(sock, rx->buf, rx->size - 1, MSG_DONTWAIT);
+    if (n < 0)
+        return -errno;
+    rx->buf[n] = '\0';
+    if (len > n)
+    {
+        DPP_LOG(DPP_LOG_CTRL, DPP_LOG_WARN, "Discarding %zd byte reply (buffer is %zu bytes)",
+                len, rx->size);
+        return -EMSGSIZE;
+    }
+    return n;
+}
+
+// 応答を待つ（呼び出し側でlock済み）
+static int hostapd_ctrl_wait(struct hostapd_ctrl *ctrl, struct ctrl_rx *rx, int timeout_ms)
+{
+    struct pollfd pfd;
+    struct timespec start, now;
+    ssize_t bytes_received;
+    int elapsed_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pfd.fd = ctrl->sock;
+    pfd.events = POLLIN;
+
+    for (;;)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = (int)((now.tv_sec - start.tv_sec) * 1000 +
+                           (now.tv_nsec - start.tv_nsec) / 1000000);
+        if (elapsed_ms >= timeout_ms)
+            return -ETIMEDOUT;
+
+        int poll_result = poll(&pfd, 1, timeout_ms - elapsed_ms);
+        if (poll_result < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (poll_result == 0)
+            return -ETIMEDOUT;
+
+        bytes_received = hostapd_ctrl_recv_sized(ctrl->sock, rx);
+        if (bytes_received == -EINTR || bytes_received == -EAGAIN)
+            continue;
+        if (bytes_received < 0)
+            return (int)bytes_received;
+
+        // ATTACH中の非同期イベント（"<level>..."）は応答ではないので読み飛ばす
+        if (bytes_received > 0 && rx->buf[0] == '<')
+            continue;
+
+        return (int)bytes_received;
     }
+}
+
+// 1コマンド送信して応答を待つ（呼び出し側でlock済み）
+static int hostapd_ctrl_transact(struct hostapd_ctrl *ctrl, const char *cmd,
+                                 struct ctrl_rx *rx, int timeout_ms)
+{
+    if (ctrl->sock < 0)
+        return -ENOTCONN;
+
+    hostapd_ctrl_drain(ctrl);
+
+    if (send(ctrl->sock, cmd, strlen(cmd), 0) < 0)
+        return -errno;
+
+    return hostapd_ctrl_wait(ctrl, rx, timeout_ms);
+}
+
+// hostapdが再起動した・止まっている場合のエラー（再接続するとよいもの）
+static bool hostapd_ctrl_disconnected(int ret)
+{
+    return ret == -ECONNREFUSED || ret == -ENOENT || ret == -ENOTCONN;
+}
+
+// 生存確認: 一時的なソケットからPINGを送り、PONGが返ればhostapdは応答している
+static int hostapd_ctrl_ping(const struct sockaddr_un *dest_addr, int timeout_ms)
+{
+    struct pollfd pfd;
+    char buf[16];
+    ssize_t len;
+    int ret = -ETIMEDOUT;
+
+    pfd.fd = hostapd_ctrl_connect_addr(dest_addr, 0);
+    if (pfd.fd < 0)
+        return -ECONNREFUSED;
+    pfd.events = POLLIN;
 
-    response[bytes_received] = '\0';
-    close(sock);
-    unlink(local_socket_path);
-    printf("Received response (%zd bytes): %s\n", bytes_received, response);
+    if (send(pfd.fd, "PING", 4, 0) < 0)
+    {
+        ret = -errno;
+    }
+    else if (poll(&pfd, 1, timeout_ms) > 0)
+    {
+        len = recv(pfd.fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+        ret = (len >= 4 && memcmp(buf, "PONG", 4) == 0) ? 0 : -EPROTO;
+    }
+    close(pfd.fd);
+    return ret;
+}
+
+static int hostapd_ctrl_timeout_ms(const struct hostapd_ctrl *ctrl)
+{
+    uint64_t timeout_ms;
+
+    if (!ctrl->srtt_us)
+        timeout_ms = HOSTAPD_CTRL_TIMEOUT_INITIAL_MS;
+    else
+        timeout_ms = (ctrl->srtt_us + 4 * (uint64_t)ctrl->rttvar_us + 999) / 1000;
+    timeout_ms <<= ctrl->backoff < 8 ? ctrl->backoff : 8;
+
+    if (timeout_ms < HOSTAPD_CTRL_TIMEOUT_MIN_MS)
+        return HOSTAPD_CTRL_TIMEOUT_MIN_MS;
+    if (timeout_ms > HOSTAPD_CTRL_TIMEOUT_MAX_MS)
+        return HOSTAPD_CTRL_TIMEOUT_MAX_MS;
+    return (int)timeout_ms;
+}
+
+static int hostapd_ctrl_probe_timeout_ms(const struct hostapd_ctrl *ctrl)
+{
+    int timeout_ms = hostapd_ctrl_timeout_ms(ctrl);
+
+    return timeout_ms < HOSTAPD_CTRL_PROBE_TIMEOUT_MS ? timeout_ms : HOSTAPD_CTRL_PROBE_TIMEOUT_MS;
+}
+
+// 応答時間の標本を加える（再送した要求の応答は使わない）
+static void hostapd_ctrl_rtt_sample(struct hostapd_ctrl *ctrl, uint64_t ns)
+{
+    uint32_t rtt_us = ns / 1000 > 0 ? (uint32_t)(ns / 1000) : 1;
+    uint32_t srtt_us = ctrl->srtt_us;
+
+    if (!srtt_us)
+    {
+        __atomic_store_n(&ctrl->rttvar_us, rtt_us / 2, __ATOMIC_RELAXED);
+        __atomic_store_n(&ctrl->srtt_us, rtt_us, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        uint32_t delta = srtt_us > rtt_us ? srtt_us - rtt_us : rtt_us - srtt_us;
+        __atomic_store_n(&ctrl->rttvar_us, (uint32_t)((3ULL * ctrl->rttvar_us + delta) / 4),
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&ctrl->srtt_us, (uint32_t)((7ULL * srtt_us + rtt_us) / 8),
+                         __ATOMIC_RELAXED);
+    }
+    ctrl->backoff = 0;
+}
+
+// ブレーカーを開く（以降の要求はcooldownの間、送らずに失敗させる）
+static void hostapd_ctrl_trip(struct hostapd_ctrl *ctrl, int err)
+{
+    uint32_t cooldown_ms = ctrl->cooldown_ms ? ctrl->cooldown_ms * 2 : HOSTAPD_CTRL_COOLDOWN_MIN_MS;
+
+    if (cooldown_ms > HOSTAPD_CTRL_COOLDOWN_MAX_MS)
+        cooldown_ms = HOSTAPD_CTRL_COOLDOWN_MAX_MS;
+    ctrl->cooldown_ms = cooldown_ms;
+    __atomic_store_n(&ctrl->open_until_ns, dpp_metrics_now() + cooldown_ms * 1000000ULL,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&ctrl->breaker, HOSTAPD_BREAKER_OPEN, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctrl->breaker_opens, 1, __ATOMIC_RELAXED);
+    DPP_LOG(DPP_LOG_CTRL, DPP_LOG_WARN, "%s: hostapd not responding (%s), failing fast for %u ms",
+            ctrl->interface, strerror(-err), cooldown_ms);
+}
+
+/*
+ * 要求を送ってよいか判定する（呼び出し側でlock済み）
+ * OPENの間は-EHOSTDOWN。期限を過ぎていればPINGを1回送り（半開）、応答があれば閉じる
+ * lockを持っているので、半開の確認を行うのは1スレッドだけ
+ */
+static int hostapd_ctrl_admit(struct hostapd_ctrl *ctrl)
+{
+    int ret;
+
+    if (ctrl->breaker != HOSTAPD_BREAKER_CLOSED)
+    {
+        if (dpp_metrics_now() < ctrl->open_until_ns)
+        {
+            __atomic_fetch_add(&ctrl->fast_failures, 1, __ATOMIC_RELAXED);
+            return -EHOSTDOWN;
+        }
+
+        __atomic_store_n(&ctrl->breaker, HOSTAPD_BREAKER_HALF_OPEN, __ATOMIC_RELAXED);
+        ret = hostapd_ctrl_ping(&ctrl->dest_addr, hostapd_ctrl_probe_timeout_ms(ctrl));
+        if (ret < 0)
+        {
+            hostapd_ctrl_trip(ctrl, ret);
+            return -EHOSTDOWN;
+        }
+        DPP_LOG(DPP_LOG_CTRL, DPP_LOG_INFO, "%s: hostapd is responding again", ctrl->interface);
+        __atomic_store_n(&ctrl->breaker, HOSTAPD_BREAKER_CLOSED, __ATOMIC_RELAXED);
+        ctrl->cooldown_ms = 0;
+        ctrl->backoff = 0;
+
+        // 止まっている間にhostapdが再起動していればソケットが変わっている
+        if (ctrl->sock >= 0)
+            close(ctrl->sock);
+        ctrl->sock = -1;
+    }
+
+    if (ctrl->sock < 0 && hostapd_ctrl_connect(ctrl) < 0)
+    {
+        hostapd_ctrl_trip(ctrl, -ECONNREFUSED);
+        return -ECONNREFUSED;
+    }
     return 0;
 }
 
-// 16進数エンコーディング関数（hostapd用）
-static char *encode_hex_string_hostapd(const char *str)
+/*
+ * 送信して応答を待つ。タイムアウトしたら別のソケットからPINGを送って制御ソケットがあるか確かめる
+ * hostapdは1スレッドで処理するので、遅いコマンドの処理中はPINGにも応答しない。PONGを待たず
+ * 処理中とみなし、倍にしたタイムアウトの分だけ（上限まで）待ち、それでも応答がなければ
+ * ブレーカーを開いて失敗させる。固まったhostapdでも上限の5秒を毎回待たずに済む
+ */
+static int hostapd_ctrl_exchange(struct hostapd_ctrl *ctrl, const char *cmd, struct ctrl_rx *rx,
+                                 uint64_t start)
+{
+    bool retried = false;
+    uint64_t elapsed_ms;
+    int wait_ms;
+    int ret;
+
+    ret = hostapd_ctrl_transact(ctrl, cmd, rx, hostapd_ctrl_timeout_ms(ctrl));
+    if (ret == -ETIMEDOUT)
+    {
+        // 制御ソケットが無ければ終了・再起動しているので、下の再接続で確かめる
+        int probe = hostapd_ctrl_ping(&ctrl->dest_addr, 0);
+        if (hostapd_ctrl_disconnected(probe))
+        {
+            ret = probe;
+        }
+        else
+        {
+            ctrl->backoff++;
+            wait_ms = hostapd_ctrl_timeout_ms(ctrl);
+            elapsed_ms = (dpp_metrics_now() - start) / 1000000;
+            if (elapsed_ms + wait_ms > HOSTAPD_CTRL_TIMEOUT_MAX_MS)
+                wait_ms = elapsed_ms < HOSTAPD_CTRL_TIMEOUT_MAX_MS ?
+                          HOSTAPD_CTRL_TIMEOUT_MAX_MS - (int)elapsed_ms : 0;
+            if (wait_ms > 0)
+                ret = hostapd_ctrl_wait(ctrl, rx, wait_ms);
+            if (ret == -ETIMEDOUT)
+            {
+                hostapd_ctrl_trip(ctrl, ret);
+                return ret;
+            }
+        }
+    }
+
+    // hostapdが再起動するとソケットが作り直されるので一度だけ再接続して再送
+    if (hostapd_ctrl_disconnected(ret))
+    {
+        close(ctrl->sock);
+        ctrl->sock = -1;
+        retried = true;
+        if (hostapd_ctrl_connect(ctrl) == 0)
+            ret = hostapd_ctrl_transact(ctrl, cmd, rx, hostapd_ctrl_timeout_ms(ctrl));
+        if (hostapd_ctrl_disconnected(ret) || ret == -ETIMEDOUT)
+        {
+            hostapd_ctrl_trip(ctrl, ret);
+            return ret;
+        }
+    }
+
+    if (ret >= 0 && !retried)
+        hostapd_ctrl_rtt_sample(ctrl, dpp_metrics_now() - start);
+    return ret;
+}
+
+// 1要求を処理する（呼び出し側でlock済み）
+static int hostapd_ctrl_request_locked(struct hostapd_ctrl *ctrl, const char *cmd,
+                                       struct ctrl_rx *rx)
+{
+    uint64_t start, ns;
+    int ret;
+
+    start = dpp_metrics_now();
+    ret = hostapd_ctrl_admit(ctrl);
+    if (ret == 0)
+        ret = hostapd_ctrl_exchange(ctrl, cmd, rx, start);
+    ns = dpp_metrics_now() - start;
+
+    // 失敗した要求で待った時間（ブレーカーの効果はこの合計で見る）
+    if (ret < 0 && ret != -EMSGSIZE)
+        __atomic_fetch_add(&ctrl->lost_ns, ns, __ATOMIC_RELAXED);
+
+    // 待ち時間（lock待ち）を含めず、送信から応答までを記録する
+    dpp_metrics_command(cmd, ns, ret, rx->buf);
+    return ret;
+}
+
+static int hostapd_ctrl_request_rx(struct hostapd_ctrl *ctrl, const char *cmd,
+                                   struct ctrl_rx *rx)
+{
+    int ret;
+
+    pthread_mutex_lock(&ctrl->lock);
+    ret = hostapd_ctrl_request_locked(ctrl, cmd, rx);
+    pthread_mutex_unlock(&ctrl->lock);
+
+    return ret;
+}
+
+/*
+ * 永続接続でコマンドを送受信（複数スレッドから同時に呼び出し可能）
+ * 応答が response_size に収まらなければ -EMSGSIZE（大きな応答は hostapd_ctrl_request_reply）
+ */
+int hostapd_ctrl_request(struct hostapd_ctrl *ctrl, const char *cmd,
+                         char *response, size_t response_size)
+{
+    struct ctrl_rx rx = {response, response_size, false, false};
+
+    if (!ctrl || !cmd || !response || response_size == 0)
+        return -EINVAL;
+
+    response[0] = '\0';
+    return hostapd_ctrl_request_rx(ctrl, cmd, &rx);
+}
+
+/*
+ * 応答の大きさに合わせて受信する（STATUS、DPP_BOOTSTRAP_INFO など）
+ * 4 KiBまではreply内のバッファを使い、それを超える場合だけ確保する
+ * 使い終わったら hostapd_reply_free() を呼ぶ
+ */
+int hostapd_ctrl_request_reply(struct hostapd_ctrl *ctrl, const char *cmd,
+                               struct hostapd_reply *reply)
+{
+    struct ctrl_rx rx;
+    int ret;
+
+    if (!ctrl || !cmd || !reply)
+        return -EINVAL;
+
+    rx.buf = reply->buf ? reply->buf : reply->inline_buf;
+    rx.size = reply->buf ? reply->size : sizeof(reply->inline_buf);
+    rx.grow = true;
+    rx.heap = rx.buf != reply->inline_buf;
+    rx.buf[0] = '\0';
+
+    ret = hostapd_ctrl_request_rx(ctrl, cmd, &rx);
+    reply->buf = rx.buf;
+    reply->size = rx.size;
+    reply->len = ret > 0 ? (size_t)ret : 0;
+    reply->field_count = -1;
+    return ret;
+}
+
+void hostapd_reply_init(struct hostapd_reply *reply)
+{
+    reply->buf = NULL;
+    reply->size = 0;
+    reply->len = 0;
+    reply->field_count = -1;
+    reply->inline_buf[0] = '\0';
+}
+
+// 応答には鍵が含まれうるので消去してから解放する
+void hostapd_reply_free(struct hostapd_reply *reply)
+{
+    if (!reply->buf)
+        return;
+    memset(reply->buf, 0, reply->len);
+    if (reply->buf != reply->inline_buf)
+        free(reply->buf);
+    hostapd_reply_init(reply);
+}
+
+// キーのハッシュ（FNV-1a。索引作成時は'='を探しながら同じ計算をする）
+#define HOSTAPD_REPLY_HASH_INIT 2166136261u
+#define HOSTAPD_REPLY_HASH_PRIME 16777619u
+
+static uint32_t hostapd_reply_hash(const char *key, size_t len)
+{
+    uint32_t hash = HOSTAPD_REPLY_HASH_INIT;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (u8)key[i]) * HOSTAPD_REPLY_HASH_PRIME;
+    return hash;
+}
+
+/*
+ * key=value の行を一度だけ走査して索引を作る
+ * 値は改行を'\0'に置き換えてバッファ内を直接指す（以降 reply->buf は1行目だけの文字列になる）
+ * 索引に入らない行（HOSTAPD_REPLY_FIELDS超）は hostapd_reply_get() が線形に探す
+ * 戻り値: 索引に入れた行数
+ */
+int hostapd_reply_index(struct hostapd_reply *reply)
+{
+    char *p, *end;
+
+    if (reply->field_count >= 0)
+        return reply->field_count;
+
+    memset(reply->slots, 0, sizeof(reply->slots));
+    reply->field_count = 0;
+    reply->overflow = NULL;
+    if (!reply->buf)
+        return 0;
+
+    p = reply->buf;
+    end = reply->buf + reply->len;
+    while (p < end)
+    {
+        uint32_t hash = HOSTAPD_REPLY_HASH_INIT;
+        char *eq = p;
+        char *eol;
+
+        while (eq < end && *eq != '=' && *eq != '\n')
+            hash = (hash ^ (u8)*eq++) * HOSTAPD_REPLY_HASH_PRIME;
+        eol = eq < end && *eq == '=' ? memchr(eq, '\n', end - eq) : eq;
+        if (!eol)
+            eol = end;
+        *eol = '\0';
+
+        if (eq < eol && eq > p && reply->field_count == HOSTAPD_REPLY_FIELDS)
+        {
+            if (!reply->overflow)
+                reply->overflow = p;
+        }
+        else if (eq < eol && eq > p)
+        {
+            struct hostapd_reply_field *field = &reply->fields[reply->field_count];
+            uint32_t slot = hash % HOSTAPD_REPLY_SLOTS;
+
+            field->key = p;
+            field->key_len = eq - p;
+            field->value = eq + 1;
+            // 同じキーが複数あれば最初の行を返す
+            while (reply->slots[slot] &&
+                   !(reply->fields[reply->slots[slot] - 1].key_len == field->key_len &&
+                     memcmp(reply->fields[reply->slots[slot] - 1].key, p, field->key_len) == 0))
+                slot = (slot + 1) % HOSTAPD_REPLY_SLOTS;
+            if (!reply->slots[slot])
+                reply->slots[slot] = ++reply->field_count;
+        }
+        p = eol + 1;
+    }
+    return reply->field_count;
+}
+
+// キーの値（無ければNULL）。未索引なら先に hostapd_reply_index() を行う
+const char *hostapd_reply_get(struct hostapd_reply *reply, const char *key)
+{
+    size_t key_len = strlen(key);
+    uint32_t slot;
+
+    hostapd_reply_index(reply);
+
+    slot = hostapd_reply_hash(key, key_len) % HOSTAPD_REPLY_SLOTS;
+    while (reply->slots[slot])
+    {
+        const struct hostapd_reply_field *field = &reply->fields[reply->slots[slot] - 1];
+        if (field->key_len == key_len && memcmp(field->key, key, key_len) == 0)
+            return field->value;
+        slot = (slot + 1) % HOSTAPD_REPLY_SLOTS;
+    }
+
+    // 索引に入りきらなかった行（'\0'区切り）
+    for (const char *p = reply->overflow; p && p < reply->buf + reply->len; p += strlen(p) + 1)
+    {
+        if (strncmp(p, key, key_len) == 0 && p[key_len] == '=')
+            return p + key_len + 1;
+    }
+    return NULL;
+}
+
+int hostapd_reply_get_int(struct hostapd_reply *reply, const char *key, int def)
+{
+    const char *value = hostapd_reply_get(reply, key);
+
+    return value ? atoi(value) : def;
+}
+
+// 全接続をクローズ
+void hostapd_ctrl_close_all(void)
+{
+    struct hostapd_ctrl *ctrl, *next;
+
+    pthread_mutex_lock(&ctrl_list_lock);
+    for (ctrl = ctrl_list; ctrl; ctrl = next)
+    {
+        next = ctrl->next;
+        hostapd_ctrl_free(ctrl);
+    }
+    ctrl_list = NULL;
+    pthread_mutex_unlock(&ctrl_list_lock);
+}
+
+// 期限を過ぎたOPENは、次の要求で確認するので半開として扱う
+static enum hostapd_breaker_state hostapd_ctrl_state(struct hostapd_ctrl *ctrl, int *retry_ms)
 {
-    if (!str)
+    enum hostapd_breaker_state state = __atomic_load_n(&ctrl->breaker, __ATOMIC_RELAXED);
+    uint64_t now, open_until;
+
+    if (retry_ms)
+        *retry_ms = 0;
+    if (state == HOSTAPD_BREAKER_OPEN)
+    {
+        now = dpp_metrics_now();
+        open_until = __atomic_load_n(&ctrl->open_until_ns, __ATOMIC_RELAXED);
+        if (now >= open_until)
+            state = HOSTAPD_BREAKER_HALF_OPEN;
+        else if (retry_ms)
+            *retry_ms = (int)((open_until - now + 999999) / 1000000);
+    }
+    return state;
+}
+
+/*
+ * インスタンスのブレーカーの状態（接続したことがなければCLOSED）
+ * retry_ms: OPENの場合、半開で確認するまでの時間
+ */
+enum hostapd_breaker_state hostapd_ctrl_breaker(const char *interface, int *retry_ms)
+{
+    struct hostapd_ctrl *ctrl;
+
+    pthread_mutex_lock(&ctrl_list_lock);
+    for (ctrl = ctrl_list; ctrl; ctrl = ctrl->next)
+    {
+        if (strcmp(ctrl->interface, interface) == 0)
+            break;
+    }
+    pthread_mutex_unlock(&ctrl_list_lock);
+
+    if (!ctrl)
+    {
+        if (retry_ms)
+            *retry_ms = 0;
+        return HOSTAPD_BREAKER_CLOSED;
+    }
+    return hostapd_ctrl_state(ctrl, retry_ms);
+}
+
+/*
+ * 接続済みの全インスタンスへPINGを送る（デーモンのアイドル時）
+ * RTTの推定を更新し、止まったインスタンスのブレーカーを要求が来る前に開く。
+ * OPENのものは期限を過ぎていれば半開の確認だけを行う。要求を処理中のインスタンスは飛ばす
+ */
+void hostapd_ctrl_probe_all(void)
+{
+    struct hostapd_ctrl *ctrl;
+    char response[16];
+
+    pthread_mutex_lock(&ctrl_list_lock);
+    ctrl = ctrl_list;
+    pthread_mutex_unlock(&ctrl_list_lock);
+
+    // 接続はhostapd_ctrl_close_all()まで解放されず、先頭にだけ追加されるのでlockなしでたどれる
+    for (; ctrl; ctrl = ctrl->next)
+    {
+        struct ctrl_rx rx = {response, sizeof(response), false, false};
+
+        if (hostapd_ctrl_state(ctrl, NULL) == HOSTAPD_BREAKER_OPEN)
+            continue;
+        // 要求を処理中なら飛ばす。取れたlockはPINGの間保持し、要求側はその後に続く
+        if (pthread_mutex_trylock(&ctrl->lock) != 0)
+            continue;
+        hostapd_ctrl_request_locked(ctrl, "PING", &rx);
+        pthread_mutex_unlock(&ctrl->lock);
+    }
+}
+
+// インスタンスごとのRTT・タイムアウト・ブレーカーの状態（Prometheus形式、または要約）
+void hostapd_ctrl_write_health(FILE *fp, bool prometheus)
+{
+    static const char *const states[] = {
+        [HOSTAPD_BREAKER_CLOSED] = "closed",
+        [HOSTAPD_BREAKER_HALF_OPEN] = "half_open",
+        [HOSTAPD_BREAKER_OPEN] = "open",
+    };
+    struct hostapd_ctrl *head, *ctrl;
+
+    pthread_mutex_lock(&ctrl_list_lock);
+    head = ctrl_list;
+    pthread_mutex_unlock(&ctrl_list_lock);
+
+    if (prometheus)
+    {
+        fprintf(fp, "# HELP dpp_hostapd_rtt_seconds Smoothed control command round-trip time per hostapd instance.\n");
+        fprintf(fp, "# TYPE dpp_hostapd_rtt_seconds gauge\n");
+        for (ctrl = head; ctrl; ctrl = ctrl->next)
+            fprintf(fp, "dpp_hostapd_rtt_seconds{interface=\"%s\"} %.6f\n", ctrl->interface,
+                    __atomic_load_n(&ctrl->srtt_us, __ATOMIC_RELAXED) / 1e6);
+
+        fprintf(fp, "# HELP dpp_hostapd_breaker_state Circuit breaker state (0 closed, 1 half-open, 2 open).\n");
+        fprintf(fp, "# TYPE dpp_hostapd_breaker_state gauge\n");
+        for (ctrl = head; ctrl; ctrl = ctrl->next)
+            fprintf(fp, "dpp_hostapd_breaker_state{interface=\"%s\"} %d\n", ctrl->interface,
+                    (int)hostapd_ctrl_state(ctrl, NULL));
+
+        fprintf(fp, "# HELP dpp_hostapd_breaker_opens_total Times the circuit breaker opened.\n");
+        fprintf(fp, "# TYPE dpp_hostapd_breaker_opens_total counter\n");
+        for (ctrl = head; ctrl; ctrl = ctrl->next)
+            fprintf(fp, "dpp_hostapd_breaker_opens_total{interface=\"%s\"} %llu\n", ctrl->interface,
+                    (unsigned long long)__atomic_load_n(&ctrl->breaker_opens, __ATOMIC_RELAXED));
+
+        fprintf(fp, "# HELP dpp_hostapd_fast_failures_total Commands failed without sending while the breaker was open.\n");
+        fprintf(fp, "# TYPE dpp_hostapd_fast_failures_total counter\n");
+        for (ctrl = head; ctrl; ctrl = ctrl->next)
+            fprintf(fp, "dpp_hostapd_fast_failures_total{interface=\"%s\"} %llu\n", ctrl->interface,
+                    (unsigned long long)__atomic_load_n(&ctrl->fast_failures, __ATOMIC_RELAXED));
+
+        fprintf(fp, "# HELP dpp_hostapd_lost_seconds_total Time spent waiting on failed control commands.\n");
+        fprintf(fp, "# TYPE dpp_hostapd_lost_seconds_total counter\n");
+        for (ctrl = head; ctrl; ctrl = ctrl->next)
+            fprintf(fp, "dpp_hostapd_lost_seconds_total{interface=\"%s\"} %.6f\n", ctrl->interface,
+                    __atomic_load_n(&ctrl->lost_ns, __ATOMIC_RELAXED) / 1e9);
+        return;
+    }
+
+    if (!head)
+        return;
+    fprintf(fp, "\n%-26s %10s %10s %10s %10s %10s\n", "hostapd instance", "rtt ms", "state",
+            "opens", "fast fail", "lost s");
+    for (ctrl = head; ctrl; ctrl = ctrl->next)
+    {
+        fprintf(fp, "%-26s %10.3f %10s %10llu %10llu %10.3f\n", ctrl->interface,
+                __atomic_load_n(&ctrl->srtt_us, __ATOMIC_RELAXED) / 1e3,
+                states[hostapd_ctrl_state(ctrl, NULL)],
+                (unsigned long long)__atomic_load_n(&ctrl->breaker_opens, __ATOMIC_RELAXED),
+                (unsigned long long)__atomic_load_n(&ctrl->fast_failures, __ATOMIC_RELAXED),
+                __atomic_load_n(&ctrl->lost_ns, __ATOMIC_RELAXED) / 1e9);
+    }
+}
+
+// イベント受信用の接続を開いてATTACHする（キャッシュせず呼び出し側が所有）
+struct hostapd_ctrl *hostapd_ctrl_open_monitor(const char *interface)
+{
+    struct hostapd_ctrl *ctrl;
+    char response[64];
+    int ret;
+
+    if (!interface)
         return NULL;
 
-    size_t len = strlen(str);
-    char *hex_str = malloc(len * 2 + 1);
-    if (!hex_str)
+    pthread_mutex_lock(&ctrl_list_lock);
+    ctrl = hostapd_ctrl_open(interface);
+    pthread_mutex_unlock(&ctrl_list_lock);
+    if (!ctrl)
         return NULL;
 
-    for (size_t i = 0; i < len; i++)
+    ret = hostapd_ctrl_request(ctrl, "ATTACH", response, sizeof(response));
+    if (ret < 0 || strncmp(response, "OK", 2) != 0)
     {
-        snprintf(hex_str + i * 2, 3, "%02x", (unsigned char)str[i]);
+        dpp_printf("Error: Failed to attach to hostapd event monitor on %s\n", interface);
+        hostapd_ctrl_free(ctrl);
+        return NULL;
     }
-    hex_str[len * 2] = '\0';
 
-    printf("DEBUG: Encoded '%s' -> '%s'\n", str, hex_str);
-    return hex_str;
+    return ctrl;
+}
+
+/*
+ * 非同期イベントを1つ受信する
+ * 戻り値: 受信したバイト数、タイムアウト時は0、エラー時は負のerrno
+ * timeout_ms < 0 の場合はイベントが届くまで待ち続ける
+ */
+int hostapd_ctrl_recv_event(struct hostapd_ctrl *ctrl, char *buf, size_t buf_size,
+                            int timeout_ms)
+{
+    struct pollfd pfd;
+    ssize_t len;
+    int ret;
+
+    if (!ctrl || !buf || buf_size == 0)
+        return -EINVAL;
+
+    pfd.fd = ctrl->sock;
+    pfd.events = POLLIN;
+    do
+    {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return -errno;
+    if (ret == 0)
+        return 0;
+
+    len = recv(ctrl->sock, buf, buf_size - 1, 0);
+    if (len < 0)
+        return -errno;
+    buf[len] = '\0';
+    return (int)len;
 }
+
+// イベント受信用の接続をDETACHしてクローズ
+void hostapd_ctrl_close(struct hostapd_ctrl *ctrl)
+{
+    char response[64];
+
+    if (!ctrl)
+        return;
+
+    hostapd_ctrl_request(ctrl, "DETACH", response, sizeof(response));
+    hostapd_ctrl_free(ctrl);
+}
+
+// hostapd制御ソケット通信
+int hostapd_cli_send_command(const char *interface, const char *cmd,
+                             char *response, size_t response_size)
+{
+    struct hostapd_ctrl *ctrl;
+    int ret;
+
+    ctrl = hostapd_ctrl_get(interface);
+    if (!ctrl)
+    {
+        return -1;
+    }
+
+    // コマンド送信（パスワード等はログ出力時に伏せられる）
+    DPP_LOG(DPP_LOG_CTRL, DPP_LOG_DEBUG, "%s <- %s", interface, cmd);
+    ret = hostapd_ctrl_request(ctrl, cmd, response, response_size);
+    if (ret == -EHOSTDOWN)
+    {
+        int retry_ms;
+
+        hostapd_ctrl_breaker(interface, &retry_ms);
+        dpp_printf("Error: hostapd on %s is not responding (next check in %d ms)\n", interface,
+                   retry_ms);
+        return -1;
+    }
+    else if (ret == -ETIMEDOUT)
+    {
+        dpp_printf("Error: Timeout waiting for response from hostapd\n");
+        dpp_printf("hostapd may not be running or may not support the command\n");
+        return -1;
+    }
+    else if (ret < 0)
+    {
+        dpp_printf("Error: Failed to communicate with hostapd: %s\n", strerror(-ret));
+        return -1;
+    }
+
+    DPP_LOG(DPP_LOG_CTRL, DPP_LOG_DEBUG, "%s -> (%d bytes) %s", interface, ret, response);
+    return 0;
+}
+
@@ -0,0 +1,552 @@
+/*
+ * DPP Configurator - Bulk Import Command
+ * Streaming import of DPP URIs from CSV/JSONL manufacturer manifests
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/dpp_configurator.h"
+
+#define IMPORT_WINDOW_SIZE (16 * 1024 * 1024) // 一度に処理するファイル範囲
+#define IMPORT_DEFAULT_BATCH 4096
+#define IMPORT_MAX_THREADS 64
+
+enum import_format
+{
+    IMPORT_FORMAT_AUTO,
+    IMPORT_FORMAT_CSV,
+    IMPORT_FORMAT_JSONL,
+};
+
+enum import_status
+{
+    IMPORT_OK,
+    IMPORT_SKIP, // 空行・コメント・CSVヘッダー
+    IMPORT_ERR_NO_URI,
+    IMPORT_ERR_UNTERMINATED,
+    IMPORT_ERR_ESCAPED,
+    IMPORT_ERR_URI,       // URIの解析・検証エラー（詳細はuri_status）
+    IMPORT_ERR_DUPLICATE, // 公開鍵が登録済み、またはインポート内で重複
+};
+
+static const char *import_status_str[] = {
+    [IMPORT_OK] = "OK",
+    [IMPORT_SKIP] = "skipped",
+    [IMPORT_ERR_NO_URI] = "no DPP URI found",
+    [IMPORT_ERR_UNTERMINATED] = "unterminated quoted field",
+    [IMPORT_ERR_ESCAPED] = "escaped characters in URI are not supported",
+    [IMPORT_ERR_URI] = "invalid DPP URI",
+    [IMPORT_ERR_DUPLICATE] = "public key already registered",
+};
+
+// 1行の処理結果（uriはmmap領域を直接指す）
+struct import_result
+{
+    const char *uri;
+    uint32_t uri_len;
+    uint32_t line;   // ワーカー担当範囲内での行番号（0始まり）
+    uint32_t column; // URI開始位置（1始まり）、URIのエラーはその位置
+    uint8_t status;
+    uint8_t uri_status;
+    u8 pubkey_hash[SHA256_MAC_LEN];
+};
+
+struct import_worker
+{
+    pthread_t thread;
+    const char *start;
+    const char *end;
+    enum import_format format;
+    bool first_chunk; // ファイル先頭を含む（CSVヘッダー判定用）
+    struct dpp_uri_ctx *uri_ctx;
+    struct import_result *results;
+    size_t count;
+    size_t capacity;
+    uint32_t lines;
+    bool failed; // 結果を保存できなかった（メモリ不足）
+};
+
+// JSONL行から "DPP:..." の文字列値を取り出す
+static enum import_status import_extract_jsonl(const char *line, const char *eol,
+                                               const char **uri, size_t *uri_len)
+{
+    const char *pos = line;
+    const char *close;
+
+    while ((pos = memchr(pos, '"', eol - pos)) != NULL)
+    {
+        pos++;
+        if (eol - pos >= 4 && memcmp(pos, "DPP:", 4) == 0)
+        {
+            close = pos;
+            while (close < eol && *close != '"')
+            {
+                if (*close == '\\')
+                    return IMPORT_ERR_ESCAPED;
+                close++;
+            }
+            if (close >= eol)
+                return IMPORT_ERR_UNTERMINATED;
+            *uri = pos;
+            *uri_len = close - pos;
+            return IMPORT_OK;
+        }
+    }
+
+    return IMPORT_ERR_NO_URI;
+}
+
+// CSV行から "DPP:" で始まる最初のフィールドを取り出す
+static enum import_status import_extract_csv(const char *line, const char *eol,
+                                             const char **uri, size_t *uri_len)
+{
+    const char *pos = line;
+    const char *field, *field_end;
+
+    while (pos <= eol)
+    {
+        if (pos < eol && *pos == '"')
+        {
+            field = pos + 1;
+            field_end = memchr(field, '"', eol - field);
+            if (!field_end)
+                return IMPORT_ERR_UNTERMINATED;
+            pos = memchr(field_end, ',', eol - field_end);
+        }
+        else
+        {
+            field = pos;
+            field_end = memchr(field, ',', eol - field);
+            if (!field_end)
+                field_end = eol;
+            pos = field_end;
+        }
+
+        if (field_end - field >= 4 && memcmp(field, "DPP:", 4) == 0)
+        {
+            *uri = field;
+            *uri_len = field_end - field;
+            return IMPORT_OK;
+        }
+
+        if (!pos)
+            break;
+        pos++; // ','
+    }
+
+    return IMPORT_ERR_NO_URI;
+}
+
+static int import_push_result(struct import_worker *w, const struct import_result *r)
+{
+    if (w->count == w->capacity)
+    {
+        size_t capacity = w->capacity ? w->capacity * 2 : 4096;
+        struct import_result *results = realloc(w->results, capacity * sizeof(*results));
+        if (!results)
+            return -1;
+        w->results = results;
+        w->capacity = capacity;
+    }
+    w->results[w->count++] = *r;
+    return 0;
+}
+
+// ワーカー: 担当範囲の各行からURIを取り出して検証
+static void *import_worker_thread(void *arg)
+{
+    struct import_worker *w = arg;
+    const char *line = w->start;
+    const char *eol;
+    struct import_result r;
+    enum import_format format;
+    size_t uri_len;
+
+    w->count = 0;
+    w->lines = 0;
+    w->failed = false;
+
+    while (line < w->end)
+    {
+        eol = memchr(line, '\n', w->end - line);
+        if (!eol)
+            eol = w->end;
+
+        memset(&r, 0, sizeof(r));
+        r.line = w->lines++;
+
+        const char *trimmed_eol = eol;
+        if (trimmed_eol > line && trimmed_eol[-1] == '\r')
+            trimmed_eol--;
+
+        if (trimmed_eol == line || line[0] == '#')
+        {
+            line = eol + 1;
+            continue;
+        }
+
+        format = w->format;
+        if (format == IMPORT_FORMAT_AUTO)
+            format = line[0] == '{' ? IMPORT_FORMAT_JSONL : IMPORT_FORMAT_CSV;
+
+        if (format == IMPORT_FORMAT_JSONL)
+            r.status = import_extract_jsonl(line, trimmed_eol, &r.uri, &uri_len);
+        else
+            r.status = import_extract_csv(line, trimmed_eol, &r.uri, &uri_len);
+
+        if (r.status == IMPORT_OK)
+        {
+            struct dpp_uri parsed;
+
+            r.uri_len = (uint32_t)uri_len;
+            r.column = (uint32_t)(r.uri - line) + 1;
+            r.uri_status = dpp_uri_parse(w->uri_ctx, r.uri, uri_len, &parsed);
+            if (r.uri_status != DPP_URI_OK)
+            {
+                r.status = IMPORT_ERR_URI;
+                r.column += (uint32_t)parsed.error_offset;
+            }
+            else
+            {
+                memcpy(r.pubkey_hash, parsed.pubkey_hash, SHA256_MAC_LEN);
+            }
+        }
+        else if (r.status == IMPORT_ERR_NO_URI && w->first_chunk && r.line == 0 &&
+                 format == IMPORT_FORMAT_CSV)
+        {
+            r.status = IMPORT_SKIP; // CSVヘッダー行
+        }
+
+        if (r.status != IMPORT_SKIP && import_push_result(w, &r) < 0)
+        {
+            w->failed = true;
+            break;
+        }
+
+        line = eol + 1;
+    }
+
+    return NULL;
+}
+
+/*
+ * バッチ内の公開鍵の重複検出（batchの添字を値とするオープンアドレス法、空きは-1）
+ * 戻り値: 同じ鍵を持つ添字。無ければ-1で、*slotに登録先の空きスロットを返す
+ */
+static int import_batch_find(const int *table, size_t mask,
+                             const struct dpp_bootstrap_record *batch, const u8 *hash,
+                             size_t *slot)
+{
+    size_t i = WPA_GET_BE32(hash + 4) & mask;
+
+    while (table[i] >= 0)
+    {
+        if (memcmp(batch[table[i]].pubkey_hash, hash, SHA256_MAC_LEN) == 0)
+            return table[i];
+        i = (i + 1) & mask;
+    }
+    *slot = i;
+    return -1;
+}
+
+// posから後ろで最初の行頭を探す
+static const char *import_next_line(const char *pos, const char *end)
+{
+    const char *eol = memchr(pos, '\n', end - pos);
+
+    return eol ? eol + 1 : end;
+}
+
+// import コマンド: マニフェストをストリーム処理してBootstrap情報を一括登録
+int cmd_import(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *file = dpp_arg(args, "file");
+    const char *format_str = dpp_arg(args, "format");
+    const char *interface = dpp_arg(args, "interface");
+    enum import_format format = IMPORT_FORMAT_AUTO;
+    struct import_worker workers[IMPORT_MAX_THREADS];
+    bool started[IMPORT_MAX_THREADS];
+    struct dpp_bootstrap_record *batch = NULL;
+    size_t batch_size = IMPORT_DEFAULT_BATCH;
+    size_t batch_count = 0;
+    int *seen = NULL;
+    size_t seen_size = 1;
+    int num_threads;
+    int fd = -1;
+    struct stat st;
+    const char *map = MAP_FAILED;
+    const char *window, *window_end, *map_end;
+    uint64_t line_base = 1;
+    uint64_t imported = 0, errors = 0;
+    int next_id = 0;
+    int first_id = 0, last_id = 0;
+    bool locked = false;
+    struct timespec t_start, t_end;
+    double elapsed;
+    int ret = -1;
+    int i;
+
+    memset(workers, 0, sizeof(workers));
+
+    if (!file)
+    {
+        dpp_printf("Error: file parameter required\n");
+        dpp_printf("Usage: import file=<path> [format=auto|csv|jsonl] [threads=<n>] [batch=<n>] [interface=<ifname>]\n");
+        goto cleanup;
+    }
+
+    if (format_str)
+    {
+        if (strcmp(format_str, "csv") == 0)
+            format = IMPORT_FORMAT_CSV;
+        else if (strcmp(format_str, "jsonl") == 0)
+            format = IMPORT_FORMAT_JSONL;
+        else if (strcmp(format_str, "auto") != 0)
+        {
+            dpp_printf("Error: Unknown format: %s (use auto, csv or jsonl)\n", format_str);
+            goto cleanup;
+        }
+    }
+
+    num_threads = dpp_arg_int(args, "threads", (int)sysconf(_SC_NPROCESSORS_ONLN));
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > IMPORT_MAX_THREADS)
+        num_threads = IMPORT_MAX_THREADS;
+
+    if (dpp_arg_int(args, "batch", 0) > 0)
+        batch_size = dpp_arg_int(args, "batch", 0);
+
+    while (seen_size < batch_size * 2)
+        seen_size *= 2;
+    batch = malloc(batch_size * sizeof(*batch));
+    seen = malloc(seen_size * sizeof(*seen));
+    if (!batch || !seen)
+        goto cleanup;
+    memset(seen, 0xff, seen_size * sizeof(*seen));
+
+    // 公開鍵の検証に使うOpenSSLのオブジェクトはワーカーごとに持つ
+    for (i = 0; i < num_threads; i++)
+    {
+        workers[i].uri_ctx = dpp_uri_ctx_new();
+        if (!workers[i].uri_ctx)
+            goto cleanup;
+    }
+
+    fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        dpp_printf("Error: Cannot open %s: %s\n", file, strerror(errno));
+        goto cleanup;
+    }
+    if (st.st_size == 0)
+    {
+        dpp_printf("Nothing to import: %s is empty\n", file);
+        ret = 0;
+        goto cleanup;
+    }
+
+    // ファイル全体をマップするが、読み込みはウィンドウ単位で行い処理後に解放する
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        dpp_printf("Error: mmap failed for %s: %s\n", file, strerror(errno));
+        goto cleanup;
+    }
+    madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+    map_end = map + st.st_size;
+
+    dpp_printf("Importing %s (%lld bytes, %d threads, batch %zu)\n",
+               file, (long long)st.st_size, num_threads, batch_size);
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    for (window = map; window < map_end; window = window_end)
+    {
+        size_t window_len = map_end - window;
+        if (window_len > IMPORT_WINDOW_SIZE)
+            window_end = import_next_line(window + IMPORT_WINDOW_SIZE, map_end);
+        else
+            window_end = map_end;
+
+        // ウィンドウを行境界でスレッド数に分割
+        const char *chunk = window;
+        size_t chunk_len = (window_end - window) / num_threads + 1;
+        for (i = 0; i < num_threads; i++)
+        {
+            workers[i].start = chunk;
+            if (i == num_threads - 1 || (size_t)(window_end - chunk) <= chunk_len)
+                workers[i].end = window_end;
+            else
+                workers[i].end = import_next_line(chunk + chunk_len, window_end);
+            workers[i].format = format;
+            workers[i].first_chunk = (chunk == map);
+            chunk = workers[i].end;
+        }
+
+        for (i = 0; i < num_threads; i++)
+        {
+            started[i] = pthread_create(&workers[i].thread, NULL,
+                                        import_worker_thread, &workers[i]) == 0;
+            if (!started[i])
+                import_worker_thread(&workers[i]); // スレッドを作れなければその場で処理
+        }
+        for (i = 0; i < num_threads; i++)
+        {
+            if (started[i])
+                pthread_join(workers[i].thread, NULL);
+        }
+        // 途中の行を落としたまま取り込まないよう、ウィンドウごと失敗にする
+        for (i = 0; i < num_threads; i++)
+        {
+            if (workers[i].failed)
+            {
+                dpp_printf("Error: Out of memory while validating %s\n", file);
+                goto cleanup;
+            }
+        }
+
+        /*
+         * 重複の確認からIDの採番・保存まではウィンドウごとに状態ファイルを排他する
+         * （同時に動くdpp_qr_codeや他のプロセスのimportと同じIDを使わない）
+         */
+        if (dpp_state_lock() < 0)
+        {
+            dpp_printf("Error: Failed to lock state file\n");
+            goto cleanup;
+        }
+        locked = true;
+        next_id = load_bootstrap_max_id() + 1;
+
+        // ファイル順に結果を確定し、バッチ単位で状態ファイルへ書き込む
+        for (i = 0; i < num_threads; i++)
+        {
+            struct import_worker *w = &workers[i];
+            for (size_t j = 0; j < w->count; j++)
+            {
+                struct import_result *r = &w->results[j];
+                if (r->status != IMPORT_OK)
+                {
+                    dpp_printf("%s:%llu:%u: error: %s\n", file,
+                               (unsigned long long)(line_base + r->line),
+                               r->column ? r->column : 1,
+                               r->status == IMPORT_ERR_URI ? dpp_uri_status_str(r->uri_status)
+                                                           : import_status_str[r->status]);
+                    errors++;
+                    continue;
+                }
+
+                // 重複はバッチ内（未保存）と保存済みの索引（先のバッチを含む）の両方を見る
+                size_t slot = 0;
+                int dup = import_batch_find(seen, seen_size - 1, batch, r->pubkey_hash, &slot);
+                int dup_id = dup >= 0 ? batch[dup].id : lookup_bootstrap_key(r->pubkey_hash);
+                if (dup_id >= 0)
+                {
+                    dpp_printf("%s:%llu:%u: error: %s (bootstrap ID %d)\n", file,
+                               (unsigned long long)(line_base + r->line), r->column,
+                               import_status_str[IMPORT_ERR_DUPLICATE], dup_id);
+                    errors++;
+                    continue;
+                }
+
+                seen[slot] = (int)batch_count;
+                batch[batch_count].id = next_id++;
+                batch[batch_count].uri = r->uri;
+                batch[batch_count].uri_len = r->uri_len;
+                batch[batch_count].pubkey_hash = r->pubkey_hash;
+                if (++batch_count == batch_size)
+                {
+                    if (save_bootstrap_batch(batch, batch_count) < 0)
+                    {
+                        dpp_printf("Error: Failed to save bootstrap batch\n");
+                        goto cleanup;
+                    }
+                    if (interface)
+                        dpp_peer_sync_queue(interface, batch[0].id, batch[batch_count - 1].id);
+                    if (imported == 0)
+                        first_id = batch[0].id;
+                    last_id = batch[batch_count - 1].id;
+                    imported += batch_count;
+                    batch_count = 0;
+                    memset(seen, 0xff, seen_size * sizeof(*seen));
+                }
+            }
+            line_base += w->lines;
+        }
+
+        if (batch_count > 0)
+        {
+            if (save_bootstrap_batch(batch, batch_count) < 0)
+            {
+                dpp_printf("Error: Failed to save bootstrap batch\n");
+                goto cleanup;
+            }
+            // 保存したバッチは検証と並行してhostapdへ事前登録する
+            if (interface)
+                dpp_peer_sync_queue(interface, batch[0].id, batch[batch_count - 1].id);
+            if (imported == 0)
+                first_id = batch[0].id;
+            last_id = batch[batch_count - 1].id;
+            imported += batch_count;
+            batch_count = 0;
+            memset(seen, 0xff, seen_size * sizeof(*seen));
+        }
+        dpp_state_unlock();
+        locked = false;
+
+        // 処理済みウィンドウのページを解放
+        madvise((void *)window, window_end - window, MADV_DONTNEED);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    elapsed = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
+    ctx->bootstrap_count += (int)imported;
+    if (imported > 0)
+        dpp_printf("Imported %llu bootstrap entries (IDs %d-%d), %llu errors\n",
+                   (unsigned long long)imported, first_id, last_id, (unsigned long long)errors);
+    else
+        dpp_printf("Imported 0 bootstrap entries, %llu errors\n", (unsigned long long)errors);
+    dpp_printf("Elapsed: %.3f s, throughput: %.0f URIs/s\n",
+               elapsed, elapsed > 0 ? imported / elapsed : 0.0);
+    ret = errors ? -1 : 0;
+
+    if (interface && imported > 0)
+    {
+        if (dpp_peer_sync_background())
+        {
+            dpp_printf("Registering peers with hostapd on %s in the background\n", interface);
+        }
+        else
+        {
+            dpp_printf("Waiting for peer registration with hostapd on %s...\n", interface);
+            dpp_peer_sync_wait();
+            clock_gettime(CLOCK_MONOTONIC, &t_end);
+            dpp_printf("Peers registered, total elapsed: %.3f s\n",
+                       (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) / 1e9);
+        }
+    }
+
+cleanup:
+    if (locked)
+        dpp_state_unlock();
+    for (i = 0; i < IMPORT_MAX_THREADS; i++)
+    {
+        free(workers[i].results);
+        dpp_uri_ctx_free(workers[i].uri_ctx);
+    }
+    if (map != MAP_FAILED)
+        munmap((void *)map, st.st_size);
+    if (fd >= 0)
+        close(fd);
+    free(batch);
+    free(seen);
+    return ret;
+}
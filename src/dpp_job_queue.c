@@ -0,0 +1,1030 @@
+/*
+ * DPP Configurator - Provisioning Job Queue
+ * Persistent queue of pending enrollees, drained by one session per
+ * interface that starts the next DPP_AUTH_INIT as soon as the previous
+ * exchange ends
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "../include/dpp_configurator.h"
+
+#define MAX_EVENT_SIZE 4096
+#define JOB_MAX_INTERFACES 16
+#define JOB_DEFAULT_TIMEOUT 30     // 1台あたりの待ち時間（秒）
+#define JOB_DEFAULT_ATTEMPTS 5
+#define JOB_BACKOFF_BASE_MS 5000
+#define JOB_BACKOFF_MAX_MS 300000
+#define JOB_RESCAN_MS 1000         // 他のプロセス・クライアントが追加したジョブを探す間隔
+#define JOB_MAX_HANDOFFS 3         // hostapdが応答しないとき試行に数えずに他へ回す回数
+#define JOB_META_ID 0              // "<次のジョブID> <最初の未完了ジョブID>"
+
+enum dpp_job_status
+{
+    DPP_JOB_PENDING,
+    DPP_JOB_DONE,
+    DPP_JOB_FAILED, // 再試行しない（上限に達した・互換性がない）
+};
+
+// 失敗の分類（再試行するかどうかを決める）
+enum dpp_job_failure
+{
+    DPP_JOB_FAILURE_NONE,
+    DPP_JOB_FAILURE_HOSTAPD,        // DPP_AUTH_INITを送れなかった
+    DPP_JOB_FAILURE_TIMEOUT,        // 終了イベントが届かなかった（圏外・応答の遅い端末）
+    DPP_JOB_FAILURE_AUTH_INIT,      // DPP-AUTH-INIT-FAILED
+    DPP_JOB_FAILURE_NOT_COMPATIBLE, // DPP-NOT-COMPATIBLE
+    DPP_JOB_FAILURE_CONF,           // DPP-CONF-FAILED
+    DPP_JOB_FAILURE_OTHER,          // DPP-FAIL など
+    DPP_JOB_FAILURES
+};
+
+static const struct
+{
+    const char *name;
+    bool retry;
+} job_failures[DPP_JOB_FAILURES] = {
+    [DPP_JOB_FAILURE_NONE] = {"-", false},
+    [DPP_JOB_FAILURE_HOSTAPD] = {"hostapd", true},
+    [DPP_JOB_FAILURE_TIMEOUT] = {"timeout", true},
+    [DPP_JOB_FAILURE_AUTH_INIT] = {"auth-init-failed", true},
+    // 端末の能力（役割・曲線）が合わないので、何度やり直しても成功しない
+    [DPP_JOB_FAILURE_NOT_COMPATIBLE] = {"not-compatible", false},
+    [DPP_JOB_FAILURE_CONF] = {"conf-failed", true},
+    [DPP_JOB_FAILURE_OTHER] = {"failed", true},
+};
+
+static const char *const job_status_names[] = {"pending", "done", "failed"};
+
+struct dpp_job
+{
+    int id;
+    enum dpp_job_status status;
+    int peer_id;
+    int configurator_id;
+    int attempts;
+    int max_attempts;
+    uint64_t retry_at;     // 次に試せる時刻（UNIX時間のミリ秒、再起動後も有効）
+    char interface[64];    // 空なら任意のインターフェース
+    char template_name[64]; // 空ならテンプレートなし
+    enum dpp_job_failure failure;
+    char *params;
+    bool active;  // いずれかのセッションで処理中
+    int handoffs; // 試行に数えずに他のインターフェースへ回した回数（保存しない）
+};
+
+struct job_queue;
+
+// インターフェースごとのセッション（hostapdは同時に1つのDPP認証しか行わない）
+struct job_session
+{
+    struct job_queue *queue;
+    char interface[108];
+    struct hostapd_ctrl *monitor;
+    pthread_t thread;
+    bool started;
+
+    unsigned int succeeded;
+    unsigned int failed;
+    unsigned int retried;
+};
+
+struct job_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct dpp_job **jobs; // 処理中のジョブを指したまま追加・削除できるようにポインタで持つ
+    size_t len;
+    int next_id;  // 読み込み済みの範囲（これ未満のIDは読み込んだ）
+    int first_open;
+    uint64_t scanned_ms;
+    bool stop;
+    bool until_idle;  // 処理できるジョブが無くなったら終了（job_run）
+    bool unreachable; // どのインターフェースのhostapdも応答しないので終了した
+    bool background;  // 結果をprintfではなくログへ（デーモン）
+    FILE *out;        // セッションのスレッドの出力先（起動したコマンドのもの）
+    struct dpp_configurator_ctx *ctx;
+    int timeout_ms;
+
+    struct job_session sessions[JOB_MAX_INTERFACES];
+    int session_count;
+};
+
+static pthread_mutex_t job_runner_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct job_queue *job_runner; // 実行中のキュー（同時に1つだけ）
+
+static uint64_t job_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void job_report(struct job_queue *queue, enum dpp_log_level level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void job_report(struct job_queue *queue, enum dpp_log_level level, const char *fmt, ...)
+{
+    char line[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (queue->background)
+        DPP_LOG(DPP_LOG_PROVISION, level, "%s", line);
+    else
+    {
+        dpp_printf("%s\n", line);
+        fflush(dpp_output());
+    }
+}
+
+static void job_meta_load(int *next_id, int *first_open)
+{
+    char meta[32];
+
+    *next_id = 1;
+    *first_open = 1;
+    if (dpp_state_read(DPP_STATE_JOB, JOB_META_ID, meta, sizeof(meta)) >= 0)
+        sscanf(meta, "%d %d", next_id, first_open);
+}
+
+// 採番用のレコードの読み書きはdpp_state_lock()中に行い、解放する前にコミットする
+static int job_meta_append(int next_id, int first_open)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%d %d", next_id, first_open);
+
+    return dpp_state_append(DPP_STATE_JOB, JOB_META_ID, buf, len) ? 0 : -1;
+}
+
+// "<status> <peer> <configurator> <attempts> <max> <retry_at> <interface|-> <template|-> <failure>\n<params>"
+static int job_save(const struct dpp_job *job)
+{
+    char head[256];
+    char *buf;
+    size_t head_len, params_len = strlen(job->params);
+    uint64_t seq;
+
+    head_len = snprintf(head, sizeof(head), "%s %d %d %d %d %llu %s %s %s\n",
+                        job_status_names[job->status], job->peer_id, job->configurator_id,
+                        job->attempts, job->max_attempts, (unsigned long long)job->retry_at,
+                        job->interface[0] ? job->interface : "-",
+                        job->template_name[0] ? job->template_name : "-",
+                        job_failures[job->failure].name);
+    buf = malloc(head_len + params_len);
+    if (!buf)
+        return -1;
+    memcpy(buf, head, head_len);
+    memcpy(buf + head_len, job->params, params_len);
+    seq = dpp_state_append(DPP_STATE_JOB, job->id, buf, head_len + params_len);
+    free(buf);
+    return seq ? 0 : -1;
+}
+
+static int job_parse(int id, const char *data, struct dpp_job *job)
+{
+    char status[16], failure[32];
+    unsigned long long retry_at;
+    const char *params;
+    int i;
+
+    memset(job, 0, sizeof(*job));
+    job->id = id;
+    if (sscanf(data, "%15s %d %d %d %d %llu %63s %63s %31s", status, &job->peer_id,
+               &job->configurator_id, &job->attempts, &job->max_attempts, &retry_at,
+               job->interface, job->template_name, failure) != 9)
+        return -1;
+    params = strchr(data, '\n');
+    if (!params)
+        return -1;
+    job->params = strdup(params + 1);
+    if (!job->params)
+        return -1;
+    job->retry_at = retry_at;
+    if (strcmp(job->interface, "-") == 0)
+        job->interface[0] = '\0';
+    if (strcmp(job->template_name, "-") == 0)
+        job->template_name[0] = '\0';
+
+    job->status = DPP_JOB_PENDING;
+    for (i = 0; i < (int)(sizeof(job_status_names) / sizeof(job_status_names[0])); i++)
+    {
+        if (strcmp(status, job_status_names[i]) == 0)
+            job->status = i;
+    }
+    for (i = 0; i < DPP_JOB_FAILURES; i++)
+    {
+        if (strcmp(failure, job_failures[i].name) == 0)
+            job->failure = i;
+    }
+    return 0;
+}
+
+static enum dpp_job_failure job_classify(const char *event_name)
+{
+    switch (dpp_metrics_event_result(event_name))
+    {
+    case DPP_METRICS_RESULT_AUTH_INIT_FAILED:
+        return DPP_JOB_FAILURE_AUTH_INIT;
+    case DPP_METRICS_RESULT_NOT_COMPATIBLE:
+        return DPP_JOB_FAILURE_NOT_COMPATIBLE;
+    case DPP_METRICS_RESULT_CONF_FAILED:
+        return DPP_JOB_FAILURE_CONF;
+    default:
+        return DPP_JOB_FAILURE_OTHER;
+    }
+}
+
+/*
+ * 再試行までの待ち時間（指数バックオフ、上限あり）
+ * 半分を固定、残り半分をランダムにして、同時に失敗した端末の再試行が重ならないようにする
+ */
+static uint64_t job_backoff_ms(int attempts, unsigned int *seed)
+{
+    uint64_t delay = JOB_BACKOFF_BASE_MS;
+    int i;
+
+    for (i = 1; i < attempts && delay < JOB_BACKOFF_MAX_MS; i++)
+        delay *= 2;
+    if (delay > JOB_BACKOFF_MAX_MS)
+        delay = JOB_BACKOFF_MAX_MS;
+    return delay / 2 + (uint64_t)rand_r(seed) % (delay / 2 + 1);
+}
+
+/*
+ * 前回以降に追加されたジョブを読み込む（ロックを保持して呼ぶ）
+ * 他のクライアントや -n で起動したプロセスが追加したジョブもここで見つかる
+ */
+static void job_queue_scan(struct job_queue *queue)
+{
+    int next_id, first_open, id;
+
+    job_meta_load(&next_id, &first_open);
+    if (queue->next_id == 0)
+        queue->next_id = first_open;
+    for (id = queue->next_id; id < next_id; id++)
+    {
+        char *data = dpp_state_get(DPP_STATE_JOB, id);
+        struct dpp_job job, *copy;
+        int parsed = data ? job_parse(id, data, &job) : -1;
+
+        free(data);
+        if (parsed < 0)
+            continue;
+        if (job.status != DPP_JOB_PENDING)
+        {
+            free(job.params);
+            continue;
+        }
+        if ((queue->len & (queue->len - 1)) == 0)
+        {
+            struct dpp_job **tmp = realloc(queue->jobs,
+                                           (queue->len ? queue->len * 2 : 1) * sizeof(*tmp));
+            if (!tmp)
+            {
+                free(job.params);
+                break;
+            }
+            queue->jobs = tmp;
+        }
+        copy = malloc(sizeof(*copy));
+        if (!copy)
+        {
+            free(job.params);
+            break;
+        }
+        *copy = job;
+        queue->jobs[queue->len++] = copy;
+    }
+    if (id > queue->next_id)
+        queue->next_id = id;
+    queue->first_open = first_open;
+    queue->scanned_ms = job_now_ms();
+}
+
+/*
+ * 完了したジョブを解放し、最初の未完了IDを返す（ロックを保持して呼ぶ）
+ * 未読み込みのIDは未完了かもしれないので、読み込み済みの範囲を超えない
+ */
+static int job_queue_prune(struct job_queue *queue)
+{
+    int open = queue->next_id;
+    size_t i, kept = 0;
+
+    for (i = 0; i < queue->len; i++)
+    {
+        struct dpp_job *job = queue->jobs[i];
+
+        if (job->status == DPP_JOB_PENDING)
+        {
+            if (job->id < open)
+                open = job->id;
+            queue->jobs[kept++] = job;
+        }
+        else
+        {
+            free(job->params);
+            free(job);
+        }
+    }
+    queue->len = kept;
+    return open;
+}
+
+/*
+ * 先頭から続く完了済みジョブを読み飛ばせるように、最初の未完了IDを進める
+ * 他のプロセスのjob_addと同時に採番用のレコードを書き換えないよう、状態ファイルを排他する
+ */
+static void job_meta_advance(int open)
+{
+    int next_id, first_open;
+
+    if (dpp_state_lock() < 0)
+        return;
+    job_meta_load(&next_id, &first_open);
+    if (open > first_open && job_meta_append(next_id, open) == 0)
+        dpp_state_commit();
+    dpp_state_unlock();
+}
+
+static bool job_eligible(const struct job_session *session, const struct dpp_job *job)
+{
+    return job->status == DPP_JOB_PENDING && !job->active &&
+           (!job->interface[0] || strcmp(job->interface, session->interface) == 0);
+}
+
+// 応答が見込めるインターフェースがあるか（exceptを除く。jobを指定すればそのジョブを扱えるもの）
+static bool job_queue_reachable(const struct job_queue *queue, const struct job_session *except,
+                                const struct dpp_job *job)
+{
+    int s;
+
+    for (s = 0; s < queue->session_count; s++)
+    {
+        const struct job_session *session = &queue->sessions[s];
+
+        if (session == except)
+            continue;
+        if (job && job->interface[0] && strcmp(job->interface, session->interface) != 0)
+            continue;
+        if (hostapd_ctrl_breaker(session->interface, NULL) != HOSTAPD_BREAKER_OPEN)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * 次に処理するジョブを選ぶ（試せる時刻になったもののうちID順で最初）
+ * 待ち時間中のジョブは飛ばすので、再試行待ちの端末が後ろの端末を止めることはない
+ */
+static struct dpp_job *job_next(struct job_session *session)
+{
+    struct job_queue *queue = session->queue;
+    struct dpp_job *job = NULL;
+    struct timespec ts;
+    uint64_t now, wake;
+    bool waiting;
+    size_t i;
+
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->stop)
+    {
+        now = job_now_ms();
+        if (now - queue->scanned_ms >= JOB_RESCAN_MS)
+            job_queue_scan(queue);
+
+        // ブレーカーが開いている間は取らない（他のインターフェースに任せる）
+        if (hostapd_ctrl_breaker(session->interface, NULL) != HOSTAPD_BREAKER_OPEN)
+        {
+            for (i = 0; i < queue->len; i++)
+            {
+                if (job_eligible(session, queue->jobs[i]) && queue->jobs[i]->retry_at <= now)
+                {
+                    job = queue->jobs[i];
+                    break;
+                }
+            }
+        }
+        if (job)
+        {
+            job->active = true;
+            break;
+        }
+
+        wake = now + JOB_RESCAN_MS;
+        waiting = false;
+        for (i = 0; i < queue->len; i++)
+        {
+            const struct dpp_job *pending = queue->jobs[i];
+            if (pending->active)
+                waiting = true;
+            else if (job_eligible(session, pending))
+            {
+                waiting = true;
+                if (pending->retry_at < wake)
+                    wake = pending->retry_at;
+            }
+        }
+        if (!waiting && queue->until_idle)
+            break;
+
+        // job_run: どのhostapdも応答しなければ、残りのジョブは次回に持ち越して終了する
+        if (queue->until_idle && !job_queue_reachable(queue, NULL, NULL))
+        {
+            queue->unreachable = true;
+            pthread_cond_broadcast(&queue->cond);
+            break;
+        }
+
+        ts.tv_sec = wake / 1000;
+        ts.tv_nsec = (long)(wake % 1000) * 1000000;
+        pthread_cond_timedwait(&queue->cond, &queue->lock, &ts);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+// 結果を記録し、失敗なら分類に応じて再試行の時刻を決める
+static void job_finish(struct job_session *session, struct dpp_job *job,
+                       enum dpp_job_failure failure, uint64_t elapsed_ms, unsigned int *seed)
+{
+    struct job_queue *queue = session->queue;
+    uint64_t delay = 0;
+    int open = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    job->failure = failure;
+    if (failure == DPP_JOB_FAILURE_NONE)
+    {
+        job->status = DPP_JOB_DONE;
+        session->succeeded++;
+    }
+    else if (job_failures[failure].retry && job->attempts < job->max_attempts)
+    {
+        delay = job_backoff_ms(job->attempts, seed);
+        job->retry_at = job_now_ms() + delay;
+        session->retried++;
+    }
+    else
+    {
+        job->status = DPP_JOB_FAILED;
+        session->failed++;
+    }
+    job->active = false;
+    job_save(job);
+
+    if (job->status == DPP_JOB_DONE)
+        job_report(queue, DPP_LOG_INFO, "[%s] job %d (peer %d): ✓ configured (%llums)",
+                   session->interface, job->id, job->peer_id, (unsigned long long)elapsed_ms);
+    else if (job->status == DPP_JOB_PENDING)
+        job_report(queue, DPP_LOG_WARN,
+                   "[%s] job %d (peer %d): ✗ %s (%llums), retry %d/%d in %.1f s",
+                   session->interface, job->id, job->peer_id, job_failures[failure].name,
+                   (unsigned long long)elapsed_ms, job->attempts + 1, job->max_attempts,
+                   delay / 1000.0);
+    else
+        job_report(queue, DPP_LOG_WARN, "[%s] job %d (peer %d): ✗ %s after %d attempt%s",
+                   session->interface, job->id, job->peer_id, job_failures[failure].name,
+                   job->attempts, job->attempts == 1 ? "" : "s");
+
+    // 完了したジョブはここで解放される
+    if (job->status != DPP_JOB_PENDING)
+        open = job_queue_prune(queue);
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    dpp_state_commit();
+    if (open > 0)
+        job_meta_advance(open);
+}
+
+// 完了（Configuration送信）または失敗のイベントを待つ
+static enum dpp_job_failure job_wait(struct job_session *session,
+                                     struct dpp_metrics_attempt *attempt)
+{
+    struct job_queue *queue = session->queue;
+    enum dpp_event_kind kind;
+    char event[MAX_EVENT_SIZE];
+    uint64_t deadline = job_now_ms() + queue->timeout_ms;
+    uint64_t now;
+    const char *name;
+    int ret, wait_ms;
+
+    while ((now = job_now_ms()) < deadline && !queue->stop)
+    {
+        // 停止要求に気付けるように区切って待つ
+        wait_ms = (int)(deadline - now);
+        if (wait_ms > JOB_RESCAN_MS)
+            wait_ms = JOB_RESCAN_MS;
+        ret = hostapd_ctrl_recv_event(session->monitor, event, sizeof(event), wait_ms);
+        if (ret < 0)
+        {
+            dpp_metrics_attempt_end(attempt, DPP_METRICS_RESULT_MONITOR_ERROR);
+            return DPP_JOB_FAILURE_HOSTAPD;
+        }
+        if (ret == 0)
+            continue;
+
+        kind = dpp_event_classify(event, &name);
+        dpp_metrics_attempt_event(attempt, kind, name);
+        if (kind == DPP_EVENT_KIND_CONF_SENT)
+            return DPP_JOB_FAILURE_NONE;
+        if (kind == DPP_EVENT_KIND_FAILED)
+            return job_classify(name);
+    }
+
+    dpp_metrics_attempt_end(attempt, DPP_METRICS_RESULT_TIMEOUT);
+    return DPP_JOB_FAILURE_TIMEOUT;
+}
+
+static void *job_session_worker(void *arg)
+{
+    struct job_session *session = arg;
+    struct job_queue *queue = session->queue;
+    char event[MAX_EVENT_SIZE];
+    struct dpp_metrics_attempt attempt;
+    enum dpp_job_failure failure;
+    struct dpp_job *job;
+    // セッションごとに異なる系列にする（同時に失敗したジョブの再試行を分散させる）
+    unsigned int seed = (unsigned int)job_now_ms() * 2654435761u ^
+                        (unsigned int)(session - queue->sessions + 1) * 0x9e3779b9u;
+    uint64_t start;
+
+    dpp_output_set(queue->out);
+    while ((job = job_next(session)) != NULL)
+    {
+        // 前のセッションの残りのイベントを捨てる
+        while (hostapd_ctrl_recv_event(session->monitor, event, sizeof(event), 0) > 0)
+            ;
+
+        // 試行回数は開始前に保存する（途中で停止しても数えられる）
+        pthread_mutex_lock(&queue->lock);
+        job->attempts++;
+        job_save(job);
+        pthread_mutex_unlock(&queue->lock);
+        dpp_state_commit();
+
+        start = job_now_ms();
+        dpp_metrics_attempt_start(&attempt);
+        if (dpp_auth_start(queue->ctx, session->interface, job->peer_id, job->configurator_id,
+                           job->params, true) < 0)
+        {
+            dpp_metrics_attempt_total(&attempt);
+            /*
+             * hostapdが応答しないなら試行に数えず、すぐに他のインターフェースへ渡す
+             * 受け取れるインターフェースが無い・回した回数が上限に達したら試行に数える
+             * （半開の確認に失敗し続けるジョブが上限に達せず回り続けないように）
+             */
+            bool handoff = false;
+
+            if (hostapd_ctrl_breaker(session->interface, NULL) == HOSTAPD_BREAKER_OPEN)
+            {
+                pthread_mutex_lock(&queue->lock);
+                if (job->handoffs < JOB_MAX_HANDOFFS && job_queue_reachable(queue, session, job))
+                {
+                    handoff = true;
+                    job->handoffs++;
+                    job->attempts--;
+                    job->active = false;
+                    job_save(job);
+                    pthread_cond_broadcast(&queue->cond);
+                }
+                pthread_mutex_unlock(&queue->lock);
+            }
+            if (handoff)
+            {
+                job_report(queue, DPP_LOG_WARN,
+                           "[%s] job %d (peer %d): ↪ hostapd not responding, handed to another interface",
+                           session->interface, job->id, job->peer_id);
+                continue;
+            }
+            job_finish(session, job, DPP_JOB_FAILURE_HOSTAPD, job_now_ms() - start, &seed);
+            continue;
+        }
+        dpp_metrics_attempt_initiated(&attempt);
+
+        // 終了イベントが届いたらすぐ次のジョブのDPP_AUTH_INITへ進む
+        failure = job_wait(session, &attempt);
+        if (queue->stop && failure == DPP_JOB_FAILURE_TIMEOUT)
+        {
+            // 停止による中断は失敗に数えない
+            pthread_mutex_lock(&queue->lock);
+            job->attempts--;
+            job->active = false;
+            job_save(job);
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        job_finish(session, job, failure, job_now_ms() - start, &seed);
+    }
+
+    dpp_state_commit();
+    return NULL;
+}
+
+static void job_queue_free(struct job_queue *queue)
+{
+    size_t i;
+    int s;
+
+    for (s = 0; s < queue->session_count; s++)
+        hostapd_ctrl_close(queue->sessions[s].monitor);
+    for (i = 0; i < queue->len; i++)
+    {
+        free(queue->jobs[i]->params);
+        free(queue->jobs[i]);
+    }
+    free(queue->jobs);
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
+
+// インターフェースごとにイベント監視を開き、セッションを起動する
+static struct job_queue *job_queue_start(struct dpp_configurator_ctx *ctx, const char *interfaces,
+                                         int timeout_ms, bool until_idle, bool background)
+{
+    struct job_queue *queue;
+    char *list, *tok, *saveptr;
+    int s;
+
+    pthread_mutex_lock(&job_runner_lock);
+    if (job_runner)
+    {
+        pthread_mutex_unlock(&job_runner_lock);
+        dpp_printf("Error: The job queue is already being processed%s\n",
+                   job_runner->background ? " by the daemon" : "");
+        return NULL;
+    }
+
+    queue = calloc(1, sizeof(*queue));
+    list = strdup(interfaces);
+    if (!queue || !list)
+    {
+        free(queue);
+        free(list);
+        pthread_mutex_unlock(&job_runner_lock);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->ctx = ctx;
+    queue->timeout_ms = timeout_ms;
+    queue->until_idle = until_idle;
+    queue->background = background;
+    queue->out = dpp_output();
+
+    for (tok = strtok_r(list, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr))
+    {
+        struct job_session *session;
+
+        if (queue->session_count == JOB_MAX_INTERFACES)
+        {
+            dpp_printf("Error: At most %d interfaces are supported\n", JOB_MAX_INTERFACES);
+            goto fail;
+        }
+        session = &queue->sessions[queue->session_count];
+        session->queue = queue;
+        snprintf(session->interface, sizeof(session->interface), "%s", tok);
+        // DPP_AUTH_INITより前にATTACHしておく
+        session->monitor = hostapd_ctrl_open_monitor(session->interface);
+        if (!session->monitor)
+            goto fail;
+        queue->session_count++;
+    }
+    free(list);
+    list = NULL;
+    if (queue->session_count == 0)
+        goto fail;
+
+    pthread_mutex_lock(&queue->lock);
+    job_queue_scan(queue);
+    pthread_mutex_unlock(&queue->lock);
+
+    for (s = 0; s < queue->session_count; s++)
+    {
+        struct job_session *session = &queue->sessions[s];
+        session->started = pthread_create(&session->thread, NULL, job_session_worker, session) == 0;
+        if (!session->started)
+            dpp_printf("Warning: Failed to start session for %s\n", session->interface);
+    }
+    job_runner = queue;
+    pthread_mutex_unlock(&job_runner_lock);
+    return queue;
+
+fail:
+    free(list);
+    job_queue_free(queue);
+    pthread_mutex_unlock(&job_runner_lock);
+    return NULL;
+}
+
+static void job_queue_join(struct job_queue *queue)
+{
+    int s;
+
+    for (s = 0; s < queue->session_count; s++)
+    {
+        if (queue->sessions[s].started)
+            pthread_join(queue->sessions[s].thread, NULL);
+    }
+
+    pthread_mutex_lock(&job_runner_lock);
+    job_runner = NULL;
+    pthread_mutex_unlock(&job_runner_lock);
+}
+
+// デーモン: キューの処理をバックグラウンドで開始（ジョブが無くなっても待ち続ける）
+int dpp_job_queue_start(struct dpp_configurator_ctx *ctx, const char *interfaces)
+{
+    struct job_queue *queue = job_queue_start(ctx, interfaces, JOB_DEFAULT_TIMEOUT * 1000, false,
+                                              true);
+
+    if (!queue)
+        return -1;
+    DPP_LOG(DPP_LOG_PROVISION, DPP_LOG_INFO, "job queue running on %s (%zu pending)",
+            interfaces, queue->len);
+    return 0;
+}
+
+// 処理中の認証の終了を待たずに止める（中断したジョブは次回に持ち越す）
+void dpp_job_queue_stop(void)
+{
+    struct job_queue *queue;
+
+    pthread_mutex_lock(&job_runner_lock);
+    queue = job_runner;
+    pthread_mutex_unlock(&job_runner_lock);
+    if (!queue)
+        return;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->stop = true;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    job_queue_join(queue);
+    dpp_state_commit();
+    job_queue_free(queue);
+}
+
+// job_add コマンド: ピアごとにジョブを追加する
+int cmd_job_add(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *peers_str = dpp_arg(args, "peers");
+    const char *interface = dpp_arg(args, "interface");
+    const char *conf_type = dpp_arg(args, "conf");
+    const char *ssid = dpp_arg(args, "ssid");
+    const char *pass = dpp_arg(args, "pass");
+    const char *matter_pin = dpp_arg(args, "matter_pin");
+    const char *conf_json = dpp_arg(args, "conf_json");
+    const char *template_name = dpp_arg(args, "template");
+    const char *discriminator = dpp_arg(args, "discriminator");
+    char params[DPP_AUTH_PARAMS_MAX];
+    struct dpp_job job;
+    int *peers = NULL;
+    size_t peer_count = 0, i;
+    int next_id, first_open;
+    int ret = -1;
+
+    (void)ctx;
+
+    if (!peers_str || (!conf_type && !conf_json && !template_name))
+    {
+        dpp_printf("Error: peers and conf (or conf_json, template) parameters required\n");
+        dpp_printf("Usage: job_add peers=<from-to|id,id,...> [configurator=<id>] conf=<type> [ssid=<ssid>] "
+                   "[pass=<pass>] [matter_pin=<pin>] [conf_json=\"<json>\"] [template=<name> [discriminator=<n>]] "
+                   "[interface=<ifname>] [attempts=<n>]\n");
+        return -1;
+    }
+    if (discriminator && !template_name)
+    {
+        dpp_printf("Error: discriminator requires a template\n");
+        return -1;
+    }
+    if ((interface && strlen(interface) >= sizeof(job.interface)) ||
+        (template_name && strlen(template_name) >= sizeof(job.template_name)))
+    {
+        dpp_printf("Error: interface or template name too long\n");
+        return -1;
+    }
+
+    // テンプレートはここで端末ごとの値を差し込んだ設定にしておく
+    if (template_name)
+    {
+        const struct dpp_template *tmpl = dpp_template_get(template_name);
+        int len;
+
+        if (!tmpl)
+            return -1;
+        len = dpp_template_render(tmpl, matter_pin, discriminator, params, sizeof(params));
+        dpp_template_release(tmpl);
+        if (len < 0)
+        {
+            dpp_printf("Error: Cannot build configuration from template (check matter_pin/discriminator)\n");
+            return -1;
+        }
+    }
+    else if (dpp_auth_build_params(conf_type, ssid, pass, matter_pin, conf_json,
+                                   params, sizeof(params)) < 0)
+        return -1;
+
+    peers = provision_parse_peers(peers_str, &peer_count);
+    if (!peers || peer_count == 0)
+    {
+        dpp_printf("Error: Invalid peers list: %s\n", peers_str);
+        goto cleanup;
+    }
+    for (i = 0; i < peer_count; i++)
+    {
+        if (lookup_bootstrap_uri(peers[i], NULL, 0) < 0)
+        {
+            dpp_printf("Error: Bootstrap ID %d not found\n", peers[i]);
+            goto cleanup;
+        }
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.status = DPP_JOB_PENDING;
+    job.configurator_id = dpp_arg_int(args, "configurator", 1);
+    job.max_attempts = dpp_arg_int(args, "attempts", JOB_DEFAULT_ATTEMPTS);
+    if (job.max_attempts < 1)
+        job.max_attempts = 1;
+    job.retry_at = 0;
+    if (interface)
+        strcpy(job.interface, interface);
+    if (template_name)
+        strcpy(job.template_name, template_name);
+    job.params = params;
+
+    /*
+     * IDの採番とジョブの追記は1回のコミットにまとめる
+     * 他のプロセスのjob_addが同じIDを使わないよう、読み込みからコミットまで状態ファイルを排他する
+     */
+    if (dpp_state_lock() == 0)
+    {
+        job_meta_load(&next_id, &first_open);
+        for (i = 0; i < peer_count; i++)
+        {
+            job.id = next_id + (int)i;
+            job.peer_id = peers[i];
+            if (job_save(&job) < 0)
+                break;
+        }
+        if (i == peer_count && job_meta_append(next_id + (int)peer_count, first_open) == 0 &&
+            dpp_state_commit() == 0)
+            ret = 0;
+        dpp_state_unlock();
+    }
+
+    if (ret < 0)
+    {
+        dpp_printf("Error: Failed to save jobs\n");
+        goto cleanup;
+    }
+    if (peer_count == 1)
+        dpp_printf("Queued job %d\n", next_id);
+    else
+        dpp_printf("Queued %zu jobs (%d-%d)\n", peer_count, next_id, next_id + (int)peer_count - 1);
+
+cleanup:
+    free(peers);
+    return ret;
+}
+
+// job_list コマンド: 未完了（status=all で全て）のジョブを表示する
+int cmd_job_list(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *status = dpp_arg(args, "status");
+    unsigned int counts[3] = {0, 0, 0};
+    uint64_t now = job_now_ms();
+    int next_id, first_open, id;
+    bool all;
+
+    (void)ctx;
+
+    if (!status)
+        status = "pending";
+    all = strcmp(status, "all") == 0;
+    if (!all && strcmp(status, "pending") != 0 && strcmp(status, "done") != 0 &&
+        strcmp(status, "failed") != 0)
+    {
+        dpp_printf("Error: Unknown status: %s (use pending, done, failed or all)\n", status);
+        return -1;
+    }
+
+    job_meta_load(&next_id, &first_open);
+    dpp_printf("%-6s %-6s %-8s %-8s %-12s %-16s %s\n", "Job", "Peer", "Status", "Attempts",
+               "Interface", "Last failure", "Next try");
+    // 未完了のジョブだけなら完了済みの先頭部分を読み飛ばせる
+    for (id = strcmp(status, "pending") == 0 ? first_open : 1; id < next_id; id++)
+    {
+        char *data = dpp_state_get(DPP_STATE_JOB, id);
+        struct dpp_job job;
+        char attempts[16], next_try[24];
+        int parsed = data ? job_parse(id, data, &job) : -1;
+
+        free(data);
+        if (parsed < 0)
+            continue;
+        counts[job.status]++;
+        if (all || strcmp(status, job_status_names[job.status]) == 0)
+        {
+            snprintf(attempts, sizeof(attempts), "%d/%d", job.attempts, job.max_attempts);
+            if (job.status != DPP_JOB_PENDING)
+                snprintf(next_try, sizeof(next_try), "-");
+            else if (job.retry_at <= now)
+                snprintf(next_try, sizeof(next_try), "now");
+            else
+                snprintf(next_try, sizeof(next_try), "in %.1f s", (job.retry_at - now) / 1000.0);
+            dpp_printf("%-6d %-6d %-8s %-8s %-12s %-16s %s\n", job.id, job.peer_id,
+                       job_status_names[job.status], attempts, job.interface[0] ? job.interface : "any",
+                       job_failures[job.failure].name, next_try);
+        }
+        free(job.params);
+    }
+    if (strcmp(status, "pending") == 0)
+        dpp_printf("%u pending\n", counts[DPP_JOB_PENDING]);
+    else
+        dpp_printf("%u pending, %u done, %u failed\n", counts[DPP_JOB_PENDING], counts[DPP_JOB_DONE],
+                   counts[DPP_JOB_FAILED]);
+    return 0;
+}
+
+// job_run コマンド: 処理できるジョブが無くなるまでキューを処理する
+int cmd_job_run(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *interfaces = dpp_arg(args, "interfaces");
+    const char *ctrl_dir = dpp_arg(args, "ctrl_dir");
+    struct job_queue *queue;
+    unsigned int succeeded = 0, failed = 0, retried = 0;
+    uint64_t start, elapsed_ms;
+    int timeout_ms = JOB_DEFAULT_TIMEOUT * 1000;
+    size_t pending;
+    int s, ret;
+
+    if (!interfaces)
+    {
+        dpp_printf("Error: interfaces parameter required\n");
+        dpp_printf("Usage: job_run interfaces=<if1,if2,...> [timeout=<seconds per device>] [ctrl_dir=<dir>]\n");
+        return -1;
+    }
+    if (dpp_arg_int(args, "timeout", 0) > 0)
+        timeout_ms = dpp_arg_int(args, "timeout", 0) * 1000;
+    if (ctrl_dir)
+        hostapd_ctrl_set_dir(ctrl_dir);
+
+    start = job_now_ms();
+    queue = job_queue_start(ctx, interfaces, timeout_ms, true, false);
+    if (!queue)
+    {
+        if (ctrl_dir)
+            hostapd_ctrl_set_dir(NULL);
+        return -1;
+    }
+    pthread_mutex_lock(&queue->lock);
+    pending = queue->len;
+    pthread_mutex_unlock(&queue->lock);
+    dpp_printf("Processing %zu pending jobs on %d interfaces\n", pending, queue->session_count);
+    fflush(dpp_output());
+
+    job_queue_join(queue);
+    elapsed_ms = job_now_ms() - start;
+
+    dpp_printf("\nJob queue summary:\n");
+    for (s = 0; s < queue->session_count; s++)
+    {
+        struct job_session *session = &queue->sessions[s];
+        dpp_printf("  %-24s %u configured, %u failed, %u retries\n", session->interface,
+                   session->succeeded, session->failed, session->retried);
+        succeeded += session->succeeded;
+        failed += session->failed;
+        retried += session->retried;
+    }
+    dpp_printf("  Total: %u configured, %u failed, %u retries in %.1f s (%.1f devices/min)\n",
+               succeeded, failed, retried, elapsed_ms / 1000.0,
+               elapsed_ms ? succeeded * 60000.0 / elapsed_ms : 0.0);
+    ret = failed ? -1 : 0;
+
+    // 試行に使えるhostapdが無くなって打ち切った場合、残ったジョブは次回に持ち越す
+    if (queue->unreachable)
+    {
+        pending = 0;
+        for (size_t i = 0; i < queue->len; i++)
+            pending += queue->jobs[i]->status == DPP_JOB_PENDING;
+        dpp_printf("  Stopped: no interface reachable (hostapd not responding), %zu job%s left pending\n",
+                   pending, pending == 1 ? "" : "s");
+        ret = -1;
+    }
+
+    job_queue_free(queue);
+    if (ctrl_dir)
+        hostapd_ctrl_set_dir(NULL);
+    return ret;
+}
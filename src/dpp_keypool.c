@@ -0,0 +1,266 @@
+/*
+ * DPP Configurator - Protocol Key Pool
+ * Bounded per-curve pools of pregenerated ephemeral protocol keys, refilled
+ * by background threads and handed out by dpp_gen_keypair() during auth init
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../include/dpp_configurator.h"
+
+#define KEYPOOL_MAX_CURVES 6
+#define KEYPOOL_MAX_SIZE 4096
+
+/*
+ * hostapdのdpp_gen_keypair()はリンク時に -Wl,--wrap=dpp_gen_keypair で
+ * __wrap_dpp_gen_keypair() に置き換わり、元の関数は __real_dpp_gen_keypair() になる
+ */
+struct crypto_ec_key *__real_dpp_gen_keypair(const struct dpp_curve_params *curve);
+struct crypto_ec_key *__wrap_dpp_gen_keypair(const struct dpp_curve_params *curve);
+
+// 曲線ごとのプール（取り出した鍵は呼び出し側のものになり、二度と渡さない）
+struct keypool_curve
+{
+    const struct dpp_curve_params *curve;
+    struct crypto_ec_key **keys; // size個のリングバッファ
+    int head;
+    int count;
+    pthread_t refill_thread;
+    bool refill_started;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t refill; // 空きができた・停止する
+    struct keypool_curve curves[KEYPOOL_MAX_CURVES];
+    int curve_count;
+    int size;
+    bool running;
+} keypool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+// このスレッドのdpp_gen_keypair()をプールから取るか
+static __thread bool keypool_attached;
+
+static struct keypool_curve *keypool_find(const struct dpp_curve_params *curve)
+{
+    for (int i = 0; i < keypool.curve_count; i++)
+    {
+        if (keypool.curves[i].curve == curve)
+            return &keypool.curves[i];
+    }
+    return NULL;
+}
+
+// 空きがある間は鍵を作り足す（鍵の生成中はロックを持たない）
+static void *keypool_refill_thread(void *arg)
+{
+    struct keypool_curve *pool = arg;
+    struct sched_param param = {0};
+
+    // 補充はCPUが空いているときだけ行い、セッションのスレッドを待たせない
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0)
+        DPP_LOG(DPP_LOG_AUTH, DPP_LOG_DEBUG, "key pool refill thread runs at normal priority");
+
+    pthread_mutex_lock(&keypool.lock);
+    while (keypool.running)
+    {
+        struct crypto_ec_key *key;
+
+        if (pool->count >= keypool.size)
+        {
+            pthread_cond_wait(&keypool.refill, &keypool.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&keypool.lock);
+        key = __real_dpp_gen_keypair(pool->curve);
+        pthread_mutex_lock(&keypool.lock);
+        if (!key)
+        {
+            DPP_LOG(DPP_LOG_AUTH, DPP_LOG_WARN, "failed to generate %s protocol key",
+                    pool->curve->name);
+            break;
+        }
+        if (!keypool.running || pool->count >= keypool.size)
+        {
+            crypto_ec_key_deinit(key);
+            continue;
+        }
+        pool->keys[(pool->head + pool->count) % keypool.size] = key;
+        pool->count++;
+    }
+    pthread_mutex_unlock(&keypool.lock);
+    return NULL;
+}
+
+/*
+ * プロトコル鍵の生成をプールからの取り出しに置き換える
+ * プールを使うのはdpp_keypool_attach()したスレッドだけで、Configuratorの署名鍵や
+ * ブートストラップ鍵、プールが空のときは従来どおりその場で生成する
+ */
+struct crypto_ec_key *__wrap_dpp_gen_keypair(const struct dpp_curve_params *curve)
+{
+    struct keypool_curve *pool;
+    struct crypto_ec_key *key = NULL;
+
+    if (!keypool_attached || !curve)
+        return __real_dpp_gen_keypair(curve);
+
+    pthread_mutex_lock(&keypool.lock);
+    pool = keypool.running ? keypool_find(curve) : NULL;
+    if (pool && pool->count > 0)
+    {
+        key = pool->keys[pool->head];
+        pool->keys[pool->head] = NULL;
+        pool->head = (pool->head + 1) % keypool.size;
+        pool->count--;
+        pool->hits++;
+        pthread_cond_broadcast(&keypool.refill);
+    }
+    else if (pool)
+    {
+        pool->misses++;
+    }
+    pthread_mutex_unlock(&keypool.lock);
+
+    return key ? key : __real_dpp_gen_keypair(curve);
+}
+
+void dpp_keypool_attach(bool attach)
+{
+    keypool_attached = attach;
+}
+
+// curves（カンマ区切り）ごとにsize個の鍵を作ってから補充スレッドを起動する
+int dpp_keypool_start(const char *curves, int size)
+{
+    char *list, *token, *saveptr = NULL;
+    int ret = 0;
+    int i;
+
+    if (size <= 0 || size > KEYPOOL_MAX_SIZE)
+    {
+        dpp_printf("Error: Key pool size must be between 1 and %d\n", KEYPOOL_MAX_SIZE);
+        return -1;
+    }
+    if (keypool.running)
+    {
+        dpp_printf("Error: Key pool is already running\n");
+        return -1;
+    }
+    list = strdup(curves);
+    if (!list)
+        return -1;
+
+    keypool.size = size;
+    keypool.curve_count = 0;
+    for (token = strtok_r(list, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr))
+    {
+        const struct dpp_curve_params *curve = dpp_get_curve_name(token);
+        struct keypool_curve *pool;
+
+        if (!curve)
+        {
+            dpp_printf("Error: Unknown curve: %s\n", token);
+            ret = -1;
+            break;
+        }
+        if (keypool_find(curve))
+            continue;
+        if (keypool.curve_count >= KEYPOOL_MAX_CURVES)
+            break;
+        pool = &keypool.curves[keypool.curve_count];
+        memset(pool, 0, sizeof(*pool));
+        pool->curve = curve;
+        pool->keys = calloc(size, sizeof(*pool->keys));
+        if (!pool->keys)
+        {
+            ret = -1;
+            break;
+        }
+        keypool.curve_count++;
+
+        // 最初のセッションから使えるよう、先に満杯にしておく
+        while (pool->count < size)
+        {
+            struct crypto_ec_key *key = __real_dpp_gen_keypair(curve);
+            if (!key)
+            {
+                ret = -1;
+                break;
+            }
+            pool->keys[pool->count++] = key;
+        }
+        if (ret < 0)
+            break;
+    }
+    free(list);
+
+    keypool.running = true;
+    for (i = 0; ret == 0 && i < keypool.curve_count; i++)
+    {
+        struct keypool_curve *pool = &keypool.curves[i];
+        pool->refill_started = pthread_create(&pool->refill_thread, NULL, keypool_refill_thread,
+                                              pool) == 0;
+        if (!pool->refill_started)
+            ret = -1;
+    }
+    if (ret < 0)
+    {
+        dpp_keypool_stop();
+        return -1;
+    }
+    DPP_LOG(DPP_LOG_AUTH, DPP_LOG_INFO, "protocol key pool started: %d curve(s), %d keys each",
+            keypool.curve_count, size);
+    return 0;
+}
+
+// 補充スレッドを止め、使われなかった鍵を破棄する
+void dpp_keypool_stop(void)
+{
+    int i;
+
+    pthread_mutex_lock(&keypool.lock);
+    keypool.running = false;
+    pthread_cond_broadcast(&keypool.refill);
+    pthread_mutex_unlock(&keypool.lock);
+
+    for (i = 0; i < keypool.curve_count; i++)
+    {
+        struct keypool_curve *pool = &keypool.curves[i];
+
+        if (pool->refill_started)
+            pthread_join(pool->refill_thread, NULL);
+        pool->refill_started = false;
+        while (pool->count > 0)
+        {
+            crypto_ec_key_deinit(pool->keys[pool->head]);
+            pool->head = (pool->head + 1) % keypool.size;
+            pool->count--;
+        }
+        free(pool->keys);
+        pool->keys = NULL;
+    }
+    keypool.curve_count = 0;
+}
+
+// 取り出せた回数とプールが空でその場で生成した回数（全曲線の合計）
+void dpp_keypool_stats(unsigned long *hits, unsigned long *misses)
+{
+    int i;
+
+    *hits = 0;
+    *misses = 0;
+    pthread_mutex_lock(&keypool.lock);
+    for (i = 0; i < keypool.curve_count; i++)
+    {
+        *hits += keypool.curves[i].hits;
+        *misses += keypool.curves[i].misses;
+    }
+    pthread_mutex_unlock(&keypool.lock);
+}
@@ -0,0 +1,687 @@
+/*
+ * DPP Configurator - Logging
+ * Leveled, per-module logger with deferred formatting: callers copy the
+ * format arguments into a lock-free ring buffer and a background thread
+ * formats and writes them to stderr
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <strings.h>
+#include <time.h>
+#include "../include/dpp_configurator.h"
+
+#define DPP_LOG_RING_SLOTS 1024 // 2のべき乗
+#define DPP_LOG_SLOT_DATA 480   // 1レコードに保存できる引数の合計サイズ
+#define DPP_LOG_LINE_SIZE 2048
+
+static const char *const log_level_names[] = {
+    [DPP_LOG_ERROR] = "ERROR",
+    [DPP_LOG_WARN] = "WARN",
+    [DPP_LOG_INFO] = "INFO",
+    [DPP_LOG_DEBUG] = "DEBUG",
+};
+
+static const char *const log_module_names[] = {
+    [DPP_LOG_MAIN] = "main",
+    [DPP_LOG_CTRL] = "ctrl",
+    [DPP_LOG_AUTH] = "auth",
+    [DPP_LOG_STATE] = "state",
+    [DPP_LOG_PEER] = "peer",
+    [DPP_LOG_PROVISION] = "provision",
+    [DPP_LOG_DAEMON] = "daemon",
+};
+
+// ログに書き出す前に値を伏せるキー（"pass=6d7970617373" → "pass=***"）
+static const char *const log_secret_keys[] = {"pass=", "psk=", "key=", "ppKey=", NULL};
+
+// 文字列の値を伏せるJSONのキー（"pass": "secret" → "pass": "***"）
+static const char *const log_secret_json_keys[] = {"\"pass\"", "\"psk\"", NULL};
+
+// 引数の種類（書式文字列の変換指定から決まる）
+enum log_arg_type
+{
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+};
+
+/*
+ * リングバッファの1レコード
+ * seqはVyukov方式のシーケンス番号: 空きなら位置、書き込み済みなら位置+1
+ */
+struct log_slot
+{
+    uint64_t seq;
+    uint64_t time_ns;
+    const char *fmt; // 書式文字列はリテラルなので保存不要
+    uint8_t module;
+    uint8_t level;
+    uint16_t len;
+    unsigned char data[DPP_LOG_SLOT_DATA];
+};
+
+uint8_t dpp_log_levels[DPP_LOG_MODULES] = {
+    DPP_LOG_WARN, DPP_LOG_WARN, DPP_LOG_WARN, DPP_LOG_WARN,
+    DPP_LOG_WARN, DPP_LOG_WARN, DPP_LOG_WARN};
+
+static struct
+{
+    struct log_slot slots[DPP_LOG_RING_SLOTS];
+    uint64_t head; // 次に書き込む位置（複数の書き込み側がCASで確保）
+    uint64_t tail; // 次に読む位置（書き込みスレッドのみ更新）
+    uint64_t dropped;
+    pthread_once_t once;
+    pthread_mutex_t lock; // 書き込みスレッドの起動・停止のみ
+    pthread_t thread;
+    bool running;
+    bool stop;
+    pthread_mutex_t wait_lock; // 以下の待ち合わせ用
+    pthread_cond_t wake;       // 書き込みスレッドを起こす（レコードが増えた・停止する）
+    pthread_cond_t drained;    // dpp_log_flush() を起こす（書き出しが進んだ）
+    bool sleeping;             // 書き込みスレッドがwakeを待っている
+    int flushers;              // drainedを待っている数
+} log_ring = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wait_lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+};
+
+static void log_ring_init(void)
+{
+    uint64_t i;
+
+    for (i = 0; i < DPP_LOG_RING_SLOTS; i++)
+        log_ring.slots[i].seq = i;
+}
+
+// 書式文字列の次の変換指定を解析する（戻り値: 変換文字の位置、無ければNULL）
+static const char *log_next_conversion(const char *p, const char **spec_start, int *stars,
+                                       char *length)
+{
+    for (; *p; p++)
+    {
+        if (*p != '%')
+            continue;
+        if (p[1] == '%')
+        {
+            p++;
+            continue;
+        }
+
+        *spec_start = p++;
+        *stars = 0;
+        *length = '\0';
+        while (*p && strchr("-+ #0", *p))
+            p++;
+        for (; *p == '*' || (*p >= '0' && *p <= '9') || *p == '.'; p++)
+        {
+            if (*p == '*')
+                (*stars)++;
+        }
+        for (; *p && strchr("hljztL", *p); p++)
+            *length = (*length == 'l' && *p == 'l') ? 'q' : (*length == 'h' && *p == 'h') ? 'H' : *p;
+        return *p ? p : NULL;
+    }
+    return NULL;
+}
+
+static enum log_arg_type log_arg_type(char conversion)
+{
+    switch (conversion)
+    {
+    case 'd':
+    case 'i':
+    case 'c':
+        return LOG_ARG_INT;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+        return LOG_ARG_UINT;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        return LOG_ARG_DOUBLE;
+    case 's':
+        return LOG_ARG_STRING;
+    default:
+        return LOG_ARG_POINTER;
+    }
+}
+
+// 長さ修飾子に合わせてva_argで整数を取り出す
+static uint64_t log_va_int(va_list *ap, char length, bool is_signed)
+{
+    switch (length)
+    {
+    case 'l':
+        return is_signed ? (uint64_t)va_arg(*ap, long) : (uint64_t)va_arg(*ap, unsigned long);
+    case 'q':
+        return is_signed ? (uint64_t)va_arg(*ap, long long) : (uint64_t)va_arg(*ap, unsigned long long);
+    case 'z':
+        return (uint64_t)va_arg(*ap, size_t);
+    case 'j':
+        return is_signed ? (uint64_t)va_arg(*ap, intmax_t) : (uint64_t)va_arg(*ap, uintmax_t);
+    case 't':
+        return (uint64_t)va_arg(*ap, ptrdiff_t);
+    default:
+        return is_signed ? (uint64_t)(int64_t)va_arg(*ap, int) : (uint64_t)va_arg(*ap, unsigned int);
+    }
+}
+
+/*
+ * 引数をスロットへコピーする（文字列は内容をコピーし、入りきらなければ切り詰める）
+ * 整数・浮動小数点・ポインタは8バイト、文字列は2バイトの長さ+内容
+ */
+static uint16_t log_capture(unsigned char *data, const char *fmt, va_list *ap)
+{
+    const char *p = fmt, *spec;
+    size_t used = 0;
+    int stars;
+    char length;
+
+    while ((p = log_next_conversion(p, &spec, &stars, &length)))
+    {
+        enum log_arg_type type = log_arg_type(*p);
+        uint64_t value;
+        int i;
+
+        for (i = 0; i < stars; i++)
+        {
+            value = (uint64_t)(int64_t)va_arg(*ap, int);
+            if (used + 8 > DPP_LOG_SLOT_DATA)
+                return used;
+            memcpy(data + used, &value, 8);
+            used += 8;
+        }
+
+        if (type == LOG_ARG_STRING)
+        {
+            const char *s = va_arg(*ap, const char *);
+            size_t len = s ? strlen(s) : 6;
+            uint16_t stored;
+
+            if (used + 2 > DPP_LOG_SLOT_DATA)
+                return used;
+            if (len > DPP_LOG_SLOT_DATA - used - 2)
+                len = DPP_LOG_SLOT_DATA - used - 2;
+            stored = (uint16_t)len;
+            memcpy(data + used, &stored, 2);
+            memcpy(data + used + 2, s ? s : "(null)", len);
+            used += 2 + len;
+        }
+        else
+        {
+            if (type == LOG_ARG_DOUBLE)
+            {
+                double d = va_arg(*ap, double);
+                memcpy(&value, &d, 8);
+            }
+            else if (type == LOG_ARG_POINTER)
+                value = (uint64_t)(uintptr_t)va_arg(*ap, void *);
+            else
+                value = log_va_int(ap, length, type == LOG_ARG_INT);
+
+            if (used + 8 > DPP_LOG_SLOT_DATA)
+                return used;
+            memcpy(data + used, &value, 8);
+            used += 8;
+        }
+        p++;
+    }
+    return (uint16_t)used;
+}
+
+// スロットの内容を書式に従って文字列にする（書き込みスレッドで実行）
+static size_t log_format(const struct log_slot *slot, char *out, size_t size)
+{
+    const char *p = slot->fmt, *spec, *conv;
+    const unsigned char *data = slot->data;
+    size_t used = 0, pos = 0;
+    char buf[64];
+    int stars;
+    char length;
+
+    while ((conv = log_next_conversion(p, &spec, &stars, &length)))
+    {
+        int64_t star_values[2] = {0, 0};
+        enum log_arg_type type = log_arg_type(*conv);
+        char piece[DPP_LOG_SLOT_DATA + 1];
+        size_t n = 0;
+        int i;
+
+        // 変換指定の前の文字列（"%%" は "%" にする）
+        for (; p < spec && pos + 1 < size; p++)
+        {
+            out[pos++] = *p;
+            if (p[0] == '%' && p[1] == '%')
+                p++;
+        }
+
+        for (i = 0; i < stars; i++)
+        {
+            if (used + 8 > slot->len)
+                goto truncated;
+            if (i < 2)
+                memcpy(&star_values[i], data + used, 8);
+            used += 8;
+        }
+
+        // 幅・精度の '*' は保存した値に置き換え、長さ修飾子は付け直す
+        i = 0;
+        for (const char *s = spec; s < conv && n + 24 < sizeof(buf); s++)
+        {
+            if (*s == '*')
+            {
+                n += snprintf(buf + n, sizeof(buf) - n, "%lld", (long long)star_values[i < 2 ? i : 1]);
+                i++;
+            }
+            else if (!strchr("hljztL", *s))
+                buf[n++] = *s;
+        }
+        if (type == LOG_ARG_INT || type == LOG_ARG_UINT)
+        {
+            if (*conv != 'c')
+            {
+                buf[n++] = 'l';
+                buf[n++] = 'l';
+            }
+        }
+        buf[n++] = *conv;
+        buf[n] = '\0';
+
+        if (type == LOG_ARG_STRING)
+        {
+            uint16_t len;
+            if (used + 2 > slot->len)
+                goto truncated;
+            memcpy(&len, data + used, 2);
+            memcpy(piece, data + used + 2, len);
+            piece[len] = '\0';
+            used += 2 + len;
+            n = snprintf(out + pos, size - pos, buf, piece);
+        }
+        else
+        {
+            uint64_t value;
+            double d;
+            if (used + 8 > slot->len)
+                goto truncated;
+            memcpy(&value, data + used, 8);
+            used += 8;
+            if (type == LOG_ARG_DOUBLE)
+            {
+                memcpy(&d, &value, 8);
+                n = snprintf(out + pos, size - pos, buf, d);
+            }
+            else if (type == LOG_ARG_POINTER)
+                n = snprintf(out + pos, size - pos, buf, (void *)(uintptr_t)value);
+            else if (*conv == 'c')
+                n = snprintf(out + pos, size - pos, buf, (int)value);
+            else if (type == LOG_ARG_INT)
+                n = snprintf(out + pos, size - pos, buf, (long long)value);
+            else
+                n = snprintf(out + pos, size - pos, buf, (unsigned long long)value);
+        }
+        pos += n < size - pos ? n : size - pos - 1;
+        p = conv + 1;
+    }
+
+    for (; *p && pos + 1 < size; p++)
+    {
+        out[pos++] = *p;
+        if (p[0] == '%' && p[1] == '%')
+            p++;
+    }
+    out[pos] = '\0';
+    return pos;
+
+truncated:
+    pos += snprintf(out + pos, size - pos, "...");
+    return pos < size ? pos : size - 1;
+}
+
+/*
+ * inが値を伏せるキーで始まるなら、値の直前までの長さを返す（無ければ0）
+ * JSONのキーはコロンの前後の空白を許し、値の開き引用符までを含める
+ */
+static size_t log_secret_key(const char *in, bool *json)
+{
+    size_t len;
+    int i;
+
+    for (i = 0; log_secret_keys[i]; i++)
+    {
+        len = strlen(log_secret_keys[i]);
+        if (strncmp(in, log_secret_keys[i], len) == 0)
+        {
+            *json = false;
+            return len;
+        }
+    }
+    for (i = 0; log_secret_json_keys[i]; i++)
+    {
+        len = strlen(log_secret_json_keys[i]);
+        if (strncmp(in, log_secret_json_keys[i], len) != 0)
+            continue;
+        len += strspn(in + len, " \t\r\n");
+        if (in[len] != ':')
+            continue;
+        len++;
+        len += strspn(in + len, " \t\r\n");
+        if (in[len] != '"')
+            continue;
+        *json = true;
+        return len + 1;
+    }
+    return 0;
+}
+
+/*
+ * パスワード・鍵の値を "***" に置き換える（in と out は別のバッファ）
+ * 値の終わりは空白・引用符・セミコロンまで。引用符で囲まれた値は閉じ引用符まで
+ */
+size_t dpp_log_redact(const char *in, char *out, size_t size)
+{
+    size_t pos = 0;
+
+    if (size == 0)
+        return 0;
+
+    while (*in && pos + 1 < size)
+    {
+        bool json;
+        size_t len = log_secret_key(in, &json);
+
+        if (len == 0)
+        {
+            out[pos++] = *in++;
+            continue;
+        }
+
+        // キーはそのまま残し、値を伏せる
+        if (pos + len + 3 >= size)
+            break;
+        memcpy(out + pos, in, len);
+        memcpy(out + pos + len, "***", 3);
+        pos += len + 3;
+        in += len;
+
+        // JSONの文字列、または key='...' の値は空白を含みうる
+        char quote = json ? '"' : 0;
+        bool quoted_arg = !quote && (*in == '\'' || *in == '"');
+        if (quoted_arg)
+            quote = *in++;
+        if (quote)
+        {
+            while (*in && *in != quote)
+                in += (*in == '\\' && in[1]) ? 2 : 1;
+            if (*in && quoted_arg)
+                in++;
+            continue;
+        }
+        while (*in && *in != ' ' && *in != '"' && *in != ';' && *in != '\n')
+            in++;
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+static void log_write_slot(const struct log_slot *slot)
+{
+    char message[DPP_LOG_LINE_SIZE];
+    char line[DPP_LOG_LINE_SIZE];
+    struct tm tm;
+    time_t sec = (time_t)(slot->time_ns / 1000000000ULL);
+
+    log_format(slot, message, sizeof(message));
+    dpp_log_redact(message, line, sizeof(line));
+    localtime_r(&sec, &tm);
+    fprintf(stderr, "%04d-%02d-%02d %02d:%02d:%02d.%03d %-5s %s: %s\n",
+            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+            (int)(slot->time_ns / 1000000 % 1000), log_level_names[slot->level],
+            log_module_names[slot->module], line);
+}
+
+// 書き込み済みのレコードをすべて書き出す（書き込みスレッド、または停止後の呼び出し元）
+static bool log_ready(void)
+{
+    const struct log_slot *slot = &log_ring.slots[log_ring.tail & (DPP_LOG_RING_SLOTS - 1)];
+
+    return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == log_ring.tail + 1;
+}
+
+static bool log_drain(void)
+{
+    bool wrote = false;
+
+    for (;;)
+    {
+        struct log_slot *slot = &log_ring.slots[log_ring.tail & (DPP_LOG_RING_SLOTS - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_ring.tail + 1)
+            break;
+        log_write_slot(slot);
+        __atomic_store_n(&slot->seq, log_ring.tail + DPP_LOG_RING_SLOTS, __ATOMIC_RELEASE);
+        __atomic_store_n(&log_ring.tail, log_ring.tail + 1, __ATOMIC_RELEASE);
+        wrote = true;
+    }
+    if (wrote)
+    {
+        fflush(stderr);
+        pthread_mutex_lock(&log_ring.wait_lock);
+        if (log_ring.flushers)
+            pthread_cond_broadcast(&log_ring.drained);
+        pthread_mutex_unlock(&log_ring.wait_lock);
+    }
+    return wrote;
+}
+
+/*
+ * 空になったら書き込み側に起こされるまで眠る
+ * sleepingを立ててからリングを見直すので、書き込み側（レコードを公開してから
+ * sleepingを見る）とすれ違っても、どちらかが必ず相手の書き込みに気付く
+ */
+static void *log_writer_thread(void *arg)
+{
+    (void)arg;
+    while (!__atomic_load_n(&log_ring.stop, __ATOMIC_ACQUIRE))
+    {
+        if (log_drain())
+            continue;
+        pthread_mutex_lock(&log_ring.wait_lock);
+        __atomic_store_n(&log_ring.sleeping, true, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!log_ready() && !__atomic_load_n(&log_ring.stop, __ATOMIC_SEQ_CST))
+            pthread_cond_wait(&log_ring.wake, &log_ring.wait_lock);
+        __atomic_store_n(&log_ring.sleeping, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&log_ring.wait_lock);
+    }
+    log_drain();
+    return NULL;
+}
+
+static void log_wake_writer(void)
+{
+    pthread_mutex_lock(&log_ring.wait_lock);
+    pthread_cond_signal(&log_ring.wake);
+    pthread_mutex_unlock(&log_ring.wait_lock);
+}
+
+static void log_start_writer(void)
+{
+    pthread_mutex_lock(&log_ring.lock);
+    if (!log_ring.running && !log_ring.stop &&
+        pthread_create(&log_ring.thread, NULL, log_writer_thread, NULL) == 0)
+        __atomic_store_n(&log_ring.running, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&log_ring.lock);
+}
+
+void dpp_log_write(enum dpp_log_module module, enum dpp_log_level level, const char *fmt, ...)
+{
+    struct log_slot *slot;
+    struct timespec ts;
+    uint64_t pos;
+    va_list ap;
+
+    pthread_once(&log_ring.once, log_ring_init);
+    if (!__atomic_load_n(&log_ring.running, __ATOMIC_ACQUIRE))
+        log_start_writer();
+
+    // スロットを確保する。満杯なら待たずに捨てる
+    pos = __atomic_load_n(&log_ring.head, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        slot = &log_ring.slots[pos & (DPP_LOG_RING_SLOTS - 1)];
+        int64_t diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&log_ring.head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            __atomic_fetch_add(&log_ring.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&log_ring.head, __ATOMIC_RELAXED);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot->time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    slot->fmt = fmt;
+    slot->module = (uint8_t)module;
+    slot->level = (uint8_t)level;
+    va_start(ap, fmt);
+    slot->len = log_capture(slot->data, fmt, &ap);
+    va_end(ap);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    // 書き込みスレッドが眠っているときだけ起こす（普段はロックを取らない）
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_ring.sleeping, __ATOMIC_RELAXED))
+        log_wake_writer();
+}
+
+// ここまでに書き込まれたレコードが書き出されるまで待つ
+void dpp_log_flush(void)
+{
+    uint64_t head = __atomic_load_n(&log_ring.head, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&log_ring.wait_lock);
+    log_ring.flushers++;
+    while (__atomic_load_n(&log_ring.running, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&log_ring.tail, __ATOMIC_ACQUIRE) < head)
+        pthread_cond_wait(&log_ring.drained, &log_ring.wait_lock);
+    log_ring.flushers--;
+    pthread_mutex_unlock(&log_ring.wait_lock);
+}
+
+// 書き込みスレッドを止める（残りは書き出してから終了）
+void dpp_log_shutdown(void)
+{
+    uint64_t dropped;
+
+    pthread_mutex_lock(&log_ring.lock);
+    if (log_ring.running)
+    {
+        __atomic_store_n(&log_ring.stop, true, __ATOMIC_SEQ_CST);
+        log_wake_writer();
+        pthread_mutex_unlock(&log_ring.lock);
+        pthread_join(log_ring.thread, NULL);
+        pthread_mutex_lock(&log_ring.lock);
+        // 書き出されずに終わったレコードを待っている dpp_log_flush() も帰す
+        pthread_mutex_lock(&log_ring.wait_lock);
+        __atomic_store_n(&log_ring.running, false, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&log_ring.drained);
+        pthread_mutex_unlock(&log_ring.wait_lock);
+        log_ring.stop = false;
+    }
+    pthread_mutex_unlock(&log_ring.lock);
+
+    dropped = __atomic_exchange_n(&log_ring.dropped, 0, __ATOMIC_RELAXED);
+    if (dropped)
+        fprintf(stderr, "Warning: %llu log messages dropped (ring buffer full)\n",
+                (unsigned long long)dropped);
+}
+
+static int log_parse_level(const char *name, size_t len)
+{
+    int i;
+
+    for (i = 0; i <= DPP_LOG_DEBUG; i++)
+    {
+        if (strlen(log_level_names[i]) == len && strncasecmp(name, log_level_names[i], len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void dpp_log_set_level(enum dpp_log_level level)
+{
+    int i;
+
+    for (i = 0; i < DPP_LOG_MODULES; i++)
+        dpp_log_levels[i] = (uint8_t)level;
+}
+
+/*
+ * "debug" / "ctrl=debug,state=info" / "warn,auth=debug" の形式でレベルを設定する
+ * モジュール名のない指定は全モジュールに適用
+ */
+int dpp_log_configure(const char *spec)
+{
+    const char *p = spec;
+
+    while (p && *p)
+    {
+        const char *end = p + strcspn(p, ",");
+        const char *eq = memchr(p, '=', end - p);
+        int level = eq ? log_parse_level(eq + 1, end - eq - 1) : log_parse_level(p, end - p);
+        int module;
+
+        if (level < 0)
+        {
+            dpp_printf("Error: Invalid log level in '%.*s'\n", (int)(end - p), p);
+            return -1;
+        }
+        if (!eq)
+        {
+            dpp_log_set_level(level);
+        }
+        else
+        {
+            for (module = 0; module < DPP_LOG_MODULES; module++)
+            {
+                if (strlen(log_module_names[module]) == (size_t)(eq - p) &&
+                    strncmp(p, log_module_names[module], eq - p) == 0)
+                    break;
+            }
+            if (module == DPP_LOG_MODULES)
+            {
+                dpp_printf("Error: Unknown log module '%.*s'\n", (int)(eq - p), p);
+                return -1;
+            }
+            dpp_log_levels[module] = (uint8_t)level;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
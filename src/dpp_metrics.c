@@ -0,0 +1,578 @@
+/*
+ * DPP Configurator - Metrics
+ * Latency histograms and result counters, exported in Prometheus text format
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../include/dpp_configurator.h"
+
+/*
+ * ヒストグラムはHDR形式（対数・線形）のバケットを持つ
+ * 2のべき乗ごとの区間を METRICS_SUB_BUCKETS 等分するので、相対誤差は最大 1/8
+ * 値はマイクロ秒で記録し、2^METRICS_MAX_EXPONENT µs（約19時間）以上は最後のバケットに入れる
+ */
+#define METRICS_SUB_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_EXPONENT 36
+#define METRICS_BUCKETS ((METRICS_MAX_EXPONENT - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+
+// Prometheusに出力するバケット境界: 2^k µs（HDRバケットの境界と一致するので集計誤差がない）
+#define METRICS_EXPORT_MIN_EXPONENT 7  // 128µs
+#define METRICS_EXPORT_MAX_EXPONENT 26 // 約67秒
+
+struct metrics_histogram
+{
+    uint64_t counts[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+};
+
+// hostapdへ送るコマンドの種類（先頭のトークン）
+static const char *const metrics_commands[] = {
+    "DPP_CONFIGURATOR_ADD",
+    "DPP_CONFIGURATOR_GET_KEY",
+    "DPP_QR_CODE",
+    "DPP_BOOTSTRAP_INFO",
+    "DPP_AUTH_INIT",
+    "ATTACH",
+    "DETACH",
+    "STATUS",
+    "PING",
+    "other",
+};
+#define METRICS_COMMANDS (sizeof(metrics_commands) / sizeof(metrics_commands[0]))
+
+enum metrics_command_result
+{
+    METRICS_COMMAND_OK,
+    METRICS_COMMAND_FAIL,  // hostapdが"FAIL"を返した
+    METRICS_COMMAND_ERROR, // 送受信エラー・タイムアウト
+    METRICS_COMMAND_RESULTS
+};
+
+static const char *const metrics_command_results[] = {"ok", "fail", "error"};
+
+static const char *const metrics_phases[] = {
+    [DPP_METRICS_PHASE_CONFIGURATOR] = "configurator",
+    [DPP_METRICS_PHASE_PEER] = "peer",
+    [DPP_METRICS_PHASE_AUTH_INIT] = "auth_init",
+    [DPP_METRICS_PHASE_AUTHENTICATION] = "authentication",
+    [DPP_METRICS_PHASE_CONFIGURATION] = "configuration",
+    [DPP_METRICS_PHASE_TOTAL] = "total",
+};
+
+static const char *const metrics_results[] = {
+    [DPP_METRICS_RESULT_SUCCESS] = "success",
+    [DPP_METRICS_RESULT_INITIATED] = "initiated",
+    [DPP_METRICS_RESULT_HOSTAPD_ERROR] = "hostapd_error",
+    [DPP_METRICS_RESULT_CONFIGURATOR_ERROR] = "configurator_error",
+    [DPP_METRICS_RESULT_PEER_ERROR] = "peer_error",
+    [DPP_METRICS_RESULT_AUTH_INIT_REJECTED] = "auth_init_rejected",
+    [DPP_METRICS_RESULT_AUTH_INIT_FAILED] = "auth_init_failed",
+    [DPP_METRICS_RESULT_NOT_COMPATIBLE] = "not_compatible",
+    [DPP_METRICS_RESULT_CONF_FAILED] = "conf_failed",
+    [DPP_METRICS_RESULT_FAIL] = "fail",
+    [DPP_METRICS_RESULT_TIMEOUT] = "timeout",
+    [DPP_METRICS_RESULT_MONITOR_ERROR] = "monitor_error",
+};
+
+// 記録は複数スレッドから行われるのでカウンタはすべてatomicに更新する
+static struct
+{
+    struct metrics_histogram phases[DPP_METRICS_PHASES];
+    struct metrics_histogram commands[METRICS_COMMANDS];
+    uint64_t command_results[METRICS_COMMANDS][METRICS_COMMAND_RESULTS];
+    uint64_t results[DPP_METRICS_RESULTS];
+} metrics;
+
+static const char *metrics_file_path;
+
+uint64_t dpp_metrics_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int metrics_bucket(uint64_t us)
+{
+    int exponent;
+    int index;
+
+    if (us < METRICS_SUB_BUCKETS)
+        return (int)us;
+
+    exponent = 63 - __builtin_clzll(us) - METRICS_SUB_BITS;
+    index = (exponent + 1) * METRICS_SUB_BUCKETS +
+            (int)((us >> exponent) & (METRICS_SUB_BUCKETS - 1));
+    return index < METRICS_BUCKETS ? index : METRICS_BUCKETS - 1;
+}
+
+// バケットの上端（このバケットに入る値はこれ未満）
+static uint64_t metrics_bucket_upper(int index)
+{
+    int exponent;
+
+    if (index < METRICS_SUB_BUCKETS)
+        return (uint64_t)index + 1;
+
+    exponent = index / METRICS_SUB_BUCKETS - 1;
+    return (uint64_t)(METRICS_SUB_BUCKETS + index % METRICS_SUB_BUCKETS + 1) << exponent;
+}
+
+static void metrics_record(struct metrics_histogram *h, uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    uint64_t max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&h->counts[metrics_bucket(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_us, us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    while (us > max &&
+           !__atomic_compare_exchange_n(&h->max_us, &max, us, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+// 出力中に記録が進んでも矛盾しないよう、先にコピーを取る
+static void metrics_snapshot(const struct metrics_histogram *h, struct metrics_histogram *copy)
+{
+    int i;
+
+    copy->count = 0;
+    for (i = 0; i < METRICS_BUCKETS; i++)
+    {
+        copy->counts[i] = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        copy->count += copy->counts[i];
+    }
+    copy->sum_us = __atomic_load_n(&h->sum_us, __ATOMIC_RELAXED);
+    copy->max_us = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+}
+
+// 分位点（秒）。バケットの上端を返すので実際の値より最大1/8大きい
+static double metrics_quantile(const struct metrics_histogram *h, double q)
+{
+    uint64_t rank, seen = 0;
+    uint64_t upper;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+
+    rank = (uint64_t)(q * h->count);
+    if (rank >= h->count)
+        rank = h->count - 1;
+    for (i = 0; i < METRICS_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen > rank)
+            break;
+    }
+    upper = metrics_bucket_upper(i < METRICS_BUCKETS ? i : METRICS_BUCKETS - 1);
+    if (upper > h->max_us)
+        upper = h->max_us;
+    return upper / 1e6;
+}
+
+void dpp_metrics_phase(enum dpp_metrics_phase phase, uint64_t ns)
+{
+    metrics_record(&metrics.phases[phase], ns);
+}
+
+void dpp_metrics_result(enum dpp_metrics_result result)
+{
+    __atomic_fetch_add(&metrics.results[result], 1, __ATOMIC_RELAXED);
+}
+
+// hostapdの失敗イベント名から結果の分類を決める
+enum dpp_metrics_result dpp_metrics_event_result(const char *event_name)
+{
+    if (strncmp(event_name, DPP_EVENT_AUTH_INIT_FAILED, strlen(DPP_EVENT_AUTH_INIT_FAILED) - 1) == 0)
+        return DPP_METRICS_RESULT_AUTH_INIT_FAILED;
+    if (strncmp(event_name, DPP_EVENT_NOT_COMPATIBLE, strlen(DPP_EVENT_NOT_COMPATIBLE) - 1) == 0)
+        return DPP_METRICS_RESULT_NOT_COMPATIBLE;
+    if (strncmp(event_name, DPP_EVENT_CONF_FAILED, strlen(DPP_EVENT_CONF_FAILED) - 1) == 0)
+        return DPP_METRICS_RESULT_CONF_FAILED;
+    return DPP_METRICS_RESULT_FAIL;
+}
+
+static size_t metrics_command_index(const char *cmd)
+{
+    size_t len = strcspn(cmd, " ");
+    size_t i;
+
+    for (i = 0; i < METRICS_COMMANDS - 1; i++)
+    {
+        if (strlen(metrics_commands[i]) == len && strncmp(cmd, metrics_commands[i], len) == 0)
+            return i;
+    }
+    return METRICS_COMMANDS - 1;
+}
+
+// hostapd_ctrl_request() から呼ばれる（retは送受信の結果）
+void dpp_metrics_command(const char *cmd, uint64_t ns, int ret, const char *response)
+{
+    size_t index = metrics_command_index(cmd);
+    enum metrics_command_result result;
+
+    if (ret < 0)
+        result = METRICS_COMMAND_ERROR;
+    else if (strncmp(response, "FAIL", 4) == 0)
+        result = METRICS_COMMAND_FAIL;
+    else
+        result = METRICS_COMMAND_OK;
+
+    metrics_record(&metrics.commands[index], ns);
+    __atomic_fetch_add(&metrics.command_results[index][result], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * 1台分のプロビジョニングの計測
+ * start: dpp_auth_start() の直前、initiated: DPP_AUTH_INITが受け付けられた直後
+ */
+void dpp_metrics_attempt_start(struct dpp_metrics_attempt *attempt)
+{
+    attempt->start_ns = dpp_metrics_now();
+    attempt->initiated_ns = 0;
+    attempt->authenticated_ns = 0;
+}
+
+void dpp_metrics_attempt_initiated(struct dpp_metrics_attempt *attempt)
+{
+    attempt->initiated_ns = dpp_metrics_now();
+}
+
+// 開始から終了までの時間を記録する（結果は失敗した箇所で記録済みの場合）
+void dpp_metrics_attempt_total(const struct dpp_metrics_attempt *attempt)
+{
+    dpp_metrics_phase(DPP_METRICS_PHASE_TOTAL, dpp_metrics_now() - attempt->start_ns);
+}
+
+// 終了した試行の時間と結果を記録する
+void dpp_metrics_attempt_end(const struct dpp_metrics_attempt *attempt,
+                             enum dpp_metrics_result result)
+{
+    dpp_metrics_attempt_total(attempt);
+    dpp_metrics_result(result);
+}
+
+// 終了したらtrueを返す（成功・失敗とも時間と結果を記録済み）
+bool dpp_metrics_attempt_event(struct dpp_metrics_attempt *attempt, enum dpp_event_kind kind,
+                               const char *event_name)
+{
+    uint64_t now = dpp_metrics_now();
+
+    switch (kind)
+    {
+    case DPP_EVENT_KIND_AUTH_SUCCESS:
+        attempt->authenticated_ns = now;
+        if (attempt->initiated_ns)
+            dpp_metrics_phase(DPP_METRICS_PHASE_AUTHENTICATION, now - attempt->initiated_ns);
+        return false;
+    case DPP_EVENT_KIND_CONF_SENT:
+        if (attempt->authenticated_ns)
+            dpp_metrics_phase(DPP_METRICS_PHASE_CONFIGURATION, now - attempt->authenticated_ns);
+        dpp_metrics_attempt_end(attempt, DPP_METRICS_RESULT_SUCCESS);
+        return true;
+    case DPP_EVENT_KIND_FAILED:
+        dpp_metrics_attempt_end(attempt, dpp_metrics_event_result(event_name));
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void metrics_write_histogram(FILE *fp, const char *name, const char *label,
+                                    const char *value, const struct metrics_histogram *h)
+{
+    uint64_t cumulative = 0;
+    int bucket = 0;
+    int exponent;
+
+    for (exponent = METRICS_EXPORT_MIN_EXPONENT; exponent <= METRICS_EXPORT_MAX_EXPONENT; exponent++)
+    {
+        // 上端が 2^exponent µs 以下のバケットをすべて加える
+        while (bucket < METRICS_BUCKETS && metrics_bucket_upper(bucket) <= (1ULL << exponent))
+            cumulative += h->counts[bucket++];
+        fprintf(fp, "%s_bucket{%s=\"%s\",le=\"%.9g\"} %llu\n", name, label, value,
+                (double)(1ULL << exponent) / 1e6, (unsigned long long)cumulative);
+    }
+    fprintf(fp, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value,
+            (unsigned long long)h->count);
+    fprintf(fp, "%s_sum{%s=\"%s\"} %.6f\n", name, label, value, h->sum_us / 1e6);
+    fprintf(fp, "%s_count{%s=\"%s\"} %llu\n", name, label, value,
+            (unsigned long long)h->count);
+}
+
+static void metrics_write_quantiles(FILE *fp, const char *name, const char *label,
+                                    const char *value, const struct metrics_histogram *h)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+    size_t i;
+
+    for (i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+    {
+        fprintf(fp, "%s{%s=\"%s\",quantile=\"%g\"} %.6f\n", name, label, value,
+                quantiles[i], metrics_quantile(h, quantiles[i]));
+    }
+}
+
+// Prometheusのテキスト形式で出力
+int dpp_metrics_write(FILE *fp)
+{
+    struct metrics_histogram *h;
+    size_t i;
+    int j;
+
+    // ヒストグラム1個は約2KBあるのでスタックではなくヒープにコピーする
+    h = malloc(sizeof(*h));
+    if (!h)
+        return -1;
+
+    fprintf(fp, "# HELP dpp_phase_duration_seconds Time spent in each provisioning phase.\n");
+    fprintf(fp, "# TYPE dpp_phase_duration_seconds histogram\n");
+    for (j = 0; j < DPP_METRICS_PHASES; j++)
+    {
+        metrics_snapshot(&metrics.phases[j], h);
+        metrics_write_histogram(fp, "dpp_phase_duration_seconds", "phase", metrics_phases[j], h);
+    }
+
+    fprintf(fp, "# HELP dpp_phase_duration_quantile_seconds Phase duration quantiles since start.\n");
+    fprintf(fp, "# TYPE dpp_phase_duration_quantile_seconds gauge\n");
+    for (j = 0; j < DPP_METRICS_PHASES; j++)
+    {
+        metrics_snapshot(&metrics.phases[j], h);
+        metrics_write_quantiles(fp, "dpp_phase_duration_quantile_seconds", "phase",
+                                metrics_phases[j], h);
+    }
+
+    fprintf(fp, "# HELP dpp_hostapd_command_duration_seconds Round-trip time of hostapd control commands.\n");
+    fprintf(fp, "# TYPE dpp_hostapd_command_duration_seconds histogram\n");
+    for (i = 0; i < METRICS_COMMANDS; i++)
+    {
+        metrics_snapshot(&metrics.commands[i], h);
+        metrics_write_histogram(fp, "dpp_hostapd_command_duration_seconds", "command",
+                                metrics_commands[i], h);
+    }
+
+    fprintf(fp, "# HELP dpp_hostapd_commands_total hostapd control commands by reply.\n");
+    fprintf(fp, "# TYPE dpp_hostapd_commands_total counter\n");
+    for (i = 0; i < METRICS_COMMANDS; i++)
+    {
+        for (j = 0; j < METRICS_COMMAND_RESULTS; j++)
+        {
+            fprintf(fp, "dpp_hostapd_commands_total{command=\"%s\",result=\"%s\"} %llu\n",
+                    metrics_commands[i], metrics_command_results[j],
+                    (unsigned long long)__atomic_load_n(&metrics.command_results[i][j],
+                                                        __ATOMIC_RELAXED));
+        }
+    }
+
+    fprintf(fp, "# HELP dpp_provision_results_total Provisioning attempts by outcome.\n");
+    fprintf(fp, "# TYPE dpp_provision_results_total counter\n");
+    for (j = 0; j < DPP_METRICS_RESULTS; j++)
+    {
+        const char *result = "failure";
+
+        if (j == DPP_METRICS_RESULT_SUCCESS)
+            result = "success";
+        else if (j == DPP_METRICS_RESULT_INITIATED)
+            result = "unknown"; // 完了を待たなかった
+        fprintf(fp, "dpp_provision_results_total{result=\"%s\",reason=\"%s\"} %llu\n",
+                result, metrics_results[j],
+                (unsigned long long)__atomic_load_n(&metrics.results[j], __ATOMIC_RELAXED));
+    }
+
+    free(h);
+    hostapd_ctrl_write_health(fp, true);
+    return ferror(fp) ? -1 : 0;
+}
+
+// 人が読む用の要約（件数と分位点）
+static void metrics_write_summary(FILE *fp)
+{
+    struct metrics_histogram *h = malloc(sizeof(*h));
+    size_t i;
+    int j;
+
+    if (!h)
+        return;
+
+    fprintf(fp, "%-26s %8s %10s %10s %10s %10s\n", "Phase", "count", "p50 ms", "p90 ms",
+            "p99 ms", "max ms");
+    for (j = 0; j < DPP_METRICS_PHASES; j++)
+    {
+        metrics_snapshot(&metrics.phases[j], h);
+        fprintf(fp, "%-26s %8llu %10.2f %10.2f %10.2f %10.2f\n", metrics_phases[j],
+                (unsigned long long)h->count, metrics_quantile(h, 0.5) * 1e3,
+                metrics_quantile(h, 0.9) * 1e3, metrics_quantile(h, 0.99) * 1e3,
+                h->max_us / 1e3);
+    }
+
+    fprintf(fp, "\n%-26s %8s %10s %10s %10s %10s\n", "hostapd command", "count", "p50 ms",
+            "p99 ms", "fail", "error");
+    for (i = 0; i < METRICS_COMMANDS; i++)
+    {
+        metrics_snapshot(&metrics.commands[i], h);
+        if (h->count == 0)
+            continue;
+        fprintf(fp, "%-26s %8llu %10.3f %10.3f %10llu %10llu\n", metrics_commands[i],
+                (unsigned long long)h->count, metrics_quantile(h, 0.5) * 1e3,
+                metrics_quantile(h, 0.99) * 1e3,
+                (unsigned long long)metrics.command_results[i][METRICS_COMMAND_FAIL],
+                (unsigned long long)metrics.command_results[i][METRICS_COMMAND_ERROR]);
+    }
+
+    fprintf(fp, "\nResults:\n");
+    for (j = 0; j < DPP_METRICS_RESULTS; j++)
+    {
+        uint64_t n = __atomic_load_n(&metrics.results[j], __ATOMIC_RELAXED);
+        if (n || j == DPP_METRICS_RESULT_SUCCESS)
+            fprintf(fp, "  %-24s %llu\n", metrics_results[j], (unsigned long long)n);
+    }
+    hostapd_ctrl_write_health(fp, false);
+
+    free(h);
+}
+
+/*
+ * ファイルへ書き出す（一時ファイルからrenameするので読み手が途中の内容を見ることはない）
+ * 一時ファイルは新しく作った一意の名前（O_EXCL）なので、置かれたシンボリックリンクを辿らない。
+ * renameは置き換え先がシンボリックリンクならリンク自体を置き換える
+ */
+int dpp_metrics_write_file(const char *path)
+{
+    char tmp_path[512];
+    FILE *fp;
+    int fd, ret;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >= (int)sizeof(tmp_path))
+        return -1;
+
+    fd = mkostemp(tmp_path, O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    // node_exporterなど別ユーザーの読み手向けに、書き込みは所有者だけ・読み込みは誰でも
+    fchmod(fd, 0644);
+    fp = fdopen(fd, "w");
+    if (!fp)
+    {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    ret = dpp_metrics_write(fp);
+    if (fclose(fp) != 0)
+        ret = -1;
+    if (ret == 0 && rename(tmp_path, path) < 0)
+        ret = -1;
+    if (ret < 0)
+        unlink(tmp_path);
+    return ret;
+}
+
+// デーモンが定期的に書き出すファイル（NULLで無効）
+void dpp_metrics_set_file(const char *path)
+{
+    metrics_file_path = path;
+}
+
+void dpp_metrics_flush(void)
+{
+    if (metrics_file_path)
+        dpp_metrics_write_file(metrics_file_path);
+}
+
+static void metrics_histogram_reset(struct metrics_histogram *h)
+{
+    int i;
+
+    for (i = 0; i < METRICS_BUCKETS; i++)
+        __atomic_store_n(&h->counts[i], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_us, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->max_us, 0, __ATOMIC_RELAXED);
+}
+
+// 記録中のスレッドと競合しないよう、memsetではなく1つずつatomicに0にする
+void dpp_metrics_reset(void)
+{
+    size_t i;
+    int j;
+
+    for (j = 0; j < DPP_METRICS_PHASES; j++)
+        metrics_histogram_reset(&metrics.phases[j]);
+    for (i = 0; i < METRICS_COMMANDS; i++)
+    {
+        metrics_histogram_reset(&metrics.commands[i]);
+        for (j = 0; j < METRICS_COMMAND_RESULTS; j++)
+            __atomic_store_n(&metrics.command_results[i][j], 0, __ATOMIC_RELAXED);
+    }
+    for (j = 0; j < DPP_METRICS_RESULTS; j++)
+        __atomic_store_n(&metrics.results[j], 0, __ATOMIC_RELAXED);
+}
+
+// metrics コマンド: Prometheus形式または要約を表示・保存
+int cmd_metrics(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *format = dpp_arg(args, "format");
+    const char *out = dpp_arg(args, "out");
+    bool summary = false;
+    int ret = 0;
+
+    (void)ctx; // 未使用パラメータの警告を避ける
+
+    if (format)
+    {
+        if (strcmp(format, "summary") == 0)
+        {
+            summary = true;
+        }
+        else if (strcmp(format, "prometheus") != 0)
+        {
+            dpp_printf("Error: Unknown format: %s\n", format);
+            dpp_printf("Usage: metrics [format=prometheus|summary] [out=<file>] [reset=1]\n");
+            return -1;
+        }
+    }
+
+    if (out)
+    {
+        if (summary)
+        {
+            dpp_printf("Error: out= is only supported for format=prometheus\n");
+            return -1;
+        }
+        if (dpp_metrics_write_file(out) < 0)
+        {
+            dpp_printf("Error: Cannot write metrics to %s: %s\n", out, strerror(errno));
+            return -1;
+        }
+        dpp_printf("Metrics written to %s\n", out);
+    }
+    else if (summary)
+    {
+        metrics_write_summary(dpp_output());
+    }
+    else
+    {
+        ret = dpp_metrics_write(dpp_output());
+    }
+
+    if (dpp_arg_int(args, "reset", 0))
+    {
+        dpp_metrics_reset();
+        dpp_printf("Metrics reset\n");
+    }
+
+    return ret;
+}
@@ -6,172 +6,176 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "../include/dpp_configurator.h"
 
-#define MAX_RESPONSE_SIZE 4096
+#define MAX_EVENT_SIZE 4096
 
-// External functions
-extern int hostapd_cli_send_command(const char *interface, const char *cmd,
-                                    char *response, size_t response_size);
-
-// DPP認証の進行状況チェック
-static int dpp_check_auth_progress(struct dpp_configurator_ctx *ctx,
-                                   const char *interface)
+// hostapdが送信するDPPイベントと、その意味
+struct dpp_event_desc
 {
-    char cmd[512];
-    char response[MAX_RESPONSE_SIZE];
-    int ret;
-
-    // DPP認証の状態を確認
-    snprintf(cmd, sizeof(cmd), "STATUS");
-    ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
-    if (ret < 0)
-    {
-        printf("Failed to check authentication progress\n");
-        return -1;
-    }
-
-    // レスポンスを解析してDPP関連の情報を探す
-    if (strstr(response, "dpp_auth_ok_on_ack"))
-    {
-        printf("✓ DPP Authentication confirmed\n");
-        return 1;
-    }
-    else if (strstr(response, "dpp_auth_"))
-    {
-        printf("? DPP Authentication in progress\n");
-        return 0;
-    }
+    const char *prefix;
+    enum dpp_event_kind kind;
+};
+
+static const struct dpp_event_desc dpp_events[] = {
+    {DPP_EVENT_AUTH_SUCCESS, DPP_EVENT_KIND_AUTH_SUCCESS},
+    {DPP_EVENT_CONF_SENT, DPP_EVENT_KIND_CONF_SENT},
+    {DPP_EVENT_CONF_FAILED, DPP_EVENT_KIND_FAILED},
+    {DPP_EVENT_AUTH_INIT_FAILED, DPP_EVENT_KIND_FAILED},
+    {DPP_EVENT_NOT_COMPATIBLE, DPP_EVENT_KIND_FAILED},
+    {DPP_EVENT_FAIL, DPP_EVENT_KIND_FAILED},
+    {DPP_EVENT_RESPONSE_PENDING, DPP_EVENT_KIND_PROGRESS},
+    {DPP_EVENT_AUTH_DIRECTION, DPP_EVENT_KIND_PROGRESS},
+    {DPP_EVENT_CONF_REQ_RX, DPP_EVENT_KIND_PROGRESS},
+    {DPP_EVENT_CONN_STATUS_RESULT, DPP_EVENT_KIND_PROGRESS},
+    {NULL, DPP_EVENT_KIND_NONE}};
 
-    return -1;
-}
-
-// DPP認証完了チェック（Configuration Request/Response含む）
-static int dpp_check_config_completion(struct dpp_configurator_ctx *ctx,
-                                       const char *interface)
+/*
+ * hostapdの非同期イベント（"<3>DPP-AUTH-SUCCESS init=1" など）を分類する
+ * event_nameには優先度プレフィックスを除いたイベント本体の先頭を返す
+ */
+enum dpp_event_kind dpp_event_classify(const char *msg, const char **event_name)
 {
-    char cmd[512];
-    char response[MAX_RESPONSE_SIZE];
-    int ret;
+    int i;
 
-    // hostapdのログレベルを上げてDPPイベントを監視
-    snprintf(cmd, sizeof(cmd), "LOG_LEVEL DEBUG");
-    ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
+    if (!msg)
+        return DPP_EVENT_KIND_NONE;
 
-    // DPP関連の統計情報を取得
-    snprintf(cmd, sizeof(cmd), "DPP_BOOTSTRAP_INFO 1");
-    ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
-    if (ret == 0 && strstr(response, "OK"))
+    // "<level>" プレフィックスを除去
+    if (msg[0] == '<')
     {
-        printf("Bootstrap info available: %s\n", response);
+        const char *end = strchr(msg, '>');
+        if (end)
+            msg = end + 1;
     }
+    if (event_name)
+        *event_name = msg;
 
-    // DPP設定送信状態を確認
-    snprintf(cmd, sizeof(cmd), "STATUS");
-    ret = hostapd_cli_send_command(interface, cmd, response, sizeof(response));
-    if (ret == 0)
+    for (i = 0; dpp_events[i].prefix; i++)
     {
-        // Configuration完了の兆候を検索
-        if (strstr(response, "DPP_CONF_SENT") ||
-            strstr(response, "dpp_conf_sent=1") ||
-            strstr(response, "conf_status=0"))
+        // イベント名の定義は末尾に空白を含むので、空白を除いた名前で比較する
+        size_t len = strlen(dpp_events[i].prefix);
+        while (len > 0 && dpp_events[i].prefix[len - 1] == ' ')
+            len--;
+        if (strncmp(msg, dpp_events[i].prefix, len) == 0 &&
+            (msg[len] == ' ' || msg[len] == '\0' || msg[len] == '\n'))
         {
-            printf("✓ DPP Configuration sent successfully\n");
-            return 1;
-        }
-        else if (strstr(response, "DPP_CONF_REQ_RX"))
-        {
-            printf("? DPP Configuration Request received, processing...\n");
-            return 0;
+            return dpp_events[i].kind;
         }
     }
 
-    return -1;
+    return DPP_EVENT_KIND_NONE;
 }
 
-// DPP認証イベントループ（非同期処理）
-static int dpp_auth_event_loop(struct dpp_configurator_ctx *ctx,
-                               const char *interface,
-                               int timeout_seconds)
+/*
+ * DPP認証イベントループ
+ * ATTACH済みの接続でイベントを待ち、Configuration送信完了または失敗で終了する
+ * （待機中はpollでブロックするだけで、定期的な問い合わせは行わない）
+ * attemptがあれば、各フェーズの時間と結果をメトリクスに記録する
+ */
+int dpp_auth_event_loop(struct dpp_configurator_ctx *ctx,
+                        struct hostapd_ctrl *monitor,
+                        int timeout_seconds,
+                        struct dpp_metrics_attempt *attempt)
 {
-    int elapsed = 0;
-    int check_interval = 2; // 2秒間隔でチェック
-    int progress_status = 0;
-    int config_status = 0;
+    enum dpp_event_kind kind;
+    char event[MAX_EVENT_SIZE];
+    struct timespec start, now;
+    const char *name;
+    int elapsed_ms;
+    int ret;
 
-    printf("Monitoring DPP authentication progress (timeout: %ds)...\n",
-           timeout_seconds);
+    dpp_printf("Monitoring DPP authentication progress (timeout: %ds)...\n",
+               timeout_seconds);
 
-    while (elapsed < timeout_seconds)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;)
     {
-        sleep(check_interval);
-        elapsed += check_interval;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = (int)((now.tv_sec - start.tv_sec) * 1000 +
+                           (now.tv_nsec - start.tv_nsec) / 1000000);
+        if (elapsed_ms >= timeout_seconds * 1000)
+            break;
+
+        ret = hostapd_ctrl_recv_event(monitor, event, sizeof(event),
+                                      timeout_seconds * 1000 - elapsed_ms);
+        if (ret < 0)
+        {
+            dpp_printf("Error: Failed to receive hostapd event: %s\n", strerror(-ret));
+            if (attempt)
+                dpp_metrics_attempt_end(attempt, DPP_METRICS_RESULT_MONITOR_ERROR);
+            return -1;
+        }
+        if (ret == 0)
+            break;
 
-        // 認証進行状況をチェック
-        progress_status = dpp_check_auth_progress(ctx, interface);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = (int)((now.tv_sec - start.tv_sec) * 1000 +
+                           (now.tv_nsec - start.tv_nsec) / 1000000);
 
-        if (progress_status == 1)
-        {
-            printf("✓ DPP Authentication completed successfully!\n");
+        kind = dpp_event_classify(event, &name);
+        if (attempt)
+            dpp_metrics_attempt_event(attempt, kind, name);
 
-            // Configuration完了もチェック
-            config_status = dpp_check_config_completion(ctx, interface);
-            if (config_status == 1)
-            {
-                printf("✓ DPP Configuration completed successfully!\n");
-                return 0;
-            }
-            else
+        switch (kind)
+        {
+        case DPP_EVENT_KIND_AUTH_SUCCESS:
+            dpp_printf("✓ DPP Authentication completed successfully! (%dms) %s\n", elapsed_ms, name);
+            break;
+        case DPP_EVENT_KIND_CONF_SENT:
+            dpp_printf("✓ DPP Configuration completed successfully! (%dms) %s\n", elapsed_ms, name);
+            return 0;
+        case DPP_EVENT_KIND_FAILED:
+            dpp_printf("✗ DPP Authentication failed (%dms): %s\n", elapsed_ms, name);
+            return -1;
+        case DPP_EVENT_KIND_PROGRESS:
+            dpp_printf("... DPP Authentication in progress (%dms): %s\n", elapsed_ms, name);
+            break;
+        case DPP_EVENT_KIND_NONE:
+            if (ctx->verbose)
             {
-                printf("? Waiting for DPP Configuration completion...\n");
+                dpp_printf("  event (%dms): %s\n", elapsed_ms, name);
             }
-        }
-        else if (progress_status == 0)
-        {
-            printf("... DPP Authentication in progress (%ds elapsed)\n", elapsed);
-        }
-        else
-        {
-            printf("Checking authentication status... (%ds elapsed)\n", elapsed);
+            break;
         }
     }
 
-    printf("✗ DPP Authentication timeout after %d seconds\n", timeout_seconds);
+    dpp_printf("✗ DPP Authentication timeout after %d seconds\n", timeout_seconds);
+    if (attempt)
+        dpp_metrics_attempt_end(attempt, DPP_METRICS_RESULT_TIMEOUT);
     return -1;
 }
 
 // DPP認証の詳細監視コマンド
-int cmd_auth_monitor(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_auth_monitor(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
-    char *interface = NULL;
-    int timeout = 30; // デフォルト30秒
-    char *timeout_str = NULL;
+    const char *interface = dpp_arg(args, "interface");
+    int timeout = dpp_arg_int(args, "timeout", 30); // デフォルト30秒
+    struct hostapd_ctrl *monitor;
     int ret;
 
-    // 引数解析
-    interface = parse_argument(args, "interface");
-    timeout_str = parse_argument(args, "timeout");
-
-    if (timeout_str)
+    if (!interface)
     {
-        timeout = atoi(timeout_str);
-        free(timeout_str);
+        dpp_printf("Error: interface parameter required\n");
+        dpp_printf("Usage: auth_monitor interface=<ifname> [timeout=<seconds>]\n");
+        return -1;
     }
 
-    if (!interface)
+    dpp_printf("Monitoring DPP authentication events on interface %s\n", interface);
+    dpp_printf("Timeout: %d seconds\n", timeout);
+
+    // イベント受信用にATTACH
+    monitor = hostapd_ctrl_open_monitor(interface);
+    if (!monitor)
     {
-        printf("Error: interface parameter required\n");
-        printf("Usage: auth_monitor interface=<ifname> [timeout=<seconds>]\n");
         return -1;
     }
 
-    printf("Monitoring DPP authentication events on interface %s\n", interface);
-    printf("Timeout: %d seconds\n", timeout);
-
     // DPP認証イベントループを開始
-    ret = dpp_auth_event_loop(ctx, interface, timeout);
+    ret = dpp_auth_event_loop(ctx, monitor, timeout, NULL);
 
-    free(interface);
+    hostapd_ctrl_close(monitor);
     return ret;
 }
@@ -43,8 +43,8 @@ struct dpp_configurator_ctx *dpp_configurator_init(void)
     ctx->operating_freq = 2412;          // デフォルト: Channel 6
     ctx->config_request_monitor = false; // Configuration Request監視状態を初期化
 
-    printf("DPP Configurator initialized (hostapd mode)\n");
-    printf("Ready for wireless interface integration\n");
+    dpp_printf("DPP Configurator initialized (hostapd mode)\n");
+    dpp_printf("Ready for wireless interface integration\n");
     return ctx;
 }
 
@@ -73,25 +73,34 @@ void dpp_configurator_deinit(struct dpp_configurator_ctx *ctx)
         dpp_global_deinit(ctx->dpp_global);
     }
 
+    // 事前登録を止めてからhostapd制御接続をクローズ
+    dpp_peer_sync_stop();
+    hostapd_ctrl_close_all();
+
+    // 未コミットの状態を書き込んでストアを閉じる
+    dpp_state_close();
+
+    // 残りのログを書き出して書き込みスレッドを止める
+    dpp_log_shutdown();
+
     os_free(ctx);
 }
 
 // 残りのコマンド実装（リアルタイム監視など）
 // GAS/Configuration関連のコマンド（簡略化版）
-int cmd_config_request_monitor(struct dpp_configurator_ctx *ctx, char *args)
+int cmd_config_request_monitor(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
 {
-    char *interface = parse_argument(args, "interface");
+    const char *interface = dpp_arg(args, "interface");
     if (!interface)
     {
-        printf("Error: interface parameter required\n");
+        dpp_printf("Error: interface parameter required\n");
         return -1;
     }
 
-    printf("Configuration Request monitoring active\n");
-    printf("hostapd will automatically handle Configuration Request/Response\n");
-    printf("Monitor hostapd logs for detailed information\n");
+    dpp_printf("Configuration Request monitoring active\n");
+    dpp_printf("hostapd will automatically handle Configuration Request/Response\n");
+    dpp_printf("Monitor hostapd logs for detailed information\n");
 
     ctx->config_request_monitor = true;
-    free(interface);
     return 0;
 }
@@ -0,0 +1,477 @@
+/*
+ * DPP Configurator - Peer Pre-registration
+ * Push stored bootstrap entries to hostapd ahead of auth_init
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "../include/dpp_configurator.h"
+
+#define MAX_RESPONSE_SIZE 4096
+#define PEER_SYNC_MAX_INTERFACES 16
+#define PEER_SYNC_COMMIT_INTERVAL 1024 // この件数ごとに対応表をコミット
+#define PEER_SYNC_QUEUED 256            // インターフェースごとにエンジンへ積んでおく要求数
+
+// 登録待ちのBootstrap IDの範囲
+struct peer_sync_job
+{
+    struct peer_sync_job *next;
+    char interface[64];
+    int first_id;
+    int last_id;
+};
+
+// 同期済みのインターフェースと、そのときのhostapdインスタンス
+struct peer_sync_instance
+{
+    char interface[64];
+    char cookie[64];
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // ジョブの追加・完了を通知
+    struct peer_sync_job *head, *tail;
+    pthread_t thread;
+    bool thread_running;
+    bool busy;
+    bool stop;
+    bool background; // デーモンではジョブの完了を待たない
+    struct peer_sync_instance instances[PEER_SYNC_MAX_INTERFACES];
+    int instance_count;
+} peer_sync = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// 同期したインスタンスを記録（lock保持）
+static void peer_sync_remember(const char *interface, const char *cookie)
+{
+    int i;
+
+    for (i = 0; i < peer_sync.instance_count; i++)
+    {
+        if (strcmp(peer_sync.instances[i].interface, interface) == 0)
+            break;
+    }
+    if (i == peer_sync.instance_count)
+    {
+        if (i == PEER_SYNC_MAX_INTERFACES)
+            return;
+        peer_sync.instance_count++;
+    }
+    snprintf(peer_sync.instances[i].interface, sizeof(peer_sync.instances[i].interface),
+             "%s", interface);
+    snprintf(peer_sync.instances[i].cookie, sizeof(peer_sync.instances[i].cookie),
+             "%s", cookie);
+}
+
+// 1件をDPP_QR_CODEで登録し、対応を追記する（コミットしない）
+static int peer_sync_register(struct hostapd_ctrl *ctrl, const char *interface,
+                              const char *cookie, int peer_id)
+{
+    char cmd[1024];
+    char response[MAX_RESPONSE_SIZE];
+    char uri[DPP_BOOTSTRAP_URI_MAX];
+    int ret;
+
+    if (lookup_bootstrap_uri(peer_id, uri, sizeof(uri)) < 0)
+        return -1;
+
+    if (snprintf(cmd, sizeof(cmd), "DPP_QR_CODE %s", uri) >= (int)sizeof(cmd))
+        return -1;
+    ret = hostapd_ctrl_request(ctrl, cmd, response, sizeof(response));
+    if (ret < 0 || response[0] < '0' || response[0] > '9')
+        return -1;
+
+    ret = atoi(response);
+    append_hostapd_mapping(DPP_STATE_HOSTAPD_PEER, peer_id, interface, cookie, ret);
+    return ret;
+}
+
+/*
+ * auth_init用: ローカルのBootstrap IDに対応するhostapd側のIDを返す
+ * 事前登録済みならstat()と対応表の参照だけで済み、未登録ならここで登録する
+ */
+int dpp_hostapd_peer(const char *interface, int peer_id)
+{
+    struct hostapd_ctrl *ctrl;
+    char cookie[64];
+    int hostapd_id;
+
+    if (hostapd_ctrl_instance_cookie(interface, cookie, sizeof(cookie)) < 0)
+    {
+        dpp_printf("Error: hostapd control interface for %s not found\n", interface);
+        return -1;
+    }
+
+    hostapd_id = load_hostapd_mapping(DPP_STATE_HOSTAPD_PEER, peer_id, interface, cookie);
+    if (hostapd_id >= 0)
+        return hostapd_id;
+
+    if (lookup_bootstrap_uri(peer_id, NULL, 0) < 0)
+    {
+        dpp_printf("Error: Cannot find bootstrap URI for peer ID %d\n", peer_id);
+        return -1;
+    }
+
+    // hostapdが再起動していれば、デーモンでは他のピアもまとめて登録し直す
+    if (peer_sync.background)
+        dpp_peer_sync_check();
+
+    ctrl = hostapd_ctrl_get(interface);
+    if (!ctrl)
+        return -1;
+
+    DPP_LOG(DPP_LOG_PEER, DPP_LOG_INFO, "Peer %d is not registered in hostapd on %s, sending DPP_QR_CODE",
+            peer_id, interface);
+    hostapd_id = peer_sync_register(ctrl, interface, cookie, peer_id);
+    dpp_state_commit();
+    return hostapd_id;
+}
+
+// 一括登録の対象（インターフェースごと）
+struct peer_sync_target
+{
+    const char *interface;
+    char cookie[64];
+    int next_id;    // 次に調べるBootstrap ID
+    int queued;     // エンジンに積んだ未完了の要求
+    int registered; // 接続できなければ-1
+};
+
+static void peer_sync_done(void *arg, int id, int ret, const char *reply)
+{
+    struct peer_sync_target *target = arg;
+
+    target->queued--;
+    if (ret < 0 || reply[0] < '0' || reply[0] > '9')
+    {
+        DPP_LOG(DPP_LOG_PEER, DPP_LOG_WARN, "DPP_QR_CODE for peer %d failed on %s: %s", id,
+                target->interface, ret < 0 ? strerror(-ret) : reply);
+        return;
+    }
+    append_hostapd_mapping(DPP_STATE_HOSTAPD_PEER, id, target->interface, target->cookie,
+                           atoi(reply));
+    target->registered++;
+}
+
+// 未登録のIDを探してエンジンに積む（戻り値: 積んだ件数）
+static int peer_sync_fill(struct dpp_ctrl_engine *engine, struct peer_sync_target *target,
+                          int last_id)
+{
+    char cmd[1024];
+    int submitted = 0;
+
+    while (target->registered >= 0 && target->queued < PEER_SYNC_QUEUED &&
+           target->next_id <= last_id)
+    {
+        int id = target->next_id++;
+        char uri[DPP_BOOTSTRAP_URI_MAX];
+
+        if (load_hostapd_mapping(DPP_STATE_HOSTAPD_PEER, id, target->interface, target->cookie) >= 0)
+            continue;
+        if (lookup_bootstrap_uri(id, uri, sizeof(uri)) < 0 ||
+            snprintf(cmd, sizeof(cmd), "DPP_QR_CODE %s", uri) >= (int)sizeof(cmd))
+            continue;
+        if (dpp_ctrl_engine_submit(engine, target->interface, cmd, peer_sync_done, target, id) < 0)
+        {
+            target->registered = -1;
+            break;
+        }
+        target->queued++;
+        submitted++;
+    }
+    return submitted;
+}
+
+/*
+ * 範囲内の未登録のBootstrap情報を複数のhostapdへまとめて登録する
+ * 1つのスレッドで全インスタンスへの要求を並行して送り、応答順に対応表へ追記する
+ * registered[i]: interfaces[i]に登録した件数（接続できなければ-1）
+ */
+int dpp_peer_sync_interfaces(const char *const *interfaces, int count, int first_id,
+                             int last_id, int *registered)
+{
+    struct peer_sync_target *targets;
+    struct dpp_ctrl_engine *engine;
+    int committed = 0, total = 0;
+    int i, ret = 0;
+
+    targets = calloc(count, sizeof(*targets));
+    engine = dpp_ctrl_engine_new(0);
+    if (!targets || !engine)
+    {
+        free(targets);
+        dpp_ctrl_engine_free(engine);
+        return -1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        targets[i].interface = interfaces[i];
+        targets[i].next_id = first_id;
+        if (hostapd_ctrl_instance_cookie(interfaces[i], targets[i].cookie,
+                                         sizeof(targets[i].cookie)) < 0)
+            targets[i].registered = -1;
+    }
+    DPP_LOG(DPP_LOG_PEER, DPP_LOG_DEBUG, "Syncing peers %d-%d to %d interfaces (%s)", first_id,
+            last_id, count, dpp_ctrl_engine_backend(engine));
+
+    while (!peer_sync.stop)
+    {
+        for (i = 0; i < count; i++)
+            peer_sync_fill(engine, &targets[i], last_id);
+        if (dpp_ctrl_engine_pending(engine) == 0)
+            break;
+        if (dpp_ctrl_engine_poll(engine, -1) < 0)
+        {
+            ret = -1;
+            break;
+        }
+
+        for (i = 0, total = 0; i < count; i++)
+            total += targets[i].registered > 0 ? targets[i].registered : 0;
+        if (total - committed >= PEER_SYNC_COMMIT_INTERVAL)
+        {
+            dpp_state_commit();
+            committed = total;
+        }
+    }
+    // 停止した場合、残りの要求は取り消される
+    dpp_ctrl_engine_free(engine);
+    dpp_state_commit();
+
+    pthread_mutex_lock(&peer_sync.lock);
+    for (i = 0; i < count; i++)
+    {
+        registered[i] = targets[i].registered;
+        if (targets[i].registered >= 0)
+            peer_sync_remember(targets[i].interface, targets[i].cookie);
+    }
+    pthread_mutex_unlock(&peer_sync.lock);
+    free(targets);
+    return ret;
+}
+
+// 範囲内の未登録のBootstrap情報をhostapdへ登録（戻り値: 登録した件数）
+int dpp_peer_sync_range(const char *interface, int first_id, int last_id)
+{
+    int registered;
+
+    if (dpp_peer_sync_interfaces(&interface, 1, first_id, last_id, &registered) < 0)
+        return -1;
+    return registered;
+}
+
+static void *peer_sync_thread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&peer_sync.lock);
+    while (!peer_sync.stop)
+    {
+        struct peer_sync_job *job = peer_sync.head;
+        if (!job)
+        {
+            pthread_cond_wait(&peer_sync.cond, &peer_sync.lock);
+            continue;
+        }
+        peer_sync.head = job->next;
+        if (!peer_sync.head)
+            peer_sync.tail = NULL;
+        peer_sync.busy = true;
+        pthread_mutex_unlock(&peer_sync.lock);
+
+        dpp_peer_sync_range(job->interface, job->first_id, job->last_id);
+        free(job);
+
+        pthread_mutex_lock(&peer_sync.lock);
+        peer_sync.busy = false;
+        pthread_cond_broadcast(&peer_sync.cond);
+    }
+    pthread_mutex_unlock(&peer_sync.lock);
+    return NULL;
+}
+
+// 範囲をバックグラウンドでの登録待ちに追加
+int dpp_peer_sync_queue(const char *interface, int first_id, int last_id)
+{
+    struct peer_sync_job *job;
+    int ret = 0;
+
+    if (first_id > last_id)
+        return 0;
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+        return -1;
+    snprintf(job->interface, sizeof(job->interface), "%s", interface);
+    job->first_id = first_id;
+    job->last_id = last_id;
+
+    pthread_mutex_lock(&peer_sync.lock);
+    if (!peer_sync.thread_running)
+    {
+        peer_sync.stop = false;
+        if (pthread_create(&peer_sync.thread, NULL, peer_sync_thread, NULL) != 0)
+        {
+            free(job);
+            ret = -1;
+            goto out;
+        }
+        peer_sync.thread_running = true;
+    }
+    if (peer_sync.tail)
+        peer_sync.tail->next = job;
+    else
+        peer_sync.head = job;
+    peer_sync.tail = job;
+    pthread_cond_broadcast(&peer_sync.cond);
+out:
+    pthread_mutex_unlock(&peer_sync.lock);
+    return ret;
+}
+
+// 登録待ちがなくなるまで待つ
+void dpp_peer_sync_wait(void)
+{
+    pthread_mutex_lock(&peer_sync.lock);
+    while (peer_sync.thread_running && (peer_sync.head || peer_sync.busy))
+        pthread_cond_wait(&peer_sync.cond, &peer_sync.lock);
+    pthread_mutex_unlock(&peer_sync.lock);
+}
+
+// 同期済みのhostapdが再起動していれば、全Bootstrap情報を登録し直す
+void dpp_peer_sync_check(void)
+{
+    struct peer_sync_instance stale[PEER_SYNC_MAX_INTERFACES];
+    char cookie[64];
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&peer_sync.lock);
+    for (i = 0; i < peer_sync.instance_count; i++)
+    {
+        struct peer_sync_instance *inst = &peer_sync.instances[i];
+        if (hostapd_ctrl_instance_cookie(inst->interface, cookie, sizeof(cookie)) == 0 &&
+            strcmp(cookie, inst->cookie) != 0)
+        {
+            stale[count++] = *inst;
+            // 同じ再起動で何度も登録し直さないよう先に更新しておく
+            snprintf(inst->cookie, sizeof(inst->cookie), "%s", cookie);
+        }
+    }
+    pthread_mutex_unlock(&peer_sync.lock);
+
+    for (i = 0; i < count; i++)
+        dpp_peer_sync_queue(stale[i].interface, 1, load_bootstrap_max_id());
+}
+
+void dpp_peer_sync_set_background(bool background)
+{
+    peer_sync.background = background;
+}
+
+bool dpp_peer_sync_background(void)
+{
+    return peer_sync.background;
+}
+
+// バックグラウンドスレッドを止める（残りのジョブは破棄）
+void dpp_peer_sync_stop(void)
+{
+    struct peer_sync_job *job;
+
+    pthread_mutex_lock(&peer_sync.lock);
+    if (!peer_sync.thread_running)
+    {
+        pthread_mutex_unlock(&peer_sync.lock);
+        return;
+    }
+    peer_sync.stop = true;
+    pthread_cond_broadcast(&peer_sync.cond);
+    pthread_mutex_unlock(&peer_sync.lock);
+
+    pthread_join(peer_sync.thread, NULL);
+
+    pthread_mutex_lock(&peer_sync.lock);
+    while ((job = peer_sync.head))
+    {
+        peer_sync.head = job->next;
+        free(job);
+    }
+    peer_sync.tail = NULL;
+    peer_sync.thread_running = false;
+    peer_sync.stop = false;
+    pthread_mutex_unlock(&peer_sync.lock);
+}
+
+// peer_sync コマンド: 保存済みのBootstrap情報をhostapdへ一括登録（interface=は複数指定可）
+int cmd_peer_sync(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *interface = dpp_arg(args, "interface");
+    const char *interfaces[PEER_SYNC_MAX_INTERFACES];
+    int registered[PEER_SYNC_MAX_INTERFACES];
+    int first_id = dpp_arg_int(args, "from", 1);
+    int last_id;
+    int count = 0;
+    int ret = 0;
+    char *list, *token, *saveptr = NULL;
+    struct timespec t_start, t_end;
+    double elapsed;
+
+    (void)ctx; // 未使用パラメータの警告を避ける
+
+    if (!interface)
+    {
+        dpp_printf("Error: interface parameter required\n");
+        dpp_printf("Usage: peer_sync interface=<ifname>[,<ifname>...] [from=<id>] [to=<id>]\n");
+        return -1;
+    }
+
+    list = strdup(interface);
+    if (!list)
+        return -1;
+    for (token = strtok_r(list, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr))
+    {
+        if (count == PEER_SYNC_MAX_INTERFACES)
+        {
+            dpp_printf("Error: At most %d interfaces are supported\n", PEER_SYNC_MAX_INTERFACES);
+            free(list);
+            return -1;
+        }
+        interfaces[count++] = token;
+    }
+
+    last_id = dpp_arg_int(args, "to", load_bootstrap_max_id());
+
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    if (count == 0 || dpp_peer_sync_interfaces(interfaces, count, first_id, last_id, registered) < 0)
+    {
+        dpp_printf("Error: Peer synchronization failed\n");
+        free(list);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    elapsed = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (registered[i] < 0)
+        {
+            dpp_printf("Error: Cannot reach hostapd on %s\n", interfaces[i]);
+            ret = -1;
+            continue;
+        }
+        dpp_printf("Registered %d peers (IDs %d-%d) with hostapd on %s in %.3f s\n",
+                   registered[i], first_id, last_id, interfaces[i], elapsed);
+    }
+    free(list);
+    return ret;
+}
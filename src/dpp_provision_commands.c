@@ -0,0 +1,894 @@
+/*
+ * DPP Configurator - Multi-radio Provisioning
+ * Spread enrollees across several hostapd instances, one worker per radio,
+ * draining one channel group at a time
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "../include/dpp_configurator.h"
+#include "common/ieee802_11_common.h"
+
+#define MAX_EVENT_SIZE 4096
+#define PROVISION_MAX_RADIOS 16
+#define PROVISION_MAX_CHANNELS 32
+#define PROVISION_DEFAULT_TIMEOUT 30
+#define PROVISION_DEVICE_LINE_MAX 256
+
+enum provision_policy
+{
+    PROVISION_POLICY_LEAST_LOADED, // 空いた無線が共有キューから次を取る
+    PROVISION_POLICY_CHANNEL,      // URIのチャネルリストに一致する無線へ割り当てる
+};
+
+enum provision_order
+{
+    PROVISION_ORDER_CHANNEL, // チャネルごとにまとめて処理する
+    PROVISION_ORDER_FIFO,    // 指定順のまま処理する
+};
+
+// devicesファイルの1行: "<peer id> <pinCode> [<discriminator>]"
+struct provision_device
+{
+    int peer_id;
+    char pin[9];
+    char discriminator[8];
+};
+
+// 処理待ちのエンローリー
+struct provision_item
+{
+    int peer_id;
+    int freq;   // DPP交換に使う周波数（URIにチャネルリストが無ければ0）
+    size_t seq; // 指定順（チャネル切り替え回数の比較用）
+    int group;  // 並べ替えのキー
+    int reroutes; // 応答しないhostapdから別の無線へ回した回数
+    const struct provision_device *device; // 端末ごとの値（無ければNULL）
+};
+
+struct provision_queue
+{
+    struct provision_item *items;
+    size_t len;
+    size_t pos;
+};
+
+struct provision_run;
+
+// 無線（hostapdの制御インターフェース）ごとの状態
+struct provision_radio
+{
+    struct provision_run *run;
+    char interface[108];
+    int freq; // 動作周波数（MHz、不明なら0）
+    struct hostapd_ctrl *monitor;
+    pthread_t thread;
+    bool started;
+
+    struct provision_queue queue; // この無線専用のキュー（channelポリシー）
+    struct provision_queue done;  // 処理した順（チャネル切り替え回数の集計用）
+
+    unsigned int succeeded;
+    unsigned int failed;
+};
+
+struct provision_run
+{
+    struct dpp_configurator_ctx *ctx;
+    const char *params;
+    const struct dpp_template *tmpl; // 端末ごとの値を差し込むテンプレート（無ければNULL）
+    int configurator_id;
+    int timeout_ms;
+    FILE *out; // ワーカーの出力先（provisionコマンドのもの）
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct provision_queue shared; // どの無線でもよいピア
+    int busy; // 処理中のピア（別の無線へ回されうるので、0になるまでワーカーは終了しない）
+
+    struct provision_radio radios[PROVISION_MAX_RADIOS];
+    int radio_count;
+};
+
+static uint64_t provision_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// "1-100" や "1,5,7-9" をIDの配列に展開
+int *provision_parse_peers(const char *spec, size_t *count)
+{
+    const char *p = spec;
+    int *ids = NULL;
+    size_t len = 0, cap = 0;
+
+    while (*p)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p || first < 0)
+            goto fail;
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                goto fail;
+        }
+        for (long id = first; id <= last; id++)
+        {
+            if (len == cap)
+            {
+                size_t new_cap = cap ? cap * 2 : 256;
+                int *tmp = realloc(ids, new_cap * sizeof(*ids));
+                if (!tmp)
+                    goto fail;
+                ids = tmp;
+                cap = new_cap;
+            }
+            ids[len++] = (int)id;
+        }
+        if (*end == ',')
+            end++;
+        else if (*end)
+            goto fail;
+        p = end;
+    }
+
+    *count = len;
+    return ids;
+
+fail:
+    free(ids);
+    return NULL;
+}
+
+static int provision_device_compare(const void *a, const void *b)
+{
+    const struct provision_device *x = a, *y = b;
+
+    return x->peer_id < y->peer_id ? -1 : x->peer_id > y->peer_id ? 1 : 0;
+}
+
+// devicesファイルを読み込み、ピアID順に並べる（値の検証はテンプレートで行う）
+static struct provision_device *provision_load_devices(const char *path, size_t *count)
+{
+    struct provision_device *devices = NULL;
+    size_t len = 0, cap = 0;
+    char line[PROVISION_DEVICE_LINE_MAX];
+    int line_no = 0;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp)
+    {
+        dpp_printf("Error: Cannot open devices file: %s\n", path);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        struct provision_device dev;
+        char pin[16], discriminator[16];
+        int n;
+
+        line_no++;
+        memset(&dev, 0, sizeof(dev));
+        discriminator[0] = '\0';
+        n = sscanf(line, "%d %15s %15s", &dev.peer_id, pin, discriminator);
+        if (n <= 0 || line[strspn(line, " \t")] == '#')
+            continue;
+        if (n < 2 || dev.peer_id <= 0 || strlen(pin) >= sizeof(dev.pin) ||
+            strlen(discriminator) >= sizeof(dev.discriminator))
+        {
+            dpp_printf("Error: %s:%d: expected \"<peer id> <pinCode> [<discriminator>]\"\n", path,
+                       line_no);
+            goto fail;
+        }
+        strcpy(dev.pin, pin);
+        strcpy(dev.discriminator, discriminator);
+
+        if (len == cap)
+        {
+            size_t new_cap = cap ? cap * 2 : 256;
+            struct provision_device *tmp = realloc(devices, new_cap * sizeof(*tmp));
+            if (!tmp)
+                goto fail;
+            devices = tmp;
+            cap = new_cap;
+        }
+        devices[len++] = dev;
+    }
+    fclose(fp);
+
+    if (len == 0)
+    {
+        dpp_printf("Error: No devices in %s\n", path);
+        free(devices);
+        return NULL;
+    }
+    qsort(devices, len, sizeof(*devices), provision_device_compare);
+    *count = len;
+    return devices;
+
+fail:
+    fclose(fp);
+    free(devices);
+    return NULL;
+}
+
+// STATUSから動作周波数を取得
+static int provision_radio_freq(const char *interface)
+{
+    struct hostapd_ctrl *ctrl = hostapd_ctrl_get(interface);
+    struct hostapd_reply reply;
+    int freq = 0;
+
+    if (!ctrl)
+        return 0;
+    hostapd_reply_init(&reply);
+    if (hostapd_ctrl_request_reply(ctrl, "STATUS", &reply) > 0)
+        freq = hostapd_reply_get_int(&reply, "freq", 0);
+    hostapd_reply_free(&reply);
+    return freq;
+}
+
+// チャネルリストに一致する無線のうち、割り当てが最も少ないもの（無ければNULL）
+static struct provision_radio *provision_match_radio(struct provision_run *run,
+                                                     const int *freqs, int n)
+{
+    struct provision_radio *best = NULL;
+    int i, j;
+
+    for (i = 0; i < run->radio_count; i++)
+    {
+        struct provision_radio *radio = &run->radios[i];
+        for (j = 0; j < n; j++)
+        {
+            if (radio->freq && radio->freq == freqs[j])
+                break;
+        }
+        if (j < n && (!best || radio->queue.len < best->queue.len))
+            best = radio;
+    }
+    return best;
+}
+
+/*
+ * エンローリーとのDPP交換に使う周波数を選ぶ
+ * いずれかの無線の動作周波数を含むならそれ（チャネル切り替え不要）、
+ * 含まなければリストの先頭
+ */
+static int provision_pick_freq(struct provision_run *run, const int *freqs, int n)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < run->radio_count; j++)
+        {
+            if (run->radios[j].freq == freqs[i])
+                return freqs[i];
+        }
+    }
+    return n > 0 ? freqs[0] : 0;
+}
+
+static int provision_queue_push(struct provision_queue *queue, const struct provision_item *item)
+{
+    // 2の累乗ごとに拡張
+    if ((queue->len & (queue->len - 1)) == 0)
+    {
+        struct provision_item *tmp = realloc(queue->items,
+                                             (queue->len ? queue->len * 2 : 1) * sizeof(*tmp));
+        if (!tmp)
+            return -1;
+        queue->items = tmp;
+    }
+    queue->items[queue->len++] = *item;
+    return 0;
+}
+
+static int provision_item_compare(const void *a, const void *b)
+{
+    const struct provision_item *x = a, *y = b;
+
+    if (x->group != y->group)
+        return x->group < y->group ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq ? 1 : 0;
+}
+
+static int provision_seq_compare(const void *a, const void *b)
+{
+    const struct provision_item *x = a, *y = b;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq ? 1 : 0;
+}
+
+/*
+ * キューをチャネルグループ順に並べ替える
+ * 無線の動作周波数のグループを先頭に、以降は周波数順。グループ内は指定順を保つ
+ */
+static void provision_queue_group(struct provision_queue *queue, int home_freq)
+{
+    size_t i;
+
+    for (i = 0; i < queue->len; i++)
+    {
+        struct provision_item *item = &queue->items[i];
+        item->group = (!item->freq || item->freq == home_freq) ? 0 : item->freq;
+    }
+    qsort(queue->items, queue->len, sizeof(*queue->items), provision_item_compare);
+}
+
+// 無線が処理した順でのチャネル切り替え回数（動作周波数から開始）
+static unsigned int provision_count_switches(const struct provision_queue *queue, int home_freq)
+{
+    unsigned int switches = 0;
+    int last = home_freq;
+    size_t i;
+
+    for (i = 0; i < queue->len; i++)
+    {
+        int freq = queue->items[i].freq ? queue->items[i].freq : home_freq;
+        if (freq != last)
+            switches++;
+        last = freq;
+    }
+    return switches;
+}
+
+// 次のピアを取得（自分のキューを優先し、空なら共有キューから）
+static bool provision_next_item(struct provision_radio *radio, struct provision_item *item)
+{
+    struct provision_run *run = radio->run;
+    bool found = false;
+
+    pthread_mutex_lock(&run->lock);
+    for (;;)
+    {
+        if (radio->queue.pos < radio->queue.len)
+            *item = radio->queue.items[radio->queue.pos++];
+        else if (run->shared.pos < run->shared.len)
+            *item = run->shared.items[run->shared.pos++];
+        else if (run->busy > 0)
+        {
+            // 他の無線から回されてくるかもしれない
+            pthread_cond_wait(&run->cond, &run->lock);
+            continue;
+        }
+        else
+            break;
+        run->busy++;
+        found = true;
+        break;
+    }
+    pthread_mutex_unlock(&run->lock);
+    return found;
+}
+
+static void provision_item_done(struct provision_run *run)
+{
+    pthread_mutex_lock(&run->lock);
+    run->busy--;
+    pthread_cond_broadcast(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+}
+
+/*
+ * 応答しない無線のピアの移し先（run->lockを保持して呼ぶ）
+ * 動作チャネルがピアのチャネルリストに含まれ、hostapdが応答する無線のうち残りが最も少ないものの
+ * 専用キュー。チャネルリストが無ければ共有キュー。移せる無線が無ければNULL
+ */
+static struct provision_queue *provision_reroute_queue(struct provision_radio *from,
+                                                       struct provision_item *item)
+{
+    struct provision_run *run = from->run;
+    struct provision_radio *best = NULL;
+    int freqs[PROVISION_MAX_CHANNELS];
+    char uri[DPP_BOOTSTRAP_URI_MAX];
+    int n = lookup_bootstrap_uri(item->peer_id, uri, sizeof(uri)) >= 0
+                ? dpp_uri_channel_freqs(uri, freqs, PROVISION_MAX_CHANNELS)
+                : 0;
+    int i, j;
+
+    for (i = 0; i < run->radio_count; i++)
+    {
+        struct provision_radio *radio = &run->radios[i];
+
+        if (radio == from || !radio->started ||
+            hostapd_ctrl_breaker(radio->interface, NULL) == HOSTAPD_BREAKER_OPEN)
+            continue;
+        for (j = 0; j < n; j++)
+        {
+            if (radio->freq && radio->freq == freqs[j])
+                break;
+        }
+        if (n > 0 && j == n)
+            continue;
+        if (!best || radio->queue.len - radio->queue.pos < best->queue.len - best->queue.pos)
+            best = radio;
+    }
+    if (!best)
+        return NULL;
+    if (n == 0)
+        return &run->shared;
+    item->freq = best->freq;
+    return &best->queue;
+}
+
+/*
+ * hostapdが応答しない（ブレーカーが開いた）無線のピアを、同じチャネルの他の無線に任せる
+ * 割り当て済みのピアも移し、移せないものはこの無線の回復を待つ（戻り値: itemを移したらtrue）
+ */
+static bool provision_reroute(struct provision_radio *radio, struct provision_item *item)
+{
+    struct provision_run *run = radio->run;
+    struct provision_queue *target;
+    size_t i, kept;
+
+    if (item->reroutes >= run->radio_count - 1)
+        return false;
+
+    pthread_mutex_lock(&run->lock);
+    item->reroutes++;
+    target = provision_reroute_queue(radio, item);
+    if (!target || provision_queue_push(target, item) < 0)
+    {
+        pthread_mutex_unlock(&run->lock);
+        return false;
+    }
+
+    kept = radio->queue.pos;
+    for (i = radio->queue.pos; i < radio->queue.len; i++)
+    {
+        struct provision_item *queued = &radio->queue.items[i];
+
+        target = provision_reroute_queue(radio, queued);
+        if (!target || provision_queue_push(target, queued) < 0)
+            radio->queue.items[kept++] = *queued;
+    }
+    radio->queue.len = kept;
+    run->busy--;
+    pthread_cond_broadcast(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+    return true;
+}
+
+// ブレーカーが半開になる（回復を確認できる）まで待つ
+static void provision_wait_breaker(struct provision_radio *radio)
+{
+    struct timespec ts;
+    int retry_ms;
+
+    if (hostapd_ctrl_breaker(radio->interface, &retry_ms) != HOSTAPD_BREAKER_OPEN)
+        return;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += retry_ms / 1000;
+    ts.tv_nsec += (long)(retry_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&radio->run->lock);
+    while (pthread_cond_timedwait(&radio->run->cond, &radio->run->lock, &ts) != ETIMEDOUT)
+        ;
+    pthread_mutex_unlock(&radio->run->lock);
+}
+
+// 完了（Configuration送信）または失敗のイベントを待つ
+static int provision_wait(struct provision_radio *radio, struct dpp_metrics_attempt *attempt,
+                          char *reason, size_t reason_size)
+{
+    enum dpp_event_kind kind;
+    char event[MAX_EVENT_SIZE];
+    uint64_t deadline = provision_now_ms() + radio->run->timeout_ms;
+    uint64_t now;
+    const char *name;
+    int ret;
+
+    while ((now = provision_now_ms()) < deadline)
+    {
+        ret = hostapd_ctrl_recv_event(radio->monitor, event, sizeof(event),
+                                      (int)(deadline - now));
+        if (ret < 0)
+        {
+            snprintf(reason, reason_size, "event monitor error");
+            dpp_metrics_attempt_end(attempt, DPP_METRICS_RESULT_MONITOR_ERROR);
+            return -1;
+        }
+        if (ret == 0)
+            break;
+
+        kind = dpp_event_classify(event, &name);
+        dpp_metrics_attempt_event(attempt, kind, name);
+        switch (kind)
+        {
+        case DPP_EVENT_KIND_CONF_SENT:
+            return 0;
+        case DPP_EVENT_KIND_FAILED:
+            snprintf(reason, reason_size, "%s", name);
+            return -1;
+        default:
+            break;
+        }
+    }
+
+    snprintf(reason, reason_size, "timeout");
+    dpp_metrics_attempt_end(attempt, DPP_METRICS_RESULT_TIMEOUT);
+    return -1;
+}
+
+static void *provision_worker(void *arg)
+{
+    struct provision_radio *radio = arg;
+    struct provision_run *run = radio->run;
+    char event[MAX_EVENT_SIZE];
+    char reason[128];
+    char params[DPP_AUTH_PARAMS_MAX + 32];
+    char device_params[DPP_AUTH_PARAMS_MAX];
+    struct provision_item item;
+    struct dpp_metrics_attempt attempt;
+    const char *base;
+    uint64_t start;
+    int peer_id;
+
+    dpp_output_set(run->out);
+    while (provision_next_item(radio, &item))
+    {
+        peer_id = item.peer_id;
+
+        // 前のピアの残りのイベントを捨てる
+        while (hostapd_ctrl_recv_event(radio->monitor, event, sizeof(event), 0) > 0)
+            ;
+
+        // 端末ごとの値があればテンプレートの差分だけを差し込む
+        base = run->params;
+        if (item.device)
+        {
+            if (dpp_template_render(run->tmpl, item.device->pin,
+                                    item.device->discriminator[0] ? item.device->discriminator : NULL,
+                                    device_params, sizeof(device_params)) < 0)
+            {
+                provision_queue_push(&radio->done, &item);
+                dpp_printf("[%s] peer %d: ✗ invalid pinCode/discriminator\n", radio->interface, peer_id);
+                radio->failed++;
+                provision_item_done(run);
+                continue;
+            }
+            base = device_params;
+        }
+
+        /*
+         * 動作チャネル以外で待ち受けるエンローリーには、Authentication Requestを待ち受けチャネルで
+         * 送ったうえで、以降の交換を無線の動作チャネルへ移すよう求める（待ち受けチャネルはURIから
+         * hostapdが選ぶので、neg_freqに同じ値を指定しても意味がない）
+         */
+        if (item.freq && radio->freq && item.freq != radio->freq)
+            snprintf(params, sizeof(params), "%s neg_freq=%d", base, radio->freq);
+        else
+            snprintf(params, sizeof(params), "%s", base);
+
+        start = provision_now_ms();
+        dpp_metrics_attempt_start(&attempt);
+        if (dpp_auth_start(run->ctx, radio->interface, peer_id, run->configurator_id,
+                           params, true) < 0)
+        {
+            dpp_metrics_attempt_total(&attempt);
+            // hostapdが応答しなければ他の無線へ回し、回復を確認できるまで新しいピアを取らない
+            if (hostapd_ctrl_breaker(radio->interface, NULL) == HOSTAPD_BREAKER_OPEN &&
+                provision_reroute(radio, &item))
+            {
+                dpp_printf("[%s] peer %d: ↪ hostapd not responding, moved to another radio\n",
+                           radio->interface, peer_id);
+                fflush(dpp_output());
+                provision_wait_breaker(radio);
+                continue;
+            }
+            provision_queue_push(&radio->done, &item);
+            dpp_printf("[%s] peer %d: ✗ failed to start authentication\n", radio->interface, peer_id);
+            radio->failed++;
+            provision_item_done(run);
+            continue;
+        }
+        provision_queue_push(&radio->done, &item);
+        dpp_metrics_attempt_initiated(&attempt);
+
+        if (provision_wait(radio, &attempt, reason, sizeof(reason)) == 0)
+        {
+            dpp_printf("[%s] peer %d: ✓ configured (%llums)\n", radio->interface, peer_id,
+                       (unsigned long long)(provision_now_ms() - start));
+            radio->succeeded++;
+        }
+        else
+        {
+            dpp_printf("[%s] peer %d: ✗ %s (%llums)\n", radio->interface, peer_id, reason,
+                       (unsigned long long)(provision_now_ms() - start));
+            radio->failed++;
+        }
+        fflush(dpp_output());
+        provision_item_done(run);
+    }
+
+    return NULL;
+}
+
+// provision コマンド: 複数の無線にピアを振り分けて並列にDPP設定を行う
+int cmd_provision(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    struct provision_run run;
+    enum provision_policy policy = PROVISION_POLICY_LEAST_LOADED;
+    enum provision_order order = PROVISION_ORDER_CHANNEL;
+    char *interfaces = dpp_arg(args, "interfaces");
+    const char *peers_str = dpp_arg(args, "peers");
+    const char *policy_str = dpp_arg(args, "policy");
+    const char *order_str = dpp_arg(args, "order");
+    const char *ctrl_dir = dpp_arg(args, "ctrl_dir");
+    const char *conf_type = dpp_arg(args, "conf");
+    const char *ssid = dpp_arg(args, "ssid");
+    const char *pass = dpp_arg(args, "pass");
+    const char *matter_pin = dpp_arg(args, "matter_pin");
+    const char *conf_json = dpp_arg(args, "conf_json");
+    const char *template_name = dpp_arg(args, "template");
+    const char *discriminator = dpp_arg(args, "discriminator");
+    const char *devices_file = dpp_arg(args, "devices");
+    const char *metrics_file = dpp_arg(args, "metrics");
+    char params[DPP_AUTH_PARAMS_MAX];
+    struct provision_device *devices = NULL;
+    size_t device_count = 0;
+    int *peers = NULL;
+    size_t peer_count = 0;
+    unsigned int succeeded = 0, failed = 0;
+    unsigned int switches = 0, switches_fifo = 0;
+    uint64_t start, elapsed_ms;
+    char *tok, *saveptr;
+    size_t i;
+    int r;
+    int ret = -1;
+
+    memset(&run, 0, sizeof(run));
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.cond, NULL);
+    run.ctx = ctx;
+    run.out = dpp_output();
+    run.configurator_id = dpp_arg_int(args, "configurator", 1);
+    run.timeout_ms = PROVISION_DEFAULT_TIMEOUT * 1000;
+
+    if (!interfaces || (!peers_str && !devices_file) || (!conf_type && !conf_json && !template_name))
+    {
+        dpp_printf("Error: interfaces, peers and conf (or conf_json, template) parameters required\n");
+        dpp_printf("Usage: provision interfaces=<if1,if2,...> peers=<from-to|id,id,...> [configurator=<id>] "
+                   "conf=<type> [ssid=<ssid>] [pass=<pass>] [matter_pin=<pin>] [conf_json=\"<json>\"] "
+                   "[template=<name> [discriminator=<n>] [devices=<file>]] "
+                   "[policy=least-loaded|channel] [order=channel|fifo] [timeout=<seconds per device>] [ctrl_dir=<dir>] "
+                   "[metrics=<file>]\n");
+        goto cleanup;
+    }
+    if ((discriminator || devices_file) && !template_name)
+    {
+        dpp_printf("Error: discriminator and devices require a template\n");
+        goto cleanup;
+    }
+
+    if (policy_str)
+    {
+        if (strcmp(policy_str, "channel") == 0)
+            policy = PROVISION_POLICY_CHANNEL;
+        else if (strcmp(policy_str, "least-loaded") != 0)
+        {
+            dpp_printf("Error: Unknown policy: %s (use least-loaded or channel)\n", policy_str);
+            goto cleanup;
+        }
+    }
+    if (order_str)
+    {
+        if (strcmp(order_str, "fifo") == 0)
+            order = PROVISION_ORDER_FIFO;
+        else if (strcmp(order_str, "channel") != 0)
+        {
+            dpp_printf("Error: Unknown order: %s (use channel or fifo)\n", order_str);
+            goto cleanup;
+        }
+    }
+    if (dpp_arg_int(args, "timeout", 0) > 0)
+        run.timeout_ms = dpp_arg_int(args, "timeout", 0) * 1000;
+    if (ctrl_dir)
+        hostapd_ctrl_set_dir(ctrl_dir);
+
+    if (devices_file)
+    {
+        devices = provision_load_devices(devices_file, &device_count);
+        if (!devices)
+            goto cleanup;
+    }
+
+    // peersを省略した場合はdevicesファイルの全端末を対象にする
+    if (peers_str)
+    {
+        peers = provision_parse_peers(peers_str, &peer_count);
+        if (!peers || peer_count == 0)
+        {
+            dpp_printf("Error: Invalid peers list: %s\n", peers_str);
+            goto cleanup;
+        }
+    }
+    else
+    {
+        peers = malloc(device_count * sizeof(*peers));
+        if (!peers)
+            goto cleanup;
+        for (i = 0; i < device_count; i++)
+            peers[i] = devices[i].peer_id;
+        peer_count = device_count;
+    }
+
+    // テンプレートは一度だけ検証・分割し、端末ごとにはpinCode/discriminatorだけを差し込む
+    if (template_name)
+    {
+        run.tmpl = dpp_template_get(template_name);
+        if (!run.tmpl)
+            goto cleanup;
+        if (dpp_template_render(run.tmpl, matter_pin, discriminator, params, sizeof(params)) < 0)
+        {
+            dpp_printf("Error: Cannot build configuration from template (check matter_pin/discriminator)\n");
+            goto cleanup;
+        }
+        for (i = 0; i < device_count; i++)
+        {
+            char scratch[DPP_AUTH_PARAMS_MAX];
+            if (dpp_template_render(run.tmpl, devices[i].pin,
+                                    devices[i].discriminator[0] ? devices[i].discriminator : NULL,
+                                    scratch, sizeof(scratch)) < 0)
+            {
+                dpp_printf("Error: %s: invalid pinCode/discriminator for peer %d\n", devices_file,
+                           devices[i].peer_id);
+                goto cleanup;
+            }
+        }
+    }
+    else if (dpp_auth_build_params(conf_type, ssid, pass, matter_pin, conf_json,
+                                   params, sizeof(params)) < 0)
+        goto cleanup;
+    run.params = params;
+
+    // 無線ごとにイベント監視を開始（DPP_AUTH_INITより前にATTACHしておく）
+    for (tok = strtok_r(interfaces, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr))
+    {
+        struct provision_radio *radio;
+
+        if (run.radio_count == PROVISION_MAX_RADIOS)
+        {
+            dpp_printf("Error: At most %d interfaces are supported\n", PROVISION_MAX_RADIOS);
+            goto cleanup;
+        }
+        radio = &run.radios[run.radio_count];
+        radio->run = &run;
+        snprintf(radio->interface, sizeof(radio->interface), "%s", tok);
+        radio->monitor = hostapd_ctrl_open_monitor(radio->interface);
+        if (!radio->monitor)
+            goto cleanup;
+        radio->freq = provision_radio_freq(radio->interface);
+        run.radio_count++;
+        dpp_printf("Radio %s: %d MHz\n", radio->interface, radio->freq);
+    }
+
+    // 割り当て: channelポリシーでは一致する無線の専用キューへ、それ以外は共有キューへ
+    for (i = 0; i < peer_count; i++)
+    {
+        struct provision_radio *radio = NULL;
+        struct provision_item item = {0};
+        int freqs[PROVISION_MAX_CHANNELS];
+        char uri[DPP_BOOTSTRAP_URI_MAX];
+        int n = lookup_bootstrap_uri(peers[i], uri, sizeof(uri)) >= 0
+                    ? dpp_uri_channel_freqs(uri, freqs, PROVISION_MAX_CHANNELS)
+                    : 0;
+
+        item.peer_id = peers[i];
+        item.seq = i;
+        if (devices)
+        {
+            struct provision_device key = {.peer_id = peers[i]};
+            item.device = bsearch(&key, devices, device_count, sizeof(*devices),
+                                  provision_device_compare);
+        }
+        if (policy == PROVISION_POLICY_CHANNEL)
+            radio = provision_match_radio(&run, freqs, n);
+        item.freq = radio ? radio->freq : provision_pick_freq(&run, freqs, n);
+        r = provision_queue_push(radio ? &radio->queue : &run.shared, &item);
+        if (r < 0)
+            goto cleanup;
+    }
+
+    // 各キューを1チャネルずつ処理できるように並べ替える
+    if (order == PROVISION_ORDER_CHANNEL)
+    {
+        for (r = 0; r < run.radio_count; r++)
+            provision_queue_group(&run.radios[r].queue, run.radios[r].freq);
+        provision_queue_group(&run.shared, run.radios[0].freq);
+    }
+
+    dpp_printf("Provisioning %zu devices on %d radios (policy: %s, order: %s)\n", peer_count,
+               run.radio_count, policy == PROVISION_POLICY_CHANNEL ? "channel" : "least-loaded",
+               order == PROVISION_ORDER_CHANNEL ? "channel" : "fifo");
+    fflush(dpp_output());
+
+    start = provision_now_ms();
+    for (r = 0; r < run.radio_count; r++)
+    {
+        struct provision_radio *radio = &run.radios[r];
+        radio->started = pthread_create(&radio->thread, NULL, provision_worker, radio) == 0;
+        if (!radio->started)
+            dpp_printf("Warning: Failed to start worker for %s\n", radio->interface);
+    }
+    for (r = 0; r < run.radio_count; r++)
+    {
+        if (run.radios[r].started)
+            pthread_join(run.radios[r].thread, NULL);
+    }
+    elapsed_ms = provision_now_ms() - start;
+
+    dpp_printf("\nProvisioning summary:\n");
+    for (r = 0; r < run.radio_count; r++)
+    {
+        struct provision_radio *radio = &run.radios[r];
+        unsigned int sw = provision_count_switches(&radio->done, radio->freq);
+        unsigned int sw_fifo;
+
+        // 同じエンローリーを指定順に処理した場合と比較
+        qsort(radio->done.items, radio->done.len, sizeof(*radio->done.items),
+              provision_seq_compare);
+        sw_fifo = provision_count_switches(&radio->done, radio->freq);
+
+        dpp_printf("  %-24s %u configured, %u failed, %u channel switches\n", radio->interface,
+                   radio->succeeded, radio->failed, sw);
+        succeeded += radio->succeeded;
+        failed += radio->failed;
+        switches += sw;
+        switches_fifo += sw_fifo;
+    }
+    // どのワーカーも起動できなかった場合の残り
+    failed += (unsigned int)(peer_count - succeeded - failed);
+    dpp_printf("  Total: %u configured, %u failed in %.1f s (%.1f devices/min)\n",
+               succeeded, failed, elapsed_ms / 1000.0,
+               elapsed_ms ? succeeded * 60000.0 / elapsed_ms : 0.0);
+    // 無線ごとに処理した顔ぶれは同じまま、順序だけを比べる（無線への割り当ての効果は含まない）
+    dpp_printf("  Channel switches: %u (%u if each radio had kept request order)\n",
+               switches, switches_fifo);
+    ret = failed ? -1 : 0;
+
+    // 各フェーズの分布（p50/p99）はPrometheus形式で保存する
+    if (metrics_file)
+    {
+        if (dpp_metrics_write_file(metrics_file) == 0)
+            dpp_printf("  Metrics written to %s\n", metrics_file);
+        else
+            dpp_printf("Warning: Cannot write metrics to %s\n", metrics_file);
+    }
+
+cleanup:
+    for (r = 0; r < run.radio_count; r++)
+    {
+        hostapd_ctrl_close(run.radios[r].monitor);
+        free(run.radios[r].queue.items);
+        free(run.radios[r].done.items);
+    }
+    if (ctrl_dir)
+        hostapd_ctrl_set_dir(NULL);
+    dpp_template_release(run.tmpl);
+    pthread_cond_destroy(&run.cond);
+    pthread_mutex_destroy(&run.lock);
+    free(run.shared.items);
+    free(peers);
+    free(devices);
+    return ret;
+}
@@ -0,0 +1,752 @@
+/*
+ * DPP Configurator - Loopback Simulator
+ * Run complete DPP authentication and configuration exchanges between an
+ * in-process configurator and virtual enrollees, without radios or hostapd
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "../include/dpp_configurator.h"
+
+#define SIM_DEFAULT_ENROLLEES 100
+#define SIM_MAX_THREADS 256
+#define SIM_DEFAULT_CURVE "prime256v1"
+#define SIM_DEFAULT_SSID "SimNetwork"
+#define SIM_DEFAULT_PASS "simulate-only"
+#define SIM_GAS_HDR_LEN 3 // Category, Action, Dialog Token
+#define SIM_DEFAULT_KEYPOOL 64 // 事前生成しておくプロトコル鍵の数（0で無効）
+#define SIM_MAX_IN_FLIGHT 32   // 署名プールを使う場合にワーカー1つが同時に扱う端末数
+
+// 交換の各段階（どちら側の処理か: C = Configurator, E = Enrollee）
+enum sim_phase
+{
+    SIM_PHASE_ENROLLEE_BOOTSTRAP, // E: ブートストラップ鍵の生成（端末の製造時に相当）
+    SIM_PHASE_QR_CODE,            // C: dpp_add_qr_code（URIの公開鍵の復号）
+    SIM_PHASE_AUTH_REQ,           // C: dpp_auth_init（プロトコル鍵の生成・Auth Request）
+    SIM_PHASE_AUTH_RESP,          // E: dpp_auth_req_rx（Auth Response）
+    SIM_PHASE_AUTH_CONF,          // C: dpp_auth_resp_rx（Auth Confirm）
+    SIM_PHASE_AUTH_CONF_RX,       // E: dpp_auth_conf_rx
+    SIM_PHASE_CONF_REQ,           // E: Configuration Request
+    SIM_PHASE_CONF_RESP,          // C: dpp_conf_req_rx（設定オブジェクトの作成）
+    SIM_PHASE_CONF_RESP_RX,       // E: dpp_conf_resp_rx
+    SIM_PHASES
+};
+
+static const struct
+{
+    const char *name;
+    bool configurator;
+} sim_phases[SIM_PHASES] = {
+    [SIM_PHASE_ENROLLEE_BOOTSTRAP] = {"enrollee_bootstrap", false},
+    [SIM_PHASE_QR_CODE] = {"qr_code", true},
+    [SIM_PHASE_AUTH_REQ] = {"auth_req", true},
+    [SIM_PHASE_AUTH_RESP] = {"auth_resp", false},
+    [SIM_PHASE_AUTH_CONF] = {"auth_conf", true},
+    [SIM_PHASE_AUTH_CONF_RX] = {"auth_conf_rx", false},
+    [SIM_PHASE_CONF_REQ] = {"conf_req", false},
+    [SIM_PHASE_CONF_RESP] = {"conf_resp", true},
+    [SIM_PHASE_CONF_RESP_RX] = {"conf_resp_rx", false},
+};
+
+struct sim_run;
+
+// ワーカーごとの状態（dpp_globalはスレッドセーフではないので共有しない）
+struct sim_worker
+{
+    struct sim_run *run;
+    pthread_t thread;
+    bool started;
+    struct dpp_global *configurator;
+    struct dpp_global *enrollee;
+    char params[DPP_AUTH_PARAMS_MAX + 32]; // dpp_set_configurator()に渡す設定
+
+    uint64_t cpu_ns[SIM_PHASES];
+    unsigned int succeeded;
+    unsigned int failed;
+    struct dpp_authentication *last_auth; // 最後に成功した交換（auth_status用）
+
+    // 署名プールから戻ってきた交換
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct sim_session *done;
+    int in_flight;
+};
+
+struct sim_run
+{
+    struct dpp_configurator_ctx *ctx;
+    const char *curve;
+    const char *params;
+    int enrollees;
+    int next; // 次に処理する仮想エンローリーの番号（ワーカー間で取り合う）
+    bool keypool;
+    uint64_t *first_frame_ns; // エンローリーごとのQRコード読み取りからAuth Requestまで（0は未送信）
+    struct dpp_worker_pool *signers; // NULLならワーカーが自分で設定応答を作る
+    FILE *out; // ワーカーの出力先（simulateコマンドのもの）
+
+    struct sim_worker *workers;
+    int worker_count;
+};
+
+/*
+ * 1台分の交換の状態
+ * 署名プールに渡している間はプールのスレッドだけが触り、終わるとワーカーへ戻る
+ * （プールのスレッドが使うのは認証状態と、読み取るだけのConfiguratorの署名鍵のみ）
+ */
+struct sim_session
+{
+    struct dpp_worker_job job; // 先頭に置く
+    struct sim_worker *worker;
+    int index;
+    enum sim_phase phase; // 実行中（失敗した）段階
+    struct dpp_authentication *initiator;
+    struct dpp_authentication *responder;
+    struct dpp_bootstrap_info *peer_bi;
+    int enrollee_id;
+    struct wpabuf *msg; // Configuration Request、応答を作った後はConfiguration Response
+    const u8 *query;
+    size_t query_len;
+    uint64_t conf_resp_cpu_ns;
+    struct sim_session *next;
+};
+
+// イベントハンドラーの呼び出し回数
+static unsigned int sim_events[4];
+
+static uint64_t sim_now_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sim_on_auth_response(struct dpp_configurator_ctx *ctx, struct dpp_authentication *auth)
+{
+    (void)ctx;
+    (void)auth;
+    __atomic_fetch_add(&sim_events[0], 1, __ATOMIC_RELAXED);
+}
+
+static void sim_on_auth_confirm(struct dpp_configurator_ctx *ctx, struct dpp_authentication *auth)
+{
+    (void)ctx;
+    (void)auth;
+    __atomic_fetch_add(&sim_events[1], 1, __ATOMIC_RELAXED);
+}
+
+static void sim_on_config_result(struct dpp_configurator_ctx *ctx, struct dpp_authentication *auth)
+{
+    (void)ctx;
+    (void)auth;
+    __atomic_fetch_add(&sim_events[2], 1, __ATOMIC_RELAXED);
+}
+
+static void sim_on_auth_failed(struct dpp_configurator_ctx *ctx, struct dpp_authentication *auth,
+                               const char *reason)
+{
+    (void)auth;
+    // 最初の1件だけ表示する
+    if (__atomic_fetch_add(&sim_events[3], 1, __ATOMIC_RELAXED) == 0 && ctx->verbose)
+        dpp_printf("Simulated exchange failed: %s\n", reason);
+}
+
+/*
+ * DPP Public Action frameの本体からヘッダと属性を取り出す
+ * （hostapdが受信時に渡すのと同じく、hdrはOUIの先頭、属性はその後）
+ */
+static int sim_frame(const struct wpabuf *msg, const u8 **hdr, const u8 **attr, size_t *attr_len)
+{
+    const u8 *buf;
+
+    if (!msg || wpabuf_len(msg) < 2 + DPP_HDR_LEN)
+        return -1;
+    buf = wpabuf_head_u8(msg);
+    *hdr = buf + 2;
+    *attr = buf + 2 + DPP_HDR_LEN;
+    *attr_len = wpabuf_len(msg) - 2 - DPP_HDR_LEN;
+    return 0;
+}
+
+// GAS Initial RequestからQuery Requestの中身（DPPの属性）を取り出す
+static int sim_gas_query(const struct wpabuf *msg, const u8 **query, size_t *query_len)
+{
+    const u8 *buf;
+    size_t len, pos;
+
+    if (!msg)
+        return -1;
+    buf = wpabuf_head_u8(msg);
+    len = wpabuf_len(msg);
+    pos = SIM_GAS_HDR_LEN;
+    // Advertisement Protocol要素
+    if (pos + 2 > len || pos + 2 + buf[pos + 1] > len)
+        return -1;
+    pos += 2 + buf[pos + 1];
+    if (pos + 2 > len)
+        return -1;
+    *query_len = buf[pos] | (buf[pos + 1] << 8);
+    pos += 2;
+    if (pos + *query_len > len)
+        return -1;
+    *query = buf + pos;
+    return 0;
+}
+
+// 前回の呼び出しからのCPU時間を段階に加算する
+static void sim_account(struct sim_worker *worker, enum sim_phase phase, uint64_t *t)
+{
+    uint64_t now = sim_now_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    worker->cpu_ns[phase] += now - *t;
+    *t = now;
+}
+
+/*
+ * Configurator側が設定を受け取るまで（Configuration Requestができるまで）
+ * 成功ならsession->msgがConfiguration Request、session->queryがその中身を指す
+ */
+static int sim_session_auth(struct sim_session *session)
+{
+    struct sim_worker *worker = session->worker;
+    struct sim_run *run = worker->run;
+    struct dpp_configurator_ctx *ctx = run->ctx;
+    struct dpp_bootstrap_info *own_bi = NULL;
+    struct wpabuf *msg = NULL;
+    const u8 *hdr, *attr;
+    size_t attr_len;
+    char cmd[64];
+    const char *uri = NULL;
+    uint64_t t = sim_now_ns(CLOCK_THREAD_CPUTIME_ID);
+    uint64_t ready;
+    int ret = -1;
+
+    // 端末側: ブートストラップ鍵とQRコードのURI
+    session->phase = SIM_PHASE_ENROLLEE_BOOTSTRAP;
+    snprintf(cmd, sizeof(cmd), "type=qrcode curve=%s", run->curve);
+    session->enrollee_id = dpp_bootstrap_gen(worker->enrollee, cmd);
+    if (session->enrollee_id > 0)
+    {
+        own_bi = dpp_bootstrap_get_id(worker->enrollee, session->enrollee_id);
+        uri = dpp_bootstrap_get_uri(worker->enrollee, session->enrollee_id);
+    }
+    sim_account(worker, session->phase, &t);
+    if (!own_bi || !uri)
+        goto out;
+
+    // Configurator側: QRコードの読み取りとAuth Request
+    session->phase = SIM_PHASE_QR_CODE;
+    ready = sim_now_ns(CLOCK_MONOTONIC);
+    session->peer_bi = dpp_add_qr_code(worker->configurator, uri);
+    sim_account(worker, session->phase, &t);
+    if (!session->peer_bi)
+        goto out;
+
+    // プロトコル鍵はプールから取る（端末側のdpp_auth_req_rx()はその場で生成する）
+    session->phase = SIM_PHASE_AUTH_REQ;
+    dpp_keypool_attach(run->keypool);
+    session->initiator = dpp_auth_init(worker->configurator, NULL, session->peer_bi, NULL,
+                                       DPP_CAPAB_CONFIGURATOR, 0, NULL, 0);
+    dpp_keypool_attach(false);
+    if (session->initiator && dpp_set_configurator(session->initiator, worker->params) < 0)
+    {
+        dpp_auth_deinit(session->initiator);
+        session->initiator = NULL;
+    }
+    sim_account(worker, session->phase, &t);
+    if (!session->initiator ||
+        sim_frame(session->initiator->req_msg, &hdr, &attr, &attr_len) < 0)
+        goto out;
+    run->first_frame_ns[session->index] = sim_now_ns(CLOCK_MONOTONIC) - ready;
+
+    // 端末側: Auth Request → Auth Response
+    session->phase = SIM_PHASE_AUTH_RESP;
+    session->responder = dpp_auth_req_rx(worker->enrollee, NULL, DPP_CAPAB_ENROLLEE, 0, NULL,
+                                         own_bi, ctx->operating_freq, hdr, attr, attr_len);
+    sim_account(worker, session->phase, &t);
+    if (!session->responder ||
+        sim_frame(session->responder->resp_msg, &hdr, &attr, &attr_len) < 0)
+        goto out;
+
+    // Configurator側: Auth Response → Auth Confirm
+    session->phase = SIM_PHASE_AUTH_CONF;
+    msg = dpp_auth_resp_rx(session->initiator, hdr, attr, attr_len);
+    sim_account(worker, session->phase, &t);
+    if (sim_frame(msg, &hdr, &attr, &attr_len) < 0)
+        goto out;
+    if (ctx->event_handler.auth_response_received)
+        ctx->event_handler.auth_response_received(ctx, session->initiator);
+
+    session->phase = SIM_PHASE_AUTH_CONF_RX;
+    if (dpp_auth_conf_rx(session->responder, hdr, attr, attr_len) < 0)
+        goto out;
+    sim_account(worker, session->phase, &t);
+    wpabuf_free(msg);
+    msg = NULL;
+    if (ctx->event_handler.auth_confirm_received)
+        ctx->event_handler.auth_confirm_received(ctx, session->initiator);
+
+    // 端末側: Configuration Request（GAS）
+    session->phase = SIM_PHASE_CONF_REQ;
+    session->msg = dpp_build_conf_req_helper(session->responder, "sim", DPP_NETROLE_STA, NULL,
+                                             NULL, NULL, NULL);
+    sim_account(worker, session->phase, &t);
+    if (sim_gas_query(session->msg, &session->query, &session->query_len) < 0)
+        goto out;
+    ret = 0;
+
+out:
+    if (ret < 0)
+        sim_account(worker, session->phase, &t);
+    wpabuf_free(msg);
+    return ret;
+}
+
+/*
+ * Configurator側: 設定オブジェクトを作ってConfiguration Responseを返す
+ * （sta-dpp・ap-dppではConnectorの作成と署名を含む。署名プールのスレッドでも呼ばれる）
+ */
+static void sim_session_conf_resp(struct sim_session *session)
+{
+    uint64_t t = sim_now_ns(CLOCK_THREAD_CPUTIME_ID);
+    struct wpabuf *resp;
+
+    session->phase = SIM_PHASE_CONF_RESP;
+    resp = dpp_conf_req_rx(session->initiator, session->query, session->query_len);
+    wpabuf_free(session->msg);
+    session->msg = resp;
+    session->query = NULL;
+    session->conf_resp_cpu_ns = sim_now_ns(CLOCK_THREAD_CPUTIME_ID) - t;
+}
+
+// 署名プールのスレッド: 応答を作り、交換を担当するワーカーへ戻す
+static void sim_sign_job(struct dpp_worker_job *job)
+{
+    struct sim_session *session = (struct sim_session *)job;
+    struct sim_worker *worker = session->worker;
+
+    sim_session_conf_resp(session);
+
+    pthread_mutex_lock(&worker->lock);
+    session->next = worker->done;
+    worker->done = session;
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+// 残しておいた最後の交換を、参照しているブートストラップ情報とともに解放する
+static void sim_worker_release(struct sim_worker *worker)
+{
+    char id[16];
+
+    if (!worker->last_auth)
+        return;
+    snprintf(id, sizeof(id), "%u", worker->last_auth->peer_bi->id);
+    dpp_auth_deinit(worker->last_auth);
+    worker->last_auth = NULL;
+    dpp_bootstrap_remove(worker->configurator, id);
+}
+
+/*
+ * 端末側でConfiguration Responseを受け取り、交換を終える
+ * 成功した交換のConfigurator側の認証状態は最後の1件だけ残す（auth_status用）
+ */
+static void sim_session_finish(struct sim_session *session, bool authenticated)
+{
+    struct sim_worker *worker = session->worker;
+    struct dpp_configurator_ctx *ctx = worker->run->ctx;
+    uint64_t t;
+    char id[16];
+    int ret = -1;
+
+    if (authenticated)
+    {
+        worker->cpu_ns[SIM_PHASE_CONF_RESP] += session->conf_resp_cpu_ns;
+        t = sim_now_ns(CLOCK_THREAD_CPUTIME_ID);
+        if (session->msg)
+        {
+            session->phase = SIM_PHASE_CONF_RESP_RX;
+            ret = dpp_conf_resp_rx(session->responder, session->msg);
+            sim_account(worker, session->phase, &t);
+        }
+        if (ret == 0 && ctx->event_handler.config_result_received)
+            ctx->event_handler.config_result_received(ctx, session->initiator);
+    }
+    if (ret < 0 && ctx->event_handler.auth_failed)
+        ctx->event_handler.auth_failed(ctx, session->initiator, sim_phases[session->phase].name);
+
+    wpabuf_free(session->msg);
+    dpp_auth_deinit(session->responder);
+    if (ret == 0)
+    {
+        // 残す認証状態が参照するのでpeer_biは残す（sim_worker_release()で削除）
+        worker->succeeded++;
+        sim_worker_release(worker);
+        worker->last_auth = session->initiator;
+    }
+    else
+    {
+        worker->failed++;
+        dpp_auth_deinit(session->initiator);
+        // 終わった端末のブートストラップ情報は残さない
+        if (session->peer_bi)
+        {
+            snprintf(id, sizeof(id), "%u", session->peer_bi->id);
+            dpp_bootstrap_remove(worker->configurator, id);
+        }
+    }
+    if (session->enrollee_id > 0)
+    {
+        snprintf(id, sizeof(id), "%d", session->enrollee_id);
+        dpp_bootstrap_remove(worker->enrollee, id);
+    }
+    free(session);
+}
+
+// 次の仮想エンローリーの交換を始める（残りがなければNULL）
+static struct sim_session *sim_session_next(struct sim_worker *worker)
+{
+    struct sim_run *run = worker->run;
+    struct sim_session *session;
+    int index = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+
+    if (index >= run->enrollees)
+        return NULL;
+    session = calloc(1, sizeof(*session));
+    if (!session)
+    {
+        worker->failed++;
+        return NULL;
+    }
+    session->worker = worker;
+    session->index = index;
+    session->job.fn = sim_sign_job;
+    return session;
+}
+
+/*
+ * 署名プールを使う場合、設定応答はプールに任せて次の端末の交換を進める
+ * （無線の送受信に相当する処理が署名を待たない）。同時に扱う端末はSIM_MAX_IN_FLIGHTまで
+ */
+static void *sim_worker_thread(void *arg)
+{
+    struct sim_worker *worker = arg;
+    struct sim_run *run = worker->run;
+    struct sim_session *session, *done;
+    bool exhausted = false;
+
+    dpp_output_set(run->out);
+    while (!exhausted || worker->in_flight > 0)
+    {
+        if (!exhausted && worker->in_flight < SIM_MAX_IN_FLIGHT)
+        {
+            session = sim_session_next(worker);
+            if (!session)
+            {
+                exhausted = true;
+                continue;
+            }
+            if (sim_session_auth(session) < 0)
+            {
+                sim_session_finish(session, false);
+            }
+            else if (run->signers)
+            {
+                worker->in_flight++;
+                dpp_worker_pool_submit(run->signers, &session->job);
+            }
+            else
+            {
+                sim_session_conf_resp(session);
+                sim_session_finish(session, true);
+            }
+            if (!worker->in_flight)
+                continue;
+        }
+
+        // 署名が終わった端末へ応答を届ける（次の端末を始められるなら待たない）
+        pthread_mutex_lock(&worker->lock);
+        while (!worker->done && (exhausted || worker->in_flight >= SIM_MAX_IN_FLIGHT))
+            pthread_cond_wait(&worker->cond, &worker->lock);
+        done = worker->done;
+        worker->done = NULL;
+        pthread_mutex_unlock(&worker->lock);
+        while (done)
+        {
+            session = done;
+            done = done->next;
+            worker->in_flight--;
+            sim_session_finish(session, true);
+        }
+    }
+    return NULL;
+}
+
+static int sim_compare_ns(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// QRコードの読み取りからAuth Requestができるまでの時間の分布
+static void sim_first_frame_report(const struct sim_run *run)
+{
+    uint64_t *samples, total = 0;
+    int count = 0;
+
+    samples = malloc(run->enrollees * sizeof(*samples));
+    if (!samples)
+        return;
+    for (int i = 0; i < run->enrollees; i++)
+    {
+        if (run->first_frame_ns[i])
+        {
+            samples[count++] = run->first_frame_ns[i];
+            total += run->first_frame_ns[i];
+        }
+    }
+    if (count > 0)
+    {
+        qsort(samples, count, sizeof(*samples), sim_compare_ns);
+        dpp_printf("  Time to first frame: avg %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                   total / 1e3 / count, samples[count / 2] / 1e3,
+                   samples[(count - 1) * 99 / 100] / 1e3, samples[count - 1] / 1e3);
+    }
+    free(samples);
+}
+
+static void sim_worker_deinit(struct sim_worker *worker)
+{
+    if (!worker->run)
+        return;
+    sim_worker_release(worker);
+    if (worker->configurator)
+        dpp_global_deinit(worker->configurator);
+    if (worker->enrollee)
+        dpp_global_deinit(worker->enrollee);
+    pthread_mutex_destroy(&worker->lock);
+    pthread_cond_destroy(&worker->cond);
+}
+
+// Configurator・端末それぞれのdpp_globalを作り、Configuratorを追加する
+static int sim_worker_init(struct sim_worker *worker, struct sim_run *run)
+{
+    struct dpp_global_config config;
+    char cmd[64];
+    int configurator_id;
+
+    memset(&config, 0, sizeof(config));
+    config.cb_ctx = run->ctx;
+    worker->run = run;
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->cond, NULL);
+    worker->configurator = dpp_global_init(&config);
+    worker->enrollee = dpp_global_init(&config);
+    if (!worker->configurator || !worker->enrollee)
+        return -1;
+
+    snprintf(cmd, sizeof(cmd), "curve=%s", run->curve);
+    configurator_id = dpp_configurator_add(worker->configurator, cmd);
+    if (configurator_id < 0)
+    {
+        dpp_printf("Error: Failed to add configurator (curve=%s)\n", run->curve);
+        return -1;
+    }
+    snprintf(worker->params, sizeof(worker->params), "configurator=%d %s", configurator_id,
+             run->params);
+    return 0;
+}
+
+// simulate コマンド: 無線なしでDPP交換を繰り返し、スループットと段階ごとのCPU時間を計測する
+int cmd_simulate(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    struct sim_run run;
+    struct dpp_event_handler saved = ctx->event_handler;
+    const char *conf_type = dpp_arg(args, "conf");
+    const char *ssid = dpp_arg(args, "ssid");
+    const char *pass = dpp_arg(args, "pass");
+    const char *matter_pin = dpp_arg(args, "matter_pin");
+    const char *conf_json = dpp_arg(args, "conf_json");
+    char params[DPP_AUTH_PARAMS_MAX];
+    uint64_t cpu_ns[SIM_PHASES];
+    uint64_t start, elapsed_ns, configurator_ns = 0, enrollee_ns = 0;
+    unsigned int succeeded = 0, failed = 0;
+    int threads = dpp_arg_int(args, "threads", 1);
+    int keypool = dpp_arg_int(args, "keypool", SIM_DEFAULT_KEYPOOL);
+    int signers = dpp_arg_int(args, "signers", 0);
+    unsigned long keypool_hits = 0, keypool_misses = 0;
+    int i, p;
+    int ret = -1;
+
+    memset(&run, 0, sizeof(run));
+    run.ctx = ctx;
+    run.out = dpp_output();
+    run.enrollees = dpp_arg_int(args, "enrollees", SIM_DEFAULT_ENROLLEES);
+    run.curve = dpp_arg(args, "curve");
+    if (!run.curve)
+        run.curve = SIM_DEFAULT_CURVE;
+    if (run.enrollees <= 0 || threads <= 0 || threads > SIM_MAX_THREADS || keypool < 0 ||
+        signers < 0)
+    {
+        dpp_printf("Error: enrollees must be positive, threads between 1 and %d, keypool and signers not negative\n",
+                   SIM_MAX_THREADS);
+        dpp_printf("Usage: simulate [enrollees=<n>] [threads=<n>] [signers=<n>] [curve=<curve>] [keypool=<n>] "
+                   "[conf=<type>] [ssid=<ssid>] [pass=<pass>] [matter_pin=<pin>] [conf_json=\"<json>\"]\n");
+        return -1;
+    }
+
+    // 既定はsta-psk（設定はhostapdへのDPP_AUTH_INITと同じ形式）
+    if (!conf_type && !conf_json)
+    {
+        conf_type = "sta-psk";
+        if (!ssid)
+            ssid = SIM_DEFAULT_SSID;
+        if (!pass)
+            pass = SIM_DEFAULT_PASS;
+    }
+    if (dpp_auth_build_params(conf_type, ssid, pass, matter_pin, conf_json, params,
+                              sizeof(params)) < 0)
+        return -1;
+    run.params = params;
+
+    run.workers = calloc(threads, sizeof(*run.workers));
+    run.first_frame_ns = calloc(run.enrollees, sizeof(*run.first_frame_ns));
+    if (!run.workers || !run.first_frame_ns)
+        goto cleanup;
+    for (i = 0; i < threads; i++)
+    {
+        if (sim_worker_init(&run.workers[i], &run) < 0)
+            goto cleanup;
+        run.worker_count++;
+    }
+
+    // 未設定のハンドラーだけ差し替え、終了後に戻す
+    memset(sim_events, 0, sizeof(sim_events));
+    if (!ctx->event_handler.auth_response_received)
+        ctx->event_handler.auth_response_received = sim_on_auth_response;
+    if (!ctx->event_handler.auth_confirm_received)
+        ctx->event_handler.auth_confirm_received = sim_on_auth_confirm;
+    if (!ctx->event_handler.config_result_received)
+        ctx->event_handler.config_result_received = sim_on_config_result;
+    if (!ctx->event_handler.auth_failed)
+        ctx->event_handler.auth_failed = sim_on_auth_failed;
+
+    // 鍵プールは満杯になってから計測を始める
+    if (keypool > 0)
+    {
+        if (dpp_keypool_start(run.curve, keypool) < 0)
+            goto cleanup;
+        run.keypool = true;
+    }
+
+    // 設定応答（Connectorの作成・署名）を別スレッドで行う
+    if (signers > 0)
+    {
+        run.signers = dpp_worker_pool_new(signers);
+        if (!run.signers)
+            goto cleanup;
+    }
+
+    dpp_printf("Simulating %d enrollees on %d thread%s (curve: %s, %s, key pool: %d", run.enrollees,
+               threads, threads == 1 ? "" : "s", run.curve, conf_json ? "conf_json" : conf_type,
+               keypool);
+    if (signers > 0)
+        dpp_printf(", %d signer thread%s", signers, signers == 1 ? "" : "s");
+    dpp_printf(")\n");
+    fflush(dpp_output());
+
+    start = sim_now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < run.worker_count; i++)
+    {
+        struct sim_worker *worker = &run.workers[i];
+        worker->started = pthread_create(&worker->thread, NULL, sim_worker_thread, worker) == 0;
+        if (!worker->started)
+            dpp_printf("Warning: Failed to start simulator thread %d\n", i);
+    }
+    for (i = 0; i < run.worker_count; i++)
+    {
+        if (run.workers[i].started)
+            pthread_join(run.workers[i].thread, NULL);
+    }
+    elapsed_ns = sim_now_ns(CLOCK_MONOTONIC) - start;
+    ctx->event_handler = saved;
+    dpp_worker_pool_free(run.signers);
+    run.signers = NULL;
+    if (run.keypool)
+    {
+        dpp_keypool_stats(&keypool_hits, &keypool_misses);
+        dpp_keypool_stop();
+        run.keypool = false;
+    }
+
+    memset(cpu_ns, 0, sizeof(cpu_ns));
+    for (i = 0; i < run.worker_count; i++)
+    {
+        struct sim_worker *worker = &run.workers[i];
+        for (p = 0; p < SIM_PHASES; p++)
+            cpu_ns[p] += worker->cpu_ns[p];
+        succeeded += worker->succeeded;
+        failed += worker->failed;
+    }
+
+    dpp_printf("\nSimulation summary:\n");
+    dpp_printf("  Handshakes: %u completed, %u failed in %.3f s (%.1f handshakes/s)\n", succeeded,
+               failed, elapsed_ns / 1e9, elapsed_ns ? succeeded * 1e9 / elapsed_ns : 0.0);
+    dpp_printf("  Events: %u auth response, %u auth confirm, %u config, %u failed\n", sim_events[0],
+               sim_events[1], sim_events[2], sim_events[3]);
+    sim_first_frame_report(&run);
+    if (keypool > 0)
+        dpp_printf("  Protocol keys: %lu from pool, %lu generated on demand (pool empty)\n",
+                   keypool_hits, keypool_misses);
+    dpp_printf("\n  %-20s %-4s %12s %14s\n", "Phase", "Side", "CPU total", "per handshake");
+    for (p = 0; p < SIM_PHASES; p++)
+    {
+        unsigned int n = succeeded + failed;
+        dpp_printf("  %-20s %-4s %10.1f ms %11.1f us\n", sim_phases[p].name,
+                   sim_phases[p].configurator ? "C" : "E", cpu_ns[p] / 1e6,
+                   n ? cpu_ns[p] / 1e3 / n : 0.0);
+        if (sim_phases[p].configurator)
+            configurator_ns += cpu_ns[p];
+        else
+            enrollee_ns += cpu_ns[p];
+    }
+    if (succeeded + failed)
+    {
+        double per = (double)configurator_ns / (succeeded + failed);
+        dpp_printf("\n  Configurator CPU per handshake: %.1f us (%.0f handshakes/s per core)\n",
+                   per / 1e3, per > 0 ? 1e9 / per : 0.0);
+        dpp_printf("  Enrollee CPU per handshake:     %.1f us\n",
+                   enrollee_ns / 1e3 / (succeeded + failed));
+    }
+
+    // 最後の交換をauth_statusと同じ形式で表示する（参照先はワーカーのdpp_globalにあるので、ここでだけ設定する）
+    for (i = run.worker_count - 1; ctx->verbose && i >= 0; i--)
+    {
+        if (run.workers[i].last_auth)
+        {
+            struct dpp_authentication *current = ctx->current_auth;
+
+            ctx->current_auth = run.workers[i].last_auth;
+            dpp_printf("\n");
+            cmd_auth_status(ctx, args);
+            ctx->current_auth = current;
+            break;
+        }
+    }
+    ret = failed ? -1 : 0;
+
+cleanup:
+    ctx->event_handler = saved;
+    dpp_worker_pool_free(run.signers);
+    if (run.keypool)
+        dpp_keypool_stop();
+    for (i = 0; run.workers && i < threads; i++)
+        sim_worker_deinit(&run.workers[i]);
+    free(run.workers);
+    free(run.first_frame_ns);
+    return ret;
+}
@@ -1,250 +1,1586 @@
 /*
  * DPP Configurator - State Management
  * Bootstrap and Configurator state persistence functions
+ *
+ * The state is an append-only log of records. Each record carries a type,
+ * an ID and a NUL-terminated payload (bootstrap URI, configurator curve, ...).
+ * A later record with the same type/ID supersedes an earlier one. An in-memory
+ * hash index maps type/ID to the file offset of the latest record, so lookups
+ * are a single hash probe instead of a scan of the whole file.
+ *
+ * Compaction writes an immutable snapshot next to the log: a header, slots
+ * sorted by type/ID and a heap of NUL-terminated payloads. The snapshot
+ * records how much of the log it covers, so a process that opens the store
+ * only indexes the log tail past that point. Both the snapshot and the log
+ * are memory-mapped and lookups return pointers into the mappings.
+ *
+ * The log is mapped into a fixed reserved address range, so growing it never
+ * moves records that were already returned. A mapping that does get replaced
+ * (a new snapshot after compaction) is unmapped once this process has
+ * committed DPP_STATE_RETIRE_COMMITS more batches. Other threads commit at any
+ * time, so readers copy the payload out under the store lock (dpp_state_get,
+ * dpp_state_read); raw pointers are only handed out to a thread that holds
+ * dpp_state_lock(), which keeps every other thread from committing.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../include/dpp_configurator.h"
 
-// Bootstrap情報の永続化
-#define DPP_STATE_FILE "/tmp/dpp_configurator_state.json"
+// 状態の永続化先
+#define DPP_STATE_FILE "/tmp/dpp_configurator_state.log"
+#define DPP_STATE_LEGACY_FILE "/tmp/dpp_configurator_state.json"
 
-// Bootstrap情報を保存
-int save_bootstrap_info(int id, const char *uri)
+#define DPP_STATE_RECORD_MAGIC 0x52505044 // "DPPR"
+#define DPP_STATE_MAX_PAYLOAD (1024 * 1024)
+#define DPP_STATE_SCAN_BUFFER (2 * 1024 * 1024) // 最大レコードより大きいこと
+#define DPP_STATE_COMMIT_THRESHOLD (256 * 1024)
+#define DPP_STATE_LOG_RESERVE ((size_t)1 << 30) // ログのマッピング用に予約する仮想アドレス範囲
+#define DPP_STATE_RETIRE_COMMITS 2              // 解放リストのマッピングを残すコミット回数
+
+#define DPP_SNAPSHOT_SUFFIX ".snap"
+#define DPP_SNAPSHOT_MAGIC 0x53505044 // "DPPS"
+#define DPP_SNAPSHOT_VERSION 1
+
+// レコードヘッダー（ファイル上の表現）
+struct dpp_state_record_hdr
 {
-    FILE *fp;
-    char buffer[4096];
-    int len;
+    uint32_t magic;
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t id;
+    uint32_t len;      // ペイロード長（終端NULを含む）
+    uint32_t checksum; // type/id/len/ペイロードのFNV-1a
+};
+
+// スナップショットファイルのヘッダー
+struct dpp_snapshot_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t log_ino;    // 対応するログファイルのinode
+    uint64_t log_offset; // ここまでのログの内容を含む
+    uint32_t count;      // スロット数
+    uint32_t max_bootstrap_id;
+    uint64_t slots_offset;
+    uint64_t heap_offset;
+    uint64_t heap_len;
+};
+
+// 固定長スロット（keyの昇順に並ぶ）
+struct dpp_snapshot_slot
+{
+    uint64_t key;
+    uint32_t offset; // ヒープ内のペイロード位置
+    uint32_t len;    // 終端NULを含む
+};
+
+// 解放を遅らせるマッピング・バッファ（返したポインタを使い終わるまで残す）
+struct dpp_state_mapping
+{
+    struct dpp_state_mapping *next;
+    void *addr;
+    size_t len;
+    bool heap;           // mallocした未コミットのバッファ（mmapではない）
+    uint64_t commit_gen; // 解放リストに移したときのcommit_gen
+};
+
+// type/ID → オフセットのハッシュ表（オープンアドレス法）
+struct dpp_state_index_entry
+{
+    uint64_t key; // 0は空きスロット
+    uint64_t offset;
+};
+
+struct dpp_state_table
+{
+    struct dpp_state_index_entry *entries;
+    size_t size; // 2のべき乗
+    size_t count;
+};
+
+struct dpp_state_store
+{
+    int fd;
+    bool opened;
+    uint64_t indexed_end;         // ここまでのレコードをインデックス済み
+    struct dpp_state_table index; // type/ID → ログ上のオフセット
+    int max_bootstrap_id;
+
+    // ログとスナップショットのマッピング
+    const char *log_map;
+    size_t log_map_len;
+    char *log_reserve;        // log_mapを置く予約範囲（NULLなら伸びるたびにマップし直す）
+    bool log_reserve_failed;
+    const char *snap_map;
+    size_t snap_map_len;
+    const struct dpp_snapshot_slot *snap_slots;
+    uint32_t snap_count;
+    const char *snap_heap;
+    uint64_t snap_heap_len;
+    struct dpp_state_mapping *retired;
+
+    // グループコミット: 追加されたレコードはpendingに溜め、1回のwrite+fdatasyncで書き込む
+    // 未コミットのレコードもpending_index（書き込み中はflushing_index）から参照できる
+    // pendingは他のスレッドの追加で置き換わるので、参照はlock中にコピーする（dpp_state_get()）
+    char *pending;
+    size_t pending_len;
+    size_t pending_cap;
+    struct dpp_state_table pending_index; // type/ID → pending内のオフセット
+    const char *flushing;                 // コミット中のバッチ（無ければNULL）
+    struct dpp_state_table flushing_index;
+    uint64_t appended_seq;
+    uint64_t durable_seq;
+    uint64_t commit_gen; // 完了したコミットの回数（解放リストの期限）
+    bool committing;
+    pthread_cond_t committed;
+    pthread_mutex_t lock;
+
+    // ファイルへの書き込みの排他（スレッド間はfile_lock、プロセス間はflock。lockより先に取る）
+    pthread_mutex_t file_lock;
+};
+
+static struct dpp_state_store state_store = {
+    .fd = -1,
+    .committed = PTHREAD_COND_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .file_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// このスレッドがdpp_state_lock()でファイルの排他を持っている深さ（入れ子にできる）
+static __thread int state_file_held;
+
+static char state_file[256] = DPP_STATE_FILE;
+
+// 状態ファイルのパスを変更（ベンチマーク用。開いているストアは閉じる）
+void dpp_state_set_file(const char *path)
+{
+    dpp_state_close();
+    snprintf(state_file, sizeof(state_file), "%s", path ? path : DPP_STATE_FILE);
+}
+
+static void state_snapshot_path(char *buf, size_t buflen)
+{
+    snprintf(buf, buflen, "%s%s", state_file, DPP_SNAPSHOT_SUFFIX);
+}
+
+static uint32_t state_checksum(const struct dpp_state_record_hdr *hdr, const void *payload)
+{
+    const uint8_t *p;
+    uint32_t h = 2166136261u;
+    size_t i;
 
-    // 既存の状態を読み込み
-    fp = fopen(DPP_STATE_FILE, "r");
-    if (fp)
+    h = (h ^ hdr->type) * 16777619u;
+    p = (const uint8_t *)&hdr->id;
+    for (i = 0; i < sizeof(hdr->id) + sizeof(hdr->len); i++)
+        h = (h ^ p[i]) * 16777619u;
+    p = payload;
+    for (i = 0; i < hdr->len; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static inline uint64_t state_key(uint8_t type, uint32_t id)
+{
+    return ((uint64_t)type << 32) | id;
+}
+
+static inline size_t state_hash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+static int state_table_grow(struct dpp_state_table *t)
+{
+    size_t new_size = t->size ? t->size * 2 : 1024;
+    struct dpp_state_index_entry *entries;
+    size_t i, j;
+
+    entries = calloc(new_size, sizeof(*entries));
+    if (!entries)
+        return -1;
+
+    for (i = 0; i < t->size; i++)
     {
-        len = fread(buffer, 1, sizeof(buffer) - 1, fp);
-        buffer[len] = '\0';
-        fclose(fp);
+        if (!t->entries[i].key)
+            continue;
+        for (j = state_hash(t->entries[i].key) & (new_size - 1); entries[j].key;
+             j = (j + 1) & (new_size - 1))
+            ;
+        entries[j] = t->entries[i];
     }
-    else
+
+    free(t->entries);
+    t->entries = entries;
+    t->size = new_size;
+    return 0;
+}
+
+static int state_table_put(struct dpp_state_table *t, uint64_t key, uint64_t offset)
+{
+    size_t i;
+
+    // 負荷率を1/2以下に保つ
+    if ((t->count + 1) * 2 > t->size && state_table_grow(t) < 0)
+        return -1;
+
+    for (i = state_hash(key) & (t->size - 1); t->entries[i].key; i = (i + 1) & (t->size - 1))
     {
-        strcpy(buffer, "{}");
+        if (t->entries[i].key == key)
+        {
+            t->entries[i].offset = offset; // 新しいレコードで上書き
+            return 0;
+        }
     }
 
-    // 新しい情報を追加
-    fp = fopen(DPP_STATE_FILE, "w");
-    if (!fp)
+    t->entries[i].key = key;
+    t->entries[i].offset = offset;
+    t->count++;
+    return 0;
+}
+
+static bool state_table_get(const struct dpp_state_table *t, uint64_t key, uint64_t *offset)
+{
+    size_t i;
+
+    if (!t->size)
+        return false;
+
+    for (i = state_hash(key) & (t->size - 1); t->entries[i].key; i = (i + 1) & (t->size - 1))
     {
-        return -1;
+        if (t->entries[i].key == key)
+        {
+            *offset = t->entries[i].offset;
+            return true;
+        }
     }
+    return false;
+}
+
+static void state_table_free(struct dpp_state_table *t)
+{
+    free(t->entries);
+    memset(t, 0, sizeof(*t));
+}
+
+static int state_index_put(struct dpp_state_store *st, uint8_t type, uint32_t id,
+                           uint64_t offset)
+{
+    if (state_table_put(&st->index, state_key(type, id), offset) < 0)
+        return -1;
+    if (type == DPP_STATE_BOOTSTRAP && (int)id > st->max_bootstrap_id)
+        st->max_bootstrap_id = (int)id;
+    return 0;
+}
 
-    fprintf(fp, "{\n");
+static bool state_index_get(struct dpp_state_store *st, uint8_t type, uint32_t id,
+                            uint64_t *offset)
+{
+    return state_table_get(&st->index, state_key(type, id), offset);
+}
 
-    // 既存のconfigurator情報があれば保持
-    if (strstr(buffer, "configurator_"))
+// バッファ中のレコードを検証（不完全・破損ならサイズ0を返す）
+static size_t state_parse_record(const char *buf, size_t avail,
+                                 struct dpp_state_record_hdr *hdr)
+{
+    if (avail < sizeof(*hdr))
+        return 0;
+    memcpy(hdr, buf, sizeof(*hdr));
+    if (hdr->magic != DPP_STATE_RECORD_MAGIC || hdr->len == 0 ||
+        hdr->len > DPP_STATE_MAX_PAYLOAD || avail < sizeof(*hdr) + hdr->len)
+        return 0;
+    if (buf[sizeof(*hdr) + hdr->len - 1] != '\0' ||
+        state_checksum(hdr, buf + sizeof(*hdr)) != hdr->checksum)
+        return 0;
+    return sizeof(*hdr) + hdr->len;
+}
+
+/*
+ * indexed_end からファイル末尾までのレコードをインデックスに追加（lock保持）
+ * 他プロセスが追記したレコードもここで取り込まれる
+ * 壊れたレコード（クラッシュで書きかけのまま、後に別のプロセスが追記した）は
+ * 次の正しいレコードまで読み飛ばす
+ * 戻り値: 末尾に正しいレコードが続かない不完全・破損データが残っていれば1
+ */
+static int state_scan_tail(struct dpp_state_store *st)
+{
+    struct dpp_state_record_hdr hdr;
+    struct stat sb;
+    char *buf;
+    size_t buf_len = 0;
+    size_t buf_cap = DPP_STATE_SCAN_BUFFER;
+    uint64_t buf_offset = st->indexed_end; // buf[0] のファイルオフセット
+    uint64_t file_size;
+    uint64_t bad_offset = 0;
+    bool resync = false; // 壊れたレコードの先で次のレコードを探している
+    size_t pos = 0;
+    int ret = 0;
+
+    if (fstat(st->fd, &sb) < 0)
+        return -1;
+    file_size = (uint64_t)sb.st_size;
+    if (file_size <= st->indexed_end)
+        return 0;
+
+    buf = malloc(buf_cap);
+    if (!buf)
+        return -1;
+
+    for (;;)
     {
-        char *start = strstr(buffer, "\"configurator_");
-        char *end = NULL;
-        if (start)
+        size_t avail = buf_len - pos;
+        size_t rec_len = state_parse_record(buf + pos, avail, &hdr);
+        const char *next;
+
+        if (rec_len)
         {
-            end = strstr(start, "\n  }\n");
-            if (end)
+            if (resync)
             {
-                end += 4; // "\n  }\n" の長さ
-                fwrite(start, 1, end - start, fp);
-                fprintf(fp, ",\n");
+                DPP_LOG(DPP_LOG_STATE, DPP_LOG_WARN,
+                        "skipped %llu bytes of corrupt records at offset %llu in %s",
+                        (unsigned long long)(buf_offset + pos - bad_offset),
+                        (unsigned long long)bad_offset, state_file);
+                resync = false;
             }
+            state_index_put(st, hdr.type, hdr.id, buf_offset + pos);
+            pos += rec_len;
+            st->indexed_end = buf_offset + pos;
+            continue;
         }
+
+        // 最大のレコードが収まるだけ読むまでは、続きが無いだけなのか判断できない
+        if (buf_offset + buf_len < file_size && avail < sizeof(hdr) + DPP_STATE_MAX_PAYLOAD)
+        {
+            memmove(buf, buf + pos, avail);
+            buf_offset += pos;
+            buf_len = avail;
+            pos = 0;
+
+            ssize_t n = pread(st->fd, buf + buf_len, buf_cap - buf_len, buf_offset + buf_len);
+            if (n <= 0)
+            {
+                ret = n < 0 ? -1 : 1;
+                break;
+            }
+            buf_len += n;
+            continue;
+        }
+        if (avail == 0)
+        {
+            ret = resync ? 1 : 0;
+            break;
+        }
+
+        // 壊れたレコード: 次のマジックの候補まで進めて検証し直す
+        if (!resync)
+        {
+            resync = true;
+            bad_offset = buf_offset + pos;
+        }
+        next = memchr(buf + pos + 1, DPP_STATE_RECORD_MAGIC & 0xff, avail - 1);
+        pos = next ? (size_t)(next - buf) : buf_len;
     }
 
-    // Bootstrap情報を追加
-    fprintf(fp, "  \"bootstrap_%d\": {\n", id);
-    fprintf(fp, "    \"id\": %d,\n", id);
-    fprintf(fp, "    \"uri\": \"%s\"\n", uri);
-    fprintf(fp, "  }\n");
-    fprintf(fp, "}\n");
+    free(buf);
+    return ret;
+}
 
-    fclose(fp);
-    return 0;
+// マッピングを解放リストへ移す（lock保持）
+static void state_retire(struct dpp_state_store *st, const void *addr, size_t len, bool heap)
+{
+    struct dpp_state_mapping *m;
+
+    if (!addr)
+        return;
+    m = malloc(sizeof(*m));
+    if (!m)
+        return; // 解放できないが、返したポインタを無効にするよりよい
+    m->addr = (void *)addr;
+    m->len = len;
+    m->heap = heap;
+    m->commit_gen = st->commit_gen;
+    m->next = st->retired;
+    st->retired = m;
 }
 
-// Configurator情報を保存
-int save_configurator_info(int id, const char *curve)
+static void state_retire_mapping(struct dpp_state_store *st, const void *addr, size_t len)
 {
-    FILE *fp;
-    char buffer[4096];
-    int len;
+    state_retire(st, addr, len, false);
+}
+
+static void state_release(struct dpp_state_mapping *m)
+{
+    if (m->heap)
+        free(m->addr);
+    else
+        munmap(m->addr, m->len);
+    free(m);
+}
 
-    // 既存の状態を読み込み
-    fp = fopen(DPP_STATE_FILE, "r");
-    if (fp)
+/*
+ * 解放リストに移してからDPP_STATE_RETIRE_COMMITS回コミットしたマッピングを解放する（lock保持）
+ * 返したポインタは呼び出し側が一時的に使うだけなので、その間に使い終わっている
+ */
+static void state_reclaim_mappings(struct dpp_state_store *st)
+{
+    struct dpp_state_mapping **pp = &st->retired;
+
+    while (*pp)
     {
-        len = fread(buffer, 1, sizeof(buffer) - 1, fp);
-        buffer[len] = '\0';
-        fclose(fp);
+        struct dpp_state_mapping *m = *pp;
+
+        if (st->commit_gen - m->commit_gen < DPP_STATE_RETIRE_COMMITS)
+        {
+            pp = &m->next;
+            continue;
+        }
+        *pp = m->next;
+        state_release(m);
     }
-    else
+}
+
+// スナップショットを読み込んでマップする（lock保持）
+static int state_snapshot_load(struct dpp_state_store *st)
+{
+    struct dpp_snapshot_hdr hdr;
+    struct stat log_sb, sb;
+    char path[300];
+    void *map;
+    int fd;
+
+    state_snapshot_path(path, sizeof(path));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &sb) < 0 || fstat(st->fd, &log_sb) < 0 ||
+        (size_t)sb.st_size < sizeof(hdr))
     {
-        strcpy(buffer, "{}");
+        close(fd);
+        return -1;
     }
 
-    // 新しい情報を追加
-    fp = fopen(DPP_STATE_FILE, "w");
-    if (!fp)
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    // 壊れたスナップショットや別のログのものは使わない
+    memcpy(&hdr, map, sizeof(hdr));
+    if (hdr.magic != DPP_SNAPSHOT_MAGIC || hdr.version != DPP_SNAPSHOT_VERSION ||
+        hdr.log_ino != (uint64_t)log_sb.st_ino ||
+        hdr.log_offset > (uint64_t)log_sb.st_size ||
+        hdr.slots_offset + (uint64_t)hdr.count * sizeof(struct dpp_snapshot_slot) > (uint64_t)sb.st_size ||
+        hdr.heap_offset + hdr.heap_len > (uint64_t)sb.st_size)
     {
+        munmap(map, sb.st_size);
         return -1;
     }
 
-    fprintf(fp, "{\n");
+    state_retire_mapping(st, st->snap_map, st->snap_map_len);
+    st->snap_map = map;
+    st->snap_map_len = sb.st_size;
+    st->snap_slots = (const struct dpp_snapshot_slot *)((const char *)map + hdr.slots_offset);
+    st->snap_count = hdr.count;
+    st->snap_heap = (const char *)map + hdr.heap_offset;
+    st->snap_heap_len = hdr.heap_len;
+    st->indexed_end = hdr.log_offset;
+    if ((int)hdr.max_bootstrap_id > st->max_bootstrap_id)
+        st->max_bootstrap_id = (int)hdr.max_bootstrap_id;
+    return 0;
+}
+
+// スナップショットから二分探索（見つからなければNULL）
+static const char *state_snapshot_find(struct dpp_state_store *st, uint64_t key)
+{
+    uint32_t lo = 0, hi = st->snap_count;
 
-    // 既存のbootstrap情報があれば保持
-    if (strstr(buffer, "bootstrap_"))
+    while (lo < hi)
     {
-        char *start = strstr(buffer, "\"bootstrap_");
-        char *end = NULL;
-        if (start)
+        uint32_t mid = lo + (hi - lo) / 2;
+        const struct dpp_snapshot_slot *slot = &st->snap_slots[mid];
+        if (slot->key == key)
         {
-            end = strstr(start, "\n  }\n");
+            if ((uint64_t)slot->offset + slot->len > st->snap_heap_len)
+                return NULL;
+            return st->snap_heap + slot->offset;
+        }
+        if (slot->key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+// ログのoffset+lenまでをマップ済みにする（lock保持）
+static int state_map_log(struct dpp_state_store *st, uint64_t end)
+{
+    struct stat sb;
+    void *map;
+
+    if (end <= st->log_map_len)
+        return 0;
+    if (fstat(st->fd, &sb) < 0 || (uint64_t)sb.st_size < end)
+        return -1;
+
+    // 予約範囲に重ねてマップし直せば、既に返したポインタの位置は変わらない
+    if (!st->log_reserve && !st->log_reserve_failed)
+    {
+        map = mmap(NULL, DPP_STATE_LOG_RESERVE, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (map == MAP_FAILED)
+            st->log_reserve_failed = true;
+        else
+            st->log_reserve = map;
+    }
+    if (st->log_reserve && (uint64_t)sb.st_size <= DPP_STATE_LOG_RESERVE)
+    {
+        map = mmap(st->log_reserve, sb.st_size, PROT_READ, MAP_SHARED | MAP_FIXED, st->fd, 0);
+        if (map == MAP_FAILED)
+            return -1;
+        st->log_map = map;
+        st->log_map_len = sb.st_size;
+        return 0;
+    }
+
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, st->fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+
+    // 予約範囲を超えたら以降は伸びるたびに別の場所へマップする
+    if (st->log_reserve)
+    {
+        state_retire_mapping(st, st->log_reserve, DPP_STATE_LOG_RESERVE);
+        st->log_reserve = NULL;
+        st->log_reserve_failed = true;
+    }
+    else
+    {
+        state_retire_mapping(st, st->log_map, st->log_map_len);
+    }
+    st->log_map = map;
+    st->log_map_len = sb.st_size;
+    return 0;
+}
+
+// 旧形式（JSON）の状態ファイルがあれば一度だけ取り込む
+static void state_migrate_legacy(struct dpp_state_store *st)
+{
+    FILE *fp;
+    char line[4096];
+    uint8_t type = 0;
+    int id = -1;
+
+    fp = fopen(DPP_STATE_LEGACY_FILE, "r");
+    if (!fp)
+        return;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *p;
+        if ((p = strstr(line, "\"bootstrap_")))
+        {
+            type = DPP_STATE_BOOTSTRAP;
+            id = atoi(p + strlen("\"bootstrap_"));
+        }
+        else if ((p = strstr(line, "\"configurator_")))
+        {
+            type = DPP_STATE_CONFIGURATOR;
+            id = atoi(p + strlen("\"configurator_"));
+        }
+        else if (type && id >= 0 &&
+                 ((p = strstr(line, "\"uri\": \"")) || (p = strstr(line, "\"curve\": \""))))
+        {
+            char *value = strstr(p, ": \"") + 3;
+            char *end = strchr(value, '"');
             if (end)
             {
-                end += 4; // "\n  }\n" の長さ
-                fwrite(start, 1, end - start, fp);
-                fprintf(fp, ",\n");
+                *end = '\0';
+                dpp_state_append(type, id, value, strlen(value));
             }
+            type = 0;
+            id = -1;
         }
     }
 
-    // Configurator情報を追加
-    fprintf(fp, "  \"configurator_%d\": {\n", id);
-    fprintf(fp, "    \"id\": %d,\n", id);
-    fprintf(fp, "    \"curve\": \"%s\"\n", curve);
-    fprintf(fp, "  }\n");
-    fprintf(fp, "}\n");
-
     fclose(fp);
+    dpp_printf("Migrated legacy state file %s\n", DPP_STATE_LEGACY_FILE);
+}
+
+// ストアを開いてインデックスを構築（lock保持）
+static int state_open_locked(struct dpp_state_store *st)
+{
+    bool created = false;
+    int ret;
+
+    if (st->opened)
+        return 0;
+
+    st->fd = open(state_file, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (st->fd < 0 && errno == ENOENT)
+    {
+        st->fd = open(state_file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        created = true;
+    }
+    if (st->fd < 0)
+    {
+        dpp_printf("Error: Cannot open state file %s: %s\n", state_file, strerror(errno));
+        return -1;
+    }
+
+    // スナップショットがあれば、それが含む範囲のログは読まずに済む
+    if (!created)
+        state_snapshot_load(st);
+
+    ret = state_scan_tail(st);
+    if (ret > 0)
+    {
+        // 末尾の書き込み途中でクラッシュした残骸（後ろに正しいレコードが無い）は、
+        // 排他ロックを取って再確認してから切り詰める
+        flock(st->fd, LOCK_EX);
+        ret = state_scan_tail(st);
+        if (ret > 0)
+        {
+            dpp_printf("Warning: Truncating incomplete record at offset %llu in %s\n",
+                       (unsigned long long)st->indexed_end, state_file);
+            if (ftruncate(st->fd, st->indexed_end) < 0)
+                dpp_printf("Warning: ftruncate failed: %s\n", strerror(errno));
+        }
+        flock(st->fd, LOCK_UN);
+    }
+
+    st->opened = true;
+
+    // 旧形式の取り込みは既定の状態ファイルのみ（ベンチマーク用のファイルには行わない）
+    if (created && strcmp(state_file, DPP_STATE_FILE) == 0)
+    {
+        pthread_mutex_unlock(&st->lock);
+        state_migrate_legacy(st);
+        dpp_state_commit();
+        pthread_mutex_lock(&st->lock);
+    }
     return 0;
 }
 
-// Configurator情報を読み込み
-char *load_configurator_curve(int id)
+// ストアを閉じる（未コミットのレコードは書き込む）
+void dpp_state_close(void)
 {
-    FILE *fp;
-    char buffer[4096];
-    char *curve = NULL;
-    char search_pattern[64];
+    struct dpp_state_store *st = &state_store;
 
-    fp = fopen(DPP_STATE_FILE, "r");
-    if (!fp)
+    dpp_state_commit();
+
+    pthread_mutex_lock(&st->lock);
+    if (st->fd >= 0)
+        close(st->fd);
+    st->fd = -1;
+    st->opened = false;
+    st->indexed_end = 0;
+    state_table_free(&st->index);
+    st->max_bootstrap_id = 0;
+    if (st->log_reserve)
+        state_retire_mapping(st, st->log_reserve, DPP_STATE_LOG_RESERVE);
+    else
+        state_retire_mapping(st, st->log_map, st->log_map_len);
+    state_retire_mapping(st, st->snap_map, st->snap_map_len);
+    st->log_reserve = NULL;
+    st->log_reserve_failed = false;
+    st->log_map = NULL;
+    st->log_map_len = 0;
+    st->snap_map = NULL;
+    st->snap_map_len = 0;
+    st->snap_slots = NULL;
+    st->snap_count = 0;
+    st->snap_heap = NULL;
+    st->snap_heap_len = 0;
+    while (st->retired)
     {
-        return NULL;
+        struct dpp_state_mapping *m = st->retired;
+        st->retired = m->next;
+        state_release(m);
     }
+    free(st->pending);
+    st->pending = NULL;
+    st->pending_len = 0;
+    st->pending_cap = 0;
+    state_table_free(&st->pending_index);
+    pthread_mutex_unlock(&st->lock);
+}
 
-    snprintf(search_pattern, sizeof(search_pattern), "\"configurator_%d\"", id);
+/*
+ * レコードを追加する（dpp_state_commit() を呼ぶまでファイルには書かれないが、
+ * このプロセスの参照には直ちに見える）
+ * 戻り値: 追加したレコードのシーケンス番号、エラー時は0
+ */
+uint64_t dpp_state_append(uint8_t type, int id, const char *data, size_t len)
+{
+    struct dpp_state_store *st = &state_store;
+    struct dpp_state_record_hdr hdr;
+    uint64_t seq = 0;
+    size_t need;
+    char *p;
+
+    if (id < 0 || len + 1 > DPP_STATE_MAX_PAYLOAD)
+        return 0;
+
+    pthread_mutex_lock(&st->lock);
+    if (state_open_locked(st) < 0)
+        goto out;
 
-    while (fgets(buffer, sizeof(buffer), fp))
+    need = st->pending_len + sizeof(hdr) + len + 1;
+    if (need > st->pending_cap)
     {
-        if (strstr(buffer, search_pattern))
+        size_t cap = st->pending_cap ? st->pending_cap : 64 * 1024;
+        while (cap < need)
+            cap *= 2;
+        /*
+         * dpp_state_lock()中のdpp_state_ref()が古い領域を指しているかもしれないので
+         * reallocせず解放リストへ（排他中は他のスレッドがコミットしないので解放されない）
+         */
+        p = malloc(cap);
+        if (!p)
+            goto out;
+        if (st->pending)
+            memcpy(p, st->pending, st->pending_len);
+        state_retire(st, st->pending, st->pending_cap, true);
+        st->pending = p;
+        st->pending_cap = cap;
+    }
+    if (state_table_put(&st->pending_index, state_key(type, (uint32_t)id), st->pending_len) < 0)
+        goto out;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = DPP_STATE_RECORD_MAGIC;
+    hdr.type = type;
+    hdr.id = (uint32_t)id;
+    hdr.len = (uint32_t)(len + 1);
+
+    p = st->pending + st->pending_len;
+    memcpy(p + sizeof(hdr), data, len);
+    p[sizeof(hdr) + len] = '\0';
+    hdr.checksum = state_checksum(&hdr, p + sizeof(hdr));
+    memcpy(p, &hdr, sizeof(hdr));
+    st->pending_len += sizeof(hdr) + len + 1;
+
+    if (type == DPP_STATE_BOOTSTRAP && id > st->max_bootstrap_id)
+        st->max_bootstrap_id = id;
+    seq = ++st->appended_seq;
+
+out:
+    pthread_mutex_unlock(&st->lock);
+    return seq;
+}
+
+static void state_file_lock(struct dpp_state_store *st)
+{
+    pthread_mutex_lock(&st->file_lock);
+    flock(st->fd, LOCK_EX);
+}
+
+static void state_file_unlock(struct dpp_state_store *st)
+{
+    flock(st->fd, LOCK_UN);
+    pthread_mutex_unlock(&st->file_lock);
+}
+
+/*
+ * 状態ファイルを排他する（他のスレッド・プロセスはコミットできなくなる）
+ * 参照してから追記・コミットするまでを、他プロセスの同じレコードの更新と混ざらないようにする
+ * 保持中のdpp_state_ref()は他プロセスのコミット済みのレコードも含めて最新を返す
+ * 同じスレッドが入れ子に呼んでもよい（最も外側のdpp_state_unlock()で解放する）
+ */
+int dpp_state_lock(void)
+{
+    struct dpp_state_store *st = &state_store;
+    int ret;
+
+    if (state_file_held > 0)
+    {
+        state_file_held++;
+        return 0;
+    }
+    pthread_mutex_lock(&st->lock);
+    ret = state_open_locked(st);
+    pthread_mutex_unlock(&st->lock);
+    if (ret < 0)
+        return -1;
+    state_file_lock(st);
+    state_file_held = 1;
+    return 0;
+}
+
+void dpp_state_unlock(void)
+{
+    if (--state_file_held == 0)
+        state_file_unlock(&state_store);
+}
+
+/*
+ * 追加済みのレコードを永続化する（グループコミット）
+ * 同時に呼び出したスレッドのレコードは1回のwrite+fdatasyncにまとめられる
+ * dpp_state_lock()中に呼んでもよい（排他を保持したまま書き込む）
+ */
+int dpp_state_commit(void)
+{
+    struct dpp_state_store *st = &state_store;
+    struct dpp_state_record_hdr hdr;
+    uint64_t target, base;
+    struct stat sb;
+    char *buf;
+    size_t len, pos;
+    int ret = 0;
+
+    pthread_mutex_lock(&st->lock);
+    target = st->appended_seq;
+
+    while (st->durable_seq < target)
+    {
+        if (st->committing)
+        {
+            // 他のスレッドがコミット中: 完了を待って自分の分が含まれたか確認
+            pthread_cond_wait(&st->committed, &st->lock);
+            continue;
+        }
+        if (!state_file_held)
         {
-            // 次の行でcurveを探す
-            while (fgets(buffer, sizeof(buffer), fp))
+            // ファイルの排他を取ってからリーダーになる（取る間に他のリーダーが済ませたかもしれない）
+            pthread_mutex_unlock(&st->lock);
+            state_file_lock(st);
+            pthread_mutex_lock(&st->lock);
+            if (st->committing || st->durable_seq >= target)
             {
-                if (strstr(buffer, "\"curve\""))
-                {
-                    // curveの値を抽出
-                    char *start = strchr(buffer, '"');
-                    if (start)
-                    {
-                        start = strchr(start + 1, '"');
-                        if (start)
-                        {
-                            start = strchr(start + 1, '"');
-                            if (start)
-                            {
-                                start++;
-                                char *end = strchr(start, '"');
-                                if (end)
-                                {
-                                    *end = '\0';
-                                    // 改行文字を除去
-                                    char *newline = strchr(start, '\n');
-                                    if (newline)
-                                    {
-                                        *newline = '\0';
-                                    }
-                                    curve = strdup(start);
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                }
+                pthread_mutex_unlock(&st->lock);
+                state_file_unlock(st);
+                pthread_mutex_lock(&st->lock);
+                continue;
             }
+        }
+
+        // リーダーとして溜まっているレコードをすべて書き込む
+        st->committing = true;
+        buf = st->pending;
+        len = st->pending_len;
+        uint64_t batch_seq = st->appended_seq;
+        st->pending = NULL;
+        st->pending_len = 0;
+        st->pending_cap = 0;
+        st->flushing = buf;
+        st->flushing_index = st->pending_index;
+        memset(&st->pending_index, 0, sizeof(st->pending_index));
+        pthread_mutex_unlock(&st->lock);
+
+        // 他プロセスの追記と混ざらないよう排他ロック中に書き込み位置を確定する
+        base = fstat(st->fd, &sb) == 0 ? (uint64_t)sb.st_size : 0;
+        for (pos = 0; pos < len;)
+        {
+            ssize_t n = write(st->fd, buf + pos, len - pos);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                dpp_printf("Error: Failed to write state file: %s\n", strerror(errno));
+                ret = -1;
+                break;
+            }
+            pos += n;
+        }
+        if (ret == 0 && fdatasync(st->fd) < 0)
+            ret = -1;
+        if (!state_file_held)
+            state_file_unlock(st);
+
+        pthread_mutex_lock(&st->lock);
+        if (ret == 0)
+        {
+            /*
+             * 他プロセスが間に追記した分を先に取り込み、続けて自分のレコードを索引する
+             * ファイルの排他を放した後に追記されたレコードも取り込まれているかもしれないので、
+             * 索引がより新しい（後ろの）レコードを指していれば置き換えない
+             */
+            if (base > st->indexed_end)
+                state_scan_tail(st);
+            for (pos = 0; pos < len; pos += sizeof(hdr) + hdr.len)
+            {
+                uint64_t indexed;
+
+                memcpy(&hdr, buf + pos, sizeof(hdr));
+                if (!state_index_get(st, hdr.type, hdr.id, &indexed) || indexed < base + pos)
+                    state_index_put(st, hdr.type, hdr.id, base + pos);
+            }
+            if (st->indexed_end == base)
+                st->indexed_end = base + len;
+            st->commit_gen++;
+            state_reclaim_mappings(st);
+        }
+        st->flushing = NULL;
+        state_table_free(&st->flushing_index);
+        state_retire(st, buf, len, true);
+        st->durable_seq = batch_seq;
+        st->committing = false;
+        pthread_cond_broadcast(&st->committed);
+        if (ret < 0)
             break;
+    }
+
+    pthread_mutex_unlock(&st->lock);
+    return ret;
+}
+
+/*
+ * レコードを探す（lock保持）: このプロセスの未コミットのバッチ、コミット中のバッチ、
+ * スナップショット以降のログ（インデックス）、スナップショットの順に新しい
+ * 返すポインタはlockを放すと、他のスレッドのコミットで解放されうる
+ */
+static const char *state_lookup_locked(struct dpp_state_store *st, uint8_t type, int id)
+{
+    struct dpp_state_record_hdr hdr;
+    uint64_t key = state_key(type, (uint32_t)id);
+    uint64_t offset;
+
+    if (id < 0 || state_open_locked(st) < 0)
+        return NULL;
+
+    if (state_table_get(&st->pending_index, key, &offset))
+        return st->pending + offset + sizeof(hdr);
+    if (st->flushing && state_table_get(&st->flushing_index, key, &offset))
+        return st->flushing + offset + sizeof(hdr);
+
+    state_scan_tail(st);
+
+    if (state_index_get(st, type, (uint32_t)id, &offset))
+    {
+        if (state_map_log(st, offset + sizeof(hdr)) < 0)
+            return NULL;
+        memcpy(&hdr, st->log_map + offset, sizeof(hdr));
+        if (hdr.magic != DPP_STATE_RECORD_MAGIC ||
+            state_map_log(st, offset + sizeof(hdr) + hdr.len) < 0)
+            return NULL;
+        return st->log_map + offset + sizeof(hdr);
+    }
+    if (st->snap_count)
+        return state_snapshot_find(st, key);
+    return NULL;
+}
+
+static const char *state_lookup(uint8_t type, int id)
+{
+    struct dpp_state_store *st = &state_store;
+    const char *data;
+
+    pthread_mutex_lock(&st->lock);
+    data = state_lookup_locked(st, type, id);
+    pthread_mutex_unlock(&st->lock);
+    return data;
+}
+
+/*
+ * レコードのペイロードへのポインタを取得（コピーもパースもしない）
+ * dpp_state_lock()を保持している間だけ使える（他のスレッドはコミットできないので
+ * 解放されない）。保持中に自分で DPP_STATE_RETIRE_COMMITS 回コミットすると無効になる
+ * 排他していないなら dpp_state_get() か dpp_state_read() でコピーを取ること
+ */
+const char *dpp_state_ref(uint8_t type, int id)
+{
+    return state_lookup(type, id);
+}
+
+// レコードのペイロードのコピーを取得（呼び出し側でfree）
+char *dpp_state_get(uint8_t type, int id)
+{
+    struct dpp_state_store *st = &state_store;
+    const char *data;
+    char *copy = NULL;
+
+    pthread_mutex_lock(&st->lock);
+    data = state_lookup_locked(st, type, id);
+    if (data)
+        copy = strdup(data);
+    pthread_mutex_unlock(&st->lock);
+    return copy;
+}
+
+/*
+ * レコードのペイロードをbufにコピーする（sizeに収まらなければsnprintfと同じく切り詰める）
+ * 戻り値: ペイロードの長さ、レコードが無ければ-1（size 0なら有無と長さだけを調べる）
+ */
+int dpp_state_read(uint8_t type, int id, char *buf, size_t size)
+{
+    struct dpp_state_store *st = &state_store;
+    const char *data;
+    size_t len = 0;
+
+    pthread_mutex_lock(&st->lock);
+    data = state_lookup_locked(st, type, id);
+    if (data)
+    {
+        len = strlen(data);
+        if (size > 0)
+        {
+            size_t n = len < size ? len : size - 1;
+            memcpy(buf, data, n);
+            buf[n] = '\0';
         }
     }
+    pthread_mutex_unlock(&st->lock);
+    return data ? (int)len : -1;
+}
 
-    fclose(fp);
-    return curve;
+static int state_slot_compare(const void *a, const void *b)
+{
+    uint64_t ka = ((const struct dpp_snapshot_slot *)a)->key;
+    uint64_t kb = ((const struct dpp_snapshot_slot *)b)->key;
+
+    return ka < kb ? -1 : ka > kb ? 1 : 0;
 }
 
-// Bootstrap情報を読み込み
-char *load_bootstrap_uri(int id)
+static int state_write_all(int fd, const void *buf, size_t len)
 {
-    FILE *fp;
-    char buffer[4096];
-    char *uri = NULL;
-    char search_pattern[64];
+    const char *p = buf;
 
-    fp = fopen(DPP_STATE_FILE, "r");
-    if (!fp)
+    while (len > 0)
     {
-        return NULL;
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * コンパクション: 現在のスナップショットとログ末尾をまとめた新しいスナップショットを書く
+ * 一時ファイルに書いてからrenameするので、読み込み中の他プロセスには影響しない
+ * （ログ自体は他プロセスが保持するオフセットを壊さないよう切り詰めない）
+ */
+int dpp_state_compact(void)
+{
+    struct dpp_state_store *st = &state_store;
+    struct dpp_snapshot_hdr hdr;
+    struct dpp_snapshot_slot *tail = NULL, *slots = NULL;
+    struct stat log_sb;
+    char path[300], tmp_path[320];
+    size_t tail_count = 0, count = 0, i, j;
+    uint64_t heap_len = 0;
+    int fd = -1;
+    int ret = -1;
+
+    if (dpp_state_commit() < 0)
+        return -1;
+
+    pthread_mutex_lock(&st->lock);
+    if (state_open_locked(st) < 0)
+        goto out;
+    state_scan_tail(st);
+
+    if (st->index.count == 0)
+    {
+        dpp_printf("State snapshot is up to date\n"); // 前回のスナップショット以降に変更なし
+        ret = 0;
+        goto out;
     }
 
-    snprintf(search_pattern, sizeof(search_pattern), "\"bootstrap_%d\"", id);
+    // ログ末尾のエントリ（ヒープ位置は後で決める。offsetにはログ上の位置を一時的に入れる）
+    tail = malloc(st->index.count * sizeof(*tail));
+    slots = malloc((st->index.count + st->snap_count) * sizeof(*slots));
+    if (!tail || !slots || state_map_log(st, st->indexed_end) < 0)
+        goto out;
+    for (i = 0; i < st->index.size; i++)
+    {
+        if (!st->index.entries[i].key)
+            continue;
+        tail[tail_count].key = st->index.entries[i].key;
+        tail[tail_count].offset = 0;
+        tail[tail_count].len = 0;
+        tail_count++;
+    }
+    qsort(tail, tail_count, sizeof(*tail), state_slot_compare);
 
-    while (fgets(buffer, sizeof(buffer), fp))
+    // 既存スナップショットとマージ（同じキーはログ側が新しい）
+    for (i = 0, j = 0; i < st->snap_count || j < tail_count;)
     {
-        if (strstr(buffer, search_pattern))
+        if (j == tail_count || (i < st->snap_count && st->snap_slots[i].key < tail[j].key))
+            slots[count++] = st->snap_slots[i++];
+        else
         {
-            // 次の行でURIを探す
-            while (fgets(buffer, sizeof(buffer), fp))
-            {
-                if (strstr(buffer, "\"uri\""))
-                {
-                    // URIの値を抽出
-                    char *start = strchr(buffer, '"');
-                    if (start)
-                    {
-                        start = strchr(start + 1, '"');
-                        if (start)
-                        {
-                            start = strchr(start + 1, '"');
-                            if (start)
-                            {
-                                start++;
-                                char *end = strchr(start, '"');
-                                if (end)
-                                {
-                                    *end = '\0';
-                                    // 改行文字を除去
-                                    char *newline = strchr(start, '\n');
-                                    if (newline)
-                                    {
-                                        *newline = '\0';
-                                    }
-                                    uri = strdup(start);
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+            if (i < st->snap_count && st->snap_slots[i].key == tail[j].key)
+                i++;
+            slots[count] = tail[j++];
+            slots[count].len = UINT32_MAX; // ログ側の印
+            count++;
+        }
+    }
+
+    state_snapshot_path(path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, getpid());
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || fstat(st->fd, &log_sb) < 0)
+        goto out;
+
+    // ヒープを書きながらスロットのオフセットを確定する
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = DPP_SNAPSHOT_MAGIC;
+    hdr.version = DPP_SNAPSHOT_VERSION;
+    hdr.log_ino = (uint64_t)log_sb.st_ino;
+    hdr.log_offset = st->indexed_end;
+    hdr.count = (uint32_t)count;
+    hdr.max_bootstrap_id = (uint32_t)st->max_bootstrap_id;
+    hdr.slots_offset = sizeof(hdr);
+    hdr.heap_offset = hdr.slots_offset + count * sizeof(*slots);
+
+    if (lseek(fd, hdr.heap_offset, SEEK_SET) < 0)
+        goto out;
+    for (i = 0; i < count; i++)
+    {
+        const char *data;
+        uint32_t len;
+
+        if (slots[i].len == UINT32_MAX)
+        {
+            uint64_t offset;
+            struct dpp_state_record_hdr rec;
+            state_index_get(st, (uint8_t)(slots[i].key >> 32), (uint32_t)slots[i].key, &offset);
+            memcpy(&rec, st->log_map + offset, sizeof(rec));
+            data = st->log_map + offset + sizeof(rec);
+            len = rec.len;
+        }
+        else
+        {
+            data = st->snap_heap + slots[i].offset;
+            len = slots[i].len;
+        }
+        if (heap_len + len > UINT32_MAX || state_write_all(fd, data, len) < 0)
+            goto out;
+        slots[i].offset = (uint32_t)heap_len;
+        slots[i].len = len;
+        heap_len += len;
+    }
+    hdr.heap_len = heap_len;
+
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        pwrite(fd, slots, count * sizeof(*slots), hdr.slots_offset) !=
+            (ssize_t)(count * sizeof(*slots)) ||
+        fsync(fd) < 0)
+        goto out;
+    close(fd);
+    fd = -1;
+
+    if (rename(tmp_path, path) < 0)
+        goto out;
+
+    // 新しいスナップショットに切り替え、インデックスは空にする
+    if (state_snapshot_load(st) == 0)
+    {
+        memset(st->index.entries, 0, st->index.size * sizeof(*st->index.entries));
+        st->index.count = 0;
+    }
+    dpp_printf("State compacted: %zu entries in snapshot %s\n", count, path);
+    ret = 0;
+
+out:
+    if (fd >= 0)
+    {
+        close(fd);
+        unlink(tmp_path);
+    }
+    free(tail);
+    free(slots);
+    pthread_mutex_unlock(&st->lock);
+    return ret;
+}
+
+// インデックス済みでスナップショットに含まれていないエントリ数
+size_t dpp_state_uncompacted(void)
+{
+    struct dpp_state_store *st = &state_store;
+    size_t count;
+
+    pthread_mutex_lock(&st->lock);
+    count = st->index.count;
+    pthread_mutex_unlock(&st->lock);
+    return count;
+}
+
+// Bootstrap情報を保存
+int save_bootstrap_info(int id, const char *uri)
+{
+    if (!uri || !dpp_state_append(DPP_STATE_BOOTSTRAP, id, uri, strlen(uri)))
+    {
+        return -1;
+    }
+    return dpp_state_commit();
+}
+
+// Configurator情報を保存
+int save_configurator_info(int id, const char *curve)
+{
+    if (!curve || !dpp_state_append(DPP_STATE_CONFIGURATOR, id, curve, strlen(curve)))
+    {
+        return -1;
+    }
+    // 同じIDで作り直したConfiguratorに古いhostapd側の対応を使わせない
+    if (dpp_state_read(DPP_STATE_HOSTAPD_CONFIGURATOR, id, NULL, 0) >= 0 &&
+        !dpp_state_append(DPP_STATE_HOSTAPD_CONFIGURATOR, id, "", 0))
+    {
+        return -1;
+    }
+    return dpp_state_commit();
+}
+
+/*
+ * hostapd側のID（Configurator/ピア）の対応を読み込み
+ * レコードは "<interface> <instance cookie> <hostapd ID>" の行の並び
+ * cookieが一致しない（hostapdが再起動した）場合は-1
+ */
+int load_hostapd_mapping(uint8_t type, int id, const char *interface, const char *cookie)
+{
+    char *record = dpp_state_get(type, id);
+    const char *p = record;
+    size_t if_len = strlen(interface);
+    size_t cookie_len = strlen(cookie);
+    int hostapd_id = -1;
+
+    while (p && *p)
+    {
+        const char *end = strchr(p, '\n');
+        if (!end)
+            break;
+        if (strncmp(p, interface, if_len) == 0 && p[if_len] == ' ')
+        {
+            const char *c = p + if_len + 1;
+            if (strncmp(c, cookie, cookie_len) == 0 && c[cookie_len] == ' ')
+                hostapd_id = atoi(c + cookie_len + 1);
             break;
         }
+        p = end + 1;
     }
+    free(record);
+    return hostapd_id;
+}
 
-    fclose(fp);
-    return uri;
+// 読み込み〜追記の間に他スレッドが同じレコードを書き換えないようにする
+static pthread_mutex_t mapping_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// hostapd側のIDの対応を追記（コミットしない。hostapd_id < 0 なら対応を削除）
+int append_hostapd_mapping(uint8_t type, int id, const char *interface, const char *cookie,
+                           int hostapd_id)
+{
+    char *record;
+    const char *old;
+    size_t if_len = strlen(interface);
+    size_t cap, len = 0;
+    char *buf;
+    int ret = -1;
+
+    pthread_mutex_lock(&mapping_lock);
+    record = dpp_state_get(type, id);
+    old = record;
+    cap = (old ? strlen(old) : 0) + if_len + strlen(cookie) + 16;
+    buf = malloc(cap);
+    if (!buf)
+        goto out;
+
+    // 他のインターフェースの行はそのまま残す
+    while (old && *old)
+    {
+        const char *end = strchr(old, '\n');
+        if (!end)
+            break;
+        if (!(strncmp(old, interface, if_len) == 0 && old[if_len] == ' '))
+        {
+            memcpy(buf + len, old, end - old + 1);
+            len += end - old + 1;
+        }
+        old = end + 1;
+    }
+    if (hostapd_id >= 0)
+        len += snprintf(buf + len, cap - len, "%s %s %d\n", interface, cookie, hostapd_id);
+
+    if (dpp_state_append(type, id, buf, len))
+        ret = 0;
+    free(buf);
+out:
+    free(record);
+    pthread_mutex_unlock(&mapping_lock);
+    return ret;
+}
+
+// hostapd側のIDの対応を保存
+int save_hostapd_mapping(uint8_t type, int id, const char *interface, const char *cookie,
+                         int hostapd_id)
+{
+    if (append_hostapd_mapping(type, id, interface, cookie, hostapd_id) < 0)
+        return -1;
+    return dpp_state_commit();
+}
+
+// 未コミットのレコードの合計サイズ
+static size_t state_pending_bytes(void)
+{
+    struct dpp_state_store *st = &state_store;
+    size_t len;
+
+    pthread_mutex_lock(&st->lock);
+    len = st->pending_len;
+    pthread_mutex_unlock(&st->lock);
+    return len;
+}
+
+/*
+ * 公開鍵の索引
+ * 鍵ハッシュの先頭31ビットをIDとするレコードに "<鍵ハッシュ(16進)> <Bootstrap ID>" の行を並べる
+ * （先頭31ビットが衝突した鍵は同じレコードの別の行になる）
+ */
+static int state_key_bucket(const u8 *pubkey_hash)
+{
+    return (int)(WPA_GET_BE32(pubkey_hash) >> 1);
+}
+
+static void state_key_hex(const u8 *pubkey_hash, char *hex)
+{
+    dpp_hex_encode(pubkey_hash, SHA256_MAC_LEN, hex);
+}
+
+// 索引レコードから鍵ハッシュに対応するBootstrap IDを探す（無ければ-1）
+static int state_key_find(const char *p, const char *hex)
+{
+    while (p && *p)
+    {
+        const char *end = strchr(p, '\n');
+        if (!end)
+            break;
+        if (strncmp(p, hex, 2 * SHA256_MAC_LEN) == 0 && p[2 * SHA256_MAC_LEN] == ' ')
+            return atoi(p + 2 * SHA256_MAC_LEN + 1);
+        p = end + 1;
+    }
+    return -1;
+}
+
+/*
+ * 公開鍵が登録済みのBootstrap IDを返す（無ければ-1）
+ * 索引の指すBootstrap情報が無ければ未登録とみなす
+ */
+int lookup_bootstrap_key(const u8 *pubkey_hash)
+{
+    char hex[2 * SHA256_MAC_LEN + 1];
+    char *record;
+    int id;
+
+    state_key_hex(pubkey_hash, hex);
+    record = dpp_state_get(DPP_STATE_BOOTSTRAP_KEY, state_key_bucket(pubkey_hash));
+    id = state_key_find(record, hex);
+    free(record);
+    if (id < 0)
+        return -1;
+    return lookup_bootstrap_uri(id, NULL, 0) > 0 ? id : -1;
+}
+
+struct state_key_entry
+{
+    int bucket;
+    int id;
+    const u8 *pubkey_hash;
+};
+
+// 索引に鍵ハッシュの行を追加したレコードを追記（oldは現在のレコード）
+static int state_key_append(const char *old, const struct state_key_entry *entries,
+                            size_t count)
+{
+    char hex[2 * SHA256_MAC_LEN + 1];
+    size_t old_len = old ? strlen(old) : 0;
+    size_t cap = old_len + count * (2 * SHA256_MAC_LEN + 16);
+    size_t len = 0, i;
+    char *buf;
+    int ret = 0;
+
+    buf = malloc(cap);
+    if (!buf)
+        return -1;
+
+    // 同じ鍵の古い行は置き換える
+    while (old && *old)
+    {
+        const char *end = strchr(old, '\n');
+        bool replaced = false;
+        if (!end)
+            break;
+        for (i = 0; i < count && !replaced; i++)
+        {
+            state_key_hex(entries[i].pubkey_hash, hex);
+            replaced = strncmp(old, hex, 2 * SHA256_MAC_LEN) == 0;
+        }
+        if (!replaced)
+        {
+            memcpy(buf + len, old, end - old + 1);
+            len += end - old + 1;
+        }
+        old = end + 1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        state_key_hex(entries[i].pubkey_hash, hex);
+        len += snprintf(buf + len, cap - len, "%s %d\n", hex, entries[i].id);
+    }
+
+    if (!dpp_state_append(DPP_STATE_BOOTSTRAP_KEY, entries[0].bucket, buf, len))
+        ret = -1;
+    free(buf);
+    return ret;
+}
+
+/*
+ * 公開鍵の索引にBootstrap IDを登録
+ * 索引レコードは読んで行を足して書き直すので、他プロセスの登録を消さないよう
+ * 読み込みからコミットまで状態ファイルを排他する
+ */
+int save_bootstrap_key(const u8 *pubkey_hash, int id)
+{
+    struct state_key_entry entry = {state_key_bucket(pubkey_hash), id, pubkey_hash};
+    int ret;
+
+    if (dpp_state_lock() < 0)
+        return -1;
+    ret = state_key_append(state_lookup(DPP_STATE_BOOTSTRAP_KEY, entry.bucket), &entry, 1);
+    if (ret == 0)
+        ret = dpp_state_commit();
+    dpp_state_unlock();
+    return ret;
+}
+
+static int state_key_entry_compare(const void *a, const void *b)
+{
+    const struct state_key_entry *ka = a, *kb = b;
+
+    if (ka->bucket != kb->bucket)
+        return ka->bucket < kb->bucket ? -1 : 1;
+    return 0;
+}
+
+/*
+ * バッチの鍵ハッシュを索引に登録する
+ * 同じIDのレコードは最後のものが有効なので、バッチ内で衝突した鍵は1つのレコードにまとめる
+ */
+static int state_key_batch(const struct dpp_bootstrap_record *records, size_t count)
+{
+    struct state_key_entry *entries;
+    size_t n = 0, i, j;
+    int ret = 0;
+
+    entries = malloc(count * sizeof(*entries));
+    if (!entries)
+        return -1;
+    for (i = 0; i < count; i++)
+    {
+        if (!records[i].pubkey_hash)
+            continue;
+        entries[n].bucket = state_key_bucket(records[i].pubkey_hash);
+        entries[n].id = records[i].id;
+        entries[n].pubkey_hash = records[i].pubkey_hash;
+        n++;
+    }
+    qsort(entries, n, sizeof(*entries), state_key_entry_compare);
+
+    if (n == 0)
+    {
+        free(entries);
+        return 0;
+    }
+
+    // 索引レコードの読み込みからコミットまで排他する（save_bootstrap_key()と同じ）
+    if (dpp_state_lock() < 0)
+    {
+        free(entries);
+        return -1;
+    }
+    for (i = 0; i < n && ret == 0; i = j)
+    {
+        for (j = i + 1; j < n && entries[j].bucket == entries[i].bucket; j++)
+            ;
+        if (state_key_append(state_lookup(DPP_STATE_BOOTSTRAP_KEY, entries[i].bucket),
+                             &entries[i], j - i) < 0 ||
+            (state_pending_bytes() >= DPP_STATE_COMMIT_THRESHOLD && dpp_state_commit() < 0))
+            ret = -1;
+    }
+    if (ret == 0)
+        ret = dpp_state_commit();
+    dpp_state_unlock();
+    free(entries);
+    return ret;
+}
+
+// 複数のBootstrap情報をまとめて保存（1回のコミット）
+int save_bootstrap_batch(const struct dpp_bootstrap_record *records, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!dpp_state_append(DPP_STATE_BOOTSTRAP, records[i].id,
+                              records[i].uri, records[i].uri_len))
+        {
+            return -1;
+        }
+
+        // 大きなバッチはメモリを抑えるため途中でも書き出す
+        if (state_pending_bytes() >= DPP_STATE_COMMIT_THRESHOLD && dpp_state_commit() < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (state_key_batch(records, count) < 0)
+        return -1;
+    return dpp_state_commit();
+}
+
+// 保存済みBootstrap IDの最大値（無ければ0）
+int load_bootstrap_max_id(void)
+{
+    struct dpp_state_store *st = &state_store;
+    int max_id = 0;
+
+    pthread_mutex_lock(&st->lock);
+    if (state_open_locked(st) == 0)
+    {
+        state_scan_tail(st);
+        max_id = st->max_bootstrap_id;
+    }
+    pthread_mutex_unlock(&st->lock);
+    return max_id;
+}
+
+// Configurator情報を読み込み
+char *load_configurator_curve(int id)
+{
+    return dpp_state_get(DPP_STATE_CONFIGURATOR, id);
+}
+
+// Bootstrap情報を読み込み
+char *load_bootstrap_uri(int id)
+{
+    return dpp_state_get(DPP_STATE_BOOTSTRAP, id);
+}
+
+/*
+ * Bootstrap情報をuriにコピーする（切り詰めはsnprintfと同じ）
+ * 戻り値: URIの長さ、無ければ-1（size 0なら有無だけを調べる）
+ */
+int lookup_bootstrap_uri(int id, char *uri, size_t size)
+{
+    return dpp_state_read(DPP_STATE_BOOTSTRAP, id, uri, size);
 }
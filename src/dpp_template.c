@@ -0,0 +1,740 @@
+/*
+ * DPP Configurator - Configuration Templates
+ * Named configuration objects validated once and patched per device
+ *
+ * A template is stored in the state log under the hash of its name. A JSON
+ * template is parsed and checked with hostapd's json_parse() once, then
+ * re-serialized into a compact string split at the point where the
+ * per-device Matter fields (pinCode, discriminator) go. Building the
+ * DPP_AUTH_INIT parameters for a device is then two memcpy()s around a few
+ * bytes of delta. Compiled templates are cached per process and rebuilt
+ * only when the stored definition changes; callers hold a reference until
+ * dpp_template_release(), so a replaced template is freed once unused.
+ *
+ * DPP_AUTH_INIT always carries the full configuration. Only when asked to
+ * (template push=<ifname>) is the static configuration also set on a hostapd
+ * Configurator with DPP_CONFIGURATOR_PARAMS, which hostapd then uses for
+ * exchanges it starts on its own (chirp/presence announcement, responder role).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/dpp_configurator.h"
+
+#define MAX_RESPONSE_SIZE 4096
+#define DPP_TEMPLATE_NAME_MAX 64
+#define DPP_TEMPLATE_PIN_LEN 8
+#define DPP_TEMPLATE_DISCRIMINATOR_MAX 4095 // Matterの判別子は12ビット
+
+// 端末ごとの値（pinCode・discriminator）を差し込む位置で分割した設定
+struct dpp_template
+{
+    struct dpp_template *next;
+    char name[DPP_TEMPLATE_NAME_MAX];
+    char *definition; // 定義のコピー（変更の検出用。状態ストア内の位置は再マップで変わる）
+    int refs;         // キャッシュと呼び出し側の参照（template_lockで保護）
+    bool json;
+
+    char *prefix; // 差し込み位置より前（"conf_json='" を含む）
+    size_t prefix_len;
+    char *suffix; // 差し込み位置以降（終端の "'" を含む）
+    size_t suffix_len;
+    bool in_matter;     // prefixがmatterオブジェクトの中で終わる
+    bool matter_fields; // そのmatterオブジェクトに他のメンバーがある
+
+    // テンプレートに書かれていた値（端末ごとの指定が無い場合に使う）
+    char pin[DPP_TEMPLATE_PIN_LEN + 1];
+    char discriminator[16];
+};
+
+static struct dpp_template *template_cache;
+static pthread_mutex_t template_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 出力バッファ（足りなければ拡張する）
+struct template_buf
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    bool error;
+};
+
+static void template_put(struct template_buf *buf, const char *data, size_t len)
+{
+    if (buf->error)
+        return;
+    if (buf->len + len + 1 > buf->cap)
+    {
+        size_t cap = buf->cap ? buf->cap : 256;
+        char *tmp;
+        while (cap < buf->len + len + 1)
+            cap *= 2;
+        tmp = realloc(buf->data, cap);
+        if (!tmp)
+        {
+            buf->error = true;
+            return;
+        }
+        buf->data = tmp;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+static void template_puts(struct template_buf *buf, const char *str)
+{
+    template_put(buf, str, strlen(str));
+}
+
+// JSON文字列としてエスケープして出力（シェル経由で渡すため ' もエスケープする）
+static void template_put_string(struct template_buf *buf, const char *str)
+{
+    char esc[8];
+
+    template_put(buf, "\"", 1);
+    for (; str && *str; str++)
+    {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+        {
+            esc[0] = '\\';
+            esc[1] = c;
+            template_put(buf, esc, 2);
+        }
+        else if (c < 0x20 || c == '\'')
+        {
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            template_put(buf, esc, 6);
+        }
+        else
+        {
+            template_put(buf, (const char *)&c, 1);
+        }
+    }
+    template_put(buf, "\"", 1);
+}
+
+static uint32_t template_fnv1a(const char *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 名前から状態ストアのIDを求める（31ビット）
+static int template_id(const char *name)
+{
+    return (int)(template_fnv1a(name, strlen(name)) & 0x7fffffff);
+}
+
+static bool template_valid_pin(const char *pin)
+{
+    return strlen(pin) == DPP_TEMPLATE_PIN_LEN && is_valid_matter_pin(pin);
+}
+
+static bool template_valid_discriminator(const char *str)
+{
+    char *end;
+    long value = strtol(str, &end, 10);
+
+    return *str && *end == '\0' && value >= 0 && value <= DPP_TEMPLATE_DISCRIMINATOR_MAX;
+}
+
+static struct json_token *template_member(struct json_token *obj, const char *name,
+                                          enum json_type type)
+{
+    struct json_token *token = json_get_member(obj, name);
+
+    return token && token->type == type ? token : NULL;
+}
+
+// DPP設定オブジェクトとして最低限必要なメンバーを確認
+static int template_validate(struct json_token *root, char *err, size_t err_size)
+{
+    struct json_token *discovery, *cred, *matter, *token;
+
+    if (!root || root->type != JSON_OBJECT)
+    {
+        snprintf(err, err_size, "configuration must be a JSON object");
+        return -1;
+    }
+    if (!template_member(root, "wi-fi_tech", JSON_STRING))
+    {
+        snprintf(err, err_size, "missing \"wi-fi_tech\" string");
+        return -1;
+    }
+
+    discovery = template_member(root, "discovery", JSON_OBJECT);
+    token = discovery ? template_member(discovery, "ssid", JSON_STRING) : NULL;
+    if (!token || !token->string || strlen(token->string) == 0 || strlen(token->string) > 32)
+    {
+        snprintf(err, err_size, "\"discovery\" must have an \"ssid\" of 1-32 characters");
+        return -1;
+    }
+
+    cred = template_member(root, "cred", JSON_OBJECT);
+    token = cred ? template_member(cred, "akm", JSON_STRING) : NULL;
+    if (!token)
+    {
+        snprintf(err, err_size, "\"cred\" must have an \"akm\" string");
+        return -1;
+    }
+    if (strstr(token->string, "psk") || strstr(token->string, "sae"))
+    {
+        struct json_token *pass = template_member(cred, "pass", JSON_STRING);
+        struct json_token *psk = template_member(cred, "psk_hex", JSON_STRING);
+        size_t len = pass ? strlen(pass->string) : 0;
+        if (!(pass && len >= 8 && len <= 63) &&
+            !(psk && strlen(psk->string) == 64 && is_hex_string(psk->string)))
+        {
+            snprintf(err, err_size, "\"cred\" needs a \"pass\" of 8-63 characters or a 64-digit \"psk_hex\"");
+            return -1;
+        }
+    }
+
+    token = json_get_member(root, "matter");
+    if (!token)
+        return 0;
+    matter = template_member(root, "matter", JSON_OBJECT);
+    if (!matter)
+    {
+        snprintf(err, err_size, "\"matter\" must be an object");
+        return -1;
+    }
+    token = json_get_member(matter, "pinCode");
+    if (token && !(token->type == JSON_STRING && template_valid_pin(token->string)))
+    {
+        snprintf(err, err_size, "\"matter\".\"pinCode\" must be a valid 8-digit string");
+        return -1;
+    }
+    token = json_get_member(matter, "discriminator");
+    if (token && !(token->type == JSON_NUMBER && token->number >= 0 &&
+                   token->number <= DPP_TEMPLATE_DISCRIMINATOR_MAX))
+    {
+        snprintf(err, err_size, "\"matter\".\"discriminator\" must be a number 0-%d",
+                 DPP_TEMPLATE_DISCRIMINATOR_MAX);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * トークン木をコンパクトなJSONとして出力する
+ * ルート直下のmatterオブジェクトからはpinCode・discriminatorを除き、
+ * 端末ごとの値を差し込む位置を*splitに記録する
+ */
+static void template_serialize(struct template_buf *buf, struct json_token *token,
+                               struct dpp_template *tmpl, size_t *split, int depth)
+{
+    struct json_token *child;
+    char num[16];
+    bool first = true;
+    bool matter = depth == 1 && token->name && strcmp(token->name, "matter") == 0 &&
+                  token->type == JSON_OBJECT;
+
+    if (token->name && depth > 0 && token->parent && token->parent->type == JSON_OBJECT)
+    {
+        template_put_string(buf, token->name);
+        template_put(buf, ":", 1);
+    }
+
+    switch (token->type)
+    {
+    case JSON_OBJECT:
+    case JSON_ARRAY:
+        template_put(buf, token->type == JSON_OBJECT ? "{" : "[", 1);
+        for (child = token->child; child; child = child->sibling)
+        {
+            if (matter && child->name && strcmp(child->name, "pinCode") == 0)
+            {
+                snprintf(tmpl->pin, sizeof(tmpl->pin), "%s", child->string);
+                continue;
+            }
+            if (matter && child->name && strcmp(child->name, "discriminator") == 0)
+            {
+                snprintf(tmpl->discriminator, sizeof(tmpl->discriminator), "%d", child->number);
+                continue;
+            }
+            if (!first)
+                template_put(buf, ",", 1);
+            template_serialize(buf, child, tmpl, split, depth + 1);
+            first = false;
+        }
+        if (matter)
+        {
+            *split = buf->len;
+            tmpl->in_matter = true;
+            tmpl->matter_fields = !first;
+        }
+        else if (depth == 0 && !tmpl->in_matter)
+        {
+            *split = buf->len; // matterが無ければルートの '}' の直前
+        }
+        template_put(buf, token->type == JSON_OBJECT ? "}" : "]", 1);
+        break;
+    case JSON_STRING:
+        template_put_string(buf, token->string);
+        break;
+    case JSON_NUMBER:
+        snprintf(num, sizeof(num), "%d", token->number);
+        template_puts(buf, num);
+        break;
+    case JSON_BOOLEAN:
+        template_puts(buf, token->number ? "true" : "false");
+        break;
+    default:
+        template_puts(buf, "null");
+        break;
+    }
+}
+
+static void template_free(struct dpp_template *tmpl)
+{
+    if (!tmpl)
+        return;
+    if (tmpl->definition)
+    {
+        memset(tmpl->definition, 0, strlen(tmpl->definition));
+        free(tmpl->definition);
+    }
+    free(tmpl->prefix);
+    free(tmpl->suffix);
+    free(tmpl);
+}
+
+static int template_set_parts(struct dpp_template *tmpl, const char *data, size_t split,
+                              size_t len)
+{
+    tmpl->prefix = strndup(data, split);
+    tmpl->suffix = strdup(data + split);
+    if (!tmpl->prefix || !tmpl->suffix)
+        return -1;
+    tmpl->prefix_len = split;
+    tmpl->suffix_len = len - split;
+    return 0;
+}
+
+/*
+ * 定義を検証して分割済みのテンプレートを作る
+ * 定義は "json\n<JSON>" または "conf\n<conf=... ssid=... pass=...>"
+ */
+static struct dpp_template *template_compile(const char *name, const char *definition,
+                                             char *err, size_t err_size)
+{
+    struct dpp_template *tmpl;
+    struct template_buf buf = {0};
+    struct json_token *root;
+    size_t split = 0;
+
+    tmpl = calloc(1, sizeof(*tmpl));
+    if (!tmpl)
+        return NULL;
+    snprintf(tmpl->name, sizeof(tmpl->name), "%s", name);
+
+    if (strncmp(definition, "conf\n", 5) == 0)
+    {
+        // 従来形式: 端末ごとの差分は末尾の matter_pin=... だけ
+        if (template_set_parts(tmpl, definition + 5, strlen(definition + 5),
+                               strlen(definition + 5)) < 0)
+            goto fail;
+        return tmpl;
+    }
+    if (strncmp(definition, "json\n", 5) != 0)
+    {
+        snprintf(err, err_size, "unknown template format");
+        goto fail;
+    }
+
+    tmpl->json = true;
+    root = json_parse(definition + 5, strlen(definition + 5));
+    if (!root)
+    {
+        snprintf(err, err_size, "invalid JSON");
+        goto fail;
+    }
+    if (template_validate(root, err, err_size) < 0)
+    {
+        json_free(root);
+        goto fail;
+    }
+
+    template_puts(&buf, "conf_json='");
+    template_serialize(&buf, root, tmpl, &split, 0);
+    template_put(&buf, "'", 1);
+    json_free(root);
+    if (buf.error || template_set_parts(tmpl, buf.data, split, buf.len) < 0)
+    {
+        free(buf.data);
+        goto fail;
+    }
+    free(buf.data);
+    return tmpl;
+
+fail:
+    template_free(tmpl);
+    return NULL;
+}
+
+// パスワードを含みうるレコードのコピーを消してから解放する
+static void template_record_free(char *record)
+{
+    if (!record)
+        return;
+    memset(record, 0, strlen(record));
+    free(record);
+}
+
+/*
+ * 保存済みのレコードのコピーを返し、*definitionに定義（名前の行の後ろ）を指させる
+ * 無いか、同じIDが別の名前なら NULL。template_record_free() で解放する
+ */
+static char *template_lookup(const char *name, const char **definition)
+{
+    char *record = dpp_state_get(DPP_STATE_TEMPLATE, template_id(name));
+    size_t name_len = strlen(name);
+
+    if (!record || strncmp(record, name, name_len) != 0 || record[name_len] != '\n')
+    {
+        template_record_free(record);
+        return NULL;
+    }
+    *definition = record + name_len + 1;
+    return record;
+}
+
+// 参照を1つ外し、最後の参照なら解放する（template_lockを保持して呼ぶ）
+static void template_unref(struct dpp_template *tmpl)
+{
+    if (--tmpl->refs == 0)
+        template_free(tmpl);
+}
+
+/*
+ * テンプレートを取得（状態ストアの定義が変わっていなければキャッシュを使う）
+ * 使い終わったら dpp_template_release() を呼ぶ
+ */
+const struct dpp_template *dpp_template_get(const char *name)
+{
+    struct dpp_template *tmpl, **pp;
+    const char *definition;
+    char *record;
+    char err[128];
+
+    record = template_lookup(name, &definition);
+    if (!record)
+    {
+        dpp_printf("Error: Template not found: %s\n", name);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&template_lock);
+    for (pp = &template_cache; (tmpl = *pp) != NULL; pp = &tmpl->next)
+    {
+        if (strcmp(tmpl->name, name) == 0)
+            break;
+    }
+    if (tmpl && strcmp(tmpl->definition, definition) != 0)
+    {
+        // 再定義された: 他のスレッドが使っていれば、そのスレッドが手放したときに解放される
+        *pp = tmpl->next;
+        template_unref(tmpl);
+        tmpl = NULL;
+    }
+    if (!tmpl)
+    {
+        err[0] = '\0';
+        tmpl = template_compile(name, definition, err, sizeof(err));
+        if (tmpl && !(tmpl->definition = strdup(definition)))
+        {
+            template_free(tmpl);
+            tmpl = NULL;
+        }
+        if (tmpl)
+        {
+            tmpl->refs = 1;
+            tmpl->next = template_cache;
+            template_cache = tmpl;
+        }
+        else
+        {
+            dpp_printf("Error: Template %s: %s\n", name, err[0] ? err : "out of memory");
+        }
+    }
+    if (tmpl)
+        tmpl->refs++;
+    pthread_mutex_unlock(&template_lock);
+    template_record_free(record);
+    return tmpl;
+}
+
+void dpp_template_release(const struct dpp_template *tmpl)
+{
+    if (!tmpl)
+        return;
+    pthread_mutex_lock(&template_lock);
+    template_unref((struct dpp_template *)tmpl);
+    pthread_mutex_unlock(&template_lock);
+}
+
+/*
+ * 端末ごとの値を差し込んでDPP_AUTH_INITのパラメータを作る
+ * pin/discriminatorがNULLならテンプレートの値を使う
+ * 戻り値: パラメータの長さ。値が不正（conf形式でのdiscriminatorを含む）か収まらなければ-1
+ */
+int dpp_template_render(const struct dpp_template *tmpl, const char *pin,
+                        const char *discriminator, char *params, size_t params_size)
+{
+    char delta[64];
+    int delta_len = 0;
+
+    if ((pin && !template_valid_pin(pin)) ||
+        (discriminator && (!tmpl->json || !template_valid_discriminator(discriminator))))
+        return -1;
+
+    if (!pin && tmpl->pin[0])
+        pin = tmpl->pin;
+    if (!discriminator && tmpl->discriminator[0])
+        discriminator = tmpl->discriminator;
+
+    if (!tmpl->json)
+    {
+        if (pin)
+            delta_len = snprintf(delta, sizeof(delta), " matter_pin=%s", pin);
+    }
+    else if (pin || discriminator)
+    {
+        delta_len = snprintf(delta, sizeof(delta), "%s%s%s%s%s%s%s%s",
+                             tmpl->in_matter ? (tmpl->matter_fields ? "," : "") : ",\"matter\":{",
+                             pin ? "\"pinCode\":\"" : "", pin ? pin : "", pin ? "\"" : "",
+                             pin && discriminator ? "," : "",
+                             discriminator ? "\"discriminator\":" : "",
+                             discriminator ? discriminator : "",
+                             tmpl->in_matter ? "" : "}");
+    }
+    if (delta_len < 0 || (size_t)delta_len >= sizeof(delta) ||
+        tmpl->prefix_len + delta_len + tmpl->suffix_len >= params_size)
+        return -1;
+
+    memcpy(params, tmpl->prefix, tmpl->prefix_len);
+    memcpy(params + tmpl->prefix_len, delta, delta_len);
+    memcpy(params + tmpl->prefix_len + delta_len, tmpl->suffix, tmpl->suffix_len + 1);
+    return (int)(tmpl->prefix_len + delta_len + tmpl->suffix_len);
+}
+
+/*
+ * テンプレートの静的な設定をDPP_CONFIGURATOR_PARAMSでhostapdのConfiguratorに設定する
+ * hostapdが自分から始める交換（プレゼンス通知・レスポンダー）の設定が変わるので、
+ * template push=<ifname> で明示されたときだけ送る
+ */
+int dpp_template_push(const struct dpp_template *tmpl, const char *interface,
+                      int hostapd_configurator_id)
+{
+    struct hostapd_ctrl *ctrl;
+    char params[DPP_AUTH_PARAMS_MAX];
+    char cmd[DPP_AUTH_PARAMS_MAX + 64];
+    char response[MAX_RESPONSE_SIZE];
+    int ret;
+
+    if (dpp_template_render(tmpl, NULL, NULL, params, sizeof(params)) < 0)
+        return -1;
+    ctrl = hostapd_ctrl_get(interface);
+    if (!ctrl)
+        return -1;
+    snprintf(cmd, sizeof(cmd), "DPP_CONFIGURATOR_PARAMS configurator=%d %s",
+             hostapd_configurator_id, params);
+    ret = hostapd_ctrl_request(ctrl, cmd, response, sizeof(response));
+    memset(cmd, 0, sizeof(cmd));
+    memset(params, 0, sizeof(params));
+    if (ret < 0 || strncmp(response, "OK", 2) != 0)
+    {
+        DPP_LOG(DPP_LOG_AUTH, DPP_LOG_WARN, "DPP_CONFIGURATOR_PARAMS failed on %s: %s",
+                interface, ret < 0 ? strerror(-ret) : response);
+        return -1;
+    }
+    DPP_LOG(DPP_LOG_AUTH, DPP_LOG_INFO, "Template %s sent to hostapd on %s", tmpl->name,
+            interface);
+    return 0;
+}
+
+// テンプレートを保存（definitionは "json\n..." または "conf\n..."）
+static int template_save(const char *name, const char *definition)
+{
+    char *record;
+    size_t len = strlen(name) + 1 + strlen(definition);
+    int ret = -1;
+
+    record = malloc(len + 1);
+    if (!record)
+        return -1;
+    snprintf(record, len + 1, "%s\n%s", name, definition);
+    if (dpp_state_append(DPP_STATE_TEMPLATE, template_id(name), record, len) &&
+        dpp_state_commit() == 0)
+        ret = 0;
+    memset(record, 0, len);
+    free(record);
+    return ret;
+}
+
+// 同じIDを別の名前のテンプレートが使っていないか
+static bool template_id_taken(const char *name)
+{
+    char *record = dpp_state_get(DPP_STATE_TEMPLATE, template_id(name));
+    size_t name_len = strlen(name);
+    bool taken = record && *record &&
+                 !(strncmp(record, name, name_len) == 0 && record[name_len] == '\n');
+
+    template_record_free(record);
+    return taken;
+}
+
+// template コマンド: 設定テンプレートの定義・表示・削除・hostapdへの設定
+int cmd_template(struct dpp_configurator_ctx *ctx, const struct dpp_args *args)
+{
+    const char *name = dpp_arg(args, "name");
+    const char *push = dpp_arg(args, "push");
+    const char *conf_json = dpp_arg(args, "conf_json");
+    const char *conf_type = dpp_arg(args, "conf");
+    const char *ssid = dpp_arg(args, "ssid");
+    char *pass = dpp_arg(args, "pass");
+    char *definition = NULL;
+    char err[128];
+    int ret = -1;
+
+    if (!name || !*name || strlen(name) >= DPP_TEMPLATE_NAME_MAX || strchr(name, '\n'))
+    {
+        dpp_printf("Error: name parameter required (up to %d characters)\n", DPP_TEMPLATE_NAME_MAX - 1);
+        dpp_printf("Usage: template name=<name> conf_json=<json> | conf=<type> ssid=<ssid> pass=<pass>\n");
+        dpp_printf("       template name=<name> [remove=1]\n");
+        dpp_printf("       template name=<name> push=<ifname> [configurator=<id>]\n");
+        goto cleanup;
+    }
+
+    if (dpp_arg_int(args, "remove", 0))
+    {
+        const char *unused;
+        char *record = template_lookup(name, &unused);
+        bool found = record != NULL;
+
+        template_record_free(record);
+        if (!found)
+        {
+            dpp_printf("Error: Template not found: %s\n", name);
+            goto cleanup;
+        }
+        if (!dpp_state_append(DPP_STATE_TEMPLATE, template_id(name), "", 0) ||
+            dpp_state_commit() < 0)
+            goto cleanup;
+        dpp_printf("Template %s removed\n", name);
+        ret = 0;
+        goto cleanup;
+    }
+
+    // hostapdが自分から始める交換にもこのテンプレートを使わせる（明示したときだけ）
+    if (push)
+    {
+        const struct dpp_template *tmpl = dpp_template_get(name);
+        int configurator_id = dpp_arg_int(args, "configurator", 1);
+        int hostapd_configurator_id;
+
+        if (!tmpl)
+            goto cleanup;
+        hostapd_configurator_id = dpp_hostapd_configurator(ctx, push, configurator_id, false, true);
+        if (hostapd_configurator_id >= 0 &&
+            dpp_template_push(tmpl, push, hostapd_configurator_id) == 0)
+        {
+            dpp_printf("Template %s set on configurator %d of hostapd on %s\n", name,
+                       configurator_id, push);
+            ret = 0;
+        }
+        else
+        {
+            dpp_printf("Error: Failed to send template %s to hostapd on %s\n", name, push);
+        }
+        dpp_template_release(tmpl);
+        goto cleanup;
+    }
+
+    // 定義が無ければ表示
+    if (!conf_json && !conf_type)
+    {
+        const struct dpp_template *tmpl = dpp_template_get(name);
+        char params[DPP_AUTH_PARAMS_MAX];
+        char redacted[DPP_AUTH_PARAMS_MAX];
+
+        if (tmpl && dpp_template_render(tmpl, NULL, NULL, params, sizeof(params)) >= 0)
+        {
+            dpp_log_redact(params, redacted, sizeof(redacted));
+            memset(params, 0, sizeof(params));
+            dpp_printf("Template %s (%s): %s\n", name, tmpl->json ? "json" : "conf", redacted);
+            ret = 0;
+        }
+        dpp_template_release(tmpl);
+        goto cleanup;
+    }
+
+    if (template_id_taken(name))
+    {
+        dpp_printf("Error: Template name %s collides with another template, choose another name\n",
+                   name);
+        goto cleanup;
+    }
+
+    if (conf_json)
+    {
+        definition = malloc(strlen(conf_json) + 6);
+        if (!definition)
+            goto cleanup;
+        sprintf(definition, "json\n%s", conf_json);
+    }
+    else
+    {
+        char params[DPP_AUTH_PARAMS_MAX];
+
+        // SSID・パスワードの16進数エンコードは定義時に一度だけ行う
+        if (dpp_auth_build_params(conf_type, ssid, pass, NULL, NULL, params, sizeof(params)) < 0)
+            goto cleanup;
+        definition = malloc(strlen(params) + 6);
+        if (!definition)
+            goto cleanup;
+        sprintf(definition, "conf\n%s", params);
+        memset(params, 0, sizeof(params));
+    }
+
+    // 保存する前に検証する
+    err[0] = '\0';
+    struct dpp_template *tmpl = template_compile(name, definition, err, sizeof(err));
+    if (!tmpl)
+    {
+        dpp_printf("Error: Invalid template %s: %s\n", name, err[0] ? err : "out of memory");
+        goto cleanup;
+    }
+    template_free(tmpl);
+
+    if (template_save(name, definition) < 0)
+    {
+        dpp_printf("Error: Failed to save template %s\n", name);
+        goto cleanup;
+    }
+    dpp_printf("Template %s saved\n", name);
+    ret = 0;
+
+cleanup:
+    if (definition)
+    {
+        memset(definition, 0, strlen(definition));
+        free(definition);
+    }
+    if (pass)
+        memset(pass, 0, strlen(pass));
+    return ret;
+}
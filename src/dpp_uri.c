@@ -0,0 +1,512 @@
+/*
+ * DPP Configurator - DPP URI Parser
+ * Allocation-free tokenizer and local pre-validation of DPP bootstrap URIs
+ *
+ * The tokenizer splits "DPP:<tag>:<value>;...;;" into pointers into the
+ * original string and checks the syntax of the C:, M:, I:, V:, H: and K:
+ * fields the way hostapd's dpp_parse_uri() does. The K: field is decoded
+ * into a stack buffer, its SubjectPublicKeyInfo is walked by hand, the
+ * point is checked against the curve and the bootstrap key hash is computed
+ * in the same pass. The curve parameters and a BN_CTX are cached in a
+ * dpp_uri_ctx, so a thread that owns a context validates URIs without
+ * touching the heap once it has seen each curve.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include "../include/dpp_configurator.h"
+#include "common/ieee802_11_common.h"
+#include "crypto/sha256.h"
+
+#define DPP_URI_MAX_SPKI 256 // P-521の非圧縮点でも160バイト程度
+
+// DPPで使える曲線（hostapdのdpp_curvesと同じ名前）
+struct dpp_uri_curve
+{
+    const char *name;
+    int nid;
+    size_t prime_len;
+    size_t oid_len;
+    u8 oid[9];
+};
+
+static const struct dpp_uri_curve dpp_uri_curves[] = {
+    {"prime256v1", NID_X9_62_prime256v1, 32, 8,
+     {0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07}},
+    {"secp384r1", NID_secp384r1, 48, 5, {0x2b, 0x81, 0x04, 0x00, 0x22}},
+    {"secp521r1", NID_secp521r1, 66, 5, {0x2b, 0x81, 0x04, 0x00, 0x23}},
+    {"brainpoolP256r1", NID_brainpoolP256r1, 32, 9,
+     {0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x07}},
+    {"brainpoolP384r1", NID_brainpoolP384r1, 48, 9,
+     {0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x0b}},
+    {"brainpoolP512r1", NID_brainpoolP512r1, 64, 9,
+     {0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x0d}},
+};
+
+#define DPP_URI_CURVES ARRAY_SIZE(dpp_uri_curves)
+
+// id-ecPublicKey (1.2.840.10045.2.1)
+static const u8 dpp_uri_ec_public_key_oid[] = {0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01};
+
+// 曲線のパラメータ y^2 = x^3 + ax + b (mod p)（必要になった時点で取得する）
+struct dpp_uri_ctx
+{
+    BN_CTX *bn_ctx;
+    BIGNUM *p[DPP_URI_CURVES];
+    BIGNUM *a[DPP_URI_CURVES];
+    BIGNUM *b[DPP_URI_CURVES];
+};
+
+static const char *dpp_uri_status_strs[DPP_URI_STATUSES] = {
+    [DPP_URI_OK] = "OK",
+    [DPP_URI_ERR_PREFIX] = "URI does not start with 'DPP:'",
+    [DPP_URI_ERR_NO_TERMINATOR] = "URI does not end with ';;'",
+    [DPP_URI_ERR_BAD_FIELD] = "malformed URI field",
+    [DPP_URI_ERR_BAD_CHANNEL] = "malformed C: (channel list) field",
+    [DPP_URI_ERR_BAD_MAC] = "malformed M: (MAC address) field",
+    [DPP_URI_ERR_BAD_VERSION] = "malformed V: (version) field",
+    [DPP_URI_ERR_BAD_INFO] = "invalid characters in I: (information) field",
+    [DPP_URI_ERR_BAD_HOST] = "invalid characters in H: (host) field",
+    [DPP_URI_ERR_NO_KEY] = "missing K: (public key) field",
+    [DPP_URI_ERR_BAD_BASE64] = "invalid base64 in K: field",
+    [DPP_URI_ERR_BAD_KEY] = "K: field is not a valid public key",
+    [DPP_URI_ERR_UNSUPPORTED_CURVE] = "K: field uses an unsupported curve",
+    [DPP_URI_ERR_BAD_POINT] = "K: field is not a point on its curve",
+};
+
+const char *dpp_uri_status_str(enum dpp_uri_status status)
+{
+    if ((unsigned int)status >= DPP_URI_STATUSES)
+        return "unknown error";
+    return dpp_uri_status_strs[status];
+}
+
+struct dpp_uri_ctx *dpp_uri_ctx_new(void)
+{
+    struct dpp_uri_ctx *ctx = calloc(1, sizeof(*ctx));
+
+    if (!ctx)
+        return NULL;
+    ctx->bn_ctx = BN_CTX_new();
+    if (!ctx->bn_ctx)
+    {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void dpp_uri_ctx_free(struct dpp_uri_ctx *ctx)
+{
+    size_t i;
+
+    if (!ctx)
+        return;
+    for (i = 0; i < DPP_URI_CURVES; i++)
+    {
+        BN_free(ctx->p[i]);
+        BN_free(ctx->a[i]);
+        BN_free(ctx->b[i]);
+    }
+    BN_CTX_free(ctx->bn_ctx);
+    free(ctx);
+}
+
+// C: "<op class>/<channel>" を ',' 区切りで並べたもの
+static bool dpp_uri_valid_chan(const char *p, const char *end)
+{
+    while (p < end)
+    {
+        int digits, value;
+
+        for (digits = 0, value = 0; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+            value = value * 10 + (*p - '0');
+        if (digits == 0 || digits > 3 || value > 255 || p == end || *p++ != '/')
+            return false;
+        for (digits = 0, value = 0; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+            value = value * 10 + (*p - '0');
+        if (digits == 0 || digits > 3 || value > 255)
+            return false;
+        if (p < end && *p++ != ',')
+            return false;
+        if (p == end && p[-1] == ',')
+            return false;
+    }
+    return true;
+}
+
+// M: 12桁の16進数（hwaddr_aton2() と同じく区切り文字は無視する）
+static bool dpp_uri_parse_mac(const char *p, const char *end, u8 *addr)
+{
+    int digits = 0;
+
+    for (; p < end; p++)
+    {
+        int v = hex2num(*p);
+        if (v < 0)
+        {
+            if (*p == ':' || *p == '-' || *p == '.')
+                continue;
+            return false;
+        }
+        if (digits >= ETH_ALEN * 2)
+            return false;
+        if (digits & 1)
+            addr[digits / 2] |= v;
+        else
+            addr[digits / 2] = v << 4;
+        digits++;
+    }
+    return digits == ETH_ALEN * 2;
+}
+
+// I:/H: は ';' 以外の印字可能なASCII文字
+static bool dpp_uri_printable(const char *p, const char *end)
+{
+    for (; p < end; p++)
+    {
+        if (*p < 0x20 || *p > 0x7e)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * URIをフィールドに分割して構文を確認する（公開鍵はデコードしない）
+ * 同じタグが複数あればhostapdと同じく最初のものを使い、未知のタグは無視する
+ */
+enum dpp_uri_status dpp_uri_tokenize(const char *uri, size_t len, struct dpp_uri *out)
+{
+    const char *pos, *end, *field_end, *value;
+
+    memset(out, 0, sizeof(*out));
+
+    if (len < 4 || memcmp(uri, "DPP:", 4) != 0)
+        return DPP_URI_ERR_PREFIX;
+    if (len < 6 || memcmp(uri + len - 2, ";;", 2) != 0)
+    {
+        out->error_offset = len;
+        return DPP_URI_ERR_NO_TERMINATOR;
+    }
+
+    // "DPP:" の後ろは "<tag>:<value>;" の繰り返し
+    pos = uri + 4;
+    end = uri + len - 1;
+    while (pos < end)
+    {
+        field_end = memchr(pos, ';', end - pos);
+        if (!field_end)
+            field_end = end;
+        out->error_offset = pos - uri;
+        if (field_end - pos < 2 || pos[1] != ':')
+            return DPP_URI_ERR_BAD_FIELD;
+        value = pos + 2;
+
+        switch (pos[0])
+        {
+        case 'C':
+            if (out->chan)
+                break;
+            if (!dpp_uri_valid_chan(value, field_end))
+                return DPP_URI_ERR_BAD_CHANNEL;
+            out->chan = value;
+            out->chan_len = field_end - value;
+            break;
+        case 'M':
+            if (out->mac)
+                break;
+            if (!dpp_uri_parse_mac(value, field_end, out->mac_addr))
+                return DPP_URI_ERR_BAD_MAC;
+            out->mac = value;
+            out->mac_len = field_end - value;
+            break;
+        case 'I':
+            if (out->info)
+                break;
+            if (!dpp_uri_printable(value, field_end))
+                return DPP_URI_ERR_BAD_INFO;
+            out->info = value;
+            out->info_len = field_end - value;
+            break;
+        case 'H':
+            if (out->host)
+                break;
+            if (value == field_end || !dpp_uri_printable(value, field_end))
+                return DPP_URI_ERR_BAD_HOST;
+            out->host = value;
+            out->host_len = field_end - value;
+            break;
+        case 'V':
+            if (out->version)
+                break;
+            if (value == field_end || field_end - value > 3)
+                return DPP_URI_ERR_BAD_VERSION;
+            for (const char *p = value; p < field_end; p++)
+            {
+                if (*p < '0' || *p > '9')
+                    return DPP_URI_ERR_BAD_VERSION;
+                out->version = out->version * 10 + (*p - '0');
+            }
+            if (out->version == 0)
+                return DPP_URI_ERR_BAD_VERSION;
+            break;
+        case 'K':
+            if (out->key)
+                break;
+            out->key = value;
+            out->key_len = field_end - value;
+            break;
+        default:
+            break;
+        }
+        pos = field_end + 1;
+    }
+
+    if (!out->key || out->key_len == 0)
+    {
+        out->error_offset = len;
+        return DPP_URI_ERR_NO_KEY;
+    }
+    out->error_offset = 0;
+    return DPP_URI_OK;
+}
+
+// DERのTLVを1つ読む（長さは2バイトまで。DER以外の冗長な長さは拒否）
+static int dpp_uri_der_next(const u8 **pos, const u8 *end, u8 tag,
+                            const u8 **value, size_t *value_len)
+{
+    const u8 *p = *pos;
+    size_t len;
+
+    if (end - p < 2 || p[0] != tag)
+        return -1;
+    len = p[1];
+    p += 2;
+    if (len & 0x80)
+    {
+        size_t n = len & 0x7f;
+        if (n < 1 || n > 2 || (size_t)(end - p) < n)
+            return -1;
+        for (len = 0; n > 0; n--)
+            len = (len << 8) | *p++;
+        if (len < 0x80)
+            return -1;
+    }
+    if ((size_t)(end - p) < len)
+        return -1;
+    *value = p;
+    *value_len = len;
+    *pos = p + len;
+    return 0;
+}
+
+/*
+ * SubjectPublicKeyInfo を確認し、曲線と点の位置を返す
+ *   SEQUENCE { SEQUENCE { OID id-ecPublicKey, OID <curve> }, BIT STRING <point> }
+ */
+static enum dpp_uri_status dpp_uri_parse_spki(const u8 *der, size_t der_len,
+                                              const struct dpp_uri_curve **curve,
+                                              const u8 **point)
+{
+    const u8 *pos = der, *end = der + der_len;
+    const u8 *spki, *alg, *oid, *bits;
+    size_t spki_len, alg_len, oid_len, bits_len, point_len;
+    size_t i;
+
+    if (dpp_uri_der_next(&pos, end, 0x30, &spki, &spki_len) < 0 || pos != end)
+        return DPP_URI_ERR_BAD_KEY;
+    pos = spki;
+    end = spki + spki_len;
+    if (dpp_uri_der_next(&pos, end, 0x30, &alg, &alg_len) < 0 ||
+        dpp_uri_der_next(&pos, end, 0x03, &bits, &bits_len) < 0 || pos != end)
+        return DPP_URI_ERR_BAD_KEY;
+
+    pos = alg;
+    end = alg + alg_len;
+    if (dpp_uri_der_next(&pos, end, 0x06, &oid, &oid_len) < 0 ||
+        oid_len != sizeof(dpp_uri_ec_public_key_oid) ||
+        memcmp(oid, dpp_uri_ec_public_key_oid, oid_len) != 0)
+        return DPP_URI_ERR_BAD_KEY;
+    if (dpp_uri_der_next(&pos, end, 0x06, &oid, &oid_len) < 0 || pos != end)
+        return DPP_URI_ERR_BAD_KEY;
+
+    *curve = NULL;
+    for (i = 0; i < DPP_URI_CURVES; i++)
+    {
+        if (oid_len == dpp_uri_curves[i].oid_len &&
+            memcmp(oid, dpp_uri_curves[i].oid, oid_len) == 0)
+        {
+            *curve = &dpp_uri_curves[i];
+            break;
+        }
+    }
+    if (!*curve)
+        return DPP_URI_ERR_UNSUPPORTED_CURVE;
+
+    // BIT STRINGの先頭は未使用ビット数（0のみ）、続いて圧縮または非圧縮の点
+    if (bits_len < 2 || bits[0] != 0)
+        return DPP_URI_ERR_BAD_KEY;
+    *point = bits + 1;
+    point_len = bits_len - 1;
+    if (!(((*point)[0] == 0x02 || (*point)[0] == 0x03) && point_len == 1 + (*curve)->prime_len) &&
+        !((*point)[0] == 0x04 && point_len == 1 + 2 * (*curve)->prime_len))
+        return DPP_URI_ERR_BAD_POINT;
+    return DPP_URI_OK;
+}
+
+static int dpp_uri_load_curve(struct dpp_uri_ctx *ctx, size_t i)
+{
+    EC_GROUP *group;
+    int ret = -1;
+
+    group = EC_GROUP_new_by_curve_name(dpp_uri_curves[i].nid);
+    if (!group)
+        return -1;
+    ctx->p[i] = BN_new();
+    ctx->a[i] = BN_new();
+    ctx->b[i] = BN_new();
+    if (ctx->p[i] && ctx->a[i] && ctx->b[i] &&
+        EC_GROUP_get_curve(group, ctx->p[i], ctx->a[i], ctx->b[i], ctx->bn_ctx) == 1)
+        ret = 0;
+    EC_GROUP_free(group);
+    if (ret < 0)
+    {
+        BN_free(ctx->p[i]);
+        BN_free(ctx->a[i]);
+        BN_free(ctx->b[i]);
+        ctx->p[i] = ctx->a[i] = ctx->b[i] = NULL;
+    }
+    return ret;
+}
+
+/*
+ * 点が曲線上にあるかを確認する
+ * 圧縮点は平方根を求める代わりに x^3 + ax + b の平方剰余性（ヤコビ記号）だけを見る。
+ * y座標の復元はhostapdがdpp_add_qr_code() で行うので、ここでは存在の確認で足りる
+ */
+static enum dpp_uri_status dpp_uri_check_point(struct dpp_uri_ctx *ctx,
+                                               const struct dpp_uri_curve *curve,
+                                               const u8 *point)
+{
+    size_t i = curve - dpp_uri_curves;
+    BIGNUM *x, *y, *rhs, *t;
+    enum dpp_uri_status status = DPP_URI_ERR_BAD_POINT;
+
+    if (!ctx->p[i] && dpp_uri_load_curve(ctx, i) < 0)
+        return DPP_URI_ERR_UNSUPPORTED_CURVE;
+
+    BN_CTX_start(ctx->bn_ctx);
+    x = BN_CTX_get(ctx->bn_ctx);
+    y = BN_CTX_get(ctx->bn_ctx);
+    rhs = BN_CTX_get(ctx->bn_ctx);
+    t = BN_CTX_get(ctx->bn_ctx);
+    if (!t || !BN_bin2bn(point + 1, (int)curve->prime_len, x) || BN_cmp(x, ctx->p[i]) >= 0)
+        goto out;
+
+    // rhs = x^3 + ax + b = (x^2 + a)x + b
+    if (!BN_mod_sqr(t, x, ctx->p[i], ctx->bn_ctx) ||
+        !BN_mod_add(t, t, ctx->a[i], ctx->p[i], ctx->bn_ctx) ||
+        !BN_mod_mul(rhs, t, x, ctx->p[i], ctx->bn_ctx) ||
+        !BN_mod_add(rhs, rhs, ctx->b[i], ctx->p[i], ctx->bn_ctx))
+        goto out;
+
+    if (point[0] == 0x04)
+    {
+        if (!BN_bin2bn(point + 1 + curve->prime_len, (int)curve->prime_len, y) ||
+            BN_cmp(y, ctx->p[i]) >= 0 || !BN_mod_sqr(t, y, ctx->p[i], ctx->bn_ctx) ||
+            BN_cmp(t, rhs) != 0)
+            goto out;
+    }
+    else
+    {
+        // y = 0 なら奇数のyは存在しない
+        int k = BN_kronecker(rhs, ctx->p[i], ctx->bn_ctx);
+        if (k < 0 || (k == 0 && point[0] == 0x03))
+            goto out;
+    }
+    status = DPP_URI_OK;
+
+out:
+    BN_CTX_end(ctx->bn_ctx);
+    return status;
+}
+
+/*
+ * URIを解析し、公開鍵を検証してBootstrap鍵ハッシュを計算する
+ * ctxがNULLなら点が曲線上にあるかの確認は省略する（DERの構造と長さのみ確認）
+ */
+enum dpp_uri_status dpp_uri_parse(struct dpp_uri_ctx *ctx, const char *uri, size_t len,
+                                  struct dpp_uri *out)
+{
+    u8 der[DPP_URI_MAX_SPKI];
+    const struct dpp_uri_curve *curve;
+    const u8 *point, *addr[1];
+    size_t der_len;
+    enum dpp_uri_status status;
+    int ret;
+
+    status = dpp_uri_tokenize(uri, len, out);
+    if (status != DPP_URI_OK)
+        return status;
+
+    out->error_offset = out->key - uri;
+    ret = dpp_base64_decode(out->key, out->key_len, der, sizeof(der));
+    if (ret < 0)
+        return DPP_URI_ERR_BAD_BASE64;
+    der_len = ret;
+
+    status = dpp_uri_parse_spki(der, der_len, &curve, &point);
+    if (status != DPP_URI_OK)
+        return status;
+    if (ctx)
+    {
+        status = dpp_uri_check_point(ctx, curve, point);
+        if (status != DPP_URI_OK)
+            return status;
+    }
+
+    // dpp_parse_uri_pk() と同じくDER全体のSHA-256
+    addr[0] = der;
+    if (sha256_vector(1, addr, &der_len, out->pubkey_hash) < 0)
+        return DPP_URI_ERR_BAD_KEY;
+    out->curve = curve->name;
+    out->error_offset = 0;
+    return DPP_URI_OK;
+}
+
+/*
+ * URIのチャネルリスト（C:<op class>/<channel>,...）を周波数に変換
+ * 戻り値: 周波数の数（C:が無いかURIが不正なら0）
+ */
+int dpp_uri_channel_freqs(const char *uri, int *freqs, int max_freqs)
+{
+    struct dpp_uri parsed;
+    const char *p, *end;
+    int count = 0;
+
+    if (dpp_uri_tokenize(uri, strlen(uri), &parsed) != DPP_URI_OK || !parsed.chan)
+        return 0;
+
+    p = parsed.chan;
+    end = parsed.chan + parsed.chan_len;
+    while (p < end && count < max_freqs)
+    {
+        int op_class = 0, chan = 0, freq;
+
+        while (*p != '/')
+            op_class = op_class * 10 + (*p++ - '0');
+        p++;
+        while (p < end && *p != ',')
+            chan = chan * 10 + (*p++ - '0');
+        freq = ieee80211_chan_to_freq(NULL, (u8)op_class, (u8)chan);
+        if (freq > 0)
+            freqs[count++] = freq;
+        if (p < end)
+            p++; // ','
+    }
+    return count;
+}
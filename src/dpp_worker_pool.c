@@ -0,0 +1,119 @@
+/*
+ * DPP Configurator - Worker Pool
+ * Fixed set of threads that run CPU-heavy DPP steps (Configuration Response
+ * building, connector signing) away from the threads driving frame exchanges
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/dpp_configurator.h"
+
+#define WORKER_POOL_MAX_THREADS 256
+
+struct dpp_worker_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct dpp_worker_job *head; // 投入順に実行する
+    struct dpp_worker_job *tail;
+    bool stopping;
+    pthread_t *threads;
+    int thread_count;
+};
+
+static void *worker_pool_thread(void *arg)
+{
+    struct dpp_worker_pool *pool = arg;
+    struct dpp_worker_job *job;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->head && !pool->stopping)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        // 停止時も投入済みのジョブは最後まで実行する
+        job = pool->head;
+        if (!job)
+            break;
+        pool->head = job->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->fn(job);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct dpp_worker_pool *dpp_worker_pool_new(int threads)
+{
+    struct dpp_worker_pool *pool;
+
+    if (threads <= 0 || threads > WORKER_POOL_MAX_THREADS)
+    {
+        dpp_printf("Error: Worker pool size must be between 1 and %d\n", WORKER_POOL_MAX_THREADS);
+        return NULL;
+    }
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->threads = calloc(threads, sizeof(*pool->threads));
+    if (!pool->threads)
+    {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (; pool->thread_count < threads; pool->thread_count++)
+    {
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, worker_pool_thread,
+                           pool) != 0)
+        {
+            dpp_printf("Error: Failed to start worker thread %d\n", pool->thread_count);
+            dpp_worker_pool_free(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+// jobは完了（job->fnの呼び出し）まで呼び出し側が保持する
+void dpp_worker_pool_submit(struct dpp_worker_pool *pool, struct dpp_worker_job *job)
+{
+    job->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail)
+        pool->tail->next = job;
+    else
+        pool->head = job;
+    pool->tail = job;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// 投入済みのジョブを全て実行してからスレッドを止める
+void dpp_worker_pool_free(struct dpp_worker_pool *pool)
+{
+    int i;
+
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->threads);
+    free(pool);
+}
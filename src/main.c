@@ -1,20 +1,229 @@
 #include "../include/dpp_configurator.h"
 
+// コマンドごとの引数スキーマ
+static const struct dpp_arg_spec no_args[] = {{NULL}};
+
+static const struct dpp_arg_spec configurator_add_args[] = {
+    {"key", DPP_ARG_STR, 0, 0},
+    {"curve", DPP_ARG_STR, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec dpp_qr_code_args[] = {
+    {"uri", DPP_ARG_REST, DPP_ARG_REQUIRED, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec import_args[] = {
+    {"file", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"format", DPP_ARG_STR, 0, 0},
+    {"threads", DPP_ARG_INT, 0, 0},
+    {"batch", DPP_ARG_INT, 0, 0},
+    {"interface", DPP_ARG_STR, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec bootstrap_get_uri_args[] = {
+    {"id", DPP_ARG_INT, DPP_ARG_REQUIRED, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec template_args[] = {
+    {"name", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"conf", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"ssid", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"pass", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"conf_json", DPP_ARG_STR, 0, DPP_ARG_MODE_JSON},
+    {"remove", DPP_ARG_INT, 0, 0},
+    {"push", DPP_ARG_STR, 0, 0},
+    {"configurator", DPP_ARG_INT, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec auth_init_args[] = {
+    {"peer", DPP_ARG_INT, DPP_ARG_REQUIRED, 0},
+    {"configurator", DPP_ARG_INT, DPP_ARG_REQUIRED, 0},
+    {"interface", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"conf", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"ssid", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"pass", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"matter_pin", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF | DPP_ARG_MODE_TEMPLATE},
+    {"conf_json", DPP_ARG_STR, 0, DPP_ARG_MODE_JSON},
+    {"template", DPP_ARG_STR, 0, DPP_ARG_MODE_TEMPLATE},
+    {"discriminator", DPP_ARG_INT, 0, DPP_ARG_MODE_TEMPLATE},
+    {"wait", DPP_ARG_INT, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec provision_args[] = {
+    {"interfaces", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"peers", DPP_ARG_STR, 0, 0},
+    {"configurator", DPP_ARG_INT, 0, 0},
+    {"policy", DPP_ARG_STR, 0, 0},
+    {"order", DPP_ARG_STR, 0, 0},
+    {"timeout", DPP_ARG_INT, 0, 0},
+    {"ctrl_dir", DPP_ARG_STR, 0, 0},
+    {"conf", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"ssid", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"pass", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"matter_pin", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF | DPP_ARG_MODE_TEMPLATE},
+    {"conf_json", DPP_ARG_STR, 0, DPP_ARG_MODE_JSON},
+    {"template", DPP_ARG_STR, 0, DPP_ARG_MODE_TEMPLATE},
+    {"discriminator", DPP_ARG_INT, 0, DPP_ARG_MODE_TEMPLATE},
+    {"devices", DPP_ARG_STR, 0, DPP_ARG_MODE_TEMPLATE},
+    {"metrics", DPP_ARG_STR, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec job_add_args[] = {
+    {"peers", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"configurator", DPP_ARG_INT, 0, 0},
+    {"interface", DPP_ARG_STR, 0, 0},
+    {"attempts", DPP_ARG_INT, 0, 0},
+    {"conf", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"ssid", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"pass", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"matter_pin", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF | DPP_ARG_MODE_TEMPLATE},
+    {"conf_json", DPP_ARG_STR, 0, DPP_ARG_MODE_JSON},
+    {"template", DPP_ARG_STR, 0, DPP_ARG_MODE_TEMPLATE},
+    {"discriminator", DPP_ARG_INT, 0, DPP_ARG_MODE_TEMPLATE},
+    {NULL}};
+
+static const struct dpp_arg_spec job_list_args[] = {
+    {"status", DPP_ARG_STR, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec job_run_args[] = {
+    {"interfaces", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"timeout", DPP_ARG_INT, 0, 0},
+    {"ctrl_dir", DPP_ARG_STR, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec auth_monitor_args[] = {
+    {"interface", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"timeout", DPP_ARG_INT, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec peer_sync_args[] = {
+    {"interface", DPP_ARG_STR, DPP_ARG_REQUIRED, 0},
+    {"from", DPP_ARG_INT, 0, 0},
+    {"to", DPP_ARG_INT, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec metrics_args[] = {
+    {"format", DPP_ARG_STR, 0, 0},
+    {"out", DPP_ARG_STR, 0, 0},
+    {"reset", DPP_ARG_INT, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec bench_args[] = {
+    {"suite", DPP_ARG_STR, 0, 0},
+    {"iterations", DPP_ARG_INT, 0, 0},
+    {"interface", DPP_ARG_STR, 0, 0},
+    {"entries", DPP_ARG_INT, 0, 0},
+    {"sizes", DPP_ARG_STR, 0, 0},
+    {"curves", DPP_ARG_STR, 0, 0},
+    {"threads", DPP_ARG_INT, 0, 0},
+    {"format", DPP_ARG_STR, 0, 0},
+    {"out", DPP_ARG_STR, 0, 0},
+    {NULL}};
+
+static const struct dpp_arg_spec simulate_args[] = {
+    {"enrollees", DPP_ARG_INT, 0, 0},
+    {"threads", DPP_ARG_INT, 0, 0},
+    {"curve", DPP_ARG_STR, 0, 0},
+    {"keypool", DPP_ARG_INT, 0, 0},
+    {"signers", DPP_ARG_INT, 0, 0},
+    {"conf", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"ssid", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"pass", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"matter_pin", DPP_ARG_STR, 0, DPP_ARG_MODE_CONF},
+    {"conf_json", DPP_ARG_STR, 0, DPP_ARG_MODE_JSON},
+    {NULL}};
+
+static const struct dpp_arg_spec daemon_args[] = {
+    {"socket", DPP_ARG_STR, 0, 0},
+    {"metrics", DPP_ARG_STR, 0, 0},
+    {"jobs", DPP_ARG_STR, 0, 0},
+    {NULL}};
+
 // コマンド一覧
 static struct dpp_command commands[] = {
-    {"configurator_add", cmd_configurator_add, "Add configurator"},
-    {"dpp_qr_code", cmd_dpp_qr_code, "Parse QR code and add bootstrap"},
-    {"bootstrap_get_uri", cmd_bootstrap_get_uri, "Get bootstrap URI"},
-    {"auth_init", cmd_auth_init_real, "Initiate DPP authentication"},
-    {"status", cmd_status, "Show status"},
-    {"help", cmd_help, "Show help"},
-    {NULL, NULL, NULL}};
+    {"configurator_add", cmd_configurator_add, configurator_add_args, "Add configurator"},
+    {"dpp_qr_code", cmd_dpp_qr_code, dpp_qr_code_args, "Parse QR code and add bootstrap"},
+    {"import", cmd_import, import_args, "Bulk import DPP URIs from a CSV/JSONL manifest"},
+    {"bootstrap_get_uri", cmd_bootstrap_get_uri, bootstrap_get_uri_args, "Get bootstrap URI"},
+    {"auth_init", cmd_auth_init_real, auth_init_args, "Initiate DPP authentication"},
+    {"template", cmd_template, template_args, "Define, show or remove a configuration template"},
+    {"provision", cmd_provision, provision_args, "Provision devices in parallel across several radios"},
+    {"job_add", cmd_job_add, job_add_args, "Queue enrollees for provisioning"},
+    {"job_list", cmd_job_list, job_list_args, "List queued provisioning jobs"},
+    {"job_run", cmd_job_run, job_run_args, "Process the provisioning job queue"},
+    {"auth_monitor", cmd_auth_monitor, auth_monitor_args, "Wait for DPP authentication/configuration events"},
+    {"status", cmd_status, no_args, "Show status"},
+    {"peer_sync", cmd_peer_sync, peer_sync_args, "Register stored bootstrap entries with hostapd"},
+    {"compact", cmd_compact, no_args, "Compact the state log into a snapshot"},
+    {"metrics", cmd_metrics, metrics_args, "Show latency histograms and result counters"},
+    {"bench", cmd_bench, bench_args, "Run benchmarks"},
+    {"simulate", cmd_simulate, simulate_args, "Run DPP exchanges in memory with virtual enrollees"},
+    {"daemon", cmd_daemon, daemon_args, "Run as daemon serving commands on a local socket"},
+    {"help", cmd_help, no_args, "Show help"},
+    {NULL, NULL, NULL, NULL}};
+
+/*
+ * argvを1つの引数文字列に結合する
+ * 空白や引用符を含む値（例: conf_json={"ssid":"My Net"}）は '...' で囲み、
+ * 中の ' と \ をエスケープしてdpp_args_parseで元に戻せるようにする
+ */
+static char *join_arguments(int argc, char *argv[])
+{
+    size_t total_len = 1;
+    char *args, *out;
+    int i;
+
+    for (i = 0; i < argc; i++)
+        total_len += 2 * strlen(argv[i]) + 3; // 最悪: 全文字をエスケープ + 引用符2つ + 空白
+
+    args = malloc(total_len);
+    if (!args)
+        return NULL;
+
+    out = args;
+    for (i = 0; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *eq = strchr(arg, '=');
+        size_t key_len = eq ? (size_t)(eq - arg) : 0;
+
+        if (i > 0)
+            *out++ = ' ';
+
+        // key=value 形式（keyは英数字と_のみ）で、値に空白か引用符を含むときだけ囲む
+        if (eq && key_len > 0 && strspn(arg, "abcdefghijklmnopqrstuvwxyz0123456789_") == key_len &&
+            (strpbrk(eq + 1, " \t") || eq[1] == '"' || eq[1] == '\''))
+        {
+            memcpy(out, arg, key_len + 1);
+            out += key_len + 1;
+            *out++ = '\'';
+            for (const char *p = eq + 1; *p; p++)
+            {
+                if (*p == '\'' || *p == '\\')
+                    *out++ = '\\';
+                *out++ = *p;
+            }
+            *out++ = '\'';
+        }
+        else
+        {
+            size_t len = strlen(arg);
+            memcpy(out, arg, len);
+            out += len;
+        }
+    }
+    *out = '\0';
+    return args;
+}
 
 int main(int argc, char *argv[])
 {
     struct dpp_configurator_ctx *ctx;
     int ret = 0;
-    char *args_str = "";
+    char *args_str;
+    bool verbose = false;
+    bool use_daemon = true;
 
     if (argc < 2)
     {
@@ -22,60 +231,75 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // DPP初期化
-    ctx = dpp_configurator_init();
-    if (!ctx)
-    {
-        printf("Error: Failed to initialize DPP\n");
-        return 1;
-    }
-
-    // verbose モード処理
+    // オプション処理（-v: verbose, -n: デーモンへ転送しない）
     int cmd_idx = 1;
-    if (argc > 1 && strcmp(argv[1], "-v") == 0)
+    while (cmd_idx < argc && argv[cmd_idx][0] == '-' && argv[cmd_idx][1] != '\0')
     {
-        ctx->verbose = true;
-        cmd_idx = 2;
-        if (argc < 3)
+        if (strcmp(argv[cmd_idx], "-v") == 0)
         {
-            print_usage(argv[0]);
-            dpp_configurator_deinit(ctx);
-            return 1;
+            verbose = true;
         }
+        else if (strcmp(argv[cmd_idx], "-n") == 0)
+        {
+            use_daemon = false;
+        }
+        else
+        {
+            break;
+        }
+        cmd_idx++;
+    }
+    if (cmd_idx >= argc)
+    {
+        print_usage(argv[0]);
+        return 1;
     }
 
     // 引数を結合
-    if (argc > cmd_idx + 1)
+    args_str = join_arguments(argc - cmd_idx - 1, argv + cmd_idx + 1);
+    if (!args_str)
+        return 1;
+
+    /*
+     * ログレベル: 環境変数 DPP_CONFIGURATOR_LOG（例: "info,ctrl=debug"）、-vで全モジュールをdebugに
+     * このプロセスのログだけに効く。デーモンへ転送したコマンドのログはデーモンの設定に従う
+     */
+    if (getenv(DPP_LOG_ENV) && dpp_log_configure(getenv(DPP_LOG_ENV)) < 0)
     {
-        size_t total_len = 0;
-        for (int i = cmd_idx + 1; i < argc; i++)
-        {
-            total_len += strlen(argv[i]) + 1; // +1 for space
-        }
+        free(args_str);
+        return 1;
+    }
+    if (verbose)
+        dpp_log_set_level(DPP_LOG_DEBUG);
 
-        args_str = malloc(total_len + 1);
-        if (args_str)
+    // デーモンが起動していればコマンドを転送（DPP初期化を省略）
+    if (use_daemon && strcmp(argv[cmd_idx], "daemon") != 0)
+    {
+        ret = dpp_daemon_forward(verbose, argv[cmd_idx], args_str);
+        if (ret != DPP_DAEMON_NOT_RUNNING)
         {
-            args_str[0] = '\0';
-            for (int i = cmd_idx + 1; i < argc; i++)
-            {
-                if (i > cmd_idx + 1)
-                {
-                    strcat(args_str, " ");
-                }
-                strcat(args_str, argv[i]);
-            }
+            free(args_str);
+            dpp_log_shutdown(); // 転送中のログ（接続エラーなど）を書き出す
+            return ret;
         }
     }
 
+    // DPP初期化
+    ctx = dpp_configurator_init();
+    if (!ctx)
+    {
+        dpp_printf("Error: Failed to initialize DPP\n");
+        free(args_str);
+        dpp_log_shutdown();
+        return 1;
+    }
+    ctx->verbose = verbose;
+
     // コマンド実行
     ret = execute_command(ctx, argv[cmd_idx], args_str);
 
     // クリーンアップ
-    if (args_str && strlen(args_str) > 0)
-    {
-        free(args_str);
-    }
+    free(args_str);
     dpp_configurator_deinit(ctx);
 
     return ret;
@@ -90,29 +314,54 @@ int execute_command(struct dpp_configurator_ctx *ctx, const char *cmd, char *arg
     {
         if (strcmp(cmd, commands[i].name) == 0)
         {
-            return commands[i].handler(ctx, args);
+            struct dpp_args parsed;
+
+            DPP_LOG(DPP_LOG_MAIN, DPP_LOG_DEBUG, "command: %s %s", cmd, args ? args : "");
+            // 引数は1回の走査でスキーマに従って分解・検査する（args内に'\0'を書き込む）
+            if (dpp_args_parse(args, commands[i].schema, &parsed) < 0)
+            {
+                dpp_printf("Use 'help' to see the parameters of %s\n", cmd);
+                return -1;
+            }
+            return commands[i].handler(ctx, &parsed);
         }
     }
 
-    printf("Unknown command: %s\n", cmd);
-    printf("Use 'help' to see available commands\n");
+    dpp_printf("Unknown command: %s\n", cmd);
+    dpp_printf("Use 'help' to see available commands\n");
     return -1;
 }
 
 void print_usage(const char *prog_name)
 {
-    printf("DPP Configurator CLI Tool (hostapd mode)\n");
-    printf("Usage: %s [-v] <command> [args...]\n\n", prog_name);
-    printf("Main Commands:\n");
-    printf("  configurator_add      Add configurator\n");
-    printf("  dpp_qr_code          Parse QR code and add bootstrap\n");
-    printf("  bootstrap_get_uri    Get bootstrap URI\n");
-    printf("  auth_init_real       Initiate DPP authentication (real wireless)\n");
-    printf("  status               Show status\n");
-    printf("  help                 Show detailed help\n");
-    printf("\nOptions:\n");
-    printf("  -v    Verbose mode\n");
-    printf("\nExample:\n");
-    printf("  %s configurator_add curve=prime256v1\n", prog_name);
-    printf("  %s auth_init_real peer=1 configurator=1 conf=sta-psk interface=wlo1 ssid=MyNetwork pass=mypass\n", prog_name);
+    dpp_printf("DPP Configurator CLI Tool (hostapd mode)\n");
+    dpp_printf("Usage: %s [-v] [-n] <command> [args...]\n", prog_name);
+    dpp_printf("  -v  verbose output and debug logs of this process (the daemon keeps its own log level)\n");
+    dpp_printf("  -n  run locally instead of forwarding to the daemon\n\n");
+    dpp_printf("Main Commands:\n");
+    dpp_printf("  configurator_add      Add configurator\n");
+    dpp_printf("  dpp_qr_code          Parse QR code and add bootstrap\n");
+    dpp_printf("  import               Bulk import DPP URIs from a CSV/JSONL manifest\n");
+    dpp_printf("  bootstrap_get_uri    Get bootstrap URI\n");
+    dpp_printf("  auth_init_real       Initiate DPP authentication (real wireless)\n");
+    dpp_printf("  template             Define, show or remove a configuration template\n");
+    dpp_printf("  provision            Provision devices in parallel across several radios\n");
+    dpp_printf("  job_add              Queue enrollees for provisioning\n");
+    dpp_printf("  job_list             List queued provisioning jobs\n");
+    dpp_printf("  job_run              Process the provisioning job queue\n");
+    dpp_printf("  auth_monitor         Wait for DPP authentication/configuration events\n");
+    dpp_printf("  status               Show status\n");
+    dpp_printf("  peer_sync            Register stored bootstrap entries with hostapd\n");
+    dpp_printf("  compact              Compact the state log into a snapshot\n");
+    dpp_printf("  metrics              Show latency histograms (Prometheus text format)\n");
+    dpp_printf("  bench                Run benchmarks\n");
+    dpp_printf("  simulate             Run DPP exchanges in memory with virtual enrollees\n");
+    dpp_printf("  daemon               Run as daemon (other commands are forwarded to it)\n");
+    dpp_printf("  help                 Show detailed help\n");
+    dpp_printf("\nOptions:\n");
+    dpp_printf("  -v    Verbose mode\n");
+    dpp_printf("  -n    Do not forward the command to a running daemon\n");
+    dpp_printf("\nExample:\n");
+    dpp_printf("  %s configurator_add curve=prime256v1\n", prog_name);
+    dpp_printf("  %s auth_init_real peer=1 configurator=1 conf=sta-psk interface=wlo1 ssid=MyNetwork pass=mypass\n", prog_name);
 }
@@ -1,156 +1,230 @@
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
 #include "../include/dpp_configurator.h"
 
-// 引数解析ユーティリティ（JSON対応版）
-char *parse_argument(char *args, const char *key)
+// コマンドの出力先（NULLなら標準出力）
+static __thread FILE *dpp_output_stream;
+
+FILE *dpp_output(void)
 {
-    if (!args || !key)
-    {
-        return NULL;
-    }
+    return dpp_output_stream ? dpp_output_stream : stdout;
+}
 
-    char key_pattern[64];
-    snprintf(key_pattern, sizeof(key_pattern), "%s=", key);
-    size_t key_len = strlen(key_pattern);
+// このスレッドの出力先を切り替え、元の出力先を返す（NULLで標準出力に戻す）
+FILE *dpp_output_set(FILE *out)
+{
+    FILE *old = dpp_output_stream;
 
-    char *pos = strstr(args, key_pattern);
-    if (!pos)
-    {
-        return NULL;
-    }
+    dpp_output_stream = out;
+    return old;
+}
 
-    // キーの位置を見つけたので、値の開始位置を特定
-    char *value_start = pos + key_len;
-    
-    // 引用符で囲まれているかチェック
-    if (*value_start == '"' || *value_start == '\'')
-    {
-        char quote_char = *value_start;
-        value_start++; // 引用符をスキップ
-        
-        // 対応する閉じ引用符を探す
-        char *value_end = value_start;
-        while (*value_end && *value_end != quote_char)
-        {
-            // エスケープされた引用符をスキップ
-            if (*value_end == '\\' && *(value_end + 1))
-            {
-                value_end += 2;
-            }
-            else
-            {
-                value_end++;
-            }
-        }
-        
-        if (*value_end == quote_char)
-        {
-            size_t value_len = value_end - value_start;
-            char *result = malloc(value_len + 1);
-            if (result)
-            {
-                strncpy(result, value_start, value_len);
-                result[value_len] = '\0';
-            }
-            return result;
-        }
-    }
-    
-    // 引用符で囲まれていない場合は、従来の処理
-    char *value_end = value_start;
-    while (*value_end && *value_end != ' ')
-    {
-        value_end++;
-    }
-    
-    size_t value_len = value_end - value_start;
-    char *result = malloc(value_len + 1);
-    if (result)
-    {
-        strncpy(result, value_start, value_len);
-        result[value_len] = '\0';
-    }
-    
-    return result;
+// コマンドの出力はprintfではなくこれを使う（バックグラウンドスレッドでは標準出力）
+int dpp_printf(const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, fmt);
+    ret = vfprintf(dpp_output(), fmt, ap);
+    va_end(ap);
+    return ret;
 }
 
-// 文字列を16進数エンコードする関数
-char *encode_hex_string(const char *str)
+// スキーマからキーの位置を探す（見つからなければ-1）
+static int args_find(const struct dpp_arg_spec *schema, const char *key, size_t key_len)
 {
-    if (!str)
+    for (int i = 0; schema[i].key; i++)
     {
-        return NULL;
+        if (strncmp(schema[i].key, key, key_len) == 0 && schema[i].key[key_len] == '\0')
+            return i;
     }
+    return -1;
+}
 
-    size_t len = strlen(str);
-    char *hex_str = malloc(len * 2 + 1);
-    if (!hex_str)
-    {
-        return NULL;
-    }
+// 10進の整数で、intの範囲に収まるか（*resultに値を入れる）
+static bool args_parse_int(const char *value, int *result)
+{
+    char *end;
+    long n;
 
-    for (size_t i = 0; i < len; i++)
-    {
-        sprintf(hex_str + i * 2, "%02x", (unsigned char)str[i]);
-    }
-    hex_str[len * 2] = '\0';
+    if (!*value)
+        return false;
+    errno = 0;
+    n = strtol(value, &end, 10);
+    if (*end != '\0' || errno == ERANGE || n < INT_MIN || n > INT_MAX)
+        return false;
+    *result = (int)n;
+    return true;
+}
 
-    return hex_str;
+static bool args_valid_int(const char *value)
+{
+    int n;
+
+    return args_parse_int(value, &n);
 }
 
-// 16進数文字列をデコードする関数
-char *decode_hex_string(const char *hex_str)
+/*
+ * 引数解析ユーティリティ
+ *
+ * "key=value key='quoted value' ..." を1回の走査で分解し、スキーマの順に
+ * 値の位置を記録する。値は buf の中を指し、終端には '\0' を書き込む（コピーしない）。
+ * 引用符の中では \<引用符> と \\ だけを展開し、それ以外の \ はそのまま残す。
+ * 同じ走査で未知のキー、重複、型、併用できない設定方式（modes）を検査し、
+ * 最後に必須のキーを確認する。
+ *
+ * 戻り値: 0 成功、-1 エラー（メッセージを表示済み）
+ */
+int dpp_args_parse(char *buf, const struct dpp_arg_spec *schema, struct dpp_args *args)
 {
-    if (!hex_str)
-    {
-        return NULL;
+    static const struct dpp_arg_spec no_args[] = {{NULL}};
+    const char *mode_key = NULL;
+    unsigned int modes = ~0u;
+    char *p = buf ? buf : "";
+    int i;
+
+    memset(args, 0, sizeof(*args));
+    args->schema = schema ? schema : no_args;
+    schema = args->schema;
+
+    // 引数文字列全体を1つの値として受け取るコマンド（dpp_qr_codeのURI）
+    if (schema[0].key && schema[0].type == DPP_ARG_REST)
+    {
+        char *end;
+
+        while (*p == ' ')
+            p++;
+        end = p + strlen(p);
+        while (end > p && end[-1] == ' ')
+            end--;
+        if (end > p)
+        {
+            *end = '\0';
+            args->value[0] = p;
+            args->len[0] = end - p;
+        }
+        goto required;
     }
 
-    size_t hex_len = strlen(hex_str);
-    if (hex_len % 2 != 0)
+    for (;;)
     {
-        return NULL; // 奇数長は無効
-    }
+        char *key, *value, *out;
+        size_t key_len;
 
-    size_t str_len = hex_len / 2;
-    char *str = malloc(str_len + 1);
-    if (!str)
-    {
-        return NULL;
-    }
+        while (*p == ' ')
+            p++;
+        if (!*p)
+            break;
 
-    for (size_t i = 0; i < str_len; i++)
-    {
-        unsigned int byte;
-        if (sscanf(hex_str + i * 2, "%2x", &byte) != 1)
+        key = p;
+        while (*p && *p != '=' && *p != ' ')
+            p++;
+        key_len = p - key;
+        if (*p != '=' || key_len == 0)
         {
-            free(str);
-            return NULL;
+            dpp_printf("Error: Invalid parameter: %.*s (expected key=value)\n", (int)(p - key), key);
+            return -1;
         }
-        str[i] = (char)byte;
-    }
-    str[str_len] = '\0';
+        p++;
 
-    return str;
-}
+        i = args_find(schema, key, key_len);
+        if (i < 0)
+        {
+            dpp_printf("Error: Unknown parameter: %.*s\n", (int)key_len, key);
+            return -1;
+        }
+        if (args->value[i])
+        {
+            dpp_printf("Error: Parameter %s given more than once\n", schema[i].key);
+            return -1;
+        }
 
-// 文字列が16進数かどうかを判定する関数
-bool is_hex_string(const char *str)
-{
-    if (!str || strlen(str) == 0)
-    {
-        return false;
+        value = p;
+        if (*p == '"' || *p == '\'')
+        {
+            char quote = *p++;
+
+            value = out = p;
+            while (*p && *p != quote)
+            {
+                if (*p == '\\' && (p[1] == quote || p[1] == '\\'))
+                    p++;
+                *out++ = *p++;
+            }
+            if (!*p)
+            {
+                dpp_printf("Error: Missing closing quote for %s\n", schema[i].key);
+                return -1;
+            }
+            p++;
+            if (*p && *p != ' ')
+            {
+                dpp_printf("Error: Unexpected characters after quoted value of %s\n", schema[i].key);
+                return -1;
+            }
+        }
+        else
+        {
+            while (*p && *p != ' ')
+                p++;
+            out = p;
+        }
+        if (*p)
+            p++;
+        *out = '\0';
+        args->value[i] = value;
+        args->len[i] = out - value;
+
+        if (schema[i].type == DPP_ARG_INT && !args_valid_int(value))
+        {
+            dpp_printf("Error: Invalid %s: %s (integer between %d and %d expected)\n", schema[i].key,
+                       value, INT_MIN, INT_MAX);
+            return -1;
+        }
+
+        // conf/ssid/pass・conf_json・templateのように同時に使えない指定方式の検査
+        if (schema[i].modes)
+        {
+            if (!(modes & schema[i].modes))
+            {
+                dpp_printf("Error: Cannot combine %s with %s\n", schema[i].key, mode_key);
+                return -1;
+            }
+            if ((modes & schema[i].modes) != modes)
+                mode_key = schema[i].key;
+            modes &= schema[i].modes;
+        }
     }
 
-    for (size_t i = 0; i < strlen(str); i++)
+required:
+    for (i = 0; schema[i].key; i++)
     {
-        if (!((str[i] >= '0' && str[i] <= '9') ||
-              (str[i] >= 'a' && str[i] <= 'f') ||
-              (str[i] >= 'A' && str[i] <= 'F')))
+        if ((schema[i].flags & DPP_ARG_REQUIRED) && !args->value[i])
         {
-            return false;
+            dpp_printf("Error: %s parameter required\n", schema[i].key);
+            return -1;
         }
     }
-    return strlen(str) % 2 == 0; // 偶数長である必要がある
+    return 0;
+}
+
+// 値を取得（未指定ならNULL）
+char *dpp_arg(const struct dpp_args *args, const char *key)
+{
+    int i = args_find(args->schema, key, strlen(key));
+
+    return i < 0 ? NULL : args->value[i];
+}
+
+// 整数の値を取得（未指定ならdef。形式はdpp_args_parseで検査済み）
+int dpp_arg_int(const struct dpp_args *args, const char *key, int def)
+{
+    const char *value = dpp_arg(args, key);
+    int n;
+
+    return value && args_parse_int(value, &n) ? n : def;
 }
 
 // Matter PINが有効かどうかを判定する関数